@@ -0,0 +1,92 @@
+#!/bin/sh
+
+# this script provided "as is", without any warranties. use it at your own risk.
+#
+# this script builds one of the benchmark and equivalence drivers found
+# in its directory against the objects of a configured and built tree
+# and runs it
+#
+# usage, from the top of the source tree after "./configure && make":
+#
+#   contrib/bench/bench.sh driver [arguments]
+#
+# a driver that compares an optimized code path with the plain one lists
+# in its leading comment the sources to be built once more without SSE2:
+#
+#    * scalar: src/http/ngx_http_parse.c
+#
+# all the global symbols of such a copy get the "_scalar" suffix
+
+
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 driver [arguments]" >&2
+    exit 1
+fi
+
+name=$1
+shift
+
+src=`dirname $0`/$name.c
+
+if [ ! -f $src ]; then
+    echo "$0: $src not found" >&2
+    exit 1
+fi
+
+if [ ! -f objs/Makefile ] || [ ! -f objs/nginx ]; then
+    echo "$0: run \"./configure && make\" first" >&2
+    exit 1
+fi
+
+tmp=`mktemp -d /tmp/nginx-bench.XXXXXX`
+trap "rm -rf $tmp" EXIT
+
+
+# the compiler, flags and include paths used to build the objects
+
+printf 'bench:\n\t@echo "$(CC)"; echo "$(CFLAGS)"; echo "$(ALL_INCS)"\n' \
+    | make -s -f objs/Makefile -f - bench > $tmp/vars
+
+cc=`sed -n 1p $tmp/vars`
+cflags=`sed -n 2p $tmp/vars`
+incs=`sed -n 3p $tmp/vars`
+
+
+# the objects and libraries of the binary, main() is renamed in nginx.o
+
+link=
+for o in `awk '/\\$\\(LINK\\) -o objs\\/nginx/ { found = 1; next }
+               found && /^$/ { exit }
+               found { sub(/\\\\$/, ""); print }' objs/Makefile`
+do
+    case $o in
+
+    objs/src/core/nginx.o)
+        objcopy --redefine-sym main=ngx_bench_nginx_main $o $tmp/nginx.o
+        link="$link $tmp/nginx.o"
+        ;;
+
+    *)
+        link="$link $o"
+        ;;
+    esac
+done
+
+
+for s in `sed -n 's/^ \* scalar: //p' $src`; do
+    o=$tmp/`basename $s .c`_scalar.o
+
+    $cc -c $cflags -U__SSE2__ $incs -o $o $s
+
+    nm -g --defined-only $o | awk '{ print $3, $3 "_scalar" }' > $tmp/syms
+    objcopy --redefine-syms=$tmp/syms $o
+
+    link="$o $link"
+done
+
+
+$cc $cflags $incs -o $tmp/$name $src $link
+
+$tmp/$name "$@"
@@ -0,0 +1,367 @@
+
+/*
+ * the known answer test and the benchmark of the CRC32C and murmur hashes
+ *
+ *   contrib/bench/bench.sh checksum [iterations]
+ *
+ * CRC32C is checked against the vectors of RFC 3720 with both the software
+ * and the SSE4.2 handlers, which are also compared with each other at all
+ * alignments and lengths; ngx_murmur_hash2() and ngx_murmur_hash64() are
+ * checked against the outputs of the reference MurmurHash2 and
+ * MurmurHash64A; then the hashes of short keys and of 4k blocks are timed
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+typedef struct {
+    char           *data;
+    size_t          len;
+    uint32_t        murmur2;
+    uint64_t        murmur64;
+    uint64_t        murmur64_seed;
+} ngx_bench_murmur_t;
+
+
+typedef struct {
+    char           *name;
+    uint64_t      (*hash)(u_char *p, size_t len);
+} ngx_bench_hash_t;
+
+
+static ngx_int_t ngx_bench_crc32c(ngx_crc32c_pt handler, char *name);
+static uint64_t ngx_bench_crc32_long(u_char *p, size_t len);
+static uint64_t ngx_bench_crc32c_sw(u_char *p, size_t len);
+static uint64_t ngx_bench_crc32c_hw(u_char *p, size_t len);
+static uint64_t ngx_bench_murmur2(u_char *p, size_t len);
+static uint64_t ngx_bench_murmur64(u_char *p, size_t len);
+static void ngx_bench_speed(ngx_uint_t n);
+static ngx_msec_t ngx_bench_msec(void);
+
+
+static ngx_crc32c_pt   ngx_bench_sw;
+static ngx_crc32c_pt   ngx_bench_hw;
+static u_char          ngx_bench_buf[4096 + 64];
+
+
+static ngx_bench_murmur_t  ngx_bench_murmur[] = {
+
+    { "", 0,
+      0x00000000, 0x0000000000000000ULL, 0x8397626cd6895052ULL },
+
+    { "a", 1,
+      0x92685f5e, 0x071717d2d36b6b11ULL, 0xe96b6245652273aeULL },
+
+    { "ab", 2,
+      0x1aa14063, 0x62be85b2fe53d1f8ULL, 0x9be5e012c4364087ULL },
+
+    { "abc", 3,
+      0x13577c9b, 0x9cc9c33498a95efbULL, 0xa9316c8740c81414ULL },
+
+    { "abcd", 4,
+      0x26873021, 0xec1044c45cc5097aULL, 0xbb245b4802d79fa0ULL },
+
+    { "123456789", 9,
+      0xdccb0167, 0x4977490251674330ULL, 0x677e6392ff4efde9ULL },
+
+    { "The quick brown fox jumps over the lazy dog", 43,
+      0x212729d0, 0x5589ca33042a861bULL, 0x029a7747a564bd84ULL },
+
+    /* bytes from 0 to 255 */
+
+    { NULL, 256,
+      0x8d730996, 0xaeebf3780095c6c1ULL, 0xa9eb2c3a60de2ae7ULL }
+};
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    u_char              *p;
+    size_t               len;
+    uint32_t             h2;
+    uint64_t             h64;
+    ngx_log_t            log;
+    ngx_uint_t           i, n;
+    ngx_cycle_t          cycle;
+    ngx_open_file_t      file;
+    ngx_bench_murmur_t  *m;
+
+    n = (argc > 1) ? (ngx_uint_t) atoi(argv[1]) : 10000000;
+
+    ngx_time_init();
+
+    ngx_memzero(&file, sizeof(ngx_open_file_t));
+    file.fd = ngx_stderr;
+
+    ngx_memzero(&log, sizeof(ngx_log_t));
+    log.file = &file;
+    log.log_level = NGX_LOG_NOTICE;
+
+    /* ngx_crc32_table_init() allocates with ngx_cycle->log */
+
+    ngx_memzero(&cycle, sizeof(ngx_cycle_t));
+    cycle.log = &log;
+    ngx_cycle = &cycle;
+
+    ngx_pagesize = getpagesize();
+    ngx_cacheline_size = NGX_CPU_CACHE_LINE;
+
+    ngx_bench_sw = ngx_crc32c_handler;
+
+    ngx_cpuinfo();
+
+    if (ngx_crc32_table_init() != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_crc32c_handler != ngx_bench_sw) {
+        ngx_bench_hw = ngx_crc32c_handler;
+
+    } else {
+        printf("SSE4.2 is not available, only the software CRC32C is checked"
+               "\n");
+    }
+
+    if (ngx_bench_crc32c(ngx_bench_sw, "software") != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_bench_hw) {
+        if (ngx_bench_crc32c(ngx_bench_hw, "sse4.2") != NGX_OK) {
+            return 1;
+        }
+
+        /* all alignments and lengths, including the 8 and 4 byte tails */
+
+        for (i = 0; i < sizeof(ngx_bench_buf); i++) {
+            ngx_bench_buf[i] = (u_char) ngx_random();
+        }
+
+        for (i = 0; i < 16; i++) {
+            for (len = 0; len < 300; len++) {
+                if (ngx_bench_hw(0xffffffff, ngx_bench_buf + i, len)
+                    != ngx_bench_sw(0xffffffff, ngx_bench_buf + i, len))
+                {
+                    printf("MISMATCH of sse4.2 and software CRC32C, "
+                           "offset %lu, length %lu\n",
+                           (unsigned long) i, (unsigned long) len);
+                    return 1;
+                }
+            }
+        }
+
+        printf("crc32c: sse4.2 and software are identical "
+               "at 16 offsets and lengths 0-299\n");
+    }
+
+    for (i = 0; i < 256; i++) {
+        ngx_bench_buf[i] = (u_char) i;
+    }
+
+    for (i = 0; i < sizeof(ngx_bench_murmur) / sizeof(ngx_bench_murmur_t);
+         i++)
+    {
+        m = &ngx_bench_murmur[i];
+        p = m->data ? (u_char *) m->data : ngx_bench_buf;
+
+        h2 = ngx_murmur_hash2(p, m->len);
+
+        if (h2 != m->murmur2) {
+            printf("MISMATCH of murmur2, vector %lu: %08x, expected %08x\n",
+                   (unsigned long) i, h2, m->murmur2);
+            return 1;
+        }
+
+        h64 = ngx_murmur_hash64(p, m->len, 0);
+
+        if (h64 != m->murmur64) {
+            printf("MISMATCH of murmur64, vector %lu\n", (unsigned long) i);
+            return 1;
+        }
+
+        h64 = ngx_murmur_hash64(p, m->len, 0x9747b28c);
+
+        if (h64 != m->murmur64_seed) {
+            printf("MISMATCH of murmur64 with a seed, vector %lu\n",
+                   (unsigned long) i);
+            return 1;
+        }
+    }
+
+    printf("murmur: %lu reference vectors match\n",
+           (unsigned long) (sizeof(ngx_bench_murmur)
+                            / sizeof(ngx_bench_murmur_t)));
+
+    ngx_bench_speed(n);
+
+    return 0;
+}
+
+
+static ngx_int_t
+ngx_bench_crc32c(ngx_crc32c_pt handler, char *name)
+{
+    u_char      buf[32];
+    uint32_t    crc;
+    ngx_uint_t  i, k;
+
+    static uint32_t  vectors[] = {
+        0xe3069283,  /* "123456789" */
+        0x8a9136aa,  /* 32 bytes of zeroes */
+        0x62a8ab43,  /* 32 bytes of 0xff */
+        0x46dd794e,  /* 32 bytes ascending from 0 to 31 */
+        0x113fdb5c   /* 32 bytes descending from 31 to 0 */
+    };
+
+    for (i = 0; i < 5; i++) {
+
+        for (k = 0; k < 32; k++) {
+            buf[k] = (i == 1) ? 0x00
+                   : (i == 2) ? 0xff
+                   : (i == 3) ? (u_char) k : (u_char) (31 - k);
+        }
+
+        if (i == 0) {
+            crc = handler(0xffffffff, (u_char *) "123456789", 9);
+
+        } else {
+            crc = handler(0xffffffff, buf, 32);
+        }
+
+        crc ^= 0xffffffff;
+
+        if (crc != vectors[i]) {
+            printf("MISMATCH of %s CRC32C, vector %lu: %08x, "
+                   "expected %08x\n",
+                   name, (unsigned long) i, crc, vectors[i]);
+            return NGX_ERROR;
+        }
+
+        /* the same in two updates */
+
+        crc = handler(0xffffffff, buf, 13);
+        crc = handler(crc, buf + 13, 19) ^ 0xffffffff;
+
+        if (i != 0 && crc != vectors[i]) {
+            printf("MISMATCH of %s CRC32C updates, vector %lu\n",
+                   name, (unsigned long) i);
+            return NGX_ERROR;
+        }
+    }
+
+    printf("crc32c: %s handler matches the RFC 3720 vectors\n", name);
+
+    return NGX_OK;
+}
+
+
+static uint64_t
+ngx_bench_crc32_long(u_char *p, size_t len)
+{
+    return ngx_crc32_long(p, len);
+}
+
+
+static uint64_t
+ngx_bench_crc32c_sw(u_char *p, size_t len)
+{
+    return ngx_bench_sw(0xffffffff, p, len) ^ 0xffffffff;
+}
+
+
+static uint64_t
+ngx_bench_crc32c_hw(u_char *p, size_t len)
+{
+    return ngx_bench_hw(0xffffffff, p, len) ^ 0xffffffff;
+}
+
+
+static uint64_t
+ngx_bench_murmur2(u_char *p, size_t len)
+{
+    return ngx_murmur_hash2(p, len);
+}
+
+
+static uint64_t
+ngx_bench_murmur64(u_char *p, size_t len)
+{
+    return ngx_murmur_hash64(p, len, 0);
+}
+
+
+static void
+ngx_bench_speed(ngx_uint_t n)
+{
+    size_t       len;
+    uint64_t     sum;
+    ngx_uint_t   i, k, s, count;
+    ngx_msec_t   elapsed;
+
+    static size_t  sizes[] = { 16, 64, 4096 };
+
+    static ngx_bench_hash_t  hashes[] = {
+        { "ngx_crc32_long", ngx_bench_crc32_long },
+        { "ngx_crc32c (software)", ngx_bench_crc32c_sw },
+        { "ngx_crc32c (sse4.2)", ngx_bench_crc32c_hw },
+        { "ngx_murmur_hash2", ngx_bench_murmur2 },
+        { "ngx_murmur_hash64", ngx_bench_murmur64 },
+        { NULL, NULL }
+    };
+
+    for (i = 0; i < sizeof(ngx_bench_buf); i++) {
+        ngx_bench_buf[i] = (u_char) ('a' + i % 26);
+    }
+
+    printf("%-24s %14s %14s %14s\n", "hash", "16 bytes", "64 bytes",
+           "4096 bytes");
+
+    sum = 0;
+
+    for (k = 0; hashes[k].name; k++) {
+
+        if (hashes[k].hash == ngx_bench_crc32c_hw && ngx_bench_hw == NULL) {
+            continue;
+        }
+
+        printf("%-24s", hashes[k].name);
+
+        for (s = 0; s < 3; s++) {
+            len = sizes[s];
+            count = n / (len / 16);
+
+            elapsed = ngx_bench_msec();
+
+            for (i = 0; i < count; i++) {
+                /* keys differ, so the hashes cannot be hoisted */
+                ngx_bench_buf[i & 31] = (u_char) i;
+                sum += hashes[k].hash(ngx_bench_buf + (i & 31), len);
+            }
+
+            elapsed = ngx_bench_msec() - elapsed;
+
+            printf(" %8.0f MB/s",
+                   (double) count * len / 1000 / (elapsed ? elapsed : 1));
+        }
+
+        printf("\n");
+    }
+
+    if (sum == 0) {
+        printf("\n");
+    }
+}
+
+
+static ngx_msec_t
+ngx_bench_msec(void)
+{
+    struct timeval  tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (ngx_msec_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
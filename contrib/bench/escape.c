@@ -0,0 +1,391 @@
+
+/*
+ * the equivalence test and the benchmark of ngx_escape_uri(),
+ * ngx_unescape_uri() and ngx_escape_json() built with SSE2 and without it
+ *
+ *   contrib/bench/bench.sh escape [strings [seed]]
+ *
+ * every byte value at offsets around 16 byte boundaries, percent encoded
+ * sequences and random strings of various density are passed to both
+ * builds with all escape and unescape types, and the lengths, outputs and
+ * the positions the functions stop at are compared; inputs and outputs end
+ * at guard pages, so an access beyond them crashes the test; then typical
+ * URIs and log values are processed by both builds
+ *
+ * scalar: src/core/ngx_string.c
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+#define NGX_BENCH_SIZE  4096
+
+
+uintptr_t ngx_escape_uri_scalar(u_char *dst, u_char *src, size_t size,
+    ngx_uint_t type);
+void ngx_unescape_uri_scalar(u_char **dst, u_char **src, size_t size,
+    ngx_uint_t type);
+uintptr_t ngx_escape_json_scalar(u_char *dst, u_char *src, size_t size);
+
+static ngx_int_t ngx_bench_compare(u_char *str, size_t len);
+static u_char *ngx_bench_guarded(ngx_uint_t n, size_t len);
+static size_t ngx_bench_random_string(u_char *buf);
+static void ngx_bench_failed(char *name, ngx_uint_t type, u_char *str,
+    size_t len);
+static void ngx_bench_speed(void);
+static ngx_msec_t ngx_bench_msec(void);
+
+
+static u_char      *ngx_bench_area[3];
+static u_char       ngx_bench_str[NGX_BENCH_SIZE];
+static ngx_uint_t   ngx_bench_checks;
+
+
+static char *ngx_bench_alphabet[] = {
+    "abcdefghijklmnopqrstuvwxyz0123456789-._~/",
+    "ABCXYZ !\"#$&'()*+,:;<=>?@[\\]^`{|}",
+    "%%%41%2f%2F%3f%00%zz%4%g0%%25",
+    "\t\r\n\x01\x1f\x7f\x80\xc3\xa9\xff"
+};
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    u_char      *p;
+    size_t       len;
+    ngx_uint_t   i, c, k, n, seed;
+
+    n = (argc > 1) ? (ngx_uint_t) atoi(argv[1]) : 1000000;
+    seed = (argc > 2) ? (ngx_uint_t) atoi(argv[2]) : (ngx_uint_t) time(NULL);
+
+    ngx_time_init();
+
+    ngx_pagesize = getpagesize();
+
+    /* the input and the two outputs, each followed by a guard page */
+
+    for (i = 0; i < 3; i++) {
+        ngx_bench_area[i] = mmap(NULL, 4 * NGX_BENCH_SIZE + ngx_pagesize,
+                                 PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE,
+                                 -1, 0);
+
+        if (ngx_bench_area[i] == MAP_FAILED
+            || mprotect(ngx_bench_area[i] + 4 * NGX_BENCH_SIZE, ngx_pagesize,
+                        PROT_NONE)
+               == -1)
+        {
+            perror("mmap");
+            return 1;
+        }
+    }
+
+#if !(defined __SSE2__)
+    printf("built without SSE2, both builds are the same\n");
+#endif
+
+    /* every byte at every offset from 0 to 40 of runs of ordinary bytes */
+
+    for (c = 0; c < 256; c++) {
+        for (k = 0; k <= 40; k++) {
+            for (len = k + 1; len <= k + 34; len += 11) {
+                ngx_memset(ngx_bench_str, (k & 1) ? 'a' : '/', len);
+                ngx_bench_str[k] = (u_char) c;
+
+                if (ngx_bench_compare(ngx_bench_str, len) != NGX_OK) {
+                    return 1;
+                }
+            }
+        }
+    }
+
+    /* percent encoded bytes at every offset */
+
+    for (c = 0; c < 256; c++) {
+        for (k = 0; k <= 40; k++) {
+            ngx_memset(ngx_bench_str, 'a', 48);
+            p = ngx_sprintf(ngx_bench_str + k, "%%%02xd", c);
+
+            if (ngx_bench_compare(ngx_bench_str, 48) != NGX_OK) {
+                return 1;
+            }
+
+            if (ngx_bench_compare(ngx_bench_str, p - ngx_bench_str - 1)
+                != NGX_OK)
+            {
+                return 1;
+            }
+        }
+    }
+
+    printf("edge cases: %lu checks are identical\n",
+           (unsigned long) ngx_bench_checks);
+
+    srandom(seed);
+    ngx_bench_checks = 0;
+
+    for (i = 0; i < n; i++) {
+        len = ngx_bench_random_string(ngx_bench_str);
+
+        if (ngx_bench_compare(ngx_bench_str, len) != NGX_OK) {
+            printf("seed %lu\n", (unsigned long) seed);
+            return 1;
+        }
+    }
+
+    printf("random strings: %lu, seed %lu: %lu checks are identical\n",
+           (unsigned long) n, (unsigned long) seed,
+           (unsigned long) ngx_bench_checks);
+
+    ngx_bench_speed();
+
+    return 0;
+}
+
+
+static ngx_int_t
+ngx_bench_compare(u_char *str, size_t len)
+{
+    u_char     *src, *dst[2], *s[2], *d[2];
+    uintptr_t   n[2], e[2];
+    ngx_uint_t  type;
+
+    src = ngx_bench_guarded(0, len);
+    ngx_memcpy(src, str, len);
+
+    for (type = NGX_ESCAPE_URI; type <= NGX_ESCAPE_MAIL_AUTH; type++) {
+
+        n[0] = ngx_escape_uri(NULL, src, len, type);
+        n[1] = ngx_escape_uri_scalar(NULL, src, len, type);
+
+        if (n[0] != n[1]) {
+            ngx_bench_failed("ngx_escape_uri(NULL)", type, str, len);
+            return NGX_ERROR;
+        }
+
+        dst[0] = ngx_bench_guarded(1, len + 2 * n[0]);
+        dst[1] = ngx_bench_guarded(2, len + 2 * n[0]);
+
+        e[0] = ngx_escape_uri(dst[0], src, len, type) - (uintptr_t) dst[0];
+        e[1] = ngx_escape_uri_scalar(dst[1], src, len, type)
+               - (uintptr_t) dst[1];
+
+        if (e[0] != e[1] || ngx_memcmp(dst[0], dst[1], e[0]) != 0) {
+            ngx_bench_failed("ngx_escape_uri", type, str, len);
+            return NGX_ERROR;
+        }
+
+        ngx_bench_checks++;
+    }
+
+    for (type = 0; type <= NGX_UNESCAPE_REDIRECT; type++) {
+
+        d[0] = ngx_bench_guarded(1, len);
+        d[1] = ngx_bench_guarded(2, len);
+        dst[0] = d[0];
+        dst[1] = d[1];
+        s[0] = src;
+        s[1] = src;
+
+        ngx_unescape_uri(&d[0], &s[0], len, type);
+        ngx_unescape_uri_scalar(&d[1], &s[1], len, type);
+
+        if (d[0] - dst[0] != d[1] - dst[1]
+            || s[0] != s[1]
+            || ngx_memcmp(dst[0], dst[1], d[0] - dst[0]) != 0)
+        {
+            ngx_bench_failed("ngx_unescape_uri", type, str, len);
+            return NGX_ERROR;
+        }
+
+        ngx_bench_checks++;
+    }
+
+    n[0] = ngx_escape_json(NULL, src, len);
+    n[1] = ngx_escape_json_scalar(NULL, src, len);
+
+    if (n[0] != n[1]) {
+        ngx_bench_failed("ngx_escape_json(NULL)", 0, str, len);
+        return NGX_ERROR;
+    }
+
+    dst[0] = ngx_bench_guarded(1, len + n[0]);
+    dst[1] = ngx_bench_guarded(2, len + n[0]);
+
+    e[0] = ngx_escape_json(dst[0], src, len) - (uintptr_t) dst[0];
+    e[1] = ngx_escape_json_scalar(dst[1], src, len) - (uintptr_t) dst[1];
+
+    if (e[0] != e[1] || ngx_memcmp(dst[0], dst[1], e[0]) != 0) {
+        ngx_bench_failed("ngx_escape_json", 0, str, len);
+        return NGX_ERROR;
+    }
+
+    ngx_bench_checks++;
+
+    return NGX_OK;
+}
+
+
+static u_char *
+ngx_bench_guarded(ngx_uint_t n, size_t len)
+{
+    return ngx_bench_area[n] + 4 * NGX_BENCH_SIZE - len;
+}
+
+
+/*
+ * a string is a sequence of runs, each taken from one of the alphabets,
+ * so that both long runs of ordinary bytes and dense escapes occur
+ */
+
+static size_t
+ngx_bench_random_string(u_char *buf)
+{
+    char        *a;
+    size_t       len, max, run, alen;
+    ngx_uint_t   i;
+
+    max = ngx_random() % 4 ? ngx_random() % 128 : ngx_random() % 1024;
+
+    for (len = 0; len < max; /* void */) {
+        a = ngx_bench_alphabet[ngx_random() % 8 < 5 ? 0
+                               : ngx_random() % 4];
+        alen = ngx_strlen(a);
+
+        run = 1 + ngx_random() % (ngx_random() % 2 ? 4 : 40);
+
+        for (i = 0; i < run && len < max; i++) {
+            buf[len++] = a[ngx_random() % alen];
+        }
+    }
+
+    return len;
+}
+
+
+static void
+ngx_bench_failed(char *name, ngx_uint_t type, u_char *str, size_t len)
+{
+    size_t  i;
+
+    printf("MISMATCH in %s, type %lu, string of %lu bytes: ",
+           name, (unsigned long) type, (unsigned long) len);
+
+    for (i = 0; i < len; i++) {
+        if (str[i] >= 0x20 && str[i] < 0x7f && str[i] != '\\') {
+            putchar(str[i]);
+
+        } else {
+            printf("\\x%02x", str[i]);
+        }
+    }
+
+    putchar('\n');
+}
+
+
+static void
+ngx_bench_speed(void)
+{
+    u_char      *src, *dst, *s, *d;
+    size_t       len, total;
+    ngx_uint_t   i, k, t, n;
+    ngx_msec_t   elapsed;
+
+    static struct {
+        char        *name;
+        char        *value;
+    } inputs[] = {
+        { "uri path",
+          "/static/assets/images/2023/10/product-photo_large-1920x1080.jpg" },
+        { "uri args",
+          "/search?q=nginx+reverse+proxy&lang=en-US&page=2&sort=relevance"
+          "&filter=type:article&utm_source=newsletter&utm_medium=email" },
+        { "quoted uri",
+          "/files/%D0%B4%D0%BE%D0%BA%D1%83%D0%BC%D0%B5%D0%BD%D1%82%D1%8B/"
+          "annual%20report%202023%20%28final%29.pdf" },
+        { "user agent",
+          "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 "
+          "(KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36 Edg/118.0" },
+        { "json value",
+          "{\"user\":\"alice\",\"items\":[1,2,3],\"note\":\"line one\\n"
+          "line two\"}" },
+        { NULL, NULL }
+    };
+
+    n = 2000000;
+
+    printf("%-12s %-22s %12s %12s\n", "input", "function", "scalar", "sse2");
+
+    for (i = 0; inputs[i].name; i++) {
+        len = ngx_strlen(inputs[i].value);
+
+        src = ngx_bench_guarded(0, len);
+        ngx_memcpy(src, inputs[i].value, len);
+
+        for (t = 0; t < 3; t++) {
+            printf("%-12s %-22s", inputs[i].name,
+                   t == 0 ? "ngx_escape_uri(ARGS)"
+                          : t == 1 ? "ngx_unescape_uri(URI)"
+                                   : "ngx_escape_json");
+
+            for (k = 0; k < 2; k++) {
+                dst = ngx_bench_area[1];
+                total = 0;
+
+                elapsed = ngx_bench_msec();
+
+                for ( /* void */ ; total < n * len; total += len) {
+
+                    switch (t) {
+
+                    case 0:
+                        (void) (k ? ngx_escape_uri(dst, src, len,
+                                                   NGX_ESCAPE_ARGS)
+                                  : ngx_escape_uri_scalar(dst, src, len,
+                                                          NGX_ESCAPE_ARGS));
+                        break;
+
+                    case 1:
+                        s = src;
+                        d = dst;
+
+                        if (k) {
+                            ngx_unescape_uri(&d, &s, len, NGX_UNESCAPE_URI);
+
+                        } else {
+                            ngx_unescape_uri_scalar(&d, &s, len,
+                                                    NGX_UNESCAPE_URI);
+                        }
+
+                        break;
+
+                    default:
+                        (void) (k ? ngx_escape_json(dst, src, len)
+                                  : ngx_escape_json_scalar(dst, src, len));
+                    }
+                }
+
+                elapsed = ngx_bench_msec() - elapsed;
+
+                printf(" %7.0f MB/s",
+                       (double) total / 1000 / (elapsed ? elapsed : 1));
+            }
+
+            printf("\n");
+        }
+    }
+}
+
+
+static ngx_msec_t
+ngx_bench_msec(void)
+{
+    struct timeval  tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (ngx_msec_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
@@ -0,0 +1,254 @@
+
+/*
+ * the benchmark of the open addressing and the bucket layouts of ngx_hash_t
+ *
+ *   contrib/bench/bench.sh hash [keys [lookups [bucket_size]]]
+ *
+ * host names are added to ngx_hash_keys_arrays_t the way the map module
+ * does, and both hashes are built from the same keys: the bucket one with
+ * the given bucket size and the minimal number of buckets found by
+ * ngx_hash_init(), the open addressing one with NGX_HASH_OPEN; every key
+ * and a set of missing names are looked up in both to check the results,
+ * then the build time and the lookup rate in a random order are measured
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+typedef struct {
+    ngx_str_t        name;
+    ngx_uint_t       key;
+    void            *value;
+} ngx_bench_query_t;
+
+
+static ngx_int_t ngx_bench_build(ngx_hash_t *hash, ngx_uint_t bucket_size,
+    ngx_hash_keys_arrays_t *ha, ngx_pool_t *pool, double *usec);
+static double ngx_bench_lookup(ngx_hash_t *hash, ngx_bench_query_t *q,
+    ngx_uint_t n);
+static double ngx_bench_usec(void);
+
+
+static ngx_log_t   ngx_bench_log;
+static uintptr_t   ngx_bench_sum;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    u_char                  *p;
+    double                   bucket_build, open_build, bucket_rate,
+                             open_rate, rate;
+    ngx_str_t                name;
+    ngx_int_t                rc;
+    ngx_uint_t               i, n, k, lookups, bucket_size, round;
+    ngx_pool_t              *pool;
+    ngx_hash_t               bucket, open;
+    ngx_open_file_t          file;
+    ngx_bench_query_t       *q;
+    ngx_hash_keys_arrays_t   ha;
+
+    static char  *tld[] = { "com", "net", "org", "io", "de", "ru", "cn" };
+
+    n = (argc > 1) ? (ngx_uint_t) atoi(argv[1]) : 10000;
+    lookups = (argc > 2) ? (ngx_uint_t) atoi(argv[2]) : 10000000;
+    bucket_size = (argc > 3) ? (ngx_uint_t) atoi(argv[3]) : 64;
+
+    if (n == 0 || lookups == 0) {
+        return 1;
+    }
+
+    ngx_time_init();
+
+    ngx_pagesize = getpagesize();
+    ngx_cacheline_size = NGX_CPU_CACHE_LINE;
+
+    ngx_memzero(&file, sizeof(ngx_open_file_t));
+    file.fd = ngx_stderr;
+
+    ngx_bench_log.file = &file;
+    ngx_bench_log.log_level = NGX_LOG_NOTICE;
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, &ngx_bench_log);
+    if (pool == NULL) {
+        return 1;
+    }
+
+    ngx_memzero(&ha, sizeof(ngx_hash_keys_arrays_t));
+
+    ha.pool = pool;
+    ha.temp_pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, &ngx_bench_log);
+
+    if (ha.temp_pool == NULL
+        || ngx_hash_keys_array_init(&ha, NGX_HASH_LARGE) != NGX_OK)
+    {
+        return 1;
+    }
+
+    /* the values are the key numbers, the missing names are odd */
+
+    for (i = 0; ha.keys.nelts < n; i++) {
+        p = ngx_pnalloc(pool, 64);
+        if (p == NULL) {
+            return 1;
+        }
+
+        name.data = p;
+        name.len = ngx_sprintf(p, "%s%xi.example.%s",
+                               (i % 3) ? "www." : "",
+                               (ngx_int_t) ngx_random() * 2,
+                               tld[i % 7])
+                   - p;
+
+        rc = ngx_hash_add_key(&ha, &name,
+                              (void *) (uintptr_t) (ha.keys.nelts + 1), 0);
+
+        if (rc == NGX_ERROR) {
+            return 1;
+        }
+    }
+
+    if (ngx_bench_build(&bucket, bucket_size, &ha, pool, &bucket_build)
+        != NGX_OK
+        || ngx_bench_build(&open, NGX_HASH_OPEN, &ha, pool, &open_build)
+           != NGX_OK)
+    {
+        return 1;
+    }
+
+    /* 90% of the lookups are hits in a random order */
+
+    q = ngx_alloc(sizeof(ngx_bench_query_t) * lookups, &ngx_bench_log);
+    if (q == NULL) {
+        return 1;
+    }
+
+    for (i = 0; i < lookups; i++) {
+
+        if (ngx_random() % 10) {
+            k = ngx_random() % n;
+            q[i].name = ((ngx_hash_key_t *) ha.keys.elts)[k].key;
+            q[i].value = (void *) (uintptr_t) (k + 1);
+
+        } else {
+            p = ngx_pnalloc(pool, 64);
+            if (p == NULL) {
+                return 1;
+            }
+
+            q[i].name.data = p;
+            q[i].name.len = ngx_sprintf(p, "%xi.example.com",
+                                        (ngx_int_t) ngx_random() * 2 + 1)
+                            - p;
+            q[i].value = NULL;
+        }
+
+        q[i].key = ngx_hash_key_lc(q[i].name.data, q[i].name.len);
+
+        if (ngx_hash_find(&bucket, q[i].key, q[i].name.data, q[i].name.len)
+            != q[i].value
+            || ngx_hash_find(&open, q[i].key, q[i].name.data, q[i].name.len)
+               != q[i].value)
+        {
+            printf("MISMATCH for \"%.*s\"\n",
+                   (int) q[i].name.len, q[i].name.data);
+            return 1;
+        }
+    }
+
+    for (k = 0; k < n; k++) {
+        name = ((ngx_hash_key_t *) ha.keys.elts)[k].key;
+        i = ngx_hash_key_lc(name.data, name.len);
+
+        if (ngx_hash_find(&open, i, name.data, name.len)
+            != (void *) (uintptr_t) (k + 1))
+        {
+            printf("MISMATCH for \"%.*s\"\n", (int) name.len, name.data);
+            return 1;
+        }
+    }
+
+    bucket_rate = 0;
+    open_rate = 0;
+
+    for (round = 0; round < 3; round++) {
+        rate = ngx_bench_lookup(&bucket, q, lookups);
+        bucket_rate = ngx_max(bucket_rate, rate);
+
+        rate = ngx_bench_lookup(&open, q, lookups);
+        open_rate = ngx_max(open_rate, rate);
+    }
+
+    printf("keys: %lu, lookups: %lu, all results are identical\n",
+           (unsigned long) n, (unsigned long) lookups);
+    printf("bucket (size %lu, %lu buckets): build %.2f ms, %.1f M lookups/s"
+           "\n", (unsigned long) bucket_size, (unsigned long) bucket.size,
+           bucket_build / 1000, bucket_rate / 1000000);
+    printf("open   (%lu slots):            build %.2f ms, %.1f M lookups/s"
+           "\n", (unsigned long) open.size,
+           open_build / 1000, open_rate / 1000000);
+
+    return (ngx_bench_sum == 0);
+}
+
+
+static ngx_int_t
+ngx_bench_build(ngx_hash_t *hash, ngx_uint_t bucket_size,
+    ngx_hash_keys_arrays_t *ha, ngx_pool_t *pool, double *usec)
+{
+    double           start;
+    ngx_hash_init_t  hinit;
+
+    ngx_memzero(hash, sizeof(ngx_hash_t));
+
+    hinit.hash = hash;
+    hinit.key = ngx_hash_key_lc;
+    hinit.max_size = 4 * ha->keys.nelts + 1024;
+    hinit.bucket_size = bucket_size;
+    hinit.name = "bench_hash";
+    hinit.pool = pool;
+    hinit.temp_pool = ha->temp_pool;
+
+    start = ngx_bench_usec();
+
+    if (ngx_hash_init(&hinit, ha->keys.elts, ha->keys.nelts) != NGX_OK) {
+        printf("could not build the hash with bucket size %lu\n",
+               (unsigned long) bucket_size);
+        return NGX_ERROR;
+    }
+
+    *usec = ngx_bench_usec() - start;
+
+    return NGX_OK;
+}
+
+
+static double
+ngx_bench_lookup(ngx_hash_t *hash, ngx_bench_query_t *q, ngx_uint_t n)
+{
+    double      start;
+    ngx_uint_t  i;
+
+    start = ngx_bench_usec();
+
+    for (i = 0; i < n; i++) {
+        ngx_bench_sum += (uintptr_t) ngx_hash_find(hash, q[i].key,
+                                                   q[i].name.data,
+                                                   q[i].name.len);
+    }
+
+    return n * 1000000.0 / ngx_max(ngx_bench_usec() - start, 1);
+}
+
+
+static double
+ngx_bench_usec(void)
+{
+    struct timeval  tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (double) tv.tv_sec * 1000000 + tv.tv_usec;
+}
@@ -0,0 +1,346 @@
+
+/*
+ * the benchmark of the radix trees compiled into multibit tries
+ *
+ *   contrib/bench/bench.sh radix [ipv4 [ipv6 [lookups]]]
+ *
+ * a table shaped like the global BGP table is made of random networks
+ * with the prefix lengths of the real one, mostly /24 and /48, the way
+ * the geo module collects them: the default value is inserted first and
+ * the networks are inserted in a random order; the tree is compiled with
+ * ngx_radix_stride_create(), random addresses, half of them inside the
+ * networks, are looked up in both to check the results, and the compile
+ * time, the sizes and the lookup rates are measured
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+typedef struct {
+    ngx_uint_t           len;
+    ngx_uint_t           weight;
+} ngx_bench_prefix_t;
+
+
+static ngx_uint_t ngx_bench_prefix_len(ngx_bench_prefix_t *prefixes);
+static double ngx_bench_usec(void);
+
+
+static ngx_log_t   ngx_bench_log;
+static uintptr_t   ngx_bench_sum;
+
+
+/* the shares of the prefix lengths in thousandths */
+
+static ngx_bench_prefix_t  ngx_bench_ipv4[] = {
+    { 8, 1 }, { 12, 1 }, { 14, 2 }, { 16, 14 }, { 17, 8 }, { 18, 14 },
+    { 19, 26 }, { 20, 44 }, { 21, 50 }, { 22, 112 }, { 23, 98 },
+    { 24, 630 }, { 0, 0 }
+};
+
+#if (NGX_HAVE_INET6)
+
+static ngx_bench_prefix_t  ngx_bench_ipv6[] = {
+    { 29, 30 }, { 32, 190 }, { 36, 40 }, { 40, 60 }, { 44, 90 },
+    { 48, 530 }, { 56, 30 }, { 64, 30 }, { 0, 0 }
+};
+
+#endif
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    double               start, compile, rate, tree_rate, stride_rate;
+    uint32_t             key, mask, *keys;
+    ngx_int_t            rc;
+    ngx_uint_t           i, n, lookups, round, len, nets;
+    ngx_pool_t          *pool, *temp_pool;
+    ngx_open_file_t      file;
+    ngx_radix_tree_t    *tree;
+    ngx_radix_stride_t  *stride;
+#if (NGX_HAVE_INET6)
+    u_char              *keys6, addr6[16], mask6[16];
+    ngx_uint_t           k, n6;
+#endif
+
+    n = (argc > 1) ? (ngx_uint_t) atoi(argv[1]) : 900000;
+#if (NGX_HAVE_INET6)
+    n6 = (argc > 2) ? (ngx_uint_t) atoi(argv[2]) : 180000;
+#endif
+    lookups = (argc > 3) ? (ngx_uint_t) atoi(argv[3]) : 10000000;
+
+    if (lookups == 0) {
+        return 1;
+    }
+
+    ngx_time_init();
+
+    ngx_pagesize = getpagesize();
+    ngx_cacheline_size = NGX_CPU_CACHE_LINE;
+
+    ngx_memzero(&file, sizeof(ngx_open_file_t));
+    file.fd = ngx_stderr;
+
+    ngx_bench_log.file = &file;
+    ngx_bench_log.log_level = NGX_LOG_NOTICE;
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, &ngx_bench_log);
+    temp_pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, &ngx_bench_log);
+
+    if (pool == NULL || temp_pool == NULL) {
+        return 1;
+    }
+
+    keys = ngx_alloc(sizeof(uint32_t) * lookups, &ngx_bench_log);
+    if (keys == NULL) {
+        return 1;
+    }
+
+    /* IPv4 */
+
+    tree = ngx_radix_tree_create(temp_pool, 0);
+    if (tree == NULL) {
+        return 1;
+    }
+
+    if (ngx_radix32tree_insert(tree, 0, 0, 1) != NGX_OK) {
+        return 1;
+    }
+
+    /* the values are as aligned as the geo module variable values */
+
+    nets = 0;
+
+    for (i = 0; i < n; i++) {
+        len = ngx_bench_prefix_len(ngx_bench_ipv4);
+        mask = (uint32_t) (0xffffffffu << (32 - len));
+        key = ((uint32_t) ngx_random() << 1 ^ (uint32_t) ngx_random()) & mask;
+
+        rc = ngx_radix32tree_insert(tree, key, mask, (i + 2) << 3);
+
+        if (rc == NGX_ERROR) {
+            return 1;
+        }
+
+        if (rc == NGX_OK) {
+            nets++;
+        }
+
+        /* every other lookup is inside a network */
+
+        if (i < lookups / 2) {
+            keys[2 * i] = key | ((uint32_t) ngx_random() & ~mask);
+        }
+    }
+
+    for (i = 0; i < lookups; i++) {
+        if (i % 2 || i / 2 >= n) {
+            keys[i] = (uint32_t) ngx_random() << 1 ^ (uint32_t) ngx_random();
+        }
+    }
+
+    start = ngx_bench_usec();
+
+    stride = ngx_radix_stride_create(pool, temp_pool, tree);
+    if (stride == NULL) {
+        return 1;
+    }
+
+    compile = ngx_bench_usec() - start;
+
+    for (i = 0; i < lookups; i++) {
+        if (ngx_radix32tree_find(tree, keys[i])
+            != ngx_radix32stride_find(stride, keys[i]))
+        {
+            printf("MISMATCH for %08x\n", keys[i]);
+            return 1;
+        }
+    }
+
+    tree_rate = 0;
+    stride_rate = 0;
+
+    for (round = 0; round < 3; round++) {
+        start = ngx_bench_usec();
+
+        for (i = 0; i < lookups; i++) {
+            ngx_bench_sum += ngx_radix32tree_find(tree, keys[i]);
+        }
+
+        rate = lookups * 1000000.0 / ngx_max(ngx_bench_usec() - start, 1);
+        tree_rate = ngx_max(tree_rate, rate);
+
+        start = ngx_bench_usec();
+
+        for (i = 0; i < lookups; i++) {
+            ngx_bench_sum += ngx_radix32stride_find(stride, keys[i]);
+        }
+
+        rate = lookups * 1000000.0 / ngx_max(ngx_bench_usec() - start, 1);
+        stride_rate = ngx_max(stride_rate, rate);
+    }
+
+    printf("ipv4: %lu networks, %lu lookups, all results are identical\n",
+           (unsigned long) nets, (unsigned long) lookups);
+    printf("  compile %.1f ms, trie %lu nodes, %lu leaves, %lu KB\n",
+           compile / 1000, (unsigned long) stride->nnodes,
+           (unsigned long) stride->nleaves,
+           (unsigned long) (stride->nnodes * sizeof(ngx_radix_stride_node_t)
+                            + stride->nleaves * sizeof(uintptr_t)) / 1024);
+    printf("  tree %.1f M lookups/s, trie %.1f M lookups/s\n",
+           tree_rate / 1000000, stride_rate / 1000000);
+
+#if (NGX_HAVE_INET6)
+
+    keys6 = (u_char *) keys;
+    lookups = lookups * sizeof(uint32_t) / 16;
+
+    ngx_destroy_pool(temp_pool);
+
+    temp_pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, &ngx_bench_log);
+    if (temp_pool == NULL) {
+        return 1;
+    }
+
+    tree = ngx_radix_tree_create(temp_pool, 0);
+    if (tree == NULL) {
+        return 1;
+    }
+
+    ngx_memzero(addr6, 16);
+    ngx_memzero(mask6, 16);
+
+    if (ngx_radix128tree_insert(tree, addr6, mask6, 1) != NGX_OK) {
+        return 1;
+    }
+
+    /* networks of 2000::/3 */
+
+    nets = 0;
+
+    for (i = 0; i < n6; i++) {
+        len = ngx_bench_prefix_len(ngx_bench_ipv6);
+
+        for (k = 0; k < 16; k++) {
+            addr6[k] = (u_char) ngx_random();
+            mask6[k] = (k * 8 + 8 <= len) ? 0xff
+                       : (k * 8 < len) ? (u_char) (0xff << (8 - len % 8))
+                                       : 0;
+        }
+
+        addr6[0] = 0x20 | (addr6[0] & 0x1f);
+
+        if (i < lookups / 2) {
+            ngx_memcpy(&keys6[32 * i], addr6, 16);
+        }
+
+        for (k = 0; k < 16; k++) {
+            addr6[k] &= mask6[k];
+        }
+
+        rc = ngx_radix128tree_insert(tree, addr6, mask6, (i + 2) << 3);
+
+        if (rc == NGX_ERROR) {
+            return 1;
+        }
+
+        if (rc == NGX_OK) {
+            nets++;
+        }
+    }
+
+    for (i = 0; i < lookups; i++) {
+        if (i % 2 || i / 2 >= n6) {
+            for (k = 0; k < 16; k++) {
+                keys6[16 * i + k] = (u_char) ngx_random();
+            }
+
+            keys6[16 * i] = 0x20 | (keys6[16 * i] & 0x1f);
+        }
+    }
+
+    start = ngx_bench_usec();
+
+    stride = ngx_radix_stride_create(pool, temp_pool, tree);
+    if (stride == NULL) {
+        return 1;
+    }
+
+    compile = ngx_bench_usec() - start;
+
+    for (i = 0; i < lookups; i++) {
+        if (ngx_radix128tree_find(tree, &keys6[16 * i])
+            != ngx_radix128stride_find(stride, &keys6[16 * i]))
+        {
+            printf("MISMATCH for an IPv6 address %lu\n", (unsigned long) i);
+            return 1;
+        }
+    }
+
+    tree_rate = 0;
+    stride_rate = 0;
+
+    for (round = 0; round < 3; round++) {
+        start = ngx_bench_usec();
+
+        for (i = 0; i < lookups; i++) {
+            ngx_bench_sum += ngx_radix128tree_find(tree, &keys6[16 * i]);
+        }
+
+        rate = lookups * 1000000.0 / ngx_max(ngx_bench_usec() - start, 1);
+        tree_rate = ngx_max(tree_rate, rate);
+
+        start = ngx_bench_usec();
+
+        for (i = 0; i < lookups; i++) {
+            ngx_bench_sum += ngx_radix128stride_find(stride, &keys6[16 * i]);
+        }
+
+        rate = lookups * 1000000.0 / ngx_max(ngx_bench_usec() - start, 1);
+        stride_rate = ngx_max(stride_rate, rate);
+    }
+
+    printf("ipv6: %lu networks, %lu lookups, all results are identical\n",
+           (unsigned long) nets, (unsigned long) lookups);
+    printf("  compile %.1f ms, trie %lu nodes, %lu leaves, %lu KB\n",
+           compile / 1000, (unsigned long) stride->nnodes,
+           (unsigned long) stride->nleaves,
+           (unsigned long) (stride->nnodes * sizeof(ngx_radix_stride_node_t)
+                            + stride->nleaves * sizeof(uintptr_t)) / 1024);
+    printf("  tree %.1f M lookups/s, trie %.1f M lookups/s\n",
+           tree_rate / 1000000, stride_rate / 1000000);
+
+#endif
+
+    return (ngx_bench_sum == 0);
+}
+
+
+static ngx_uint_t
+ngx_bench_prefix_len(ngx_bench_prefix_t *prefixes)
+{
+    ngx_uint_t  r;
+
+    r = ngx_random() % 1000;
+
+    while (prefixes[1].len && r >= prefixes->weight) {
+        r -= prefixes->weight;
+        prefixes++;
+    }
+
+    return prefixes->len;
+}
+
+
+static double
+ngx_bench_usec(void)
+{
+    struct timeval  tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (double) tv.tv_sec * 1000000 + tv.tv_usec;
+}
@@ -0,0 +1,318 @@
+
+/*
+ * the benchmark of the server names lookup with large wildcard lists
+ *
+ *   contrib/bench/bench.sh servernames [sites [lookups]]
+ *
+ * each site has an exact name, a "*.site" and a ".site" head wildcard and
+ * a "site.*" tail wildcard; the names are added and hashed the way
+ * ngx_http_server_names() does, with the open addressing layout and with
+ * the former 128 byte buckets; host names of the sites with one or more
+ * leading labels and missing hosts are looked up with
+ * ngx_hash_find_combined() in both, the results are compared, and the
+ * lookup rates are measured
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+typedef struct {
+    ngx_str_t             host;
+    ngx_uint_t            key;
+    void                 *value;
+} ngx_bench_query_t;
+
+
+static ngx_int_t ngx_bench_build(ngx_hash_combined_t *hash,
+    ngx_uint_t bucket_size, ngx_hash_keys_arrays_t *ha, ngx_pool_t *pool);
+static int ngx_libc_cdecl ngx_bench_cmp_dns_wildcards(const void *one,
+    const void *two);
+static double ngx_bench_lookup(ngx_hash_combined_t *hash,
+    ngx_bench_query_t *q, ngx_uint_t n);
+static double ngx_bench_usec(void);
+
+
+static ngx_log_t   ngx_bench_log;
+static uintptr_t   ngx_bench_sum;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    u_char                  *p;
+    double                   start, bucket_build, open_build, bucket_rate,
+                             open_rate, rate;
+    ngx_str_t                name;
+    ngx_uint_t               i, k, n, lookups, round;
+    ngx_pool_t              *pool;
+    ngx_open_file_t          file;
+    ngx_bench_query_t       *q;
+    ngx_hash_combined_t      bucket, open;
+    ngx_hash_keys_arrays_t   ha;
+
+    static char  *forms[] = { "site%ui.example.com", "*.site%ui.example.com",
+                              ".site%ui.example.net", "site%ui.example.*" };
+
+    n = (argc > 1) ? (ngx_uint_t) atoi(argv[1]) : 10000;
+    lookups = (argc > 2) ? (ngx_uint_t) atoi(argv[2]) : 10000000;
+
+    if (n == 0 || lookups == 0) {
+        return 1;
+    }
+
+    ngx_time_init();
+
+    ngx_pagesize = getpagesize();
+    ngx_cacheline_size = NGX_CPU_CACHE_LINE;
+
+    ngx_memzero(&file, sizeof(ngx_open_file_t));
+    file.fd = ngx_stderr;
+
+    ngx_bench_log.file = &file;
+    ngx_bench_log.log_level = NGX_LOG_NOTICE;
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, &ngx_bench_log);
+    if (pool == NULL) {
+        return 1;
+    }
+
+    ngx_memzero(&ha, sizeof(ngx_hash_keys_arrays_t));
+
+    ha.pool = pool;
+    ha.temp_pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, &ngx_bench_log);
+
+    if (ha.temp_pool == NULL
+        || ngx_hash_keys_array_init(&ha, NGX_HASH_LARGE) != NGX_OK)
+    {
+        return 1;
+    }
+
+    /*
+     * the value of a name is its site number and form, shifted since
+     * the wildcard hashes keep flags in the two low bits of values
+     */
+
+    for (i = 0; i < n; i++) {
+        for (k = 0; k < 4; k++) {
+            p = ngx_pnalloc(pool, 64);
+            if (p == NULL) {
+                return 1;
+            }
+
+            name.data = p;
+            name.len = ngx_sprintf(p, forms[k], i) - p;
+
+            if (ngx_hash_add_key(&ha, &name,
+                                 (void *) ((4 * i + k + 1) << 2),
+                                 NGX_HASH_WILDCARD_KEY)
+                != NGX_OK)
+            {
+                return 1;
+            }
+        }
+    }
+
+    ngx_qsort(ha.dns_wc_head.elts, (size_t) ha.dns_wc_head.nelts,
+              sizeof(ngx_hash_key_t), ngx_bench_cmp_dns_wildcards);
+    ngx_qsort(ha.dns_wc_tail.elts, (size_t) ha.dns_wc_tail.nelts,
+              sizeof(ngx_hash_key_t), ngx_bench_cmp_dns_wildcards);
+
+    start = ngx_bench_usec();
+
+    if (ngx_bench_build(&bucket, 128, &ha, pool) != NGX_OK) {
+        return 1;
+    }
+
+    bucket_build = ngx_bench_usec() - start;
+    start = ngx_bench_usec();
+
+    if (ngx_bench_build(&open, NGX_HASH_OPEN, &ha, pool) != NGX_OK) {
+        return 1;
+    }
+
+    open_build = ngx_bench_usec() - start;
+
+    /*
+     * exact names, names under "*.site" with one or two more labels,
+     * the "site.example.net" matched by ".site", "site.example.org"
+     * matched by "site.*", and missing hosts in equal shares
+     */
+
+    q = ngx_alloc(sizeof(ngx_bench_query_t) * lookups, &ngx_bench_log);
+    if (q == NULL) {
+        return 1;
+    }
+
+    for (i = 0; i < lookups; i++) {
+        p = ngx_pnalloc(pool, 64);
+        if (p == NULL) {
+            return 1;
+        }
+
+        q[i].host.data = p;
+
+        k = ngx_random() % n;
+
+        switch (i % 6) {
+
+        case 0:
+            q[i].value = (void *) ((4 * k + 1) << 2);
+            p = ngx_sprintf(p, "site%ui.example.com", k);
+            break;
+
+        case 1:
+            q[i].value = (void *) ((4 * k + 2) << 2);
+            p = ngx_sprintf(p, "www.site%ui.example.com", k);
+            break;
+
+        case 2:
+            q[i].value = (void *) ((4 * k + 2) << 2);
+            p = ngx_sprintf(p, "static.cdn.site%ui.example.com", k);
+            break;
+
+        case 3:
+            q[i].value = (void *) ((4 * k + 3) << 2);
+            p = ngx_sprintf(p, "site%ui.example.net", k);
+            break;
+
+        case 4:
+            q[i].value = (void *) ((4 * k + 4) << 2);
+            p = ngx_sprintf(p, "site%ui.example.org", k);
+            break;
+
+        default:
+            q[i].value = NULL;
+            p = ngx_sprintf(p, "www.site%ui.example.org", k);
+        }
+
+        q[i].host.len = p - q[i].host.data;
+
+        q[i].key = ngx_hash_key(q[i].host.data, q[i].host.len);
+
+        if (ngx_hash_find_combined(&bucket, q[i].key, q[i].host.data,
+                                   q[i].host.len)
+            != q[i].value
+            || ngx_hash_find_combined(&open, q[i].key, q[i].host.data,
+                                      q[i].host.len)
+               != q[i].value)
+        {
+            printf("MISMATCH for \"%.*s\"\n",
+                   (int) q[i].host.len, q[i].host.data);
+            return 1;
+        }
+    }
+
+    bucket_rate = 0;
+    open_rate = 0;
+
+    for (round = 0; round < 3; round++) {
+        rate = ngx_bench_lookup(&bucket, q, lookups);
+        bucket_rate = ngx_max(bucket_rate, rate);
+
+        rate = ngx_bench_lookup(&open, q, lookups);
+        open_rate = ngx_max(open_rate, rate);
+    }
+
+    printf("sites: %lu, names: %lu, lookups: %lu, "
+           "all results are identical\n",
+           (unsigned long) n, (unsigned long) (4 * n),
+           (unsigned long) lookups);
+    printf("bucket (size 128): build %.2f ms, %.1f M lookups/s\n",
+           bucket_build / 1000, bucket_rate / 1000000);
+    printf("open:              build %.2f ms, %.1f M lookups/s\n",
+           open_build / 1000, open_rate / 1000000);
+
+    return (ngx_bench_sum == 0);
+}
+
+
+static ngx_int_t
+ngx_bench_build(ngx_hash_combined_t *hash, ngx_uint_t bucket_size,
+    ngx_hash_keys_arrays_t *ha, ngx_pool_t *pool)
+{
+    ngx_hash_init_t  hinit;
+
+    ngx_memzero(hash, sizeof(ngx_hash_combined_t));
+
+    hinit.key = ngx_hash_key_lc;
+    hinit.max_size = 4 * ha->keys.nelts + 1024;
+    hinit.bucket_size = bucket_size;
+    hinit.name = "server_names_hash";
+    hinit.pool = pool;
+
+    hinit.hash = &hash->hash;
+    hinit.temp_pool = NULL;
+
+    if (ngx_hash_init(&hinit, ha->keys.elts, ha->keys.nelts) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    hinit.hash = NULL;
+    hinit.temp_pool = ha->temp_pool;
+
+    if (ngx_hash_wildcard_init(&hinit, ha->dns_wc_head.elts,
+                               ha->dns_wc_head.nelts)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    hash->wc_head = (ngx_hash_wildcard_t *) hinit.hash;
+
+    hinit.hash = NULL;
+
+    if (ngx_hash_wildcard_init(&hinit, ha->dns_wc_tail.elts,
+                               ha->dns_wc_tail.nelts)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    hash->wc_tail = (ngx_hash_wildcard_t *) hinit.hash;
+
+    return NGX_OK;
+}
+
+
+static int ngx_libc_cdecl
+ngx_bench_cmp_dns_wildcards(const void *one, const void *two)
+{
+    ngx_hash_key_t  *first, *second;
+
+    first = (ngx_hash_key_t *) one;
+    second = (ngx_hash_key_t *) two;
+
+    return ngx_dns_strcmp(first->key.data, second->key.data);
+}
+
+
+static double
+ngx_bench_lookup(ngx_hash_combined_t *hash, ngx_bench_query_t *q,
+    ngx_uint_t n)
+{
+    double      start;
+    ngx_uint_t  i;
+
+    start = ngx_bench_usec();
+
+    for (i = 0; i < n; i++) {
+        ngx_bench_sum += (uintptr_t) ngx_hash_find_combined(hash, q[i].key,
+                                                            q[i].host.data,
+                                                            q[i].host.len);
+    }
+
+    return n * 1000000.0 / ngx_max(ngx_bench_usec() - start, 1);
+}
+
+
+static double
+ngx_bench_usec(void)
+{
+    struct timeval  tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (double) tv.tv_sec * 1000000 + tv.tv_usec;
+}
@@ -0,0 +1,195 @@
+
+/*
+ * the event loop benchmark of the connection slots layout
+ *
+ *   contrib/bench/bench.sh slots [connections [events]]
+ *
+ * events are delivered to random connections the way the epoll module
+ * does: the connection is taken from the event data, its read event is
+ * handled, and the handler updates the connection and its write event;
+ * the same loop runs over the former layout of three separate arrays of
+ * connections, read events and write events, and over the slots
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+static void ngx_bench_read_handler(ngx_event_t *ev);
+static void ngx_bench_write_handler(ngx_event_t *ev);
+static double ngx_bench_loop(ngx_connection_t **ready, ngx_uint_t n);
+static double ngx_bench_usec(void);
+
+
+static ngx_uint_t  ngx_bench_total;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    double                  arrays, slots, rate;
+    ngx_log_t               log;
+    ngx_uint_t              i, n, events, round;
+    ngx_event_t            *rev, *wev;
+    ngx_open_file_t         file;
+    ngx_connection_t       *c, **ready, **ready_slots;
+    ngx_connection_slot_t  *slot;
+
+    n = (argc > 1) ? (ngx_uint_t) atoi(argv[1]) : 500000;
+    events = (argc > 2) ? (ngx_uint_t) atoi(argv[2]) : 20000000;
+
+    if (n == 0 || events == 0) {
+        return 1;
+    }
+
+    ngx_time_init();
+
+    ngx_memzero(&file, sizeof(ngx_open_file_t));
+    file.fd = ngx_stderr;
+
+    ngx_memzero(&log, sizeof(ngx_log_t));
+    log.file = &file;
+    log.log_level = NGX_LOG_NOTICE;
+
+    c = ngx_calloc(sizeof(ngx_connection_t) * n, &log);
+    rev = ngx_calloc(sizeof(ngx_event_t) * n, &log);
+    wev = ngx_calloc(sizeof(ngx_event_t) * n, &log);
+    slot = ngx_memalign(NGX_CPU_CACHE_LINE, sizeof(ngx_connection_slot_t) * n,
+                        &log);
+    ready = ngx_alloc(sizeof(ngx_connection_t *) * events, &log);
+    ready_slots = ngx_alloc(sizeof(ngx_connection_t *) * events, &log);
+
+    if (c == NULL || rev == NULL || wev == NULL || slot == NULL
+        || ready == NULL || ready_slots == NULL)
+    {
+        return 1;
+    }
+
+    ngx_memzero(slot, sizeof(ngx_connection_slot_t) * n);
+
+    for (i = 0; i < n; i++) {
+        c[i].fd = (ngx_socket_t) i;
+        c[i].read = &rev[i];
+        c[i].write = &wev[i];
+        rev[i].data = &c[i];
+        rev[i].handler = ngx_bench_read_handler;
+        wev[i].data = &c[i];
+        wev[i].handler = ngx_bench_write_handler;
+
+        slot[i].events.connection.fd = (ngx_socket_t) i;
+        slot[i].events.connection.read = &slot[i].events.read;
+        slot[i].events.connection.write = &slot[i].events.write;
+        slot[i].events.read.data = &slot[i].events.connection;
+        slot[i].events.read.handler = ngx_bench_read_handler;
+        slot[i].events.write.data = &slot[i].events.connection;
+        slot[i].events.write.handler = ngx_bench_write_handler;
+    }
+
+    for (i = 0; i < events; i++) {
+        ready[i] = &c[ngx_random() % n];
+        ready_slots[i] = &slot[ready[i] - c].events.connection;
+    }
+
+    /*
+     * the best of several alternating rounds, as small pools fit
+     * in the caches and their rates are easily disturbed
+     */
+
+    arrays = 0;
+    slots = 0;
+
+    for (round = 0; round < 9; round++) {
+        rate = ngx_bench_loop(ready, events);
+        arrays = ngx_max(arrays, rate);
+
+        rate = ngx_bench_loop(ready_slots, events);
+        slots = ngx_max(slots, rate);
+    }
+
+    printf("connections: %lu, slot size: %lu, events: %lu\n",
+           (unsigned long) n, (unsigned long) sizeof(ngx_connection_slot_t),
+           (unsigned long) events);
+    printf("arrays: %.0f events/s\n", arrays);
+    printf("slots:  %.0f events/s (%+.1f%%)\n",
+           slots, (slots / arrays - 1) * 100);
+
+    return (ngx_bench_total == 0);
+}
+
+
+static void
+ngx_bench_read_handler(ngx_event_t *ev)
+{
+    ngx_event_t       *wev;
+    ngx_connection_t  *c;
+
+    c = ev->data;
+
+    ev->ready = 0;
+    c->sent++;
+
+    wev = c->write;
+
+    if (!wev->active) {
+        wev->ready = 1;
+        wev->handler(wev);
+    }
+}
+
+
+static void
+ngx_bench_write_handler(ngx_event_t *ev)
+{
+    ngx_connection_t  *c;
+
+    c = ev->data;
+
+    ev->ready = 0;
+    ngx_bench_total += c->fd;
+}
+
+
+static double
+ngx_bench_loop(ngx_connection_t **ready, ngx_uint_t n)
+{
+    double             start;
+    ngx_uint_t         i;
+    ngx_event_t       *rev;
+    ngx_connection_t  *c;
+
+    start = ngx_bench_usec();
+
+    for (i = 0; i < n; i++) {
+        c = ready[i];
+
+        if (c->fd == (ngx_socket_t) -1) {
+            continue;
+        }
+
+        rev = c->read;
+
+        if (rev->instance) {
+            continue;
+        }
+
+        rev->ready = 1;
+        rev->available = -1;
+
+        rev->handler(rev);
+    }
+
+    return n * 1000000.0 / ngx_max(ngx_bench_usec() - start, 1);
+}
+
+
+static double
+ngx_bench_usec(void)
+{
+    struct timeval  tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (double) tv.tv_sec * 1000000 + tv.tv_usec;
+}
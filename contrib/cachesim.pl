@@ -0,0 +1,309 @@
+#!/usr/bin/perl -w
+
+# this script provided "as is", without any warranties. use it at your own risk.
+#
+# this script replays an access log or a trace through models of the
+# eviction policies of proxy_cache_path (the "eviction" parameter) and
+# reports the object and byte hit ratios of each one
+#
+# usage:
+#
+#   cachesim.pl -s 10g [-b 4096] [-p lru,slru,gdsf,tinylfu] < access.log
+#
+# the input is either an access log in the "combined" or "main" format,
+# where the request URI is the key and the response body size is
+# the size, or a trace with a key and a size in bytes on each line:
+#
+#   /images/logo.png 5230
+#
+# the models follow the cache manager: responses are stored on the
+# first miss, sizes are rounded up to blocks, and nodes are evicted
+# until the cache fits into its maximum size
+
+
+use warnings;
+use strict;
+
+use Getopt::Std;
+use Digest::MD5 qw(md5);
+
+
+my %opts;
+
+getopts('s:b:p:', \%opts) or usage();
+
+usage() unless defined $opts{s};
+
+my $bsize = $opts{b} || 4096;
+my $max = size($opts{s}) / $bsize;
+my @policies = split /,/, ($opts{p} || 'lru,slru,gdsf,tinylfu');
+
+die "cache size is too small\n" if $max < 1;
+
+for (@policies) {
+	die "unknown policy \"$_\"\n" unless /^(lru|slru|gdsf|tinylfu)$/;
+}
+
+my (@keys, @sizes);
+
+while (<STDIN>) {
+	if (/"[A-Z]+ (\S+)[^"]*" \d{3} (\d+|-)/) {
+		push @keys, $1;
+		push @sizes, $2 eq '-' ? 0 : $2;
+
+	} elsif (/^(\S+)\s+(\d+)\s*$/) {
+		push @keys, $1;
+		push @sizes, $2;
+	}
+}
+
+die "no requests found\n" unless @keys;
+
+printf "%-10s %10s %12s %12s\n", 'policy', 'requests', 'object hit', 'byte hit';
+
+for my $policy (@policies) {
+	my ($hits, $bytes, $total) = simulate($policy);
+
+	printf "%-10s %10d %11.2f%% %11.2f%%\n", $policy, scalar @keys,
+		100 * $hits / @keys, $total ? 100 * $bytes / $total : 0;
+}
+
+
+sub usage {
+	die "usage: $0 -s size [-b block_size] [-p policy,...] < log\n";
+}
+
+sub size {
+	my ($s) = @_;
+	my %units = (k => 1024, m => 1024 ** 2, g => 1024 ** 3);
+
+	$s =~ /^(\d+)([kmg]?)$/i or die "invalid size \"$s\"\n";
+
+	return $1 * ($2 ? $units{lc $2} : 1);
+}
+
+
+# the queues are doubly linked lists with sentinels, the heads are
+# the most recently used nodes as in ngx_queue_t
+
+sub queue_new {
+	my $q = {};
+	$q->{prev} = $q->{next} = $q;
+	return $q;
+}
+
+sub queue_insert_head {
+	my ($q, $n) = @_;
+	$n->{next} = $q->{next};
+	$n->{next}{prev} = $n;
+	$n->{prev} = $q;
+	$q->{next} = $n;
+}
+
+sub queue_remove {
+	my ($n) = @_;
+	$n->{next}{prev} = $n->{prev};
+	$n->{prev}{next} = $n->{next};
+	delete @$n{qw(prev next)};
+}
+
+
+# a count-min sketch with four rows of saturating counters,
+# halved after ten samples per counter of a row
+
+sub freq {
+	my ($c, $n, $add) = @_;
+	my $freq = 15;
+
+	for my $i (0 .. 3) {
+		my $j = $i * $c->{width} + ($n->{hash}[$i] & ($c->{width} - 1));
+
+		$c->{sketch}[$j]++ if $add && $c->{sketch}[$j] < 15;
+		$freq = $c->{sketch}[$j] if $c->{sketch}[$j] < $freq;
+	}
+
+	if ($add && ++$c->{samples} >= 10 * $c->{width}) {
+		$_ >>= 1 for @{$c->{sketch}};
+		$c->{samples} = int($c->{samples} / 2);
+	}
+
+	return $freq;
+}
+
+
+use constant { PROBATION => 0, PROTECTED => 1, WINDOW => 2 };
+
+sub link_node {
+	my ($c, $n) = @_;
+	queue_insert_head($c->{queue}[$n->{segment}], $n);
+	$c->{length}[$n->{segment}]++;
+}
+
+sub unlink_node {
+	my ($c, $n) = @_;
+	queue_remove($n);
+	$c->{length}[$n->{segment}]--;
+}
+
+sub move_tail {
+	my ($c, $from, $to) = @_;
+	my $n = $c->{queue}[$from]{prev};
+
+	unlink_node($c, $n);
+	$n->{segment} = $to;
+	link_node($c, $n);
+}
+
+sub access {
+	my ($c, $n, $fresh) = @_;
+	my $policy = $c->{policy};
+
+	if ($policy eq 'gdsf') {
+		$n->{priority} = $c->{clock};
+
+	} elsif ($policy eq 'tinylfu') {
+		freq($c, $n, 1);
+
+		if ($fresh) {
+			$n->{segment} = WINDOW;
+
+		} elsif ($n->{segment} != WINDOW) {
+			$n->{segment} = PROTECTED;
+		}
+
+	} elsif ($policy eq 'slru' && !$fresh) {
+		$n->{segment} = PROTECTED;
+	}
+
+	link_node($c, $n);
+
+	while ($c->{length}[WINDOW] > 1
+	       && $c->{length}[WINDOW] > int($c->{count} / 100))
+	{
+		move_tail($c, WINDOW, PROBATION);
+	}
+
+	while ($c->{length}[PROTECTED] > $c->{count} - int($c->{count} / 5)) {
+		move_tail($c, PROTECTED, PROBATION);
+	}
+}
+
+sub oldest {
+	my ($c) = @_;
+	my $oldest;
+
+	for my $q (@{$c->{queue}}) {
+		next if $q->{prev} == $q;
+
+		$oldest = $q->{prev}
+			if !$oldest || $q->{prev}{time} < $oldest->{time};
+	}
+
+	return $oldest;
+}
+
+sub victim {
+	my ($c) = @_;
+	my $policy = $c->{policy};
+	my $probation = $c->{queue}[PROBATION];
+
+	if ($policy eq 'gdsf') {
+		my ($victim, $min);
+		my $q = $probation->{prev};
+
+		for (1 .. 8) {
+			last if $q == $probation;
+
+			my $h = $q->{priority} + int($q->{uses} * 1024 / $q->{size});
+
+			($victim, $min) = ($q, $h) if !$victim || $h < $min;
+
+			$q = $q->{prev};
+		}
+
+		return oldest($c) unless $victim;
+
+		$c->{clock} = $min if $min > $c->{clock};
+
+		return $victim;
+	}
+
+	if ($policy eq 'tinylfu') {
+		return oldest($c) if $c->{length}[PROBATION] < 2;
+
+		my ($candidate, $victim) = ($probation->{next}, $probation->{prev});
+
+		return freq($c, $candidate, 0) > freq($c, $victim, 0)
+			? $victim : $candidate;
+	}
+
+	if ($policy eq 'slru' && $probation->{prev} != $probation) {
+		return $probation->{prev};
+	}
+
+	return oldest($c);
+}
+
+sub simulate {
+	my ($policy) = @_;
+	my ($hits, $bytes, $total) = (0, 0, 0);
+	my %nodes;
+
+	my $width = 256;
+	$width <<= 1 while $width < $max;
+
+	my $c = {
+		policy => $policy,
+		queue => [ queue_new(), queue_new(), queue_new() ],
+		length => [ 0, 0, 0 ],
+		count => 0,
+		size => 0,
+		clock => 0,
+		width => $width,
+		sketch => [ (0) x (4 * $width) ],
+		samples => 0,
+	};
+
+	for my $i (0 .. $#keys) {
+		my $n = $nodes{$keys[$i]};
+		my $fresh = 0;
+
+		$total += $sizes[$i];
+
+		if ($n) {
+			$hits++;
+			$bytes += $sizes[$i];
+			unlink_node($c, $n);
+			$n->{uses}++ if $n->{uses} < 1023;
+
+		} else {
+			$n = $nodes{$keys[$i]} = {
+				key => $keys[$i],
+				hash => [ unpack 'V4', md5($keys[$i]) ],
+				segment => PROBATION,
+				priority => 0,
+				uses => 1,
+				size => int(($sizes[$i] + $bsize - 1) / $bsize) || 1,
+			};
+
+			$c->{count}++;
+			$c->{size} += $n->{size};
+			$fresh = 1;
+		}
+
+		$n->{time} = $i;
+
+		access($c, $n, $fresh);
+
+		while ($c->{size} > $max) {
+			my $v = victim($c);
+
+			unlink_node($c, $v);
+			delete $nodes{$v->{key}};
+			$c->{count}--;
+			$c->{size} -= $v->{size};
+		}
+	}
+
+	return ($hits, $bytes, $total);
+}
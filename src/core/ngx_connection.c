@@ -14,6 +14,10 @@ ngx_os_io_t  ngx_io;
 
 
 static void ngx_drain_connections(ngx_cycle_t *cycle);
+#if (NGX_HAVE_REUSEPORT_CBPF)
+static void ngx_attach_reuseport_cpu_filter(ngx_cycle_t *cycle,
+    ngx_listening_t *ls);
+#endif
 
 
 // 将 sockaddr 和 socklen 保存至 ngx_cycle_t 中的 listening 动态数组中
@@ -93,6 +97,10 @@ ngx_create_listening(ngx_conf_t *cf, struct sockaddr *sockaddr,
     ls->fastopen = -1;
 #endif
 
+#if (NGX_HAVE_BUSY_POLL)
+    ls->busy_poll = -1;
+#endif
+
     return ls;
 }
 
@@ -852,6 +860,27 @@ ngx_configure_listening_sockets(ngx_cycle_t *cycle)
         }
 #endif
 
+#if (NGX_HAVE_BUSY_POLL)
+        /* accepted sockets inherit the value */
+
+        if (ls[i].busy_poll != -1) {
+            if (setsockopt(ls[i].fd, SOL_SOCKET, SO_BUSY_POLL,
+                           (const void *) &ls[i].busy_poll, sizeof(int))
+                == -1)
+            {
+                ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                              "setsockopt(SO_BUSY_POLL, %d) %V failed, ignored",
+                              ls[i].busy_poll, &ls[i].addr_text);
+            }
+        }
+#endif
+
+#if (NGX_HAVE_REUSEPORT_CBPF)
+        if (ls[i].reuseport && ls[i].worker == 0) {
+            ngx_attach_reuseport_cpu_filter(cycle, &ls[i]);
+        }
+#endif
+
 #if 0
         if (1) {
             int tcp_nodelay = 1;
@@ -1034,6 +1063,187 @@ ngx_configure_listening_sockets(ngx_cycle_t *cycle)
 }
 
 
+#if (NGX_HAVE_REUSEPORT_CBPF)
+
+/*
+ * The reuseport group program returns the index of the socket in the group,
+ * it maps the CPU which handles the connection to the worker bound to this
+ * CPU by "worker_cpu_affinity", or to "cpu % workers" if there is no such
+ * worker.  The kernel falls back to hashing if the index is out of the group.
+ *
+ * The program relies on the index of the socket of each worker in the group
+ * being equal to ngx_worker.  The kernel numbers the sockets in the order
+ * they are listened, and removing a socket moves the last one to its place.
+ * The sockets of a group are cloned and listened in the worker order, and
+ * the master process keeps all of them open, so a respawned worker does not
+ * change the group.  On reload a socket is taken over from the socket of the
+ * same worker in the previous cycle, the sockets of new workers are listened
+ * at the end of the group, and the sockets of removed workers are the last
+ * ones.  The program is rebuilt in each cycle, so it always follows the
+ * current number of workers.  The order is unknown if a socket is inherited
+ * from another binary or joins the group on reload, and the program is
+ * detached then.
+ */
+
+#define ngx_reuseport_cbpf(f, c, t, e, v)                                     \
+    (f)->code = c; (f)->jt = t; (f)->jf = e; (f)->k = v
+
+static void
+ngx_attach_reuseport_cpu_filter(ngx_cycle_t *cycle, ngx_listening_t *ls)
+{
+    ngx_int_t           *map;
+    ngx_uint_t           i, n, cpu, worker, workers, ordered;
+    ngx_core_conf_t     *ccf;
+    ngx_listening_t     *gls;
+    struct sock_fprog    prog;
+    struct sock_filter  *code;
+#if (NGX_HAVE_CPU_AFFINITY)
+    ngx_cpuset_t        *mask;
+#endif
+
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+
+    workers = ccf->worker_processes;
+
+    ordered = 1;
+
+    if (ls->reuseport_cpu && workers > 1) {
+
+        /* the sockets of the group are listed in the worker order */
+
+        worker = 0;
+        gls = cycle->listening.elts;
+
+        for (i = 0; i < cycle->listening.nelts; i++) {
+
+            if (!gls[i].reuseport
+                || gls[i].type != ls->type
+                || ngx_cmp_sockaddr(gls[i].sockaddr, gls[i].socklen,
+                                    ls->sockaddr, ls->socklen, 1)
+                   != NGX_OK)
+            {
+                continue;
+            }
+
+            if (gls[i].worker != worker++
+                || gls[i].inherited
+                || (gls[i].previous
+                    && (!gls[i].previous->reuseport
+                        || gls[i].previous->worker != gls[i].worker)))
+            {
+                ordered = 0;
+
+                ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0,
+                              "order of reuseport sockets of %V is unknown, "
+                              "connections are not steered by CPU",
+                              &ls->addr_text);
+                break;
+            }
+        }
+    }
+
+    if (!ls->reuseport_cpu || workers < 2 || !ordered) {
+
+#ifdef SO_DETACH_REUSEPORT_BPF
+        /* the program may remain from the previous configuration */
+
+        if (setsockopt(ls->fd, SOL_SOCKET, SO_DETACH_REUSEPORT_BPF, NULL, 0)
+            == 0)
+        {
+            ngx_log_debug1(NGX_LOG_DEBUG_CORE, cycle->log, 0,
+                           "reuseport program detached from %V",
+                           &ls->addr_text);
+        }
+#endif
+
+        return;
+    }
+
+    map = ngx_alloc(CPU_SETSIZE * sizeof(ngx_int_t)
+                    + (2 * CPU_SETSIZE + 3) * sizeof(struct sock_filter),
+                    cycle->log);
+    if (map == NULL) {
+        return;
+    }
+
+    code = (struct sock_filter *) &map[CPU_SETSIZE];
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        map[cpu] = -1;
+    }
+
+#if (NGX_HAVE_CPU_AFFINITY)
+
+    for (worker = 0; worker < workers; worker++) {
+        mask = ngx_get_cpu_affinity(cycle, worker);
+
+        if (mask == NULL) {
+            break;
+        }
+
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (map[cpu] == -1 && CPU_ISSET(cpu, mask)) {
+                map[cpu] = worker;
+            }
+        }
+    }
+
+#endif
+
+    n = 0;
+
+    /* A = current CPU */
+
+    ngx_reuseport_cbpf(&code[n], BPF_LD|BPF_W|BPF_ABS, 0, 0,
+                       (uint32_t) (SKF_AD_OFF + SKF_AD_CPU));
+    n++;
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (map[cpu] == -1) {
+            continue;
+        }
+
+        /* if (A == cpu) return worker */
+
+        ngx_reuseport_cbpf(&code[n], BPF_JMP|BPF_JEQ|BPF_K, 0, 1, cpu);
+        n++;
+
+        ngx_reuseport_cbpf(&code[n], BPF_RET|BPF_K, 0, 0, map[cpu]);
+        n++;
+    }
+
+    /* return A % workers */
+
+    ngx_reuseport_cbpf(&code[n], BPF_ALU|BPF_MOD|BPF_K, 0, 0, workers);
+    n++;
+
+    ngx_reuseport_cbpf(&code[n], BPF_RET|BPF_A, 0, 0, 0);
+    n++;
+
+    prog.len = n;
+    prog.filter = code;
+
+    if (setsockopt(ls->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                   &prog, sizeof(struct sock_fprog))
+        == -1)
+    {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                      "setsockopt(SO_ATTACH_REUSEPORT_CBPF) "
+                      "for %V failed, ignored",
+                      &ls->addr_text);
+
+    } else {
+        ngx_log_debug3(NGX_LOG_DEBUG_CORE, cycle->log, 0,
+                       "reuseport program attached to %V: %ui insns, "
+                       "%ui workers", &ls->addr_text, n, workers);
+    }
+
+    ngx_free(map);
+}
+
+#endif
+
+
 void
 ngx_close_listening_sockets(ngx_cycle_t *cycle)
 {
@@ -1128,6 +1338,12 @@ ngx_get_connection(ngx_socket_t s, ngx_log_t *log)
 
     c = ngx_cycle->free_connections;
 
+    if (c == NULL
+        && ngx_grow_connections((ngx_cycle_t *) ngx_cycle) == NGX_OK)
+    {
+        c = ngx_cycle->free_connections;
+    }
+
     if (c == NULL) {
         ngx_log_error(NGX_LOG_ALERT, log, 0,
                       "%ui worker_connections are not enough",
@@ -1173,11 +1389,214 @@ ngx_get_connection(ngx_socket_t s, ngx_log_t *log)
 }
 
 
+ngx_int_t
+ngx_grow_connections(ngx_cycle_t *cycle)
+{
+    ngx_uint_t              i, n;
+    ngx_event_t            *rev, *wev;
+    ngx_connection_t       *c, *next;
+    ngx_connection_slot_t  *slot;
+
+    n = ngx_min(cycle->connection_chunk,
+                cycle->connection_n - cycle->alloc_connection_n);
+
+    if (n == 0) {
+        return NGX_DECLINED;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_CORE, cycle->log, 0,
+                   "grow connections: %ui+%ui", cycle->alloc_connection_n, n);
+
+    slot = &cycle->connections[cycle->alloc_connection_n];
+
+    i = n;
+    next = cycle->free_connections;
+
+    do {
+        i--;
+
+        c = &slot[i].events.connection;
+        rev = &slot[i].events.read;
+        wev = &slot[i].events.write;
+
+        rev->closed = 1;
+        rev->instance = 1;
+
+        wev->closed = 1;
+
+        c->data = next;
+        c->read = rev;
+        c->write = wev;
+        c->fd = (ngx_socket_t) -1;
+
+        next = c;
+    } while (i);
+
+    /*
+     * free_connection_n already counts the connections not allocated yet,
+     * so it is not changed here
+     */
+
+    if (cycle->free_connections == NULL) {
+        cycle->free_connections_tail = &slot[n - 1].events.connection;
+    }
+
+    cycle->free_connections = next;
+    cycle->alloc_connection_n += n;
+
+    cycle->last_chunk = (cycle->alloc_connection_n > cycle->connection_chunk)
+                        ? slot : NULL;
+
+    return NGX_OK;
+}
+
+
+#if (NGX_HAVE_MAP_ANON)
+
+void
+ngx_shrink_connections(ngx_cycle_t *cycle)
+{
+    u_char                 *start, *end;
+    ngx_uint_t              n, free;
+    ngx_connection_t       *c, *next, *kept, *moved, *moved_tail;
+    ngx_connection_slot_t  *first, *last, *slot;
+
+    if (cycle->alloc_connection_n <= cycle->connection_chunk) {
+        return;
+    }
+
+    /* the last chunk may be partial */
+
+    n = (cycle->alloc_connection_n - 1) % cycle->connection_chunk + 1;
+
+    first = &cycle->connections[cycle->alloc_connection_n - n];
+    last = &cycle->connections[cycle->alloc_connection_n];
+
+    free = 0;
+
+    for (c = cycle->free_connections; c; c = c->data) {
+        if ((ngx_connection_slot_t *) c >= first
+            && (ngx_connection_slot_t *) c < last)
+        {
+            free++;
+        }
+    }
+
+    if (free != n) {
+        return;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_CORE, cycle->log, 0,
+                   "shrink connections: %ui-%ui", cycle->alloc_connection_n, n);
+
+    cycle->alloc_connection_n -= n;
+
+    cycle->last_chunk = (cycle->alloc_connection_n > cycle->connection_chunk)
+                        ? first - cycle->connection_chunk : NULL;
+
+    /*
+     * the free connections of the released chunk are removed, and the ones
+     * of the new last chunk are moved to the tail, so they are reused last
+     */
+
+    kept = NULL;
+    moved = NULL;
+    moved_tail = NULL;
+
+    c = cycle->free_connections;
+    cycle->free_connections = NULL;
+
+    for ( /* void */ ; c; c = next) {
+        next = c->data;
+        slot = (ngx_connection_slot_t *) c;
+
+        if (slot >= first) {
+            continue;
+        }
+
+        c->data = NULL;
+
+        if (cycle->last_chunk && slot >= cycle->last_chunk) {
+            if (moved_tail) {
+                moved_tail->data = c;
+
+            } else {
+                moved = c;
+            }
+
+            moved_tail = c;
+            continue;
+        }
+
+        if (kept) {
+            kept->data = c;
+
+        } else {
+            cycle->free_connections = c;
+        }
+
+        kept = c;
+    }
+
+    if (moved) {
+        if (kept) {
+            kept->data = moved;
+
+        } else {
+            cycle->free_connections = moved;
+        }
+
+        kept = moved_tail;
+    }
+
+    cycle->free_connections_tail = kept;
+
+    /* return the whole pages of the chunk to the system */
+
+    start = ngx_align_ptr(first, ngx_pagesize);
+    end = (u_char *) ((uintptr_t) last & ~((uintptr_t) ngx_pagesize - 1));
+
+    if (start >= end) {
+        return;
+    }
+
+    if (mmap(start, end - start, PROT_READ|PROT_WRITE,
+             MAP_ANON|MAP_PRIVATE|MAP_FIXED, -1, 0)
+        == MAP_FAILED)
+    {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "mmap(MAP_ANON|MAP_FIXED, %uz) failed", end - start);
+    }
+}
+
+#endif
+
+
 void
 ngx_free_connection(ngx_connection_t *c)
 {
-    c->data = ngx_cycle->free_connections;
-    ngx_cycle->free_connections = c;
+    /*
+     * the connections of the last chunk are reused after all others,
+     * so the chunk becomes free and can be returned to the system
+     */
+
+    if (ngx_cycle->last_chunk
+        && (ngx_connection_slot_t *) c >= ngx_cycle->last_chunk
+        && ngx_cycle->free_connections)
+    {
+        c->data = NULL;
+        ngx_cycle->free_connections_tail->data = c;
+        ngx_cycle->free_connections_tail = c;
+
+    } else {
+        if (ngx_cycle->free_connections == NULL) {
+            ngx_cycle->free_connections_tail = c;
+        }
+
+        c->data = ngx_cycle->free_connections;
+        ngx_cycle->free_connections = c;
+    }
+
     ngx_cycle->free_connection_n++;
 
     if (ngx_cycle->files && ngx_cycle->files[c->fd] == c) {
@@ -1368,15 +1787,15 @@ ngx_close_idle_connections(ngx_cycle_t *cycle)
     ngx_uint_t         i;
     ngx_connection_t  *c;
 
-    c = cycle->connections;
+    for (i = 0; i < cycle->alloc_connection_n; i++) {
 
-    for (i = 0; i < cycle->connection_n; i++) {
+        c = &cycle->connections[i].events.connection;
 
         /* THREAD: lock */
 
-        if (c[i].fd != (ngx_socket_t) -1 && c[i].idle) {
-            c[i].close = 1;
-            c[i].read->handler(c[i].read);
+        if (c->fd != (ngx_socket_t) -1 && c->idle) {
+            c->close = 1;
+            c->read->handler(c->read);
         }
     }
 }
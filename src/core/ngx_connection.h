@@ -66,6 +66,11 @@ struct ngx_listening_s {
 
     ngx_uint_t          worker;
 
+    /* per worker accept statistics, see the "stub_status extended" */
+    ngx_uint_t          accept_events;
+    ngx_uint_t          accepted;
+    ngx_uint_t          accept_batch_max;
+
     unsigned            open:1;
     unsigned            remain:1;
     unsigned            ignore:1;
@@ -84,6 +89,7 @@ struct ngx_listening_s {
 #endif
     unsigned            reuseport:1;
     unsigned            add_reuseport:1;
+    unsigned            reuseport_cpu:1;
     unsigned            keepalive:2;
 
     unsigned            deferred_accept:1;
@@ -100,6 +106,10 @@ struct ngx_listening_s {
     int                 fastopen;
 #endif
 
+#if (NGX_HAVE_BUSY_POLL)
+    int                 busy_poll;
+#endif
+
 };
 
 
@@ -139,10 +149,11 @@ struct ngx_connection_s {
      * 连接归化给连接池时，data 指针再次变成 next 指针，指向下一个空闲连接
      */
     void               *data;
-    ngx_event_t        *read;       // 连接对应的读事件，从 read_events 数组中获取
-    ngx_event_t        *write;      // 连接对应的写事件，从 write_events 数组中获取
+    ngx_event_t        *read;       // 连接对应的读事件，与连接一同在 ngx_connection_slot_t 中分配
+    ngx_event_t        *write;      // 连接对应的写事件，与连接一同在 ngx_connection_slot_t 中分配
 
     ngx_socket_t        fd;         // 当前连接的 TCP socket 句柄
+    int                 type;
 
     /*
      * 直接接收 socket 数据时调用的方法
@@ -158,39 +169,19 @@ struct ngx_connection_s {
     ngx_recv_chain_pt   recv_chain;
     ngx_send_chain_pt   send_chain;
 
-    ngx_listening_t    *listening;  // socket 监听对象
-
     off_t               sent;       // 发送偏移量，表示已经向 socket 写入了多少数据
 
     ngx_log_t          *log;        // 日志对象
 
     ngx_pool_t         *pool;       // 内存池对象，每一个连接在建立时都会创建一个 ngx_pool_t 对象
 
-    int                 type;
-
-    struct sockaddr    *sockaddr;   // 对端的 IP 地址信息
-    socklen_t           socklen;
-    ngx_str_t           addr_text;
-
-    ngx_proxy_protocol_t  *proxy_protocol;
+    ngx_buf_t          *buffer;     // 接收缓冲区
 
 #if (NGX_SSL || NGX_COMPAT)
     ngx_ssl_connection_t  *ssl;
 #endif
 
-    ngx_udp_connection_t  *udp;
-
-    struct sockaddr    *local_sockaddr;
-    socklen_t           local_socklen;
-
-    ngx_buf_t          *buffer;     // 接收缓冲区
-
-    ngx_queue_t         queue;
-
-    ngx_atomic_uint_t   number;
-
-    ngx_msec_t          start_time;
-    ngx_uint_t          requests;
+    ngx_listening_t    *listening;  // socket 监听对象
 
     unsigned            buffered:8;
 
@@ -219,6 +210,29 @@ struct ngx_connection_s {
 #if (NGX_THREADS || NGX_COMPAT)
     ngx_thread_task_t  *sendfile_task;
 #endif
+
+    /*
+     * the fields above are used while processing events, the fields below
+     * are mostly used when a connection is set up and logged
+     */
+
+    struct sockaddr    *sockaddr;   // 对端的 IP 地址信息
+    socklen_t           socklen;
+    ngx_str_t           addr_text;
+
+    ngx_proxy_protocol_t  *proxy_protocol;
+
+    ngx_udp_connection_t  *udp;
+
+    struct sockaddr    *local_sockaddr;
+    socklen_t           local_socklen;
+
+    ngx_queue_t         queue;
+
+    ngx_atomic_uint_t   number;
+
+    ngx_msec_t          start_time;
+    ngx_uint_t          requests;
 };
 
 
@@ -257,6 +271,10 @@ ngx_int_t ngx_tcp_nodelay(ngx_connection_t *c);
 ngx_int_t ngx_connection_error(ngx_connection_t *c, ngx_err_t err, char *text);
 
 ngx_connection_t *ngx_get_connection(ngx_socket_t s, ngx_log_t *log);
+ngx_int_t ngx_grow_connections(ngx_cycle_t *cycle);
+#if (NGX_HAVE_MAP_ANON)
+void ngx_shrink_connections(ngx_cycle_t *cycle);
+#endif
 
 // 在 ngx_close_connection() 中调用了 ngx_free_connection() 函数，一个是关闭连接，一个是将连接从连接池中移入至空闲链表中
 void ngx_close_connection(ngx_connection_t *c);
@@ -9,6 +9,9 @@
 #include <ngx_core.h>
 
 
+ngx_uint_t  ngx_cpu_features;
+
+
 #if (( __i386__ || __amd64__ ) && ( __GNUC__ || __INTEL_COMPILER ))
 
 
@@ -67,7 +70,10 @@ ngx_cpuid(uint32_t i, uint32_t *buf)
 #endif
 
 
-/* auto detect the L2 cache line size of modern and widespread CPUs */
+/*
+ * auto detect the L2 cache line size of modern and widespread CPUs
+ * and the instruction set extensions used by the optimized code paths
+ */
 
 void
 ngx_cpuinfo(void)
@@ -91,6 +97,10 @@ ngx_cpuinfo(void)
 
     ngx_cpuid(1, cpu);
 
+    if (cpu[3] & 0x00100000) {
+        ngx_cpu_features |= NGX_CPU_SSE42;
+    }
+
     if (ngx_strcmp(vendor, "GenuineIntel") == 0) {
 
         switch ((cpu[0] & 0xf00) >> 8) {
@@ -73,6 +73,33 @@ ngx_crc32_update(uint32_t *crc, u_char *p, size_t len)
     crc ^= 0xffffffff
 
 
+typedef uint32_t (*ngx_crc32c_pt)(uint32_t crc, u_char *p, size_t len);
+
+extern ngx_crc32c_pt  ngx_crc32c_handler;
+
+
+static ngx_inline uint32_t
+ngx_crc32c(u_char *p, size_t len)
+{
+    return ngx_crc32c_handler(0xffffffff, p, len) ^ 0xffffffff;
+}
+
+
+#define ngx_crc32c_init(crc)                                                  \
+    crc = 0xffffffff
+
+
+static ngx_inline void
+ngx_crc32c_update(uint32_t *crc, u_char *p, size_t len)
+{
+    *crc = ngx_crc32c_handler(*crc, p, len);
+}
+
+
+#define ngx_crc32c_final(crc)                                                 \
+    crc ^= 0xffffffff
+
+
 ngx_int_t ngx_crc32_table_init(void);
 
 
@@ -1387,8 +1387,10 @@ ngx_clean_old_cycles(ngx_event_t *ev)
 
         found = 0;
 
-        for (n = 0; n < cycle[i]->connection_n; n++) {
-            if (cycle[i]->connections[n].fd != (ngx_socket_t) -1) {
+        for (n = 0; n < cycle[i]->alloc_connection_n; n++) {
+            if (cycle[i]->connections[n].events.connection.fd
+                != (ngx_socket_t) -1)
+            {
                 found = 1;
 
                 ngx_log_debug1(NGX_LOG_DEBUG_CORE, log, 0, "live fd:%ui", n);
@@ -1448,25 +1450,25 @@ ngx_shutdown_timer_handler(ngx_event_t *ev)
 
     cycle = ev->data;
 
-    c = cycle->connections;
+    for (i = 0; i < cycle->alloc_connection_n; i++) {
 
-    for (i = 0; i < cycle->connection_n; i++) {
+        c = &cycle->connections[i].events.connection;
 
-        if (c[i].fd == (ngx_socket_t) -1
-            || c[i].read == NULL
-            || c[i].read->accept
-            || c[i].read->channel
-            || c[i].read->resolver)
+        if (c->fd == (ngx_socket_t) -1
+            || c->read == NULL
+            || c->read->accept
+            || c->read->channel
+            || c->read->resolver)
         {
             continue;
         }
 
         ngx_log_debug1(NGX_LOG_DEBUG_CORE, ev->log, 0,
-                       "*%uA shutdown timeout", c[i].number);
+                       "*%uA shutdown timeout", c->number);
 
-        c[i].close = 1;
-        c[i].error = 1;
+        c->close = 1;
+        c->error = 1;
 
-        c[i].read->handler(c[i].read);
+        c->read->handler(c->read);
     }
 }
@@ -54,6 +54,7 @@ struct ngx_cycle_s {
      * 取出一个空闲连接，并将 free_connections 指向单向链表的下一个节点。当连接关闭需要归还连接时，将其插入到 free_connections 的头结点即可
      */
     ngx_connection_t         *free_connections;
+    ngx_connection_t         *free_connections_tail;       // 空闲连接链表的尾节点，仅当链表非空时有效
     ngx_uint_t                free_connection_n;            // 空闲连接数量，也就是还能够分配出多少个连接出去
 
     ngx_module_t            **modules;
@@ -76,13 +77,13 @@ struct ngx_cycle_s {
     ngx_list_t                shared_memory;
 
     ngx_uint_t                connection_n;                 // 初始化时 connection_n == free_connection_n，表示连接池总大小
+    ngx_uint_t                connection_chunk;             // 连接池每次增长的连接数量
+    ngx_uint_t                alloc_connection_n;           // 已经初始化的连接数量，不超过 connection_n
+    ngx_connection_slot_t    *last_chunk;                   // 最后一块连接的首地址，只有一块时为 NULL
     ngx_uint_t                files_n;                      // 单个进程能够打开的最大文件数量
 
-    ngx_connection_t         *connections;                  // 连接池首地址，与 free_connections 搭配使用
-
-    // 读/写事件数组，其大小等于 connection_n，在 nginx 启动时和 connections 连接池一起初始化
-    ngx_event_t              *read_events;
-    ngx_event_t              *write_events;
+    // 连接池首地址，与 free_connections 搭配使用，每个连接与其读/写事件一同分配
+    ngx_connection_slot_t    *connections;
 
     ngx_cycle_t              *old_cycle;
 
@@ -109,6 +110,9 @@ typedef struct {
     ngx_int_t                 rlimit_nofile;
     off_t                     rlimit_core;
 
+    size_t                    pool_cache;
+    ngx_int_t                 slab_magazine;
+
     int                       priority;
 
     ngx_uint_t                cpu_affinity_auto;
@@ -142,7 +146,7 @@ ngx_int_t ngx_signal_process(ngx_cycle_t *cycle, char *sig);
 void ngx_reopen_files(ngx_cycle_t *cycle, ngx_uid_t user);
 char **ngx_set_environment(ngx_cycle_t *cycle, ngx_uint_t *last);
 ngx_pid_t ngx_exec_new_binary(ngx_cycle_t *cycle, char *const *argv);
-ngx_cpuset_t *ngx_get_cpu_affinity(ngx_uint_t n);
+ngx_cpuset_t *ngx_get_cpu_affinity(ngx_cycle_t *cycle, ngx_uint_t n);
 ngx_shm_zone_t *ngx_shared_memory_add(ngx_conf_t *cf, ngx_str_t *name,
     size_t size, void *tag);
 void ngx_set_shutdown_timer(ngx_cycle_t *cycle);
@@ -8,6 +8,43 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 
+#if (defined __SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/*
+ * The open addressing table keeps a control byte per slot: either
+ * NGX_HASH_CTRL_EMPTY or the top 7 bits of the mixed key.  Slots are
+ * grouped by 16, a group is matched against the control byte at once,
+ * and groups are probed in a triangular sequence, which visits every
+ * group of a power of two sized table.  The table is read-only once
+ * built, so there are no tombstones, and its load is kept under 7/8.
+ */
+
+#define NGX_HASH_GROUP        16
+#define NGX_HASH_CTRL_EMPTY   0x80
+
+#if (NGX_PTR_SIZE == 8)
+#define ngx_hash_mix(key)                                                     \
+    ((ngx_uint_t) (key) * (ngx_uint_t) 0x9e3779b97f4a7c15)
+#define ngx_hash_ctrl(h)      (u_char) ((h) >> 57)
+#else
+#define ngx_hash_mix(key)                                                     \
+    ((ngx_uint_t) (key) * (ngx_uint_t) 0x9e3779b9)
+#define ngx_hash_ctrl(h)      (u_char) ((h) >> 25)
+#endif
+
+#define ngx_hash_group(h)     ((h) ^ ((h) >> (NGX_PTR_SIZE * 4)))
+
+
+static ngx_inline ngx_uint_t ngx_hash_group_match(u_char *ctrl, u_char c);
+static ngx_inline ngx_uint_t ngx_hash_first_bit(ngx_uint_t m);
+static void *ngx_hash_find_open(ngx_hash_t *hash, ngx_uint_t key,
+    u_char *name, size_t len);
+static ngx_int_t ngx_hash_open_init(ngx_hash_init_t *hinit,
+    ngx_hash_key_t *names, ngx_uint_t nelts);
+
 
 void *
 ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len)
@@ -19,6 +56,10 @@ ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len)
     ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0, "hf:\"%*s\"", len, name);
 #endif
 
+    if (hash->ctrl) {
+        return ngx_hash_find_open(hash, key, name, len);
+    }
+
     elt = hash->buckets[key % hash->size];
 
     if (elt == NULL) {
@@ -49,6 +90,96 @@ ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len)
 }
 
 
+static ngx_inline ngx_uint_t
+ngx_hash_group_match(u_char *ctrl, u_char c)
+{
+#if (defined __SSE2__)
+
+    __m128i  group;
+
+    group = _mm_load_si128((__m128i *) ctrl);
+
+    return (ngx_uint_t) _mm_movemask_epi8(_mm_cmpeq_epi8(group,
+                                                 _mm_set1_epi8((char) c)));
+
+#else
+
+    ngx_uint_t  i, m;
+
+    m = 0;
+
+    for (i = 0; i < NGX_HASH_GROUP; i++) {
+        if (ctrl[i] == c) {
+            m |= (ngx_uint_t) 1 << i;
+        }
+    }
+
+    return m;
+
+#endif
+}
+
+
+static ngx_inline ngx_uint_t
+ngx_hash_first_bit(ngx_uint_t m)
+{
+#if (defined __GNUC__)
+
+    return (ngx_uint_t) __builtin_ctzl((unsigned long) m);
+
+#else
+
+    ngx_uint_t  i;
+
+    for (i = 0; !(m & 1); i++) {
+        m >>= 1;
+    }
+
+    return i;
+
+#endif
+}
+
+
+static void *
+ngx_hash_find_open(ngx_hash_t *hash, ngx_uint_t key, u_char *name,
+    size_t len)
+{
+    u_char          *ctrl, c;
+    ngx_uint_t       h, g, m, mask, step, slot;
+    ngx_hash_elt_t  *elt;
+
+    h = ngx_hash_mix(key);
+    c = ngx_hash_ctrl(h);
+
+    mask = hash->size / NGX_HASH_GROUP - 1;
+    g = ngx_hash_group(h) & mask;
+
+    for (step = 1; /* void */ ; step++) {
+
+        ctrl = &hash->ctrl[g * NGX_HASH_GROUP];
+
+        for (m = ngx_hash_group_match(ctrl, c); m; m &= m - 1) {
+
+            slot = g * NGX_HASH_GROUP + ngx_hash_first_bit(m);
+            elt = hash->buckets[slot];
+
+            if (len == (size_t) elt->len
+                && ngx_memcmp(name, elt->name, len) == 0)
+            {
+                return elt->value;
+            }
+        }
+
+        if (ngx_hash_group_match(ctrl, NGX_HASH_CTRL_EMPTY)) {
+            return NULL;
+        }
+
+        g = (g + step) & mask;
+    }
+}
+
+
 void *
 ngx_hash_find_wc_head(ngx_hash_wildcard_t *hwc, u_char *name, size_t len)
 {
@@ -257,6 +388,10 @@ ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names, ngx_uint_t nelts)
     ngx_uint_t       i, n, key, size, start, bucket_size;
     ngx_hash_elt_t  *elt, **buckets;
 
+    if (hinit->bucket_size == NGX_HASH_OPEN) {
+        return ngx_hash_open_init(hinit, names, nelts);
+    }
+
     if (hinit->max_size == 0) {
         ngx_log_error(NGX_LOG_EMERG, hinit->pool->log, 0,
                       "could not build %s, you should "
@@ -447,6 +582,7 @@ found:
 
     hinit->hash->buckets = buckets;
     hinit->hash->size = size;
+    hinit->hash->ctrl = NULL;
 
 #if 0
 
@@ -482,6 +618,116 @@ found:
 }
 
 
+static ngx_int_t
+ngx_hash_open_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
+    ngx_uint_t nelts)
+{
+    u_char           *ctrl, *elts, c;
+    size_t            len;
+    ngx_uint_t        i, n, h, g, m, mask, step, size;
+    ngx_hash_elt_t   *elt, **buckets;
+
+    len = 0;
+    i = 0;
+
+    for (n = 0; n < nelts; n++) {
+        if (names[n].key.data == NULL) {
+            continue;
+        }
+
+        if (names[n].key.len > 65535) {
+            ngx_log_error(NGX_LOG_EMERG, hinit->pool->log, 0,
+                          "could not build %s, too long key \"%V\"",
+                          hinit->name, &names[n].key);
+            return NGX_ERROR;
+        }
+
+        len += NGX_HASH_ELT_SIZE(&names[n]);
+        i++;
+    }
+
+    for (size = NGX_HASH_GROUP; size - size / 8 < i; size *= 2) {
+        /* void */
+    }
+
+    if (size > hinit->max_size) {
+        ngx_log_error(NGX_LOG_EMERG, hinit->pool->log, 0,
+                      "could not build %s, you should "
+                      "increase %s_max_size: %i",
+                      hinit->name, hinit->name, hinit->max_size);
+        return NGX_ERROR;
+    }
+
+    if (hinit->hash == NULL) {
+        hinit->hash = ngx_pcalloc(hinit->pool, sizeof(ngx_hash_wildcard_t));
+        if (hinit->hash == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    buckets = ngx_pcalloc(hinit->pool, size * sizeof(ngx_hash_elt_t *));
+    if (buckets == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctrl = ngx_pnalloc(hinit->pool, size + NGX_HASH_GROUP);
+    if (ctrl == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctrl = ngx_align_ptr(ctrl, NGX_HASH_GROUP);
+    ngx_memset(ctrl, NGX_HASH_CTRL_EMPTY, size);
+
+    elts = ngx_palloc(hinit->pool, len + sizeof(void *));
+    if (elts == NULL) {
+        return NGX_ERROR;
+    }
+
+    elts = ngx_align_ptr(elts, sizeof(void *));
+
+    mask = size / NGX_HASH_GROUP - 1;
+
+    for (n = 0; n < nelts; n++) {
+        if (names[n].key.data == NULL) {
+            continue;
+        }
+
+        elt = (ngx_hash_elt_t *) elts;
+        elts += NGX_HASH_ELT_SIZE(&names[n]);
+
+        elt->value = names[n].value;
+        elt->len = (u_short) names[n].key.len;
+
+        ngx_strlow(elt->name, names[n].key.data, names[n].key.len);
+
+        h = ngx_hash_mix(names[n].key_hash);
+        c = ngx_hash_ctrl(h);
+        g = ngx_hash_group(h) & mask;
+
+        for (step = 1; /* void */ ; step++) {
+            m = ngx_hash_group_match(&ctrl[g * NGX_HASH_GROUP],
+                                     NGX_HASH_CTRL_EMPTY);
+            if (m) {
+                break;
+            }
+
+            g = (g + step) & mask;
+        }
+
+        i = g * NGX_HASH_GROUP + ngx_hash_first_bit(m);
+
+        ctrl[i] = c;
+        buckets[i] = elt;
+    }
+
+    hinit->hash->buckets = buckets;
+    hinit->hash->size = size;
+    hinit->hash->ctrl = ctrl;
+
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_hash_wildcard_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
     ngx_uint_t nelts)
@@ -29,6 +29,8 @@ typedef struct {
     ngx_hash_elt_t  **buckets;
     // 哈希表中 bucket 总数
     ngx_uint_t        size;
+    // 开放寻址表的控制字节，为 NULL 时为普通的 bucket 哈希表
+    u_char           *ctrl;
 } ngx_hash_t;
 
 
@@ -59,6 +61,12 @@ typedef struct {
 } ngx_hash_combined_t;
 
 
+/*
+ * bucket_size NGX_HASH_OPEN builds an open addressing table: no bucket
+ * size search is done, and max_size limits the number of slots, a power
+ * of two that keeps the load under 7/8
+ */
+
 typedef struct {
     ngx_hash_t       *hash;
     ngx_hash_key_pt   key;
@@ -72,6 +80,8 @@ typedef struct {
 } ngx_hash_init_t;
 
 
+#define NGX_HASH_OPEN             0
+
 #define NGX_HASH_SMALL            1
 #define NGX_HASH_LARGE            2
 
@@ -50,3 +50,68 @@ ngx_murmur_hash2(u_char *data, size_t len)
 
     return h;
 }
+
+
+/*
+ * MurmurHash64A: processes 8 bytes per round, the seed allows
+ * to chain hashes of several pieces of data
+ */
+
+uint64_t
+ngx_murmur_hash64(u_char *data, size_t len, uint64_t seed)
+{
+    uint64_t  h, k;
+
+    h = seed ^ (len * 0xc6a4a7935bd1e995ULL);
+
+    while (len >= 8) {
+        k  = (uint64_t) data[0];
+        k |= (uint64_t) data[1] << 8;
+        k |= (uint64_t) data[2] << 16;
+        k |= (uint64_t) data[3] << 24;
+        k |= (uint64_t) data[4] << 32;
+        k |= (uint64_t) data[5] << 40;
+        k |= (uint64_t) data[6] << 48;
+        k |= (uint64_t) data[7] << 56;
+
+        k *= 0xc6a4a7935bd1e995ULL;
+        k ^= k >> 47;
+        k *= 0xc6a4a7935bd1e995ULL;
+
+        h ^= k;
+        h *= 0xc6a4a7935bd1e995ULL;
+
+        data += 8;
+        len -= 8;
+    }
+
+    switch (len) {
+    case 7:
+        h ^= (uint64_t) data[6] << 48;
+        /* fall through */
+    case 6:
+        h ^= (uint64_t) data[5] << 40;
+        /* fall through */
+    case 5:
+        h ^= (uint64_t) data[4] << 32;
+        /* fall through */
+    case 4:
+        h ^= (uint64_t) data[3] << 24;
+        /* fall through */
+    case 3:
+        h ^= (uint64_t) data[2] << 16;
+        /* fall through */
+    case 2:
+        h ^= (uint64_t) data[1] << 8;
+        /* fall through */
+    case 1:
+        h ^= (uint64_t) data[0];
+        h *= 0xc6a4a7935bd1e995ULL;
+    }
+
+    h ^= h >> 47;
+    h *= 0xc6a4a7935bd1e995ULL;
+    h ^= h >> 47;
+
+    return h;
+}
@@ -14,6 +14,7 @@
 
 
 uint32_t ngx_murmur_hash2(u_char *data, size_t len);
+uint64_t ngx_murmur_hash64(u_char *data, size_t len, uint64_t seed);
 
 
 #endif /* _NGX_MURMURHASH_H_INCLUDED_ */
@@ -13,6 +13,21 @@ static ngx_inline void *ngx_palloc_small(ngx_pool_t *pool, size_t size,
     ngx_uint_t align);
 static void *ngx_palloc_block(ngx_pool_t *pool, size_t size);
 static void *ngx_palloc_large(ngx_pool_t *pool, size_t size);
+static void *ngx_pool_cache_alloc(size_t size, ngx_log_t *log);
+static void ngx_pool_cache_free(void *p, size_t size);
+
+
+typedef struct ngx_pool_cached_block_s  ngx_pool_cached_block_t;
+
+struct ngx_pool_cached_block_s {
+    ngx_pool_cached_block_t  *next;
+};
+
+
+size_t                    ngx_pool_cache_max;
+ngx_pool_cache_stat_t     ngx_pool_cache_stat;
+
+static ngx_pool_cached_block_t  *ngx_pool_cache[NGX_POOL_CACHE_SLOTS];
 
 
 ngx_pool_t *
@@ -20,7 +35,7 @@ ngx_create_pool(size_t size, ngx_log_t *log)
 {
     ngx_pool_t  *p;
 
-    p = ngx_memalign(NGX_POOL_ALIGNMENT, size, log);
+    p = ngx_pool_cache_alloc(size, log);
     if (p == NULL) {
         return NULL;
     }
@@ -82,12 +97,12 @@ ngx_destroy_pool(ngx_pool_t *pool)
 
     for (l = pool->large; l; l = l->next) {
         if (l->alloc) {
-            ngx_free(l->alloc);
+            ngx_pool_cache_free(l->alloc, l->size);
         }
     }
 
     for (p = pool, n = pool->d.next; /* void */; p = n, n = n->d.next) {
-        ngx_free(p);
+        ngx_pool_cache_free(p, p->d.end - (u_char *) p);
 
         if (n == NULL) {
             break;
@@ -104,7 +119,7 @@ ngx_reset_pool(ngx_pool_t *pool)
 
     for (l = pool->large; l; l = l->next) {
         if (l->alloc) {
-            ngx_free(l->alloc);
+            ngx_pool_cache_free(l->alloc, l->size);
         }
     }
 
@@ -183,7 +198,7 @@ ngx_palloc_block(ngx_pool_t *pool, size_t size)
 
     psize = (size_t) (pool->d.end - (u_char *) pool);
 
-    m = ngx_memalign(NGX_POOL_ALIGNMENT, psize, pool->log);
+    m = ngx_pool_cache_alloc(psize, pool->log);
     if (m == NULL) {
         return NULL;
     }
@@ -217,7 +232,7 @@ ngx_palloc_large(ngx_pool_t *pool, size_t size)
     ngx_uint_t         n;
     ngx_pool_large_t  *large;
 
-    p = ngx_alloc(size, pool->log);
+    p = ngx_pool_cache_alloc(size, pool->log);
     if (p == NULL) {
         return NULL;
     }
@@ -227,6 +242,7 @@ ngx_palloc_large(ngx_pool_t *pool, size_t size)
     for (large = pool->large; large; large = large->next) {
         if (large->alloc == NULL) {
             large->alloc = p;
+            large->size = size;
             return p;
         }
 
@@ -237,11 +253,12 @@ ngx_palloc_large(ngx_pool_t *pool, size_t size)
 
     large = ngx_palloc_small(pool, sizeof(ngx_pool_large_t), 1);
     if (large == NULL) {
-        ngx_free(p);
+        ngx_pool_cache_free(p, size);
         return NULL;
     }
 
     large->alloc = p;
+    large->size = size;
     large->next = pool->large;
     pool->large = large;
 
@@ -267,6 +284,7 @@ ngx_pmemalign(ngx_pool_t *pool, size_t size, size_t alignment)
     }
 
     large->alloc = p;
+    large->size = 0;
     large->next = pool->large;
     pool->large = large;
 
@@ -283,7 +301,7 @@ ngx_pfree(ngx_pool_t *pool, void *p)
         if (p == l->alloc) {
             ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, pool->log, 0,
                            "free: %p", l->alloc);
-            ngx_free(l->alloc);
+            ngx_pool_cache_free(l->alloc, l->size);
             l->alloc = NULL;
 
             return NGX_OK;
@@ -401,30 +419,74 @@ ngx_pool_delete_file(void *data)
 }
 
 
-#if 0
 
 static void *
-ngx_get_cached_block(size_t size)
+ngx_pool_cache_alloc(size_t size, ngx_log_t *log)
 {
-    void                     *p;
-    ngx_cached_block_slot_t  *slot;
+    ngx_uint_t                n;
+    ngx_pool_cached_block_t  *block;
 
-    if (ngx_cycle->cache == NULL) {
-        return NULL;
+    if (size > NGX_POOL_CACHE_MAX_SIZE) {
+        return ngx_memalign(NGX_POOL_ALIGNMENT, size, log);
     }
 
-    slot = &ngx_cycle->cache[(size + ngx_pagesize - 1) / ngx_pagesize];
+    n = size ? (size - 1) >> NGX_POOL_CACHE_SHIFT : 0;
+
+    block = ngx_pool_cache[n];
+
+    if (block) {
+        ngx_pool_cache[n] = block->next;
+
+        ngx_pool_cache_stat.size -= (n + 1) << NGX_POOL_CACHE_SHIFT;
+        ngx_pool_cache_stat.hits++;
 
-    slot->tries++;
+        ngx_log_debug2(NGX_LOG_DEBUG_ALLOC, log, 0,
+                       "pool cache: %p:%uz", block,
+                       (n + 1) << NGX_POOL_CACHE_SHIFT);
 
-    if (slot->number) {
-        p = slot->block;
-        slot->block = slot->block->next;
-        slot->number--;
-        return p;
+        return block;
     }
 
-    return NULL;
+    if (ngx_pool_cache_max) {
+        ngx_pool_cache_stat.misses++;
+    }
+
+    /* the size is rounded up so the block fits any size of its class */
+
+    return ngx_memalign(NGX_POOL_ALIGNMENT, (n + 1) << NGX_POOL_CACHE_SHIFT,
+                        log);
 }
 
-#endif
+
+static void
+ngx_pool_cache_free(void *p, size_t size)
+{
+    size_t                    bsize;
+    ngx_uint_t                n;
+    ngx_pool_cached_block_t  *block;
+
+    if (size == 0 || size > NGX_POOL_CACHE_MAX_SIZE) {
+        ngx_free(p);
+        return;
+    }
+
+    n = (size - 1) >> NGX_POOL_CACHE_SHIFT;
+    bsize = (n + 1) << NGX_POOL_CACHE_SHIFT;
+
+    if (ngx_pool_cache_stat.size + bsize > ngx_pool_cache_max) {
+
+        if (ngx_pool_cache_max) {
+            ngx_pool_cache_stat.drops++;
+        }
+
+        ngx_free(p);
+        return;
+    }
+
+    block = p;
+    block->next = ngx_pool_cache[n];
+    ngx_pool_cache[n] = block;
+
+    ngx_pool_cache_stat.size += bsize;
+    ngx_pool_cache_stat.frees++;
+}
@@ -26,6 +26,16 @@
     ngx_align((sizeof(ngx_pool_t) + 2 * sizeof(ngx_pool_large_t)),            \
               NGX_POOL_ALIGNMENT)
 
+/*
+ * the pool blocks and large allocations up to NGX_POOL_CACHE_MAX_SIZE
+ * are rounded up to a multiple of NGX_POOL_CACHE_GRAIN, so a freed block
+ * can be reused for any allocation of the same size class
+ */
+#define NGX_POOL_CACHE_SHIFT     8
+#define NGX_POOL_CACHE_GRAIN     (1 << NGX_POOL_CACHE_SHIFT)
+#define NGX_POOL_CACHE_SLOTS     256
+#define NGX_POOL_CACHE_MAX_SIZE  (NGX_POOL_CACHE_SLOTS * NGX_POOL_CACHE_GRAIN)
+
 
 typedef void (*ngx_pool_cleanup_pt)(void *data);
 
@@ -43,6 +53,7 @@ typedef struct ngx_pool_large_s  ngx_pool_large_t;
 struct ngx_pool_large_s {
     ngx_pool_large_t     *next;
     void                 *alloc;
+    size_t                size;     /* 0 if the allocation is not cached */
 };
 
 
@@ -72,6 +83,15 @@ typedef struct {
 } ngx_pool_cleanup_file_t;
 
 
+typedef struct {
+    ngx_uint_t            hits;
+    ngx_uint_t            misses;
+    ngx_uint_t            frees;    /* the blocks kept in the cache */
+    ngx_uint_t            drops;    /* the blocks freed due to the limit */
+    size_t                size;     /* the memory kept in the cache */
+} ngx_pool_cache_stat_t;
+
+
 ngx_pool_t *ngx_create_pool(size_t size, ngx_log_t *log);
 void ngx_destroy_pool(ngx_pool_t *pool);
 void ngx_reset_pool(ngx_pool_t *pool);
@@ -89,4 +109,12 @@ void ngx_pool_cleanup_file(void *data);
 void ngx_pool_delete_file(void *data);
 
 
+/*
+ * the block cache is per process and is not thread safe, so pools must not
+ * be created or destroyed in thread pool threads; 0 disables the cache
+ */
+extern size_t                 ngx_pool_cache_max;
+extern ngx_pool_cache_stat_t  ngx_pool_cache_stat;
+
+
 #endif /* _NGX_PALLOC_H_INCLUDED_ */
@@ -9,7 +9,37 @@
 #include <ngx_core.h>
 
 
+typedef struct {
+    ngx_radix_node_t  *node;
+    uintptr_t          value;
+} ngx_radix_stride_slot_t;
+
+
+typedef struct {
+    ngx_array_t        nodes;
+    ngx_array_t        leaves;
+} ngx_radix_stride_ctx_t;
+
+
 static ngx_radix_node_t *ngx_radix_alloc(ngx_radix_tree_t *tree);
+static ngx_int_t ngx_radix_stride_build(ngx_radix_stride_ctx_t *ctx,
+    ngx_uint_t index, ngx_radix_node_t *node, uintptr_t value);
+static void ngx_radix_stride_expand(ngx_radix_node_t *node,
+    ngx_radix_stride_slot_t *slots, ngx_uint_t n, uintptr_t value);
+static ngx_inline ngx_uint_t ngx_radix_stride_rank(uint64_t *bits,
+    ngx_uint_t i);
+static ngx_inline uintptr_t ngx_radix_stride_leaf(ngx_radix_stride_t *tree,
+    ngx_radix_stride_node_t *node, ngx_uint_t i);
+
+
+#if (defined __GNUC__)
+#define ngx_radix_popcount(x)  (ngx_uint_t) __builtin_popcountll(x)
+#else
+static ngx_inline ngx_uint_t ngx_radix_popcount(uint64_t x);
+#endif
+
+#define ngx_radix_stride_bit(bits, i)                                         \
+    ((bits)[(i) >> 6] & ((uint64_t) 1 << ((i) & 63)))
 
 
 ngx_radix_tree_t *
@@ -460,6 +490,273 @@ ngx_radix128tree_find(ngx_radix_tree_t *tree, u_char *key)
 #endif
 
 
+ngx_radix_stride_t *
+ngx_radix_stride_create(ngx_pool_t *pool, ngx_pool_t *temp_pool,
+    ngx_radix_tree_t *tree)
+{
+    ngx_radix_stride_t      *st;
+    ngx_radix_stride_ctx_t   ctx;
+
+    if (ngx_array_init(&ctx.nodes, temp_pool, 64,
+                       sizeof(ngx_radix_stride_node_t))
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    if (ngx_array_init(&ctx.leaves, temp_pool, 256, sizeof(uintptr_t))
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    if (ngx_array_push(&ctx.nodes) == NULL) {
+        return NULL;
+    }
+
+    if (ngx_radix_stride_build(&ctx, 0, tree->root, NGX_RADIX_NO_VALUE)
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    st = ngx_palloc(pool, sizeof(ngx_radix_stride_t));
+    if (st == NULL) {
+        return NULL;
+    }
+
+    st->nnodes = ctx.nodes.nelts;
+    st->nleaves = ctx.leaves.nelts;
+
+    st->nodes = ngx_palloc(pool,
+                           st->nnodes * sizeof(ngx_radix_stride_node_t));
+    if (st->nodes == NULL) {
+        return NULL;
+    }
+
+    st->leaves = ngx_palloc(pool, st->nleaves * sizeof(uintptr_t));
+    if (st->leaves == NULL) {
+        return NULL;
+    }
+
+    ngx_memcpy(st->nodes, ctx.nodes.elts,
+               st->nnodes * sizeof(ngx_radix_stride_node_t));
+    ngx_memcpy(st->leaves, ctx.leaves.elts, st->nleaves * sizeof(uintptr_t));
+
+    return st;
+}
+
+
+static ngx_int_t
+ngx_radix_stride_build(ngx_radix_stride_ctx_t *ctx, ngx_uint_t index,
+    ngx_radix_node_t *node, uintptr_t value)
+{
+    ngx_uint_t                i, n, base;
+    uintptr_t                *leaf;
+    ngx_radix_stride_node_t  *sn, *child;
+    ngx_radix_stride_slot_t   slots[256];
+
+    if (node->value != NGX_RADIX_NO_VALUE) {
+        value = node->value;
+    }
+
+    ngx_radix_stride_expand(node->left, slots, 128, value);
+    ngx_radix_stride_expand(node->right, &slots[128], 128, value);
+
+    n = 0;
+
+    for (i = 0; i < 256; i++) {
+        if (slots[i].node) {
+            n++;
+        }
+    }
+
+    base = ctx->nodes.nelts;
+
+    if (n) {
+        child = ngx_array_push_n(&ctx->nodes, n);
+        if (child == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    sn = (ngx_radix_stride_node_t *) ctx->nodes.elts + index;
+
+    ngx_memzero(sn, sizeof(ngx_radix_stride_node_t));
+
+    sn->child_base = (uint32_t) base;
+    sn->leaf_base = (uint32_t) ctx->leaves.nelts;
+
+    for (i = 0; i < 256; i++) {
+
+        if (slots[i].node) {
+            sn->child[i >> 6] |= (uint64_t) 1 << (i & 63);
+            continue;
+        }
+
+        if (i > 0
+            && slots[i - 1].node == NULL
+            && slots[i - 1].value == slots[i].value)
+        {
+            continue;
+        }
+
+        sn->leaf[i >> 6] |= (uint64_t) 1 << (i & 63);
+
+        leaf = ngx_array_push(&ctx->leaves);
+        if (leaf == NULL) {
+            return NGX_ERROR;
+        }
+
+        *leaf = slots[i].value;
+    }
+
+    for (i = 0; i < 256; i++) {
+        if (slots[i].node == NULL) {
+            continue;
+        }
+
+        if (ngx_radix_stride_build(ctx, base++, slots[i].node,
+                                   slots[i].value)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_radix_stride_expand(ngx_radix_node_t *node,
+    ngx_radix_stride_slot_t *slots, ngx_uint_t n, uintptr_t value)
+{
+    ngx_uint_t  i;
+
+    if (node == NULL) {
+        for (i = 0; i < n; i++) {
+            slots[i].node = NULL;
+            slots[i].value = value;
+        }
+
+        return;
+    }
+
+    if (node->value != NGX_RADIX_NO_VALUE) {
+        value = node->value;
+    }
+
+    if (n == 1) {
+        slots[0].node = (node->left || node->right) ? node : NULL;
+        slots[0].value = value;
+        return;
+    }
+
+    ngx_radix_stride_expand(node->left, slots, n / 2, value);
+    ngx_radix_stride_expand(node->right, &slots[n / 2], n / 2, value);
+}
+
+
+uintptr_t
+ngx_radix32stride_find(ngx_radix_stride_t *tree, uint32_t key)
+{
+    ngx_uint_t                i, shift;
+    ngx_radix_stride_node_t  *node;
+
+    node = tree->nodes;
+
+    for (shift = 24; /* void */ ; shift -= 8) {
+        i = (key >> shift) & 0xff;
+
+        if (!ngx_radix_stride_bit(node->child, i)) {
+            return ngx_radix_stride_leaf(tree, node, i);
+        }
+
+        node = &tree->nodes[node->child_base
+                            + ngx_radix_stride_rank(node->child, i)];
+    }
+}
+
+
+#if (NGX_HAVE_INET6)
+
+uintptr_t
+ngx_radix128stride_find(ngx_radix_stride_t *tree, u_char *key)
+{
+    ngx_uint_t                i, n;
+    ngx_radix_stride_node_t  *node;
+
+    node = tree->nodes;
+
+    for (n = 0; /* void */ ; n++) {
+        i = key[n];
+
+        if (!ngx_radix_stride_bit(node->child, i)) {
+            return ngx_radix_stride_leaf(tree, node, i);
+        }
+
+        node = &tree->nodes[node->child_base
+                            + ngx_radix_stride_rank(node->child, i)];
+    }
+}
+
+#endif
+
+
+static ngx_inline ngx_uint_t
+ngx_radix_stride_rank(uint64_t *bits, ngx_uint_t i)
+{
+    ngx_uint_t  w, n;
+
+    /* the number of bits set below the i-th one */
+
+    n = 0;
+
+    for (w = 0; w < (i >> 6); w++) {
+        n += ngx_radix_popcount(bits[w]);
+    }
+
+    return n + ngx_radix_popcount(bits[w]
+                                  & (((uint64_t) 1 << (i & 63)) - 1));
+}
+
+
+static ngx_inline uintptr_t
+ngx_radix_stride_leaf(ngx_radix_stride_t *tree, ngx_radix_stride_node_t *node,
+    ngx_uint_t i)
+{
+    ngx_uint_t  n;
+
+    /* the run the slot belongs to is the last one started at or below it */
+
+    n = ngx_radix_stride_rank(node->leaf, i);
+
+    if (ngx_radix_stride_bit(node->leaf, i)) {
+        n++;
+    }
+
+    return tree->leaves[node->leaf_base + n - 1];
+}
+
+
+#if !(defined __GNUC__)
+
+static ngx_inline ngx_uint_t
+ngx_radix_popcount(uint64_t x)
+{
+    ngx_uint_t  n;
+
+    for (n = 0; x; n++) {
+        x &= x - 1;
+    }
+
+    return n;
+}
+
+#endif
+
+
 static ngx_radix_node_t *
 ngx_radix_alloc(ngx_radix_tree_t *tree)
 {
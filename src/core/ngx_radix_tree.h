@@ -34,6 +34,30 @@ typedef struct {
 } ngx_radix_tree_t;
 
 
+/*
+ * a read-only multibit trie compiled from a radix tree: each node covers
+ * 8 bits of the key, the "child" bitmap marks the slots continued by
+ * a child node, and the "leaf" bitmap marks the slots starting a run
+ * of leaf slots with the same value; children and leaf values of
+ * a node are stored contiguously and indexed by the bitmap ranks
+ */
+
+typedef struct {
+    uint64_t           child[4];
+    uint64_t           leaf[4];
+    uint32_t           child_base;
+    uint32_t           leaf_base;
+} ngx_radix_stride_node_t;
+
+
+typedef struct {
+    ngx_radix_stride_node_t  *nodes;
+    uintptr_t                *leaves;
+    ngx_uint_t                nnodes;
+    ngx_uint_t                nleaves;
+} ngx_radix_stride_t;
+
+
 ngx_radix_tree_t *ngx_radix_tree_create(ngx_pool_t *pool,
     ngx_int_t preallocate);
 
@@ -51,5 +75,12 @@ ngx_int_t ngx_radix128tree_delete(ngx_radix_tree_t *tree,
 uintptr_t ngx_radix128tree_find(ngx_radix_tree_t *tree, u_char *key);
 #endif
 
+ngx_radix_stride_t *ngx_radix_stride_create(ngx_pool_t *pool,
+    ngx_pool_t *temp_pool, ngx_radix_tree_t *tree);
+uintptr_t ngx_radix32stride_find(ngx_radix_stride_t *tree, uint32_t key);
+#if (NGX_HAVE_INET6)
+uintptr_t ngx_radix128stride_find(ngx_radix_stride_t *tree, u_char *key);
+#endif
+
 
 #endif /* _NGX_RADIX_TREE_H_INCLUDED_ */
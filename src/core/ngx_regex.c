@@ -9,16 +9,32 @@
 #include <ngx_core.h>
 
 
+#define NGX_REGEX_CACHE_POOL_SIZE  512
+
+
 typedef struct {
     ngx_flag_t  pcre_jit;
 } ngx_regex_conf_t;
 
 
+typedef struct {
+    ngx_str_node_t   sn;
+    ngx_pool_t      *pool;
+    ngx_regex_t      regex;
+    ngx_uint_t       generation;
+    ngx_uint_t       count;
+    int              study_opt;
+    unsigned         studied:1;
+} ngx_regex_cached_t;
+
+
+static pcre *ngx_regex_pcre_compile(ngx_regex_compile_t *rc,
+    ngx_pool_t *pool);
+static ngx_int_t ngx_regex_cache_get(ngx_regex_compile_t *rc);
+static void ngx_regex_cache_free(ngx_regex_cached_t *rec);
+static void ngx_regex_cache_cleanup(void *data);
 static void * ngx_libc_cdecl ngx_regex_malloc(size_t size);
 static void ngx_libc_cdecl ngx_regex_free(void *p);
-#if (NGX_HAVE_PCRE_JIT)
-static void ngx_pcre_free_studies(void *data);
-#endif
 
 static ngx_int_t ngx_regex_module_init(ngx_cycle_t *cycle);
 
@@ -68,12 +84,25 @@ ngx_module_t  ngx_regex_module = {
 static ngx_pool_t  *ngx_pcre_pool;
 static ngx_list_t  *ngx_pcre_studies;
 
+/*
+ * Regexes compiled at configuration time are kept in the master process
+ * cache and are shared by all cycles using them, so a reload only compiles
+ * and studies the patterns which were not used by the previous cycles.
+ */
+
+static ngx_rbtree_t        ngx_regex_cache;
+static ngx_rbtree_node_t   ngx_regex_cache_sentinel;
+static ngx_uint_t          ngx_regex_cache_generation;
+
 
 void
 ngx_regex_init(void)
 {
     pcre_malloc = ngx_regex_malloc;
     pcre_free = ngx_regex_free;
+
+    ngx_rbtree_init(&ngx_regex_cache, &ngx_regex_cache_sentinel,
+                    ngx_str_rbtree_insert_value);
 }
 
 
@@ -94,54 +123,39 @@ ngx_regex_malloc_done(void)
 ngx_int_t
 ngx_regex_compile(ngx_regex_compile_t *rc)
 {
-    int               n, erroff;
-    char             *p;
-    pcre             *re;
-    const char       *errstr;
-    ngx_regex_elt_t  *elt;
-
-    ngx_regex_malloc_init(rc->pool);
-
-    re = pcre_compile((const char *) rc->pattern.data, (int) rc->options,
-                      &errstr, &erroff, NULL);
+    int         n;
+    char       *p;
+    pcre       *re;
+    ngx_int_t   rv;
 
-    /* ensure that there is no current pool */
-    ngx_regex_malloc_done();
+    if (ngx_pcre_studies == NULL) {
 
-    if (re == NULL) {
-        if ((size_t) erroff == rc->pattern.len) {
-           rc->err.len = ngx_snprintf(rc->err.data, rc->err.len,
-                              "pcre_compile() failed: %s in \"%V\"",
-                               errstr, &rc->pattern)
-                      - rc->err.data;
+        /* do not cache and study at runtime */
 
-        } else {
-           rc->err.len = ngx_snprintf(rc->err.data, rc->err.len,
-                              "pcre_compile() failed: %s in \"%V\" at \"%s\"",
-                               errstr, &rc->pattern, rc->pattern.data + erroff)
-                      - rc->err.data;
+        re = ngx_regex_pcre_compile(rc, rc->pool);
+        if (re == NULL) {
+            return NGX_ERROR;
         }
 
-        return NGX_ERROR;
-    }
+        rc->regex = ngx_pcalloc(rc->pool, sizeof(ngx_regex_t));
+        if (rc->regex == NULL) {
+            goto nomem;
+        }
 
-    rc->regex = ngx_pcalloc(rc->pool, sizeof(ngx_regex_t));
-    if (rc->regex == NULL) {
-        goto nomem;
-    }
+        rc->regex->code = re;
 
-    rc->regex->code = re;
+    } else {
+        rv = ngx_regex_cache_get(rc);
 
-    /* do not study at runtime */
+        if (rv == NGX_DECLINED) {
+            return NGX_ERROR;
+        }
 
-    if (ngx_pcre_studies != NULL) {
-        elt = ngx_list_push(ngx_pcre_studies);
-        if (elt == NULL) {
+        if (rv == NGX_ERROR) {
             goto nomem;
         }
 
-        elt->regex = rc->regex;
-        elt->name = rc->pattern.data;
+        re = rc->regex->code;
     }
 
     n = pcre_fullinfo(re, NULL, PCRE_INFO_CAPTURECOUNT, &rc->captures);
@@ -194,6 +208,171 @@ nomem:
 }
 
 
+static pcre *
+ngx_regex_pcre_compile(ngx_regex_compile_t *rc, ngx_pool_t *pool)
+{
+    int          erroff;
+    pcre        *re;
+    const char  *errstr;
+
+    ngx_regex_malloc_init(pool);
+
+    re = pcre_compile((const char *) rc->pattern.data, (int) rc->options,
+                      &errstr, &erroff, NULL);
+
+    /* ensure that there is no current pool */
+    ngx_regex_malloc_done();
+
+    if (re == NULL) {
+        if ((size_t) erroff == rc->pattern.len) {
+           rc->err.len = ngx_snprintf(rc->err.data, rc->err.len,
+                              "pcre_compile() failed: %s in \"%V\"",
+                               errstr, &rc->pattern)
+                      - rc->err.data;
+
+        } else {
+           rc->err.len = ngx_snprintf(rc->err.data, rc->err.len,
+                              "pcre_compile() failed: %s in \"%V\" at \"%s\"",
+                               errstr, &rc->pattern, rc->pattern.data + erroff)
+                      - rc->err.data;
+        }
+    }
+
+    return re;
+}
+
+
+static ngx_int_t
+ngx_regex_cache_get(ngx_regex_compile_t *rc)
+{
+    pcre                 *re;
+    uint32_t              hash;
+    ngx_pool_t           *pool;
+    ngx_regex_cached_t   *rec, **recp;
+
+    hash = ngx_crc32_long(rc->pattern.data, rc->pattern.len)
+           ^ (uint32_t) rc->options;
+
+    rec = (ngx_regex_cached_t *) ngx_str_rbtree_lookup(&ngx_regex_cache,
+                                                       &rc->pattern, hash);
+
+    if (rec == NULL) {
+
+        pool = ngx_create_pool(NGX_REGEX_CACHE_POOL_SIZE, ngx_cycle->log);
+        if (pool == NULL) {
+            return NGX_ERROR;
+        }
+
+        re = ngx_regex_pcre_compile(rc, pool);
+        if (re == NULL) {
+            ngx_destroy_pool(pool);
+            return NGX_DECLINED;
+        }
+
+        rec = ngx_pcalloc(pool, sizeof(ngx_regex_cached_t));
+        if (rec == NULL) {
+            ngx_destroy_pool(pool);
+            return NGX_ERROR;
+        }
+
+        rec->sn.str.data = ngx_pnalloc(pool, rc->pattern.len + 1);
+        if (rec->sn.str.data == NULL) {
+            ngx_destroy_pool(pool);
+            return NGX_ERROR;
+        }
+
+        ngx_memcpy(rec->sn.str.data, rc->pattern.data, rc->pattern.len);
+        rec->sn.str.data[rc->pattern.len] = '\0';
+        rec->sn.str.len = rc->pattern.len;
+        rec->sn.node.key = hash;
+
+        rec->pool = pool;
+        rec->regex.code = re;
+
+        ngx_rbtree_insert(&ngx_regex_cache, &rec->sn.node);
+    }
+
+    if (rec->generation != ngx_regex_cache_generation) {
+
+        /* the first use of the regex by the cycle being configured */
+
+        recp = ngx_list_push(ngx_pcre_studies);
+        if (recp == NULL) {
+            if (rec->count == 0) {
+                ngx_regex_cache_free(rec);
+            }
+
+            return NGX_ERROR;
+        }
+
+        *recp = rec;
+
+        rec->generation = ngx_regex_cache_generation;
+        rec->count++;
+    }
+
+    rc->regex = &rec->regex;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_regex_cache_free(ngx_regex_cached_t *rec)
+{
+    ngx_rbtree_delete(&ngx_regex_cache, &rec->sn.node);
+
+#if (NGX_HAVE_PCRE_JIT)
+
+    /*
+     * The PCRE JIT compiler uses mmap for its executable codes, so we
+     * have to explicitly call the pcre_free_study() function to free
+     * this memory.
+     */
+
+    if (rec->regex.extra != NULL) {
+        pcre_free_study(rec->regex.extra);
+    }
+
+#endif
+
+    rec->pool->log = ngx_cycle->log;
+
+    ngx_destroy_pool(rec->pool);
+}
+
+
+static void
+ngx_regex_cache_cleanup(void *data)
+{
+    ngx_list_t *studies = data;
+
+    ngx_uint_t           i;
+    ngx_list_part_t     *part;
+    ngx_regex_cached_t  **elts;
+
+    part = &studies->part;
+    elts = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            elts = part->elts;
+            i = 0;
+        }
+
+        if (--elts[i]->count == 0) {
+            ngx_regex_cache_free(elts[i]);
+        }
+    }
+}
+
+
 ngx_int_t
 ngx_regex_exec_array(ngx_array_t *a, ngx_str_t *s, ngx_log_t *log)
 {
@@ -248,80 +427,31 @@ ngx_regex_free(void *p)
 }
 
 
-#if (NGX_HAVE_PCRE_JIT)
-
-static void
-ngx_pcre_free_studies(void *data)
-{
-    ngx_list_t *studies = data;
-
-    ngx_uint_t        i;
-    ngx_list_part_t  *part;
-    ngx_regex_elt_t  *elts;
-
-    part = &studies->part;
-    elts = part->elts;
-
-    for (i = 0; /* void */ ; i++) {
-
-        if (i >= part->nelts) {
-            if (part->next == NULL) {
-                break;
-            }
-
-            part = part->next;
-            elts = part->elts;
-            i = 0;
-        }
-
-        if (elts[i].regex->extra != NULL) {
-            pcre_free_study(elts[i].regex->extra);
-        }
-    }
-}
-
-#endif
-
-
 static ngx_int_t
 ngx_regex_module_init(ngx_cycle_t *cycle)
 {
-    int               opt;
-    const char       *errstr;
-    ngx_uint_t        i;
-    ngx_list_part_t  *part;
-    ngx_regex_elt_t  *elts;
+    int                   opt;
+    const char           *errstr;
+    ngx_uint_t            i, n, reused;
+    ngx_list_part_t      *part;
+    ngx_regex_cached_t   *rec, **elts;
 
     opt = 0;
 
 #if (NGX_HAVE_PCRE_JIT)
     {
-    ngx_regex_conf_t    *rcf;
-    ngx_pool_cleanup_t  *cln;
+    ngx_regex_conf_t  *rcf;
 
     rcf = (ngx_regex_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_regex_module);
 
     if (rcf->pcre_jit) {
         opt = PCRE_STUDY_JIT_COMPILE;
-
-        /*
-         * The PCRE JIT compiler uses mmap for its executable codes, so we
-         * have to explicitly call the pcre_free_study() function to free
-         * this memory.
-         */
-
-        cln = ngx_pool_cleanup_add(cycle->pool, 0);
-        if (cln == NULL) {
-            return NGX_ERROR;
-        }
-
-        cln->handler = ngx_pcre_free_studies;
-        cln->data = ngx_pcre_studies;
     }
     }
 #endif
 
-    ngx_regex_malloc_init(cycle->pool);
+    n = 0;
+    reused = 0;
 
     part = &ngx_pcre_studies->part;
     elts = part->elts;
@@ -338,32 +468,70 @@ ngx_regex_module_init(ngx_cycle_t *cycle)
             i = 0;
         }
 
-        elts[i].regex->extra = pcre_study(elts[i].regex->code, opt, &errstr);
+        rec = elts[i];
+        n++;
+
+        if (rec->studied) {
+
+            if (rec->study_opt == opt) {
+                reused++;
+                continue;
+            }
+
+            if (rec->count > 1 && ngx_process == NGX_PROCESS_SINGLE) {
+
+                /*
+                 * the study is still used by the requests
+                 * served by the previous cycle
+                 */
+
+                reused++;
+                continue;
+            }
+
+#if (NGX_HAVE_PCRE_JIT)
+            if (rec->regex.extra != NULL) {
+                pcre_free_study(rec->regex.extra);
+            }
+#endif
+        }
+
+        rec->pool->log = cycle->log;
+
+        ngx_regex_malloc_init(rec->pool);
+
+        rec->regex.extra = pcre_study(rec->regex.code, opt, &errstr);
+
+        ngx_regex_malloc_done();
+
+        rec->studied = 1;
+        rec->study_opt = opt;
 
         if (errstr != NULL) {
             ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
                           "pcre_study() failed: %s in \"%s\"",
-                          errstr, elts[i].name);
+                          errstr, rec->sn.str.data);
         }
 
 #if (NGX_HAVE_PCRE_JIT)
         if (opt & PCRE_STUDY_JIT_COMPILE) {
-            int jit, n;
+            int jit, rv;
 
             jit = 0;
-            n = pcre_fullinfo(elts[i].regex->code, elts[i].regex->extra,
-                              PCRE_INFO_JIT, &jit);
+            rv = pcre_fullinfo(rec->regex.code, rec->regex.extra,
+                               PCRE_INFO_JIT, &jit);
 
-            if (n != 0 || jit != 1) {
+            if (rv != 0 || jit != 1) {
                 ngx_log_error(NGX_LOG_INFO, cycle->log, 0,
                               "JIT compiler does not support pattern: \"%s\"",
-                              elts[i].name);
+                              rec->sn.str.data);
             }
         }
 #endif
     }
 
-    ngx_regex_malloc_done();
+    ngx_log_debug2(NGX_LOG_DEBUG_CORE, cycle->log, 0,
+                   "regex cache: %ui of %ui regexes reused", reused, n);
 
     ngx_pcre_studies = NULL;
 
@@ -374,7 +542,8 @@ ngx_regex_module_init(ngx_cycle_t *cycle)
 static void *
 ngx_regex_create_conf(ngx_cycle_t *cycle)
 {
-    ngx_regex_conf_t  *rcf;
+    ngx_regex_conf_t    *rcf;
+    ngx_pool_cleanup_t  *cln;
 
     rcf = ngx_pcalloc(cycle->pool, sizeof(ngx_regex_conf_t));
     if (rcf == NULL) {
@@ -383,11 +552,27 @@ ngx_regex_create_conf(ngx_cycle_t *cycle)
 
     rcf->pcre_jit = NGX_CONF_UNSET;
 
-    ngx_pcre_studies = ngx_list_create(cycle->pool, 8, sizeof(ngx_regex_elt_t));
+    ngx_pcre_studies = ngx_list_create(cycle->pool, 8,
+                                       sizeof(ngx_regex_cached_t *));
     if (ngx_pcre_studies == NULL) {
         return NULL;
     }
 
+    /*
+     * the cached regexes used by the cycle are released
+     * when the cycle is destroyed
+     */
+
+    cln = ngx_pool_cleanup_add(cycle->pool, 0);
+    if (cln == NULL) {
+        return NULL;
+    }
+
+    cln->handler = ngx_regex_cache_cleanup;
+    cln->data = ngx_pcre_studies;
+
+    ngx_regex_cache_generation++;
+
     return rcf;
 }
 
@@ -19,6 +19,7 @@ ngx_int_t
 ngx_shmtx_create(ngx_shmtx_t *mtx, ngx_shmtx_sh_t *addr, u_char *name)
 {
     mtx->lock = &addr->lock;
+    mtx->contended = &addr->contended;
 
     if (mtx->spin == (ngx_uint_t) -1) {
         return NGX_OK;
@@ -73,10 +74,14 @@ ngx_shmtx_lock(ngx_shmtx_t *mtx)
 
     ngx_log_debug0(NGX_LOG_DEBUG_CORE, ngx_cycle->log, 0, "shmtx lock");
 
+    if (*mtx->lock == 0 && ngx_atomic_cmp_set(mtx->lock, 0, ngx_pid)) {
+        return;
+    }
+
     for ( ;; ) {
 
         if (*mtx->lock == 0 && ngx_atomic_cmp_set(mtx->lock, 0, ngx_pid)) {
-            return;
+            goto contended;
         }
 
         if (ngx_ncpu > 1) {
@@ -90,7 +95,7 @@ ngx_shmtx_lock(ngx_shmtx_t *mtx)
                 if (*mtx->lock == 0
                     && ngx_atomic_cmp_set(mtx->lock, 0, ngx_pid))
                 {
-                    return;
+                    goto contended;
                 }
             }
         }
@@ -102,7 +107,7 @@ ngx_shmtx_lock(ngx_shmtx_t *mtx)
 
             if (*mtx->lock == 0 && ngx_atomic_cmp_set(mtx->lock, 0, ngx_pid)) {
                 (void) ngx_atomic_fetch_add(mtx->wait, -1);
-                return;
+                goto contended;
             }
 
             ngx_log_debug1(NGX_LOG_DEBUG_CORE, ngx_cycle->log, 0,
@@ -130,6 +135,12 @@ ngx_shmtx_lock(ngx_shmtx_t *mtx)
 
         ngx_sched_yield();
     }
+
+contended:
+
+    /* the lock is held, so the counter is updated without atomics */
+
+    (*mtx->contended)++;
 }
 
 
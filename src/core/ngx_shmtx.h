@@ -18,12 +18,14 @@ typedef struct {
 #if (NGX_HAVE_POSIX_SEM)
     ngx_atomic_t   wait;
 #endif
+    ngx_atomic_t   contended;
 } ngx_shmtx_sh_t;
 
 
 typedef struct {
 #if (NGX_HAVE_ATOMIC_OPS)
     ngx_atomic_t  *lock;
+    ngx_atomic_t  *contended;
 #if (NGX_HAVE_POSIX_SEM)
     ngx_atomic_t  *wait;
     ngx_uint_t     semaphore;
@@ -41,6 +41,51 @@
 #endif
 
 
+/*
+ * A worker keeps freed chunks of each slot in a magazine and reuses them
+ * without the pool mutex.  The cached chunks of a slot are linked through
+ * their first word; the magazine header is allocated from the pool, kept
+ * in the pool list of magazines, and is only changed by its owner, so
+ * ngx_slab_alloc() and ngx_slab_free() take the mutex only to refill a
+ * magazine in a batch or to return its older half.
+ *
+ * The header keeps the owner pid: the master process returns the chunks
+ * of a worker that has exited with ngx_slab_reclaim_magazines().  When
+ * the pool runs out of memory, its flush generation is increased, and
+ * the other workers return their chunks on the next call for the pool.
+ */
+
+#define NGX_SLAB_MAGAZINE_POOLS  32
+#define NGX_SLAB_MAGAZINE_SLOTS  16
+
+
+struct ngx_slab_magazine_s {
+    ngx_slab_magazine_t  *next;
+    ngx_pid_t             pid;
+    ngx_uint_t            flush;
+    ngx_uint_t            n[NGX_SLAB_MAGAZINE_SLOTS];
+    ngx_uint_t            reqs[NGX_SLAB_MAGAZINE_SLOTS];
+    void                 *chunks[NGX_SLAB_MAGAZINE_SLOTS];
+};
+
+
+typedef struct {
+    ngx_slab_pool_t      *pool;
+    ngx_slab_magazine_t  *magazine;
+} ngx_slab_magazine_ref_t;
+
+
+#define ngx_slab_magazine_push(mag, slot, p)                                  \
+    *(void **) (p) = (mag)->chunks[slot];                                     \
+    (mag)->chunks[slot] = p;                                                  \
+    (mag)->n[slot]++
+
+#define ngx_slab_magazine_pop(mag, slot, p)                                   \
+    p = (mag)->chunks[slot];                                                  \
+    (mag)->chunks[slot] = *(void **) (p);                                     \
+    (mag)->n[slot]--
+
+
 #define ngx_slab_slots(pool)                                                  \
     (ngx_slab_page_t *) ((u_char *) (pool) + sizeof(ngx_slab_pool_t))
 
@@ -69,6 +114,20 @@
 
 #endif
 
+static void *ngx_slab_alloc_shared(ngx_slab_pool_t *pool, size_t size);
+static void ngx_slab_free_shared(ngx_slab_pool_t *pool, void *p);
+static ngx_uint_t ngx_slab_size_slot(ngx_slab_pool_t *pool, size_t size);
+static ngx_uint_t ngx_slab_chunk_slot(ngx_slab_pool_t *pool, void *p);
+static ngx_slab_magazine_t *ngx_slab_magazine(ngx_slab_pool_t *pool,
+    ngx_uint_t create);
+static void ngx_slab_magazine_sync(ngx_slab_pool_t *pool,
+    ngx_slab_magazine_t *mag);
+static void ngx_slab_magazine_refill(ngx_slab_pool_t *pool,
+    ngx_slab_magazine_t *mag, ngx_uint_t slot);
+static ngx_uint_t ngx_slab_magazine_flush(ngx_slab_pool_t *pool,
+    ngx_slab_magazine_t *mag, ngx_uint_t slot, ngx_uint_t n);
+static ngx_uint_t ngx_slab_magazine_release(ngx_slab_pool_t *pool,
+    ngx_slab_magazine_t *mag);
 static ngx_slab_page_t *ngx_slab_alloc_pages(ngx_slab_pool_t *pool,
     ngx_uint_t pages);
 static void ngx_slab_free_pages(ngx_slab_pool_t *pool, ngx_slab_page_t *page,
@@ -81,6 +140,12 @@ static ngx_uint_t  ngx_slab_max_size;
 static ngx_uint_t  ngx_slab_exact_size;
 static ngx_uint_t  ngx_slab_exact_shift;
 
+ngx_uint_t         ngx_slab_magazine_size;
+
+static ngx_slab_magazine_ref_t   ngx_slab_magazines[NGX_SLAB_MAGAZINE_POOLS];
+static ngx_slab_magazine_ref_t  *ngx_slab_last_magazine;
+static ngx_uint_t                ngx_slab_refilling;
+
 
 void
 ngx_slab_sizes_init(void)
@@ -159,6 +224,12 @@ ngx_slab_init(ngx_slab_pool_t *pool)
     pool->last = pool->pages + pages;
     pool->pfree = pages;
 
+    pool->mutexes = NULL;
+    pool->nmutexes = 0;
+
+    pool->magazines = NULL;
+    pool->flush = 0;
+
     pool->log_nomem = 1;
     pool->log_ctx = &pool->zero;
     pool->zero = '\0';
@@ -168,7 +239,28 @@ ngx_slab_init(ngx_slab_pool_t *pool)
 void *
 ngx_slab_alloc(ngx_slab_pool_t *pool, size_t size)
 {
-    void  *p;
+    void                 *p;
+    ngx_uint_t            slot;
+    ngx_slab_magazine_t  *mag;
+
+    /* the magazine is only changed by this process, the mutex is not needed */
+
+    slot = ngx_slab_size_slot(pool, size);
+
+    if (slot != NGX_SLAB_MAGAZINE_SLOTS) {
+        mag = ngx_slab_magazine(pool, 0);
+
+        if (mag && mag->n[slot] && mag->flush == pool->flush) {
+            ngx_slab_magazine_pop(mag, slot, p);
+            mag->reqs[slot]++;
+
+            ngx_log_debug3(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
+                           "slab alloc: %uz slot: %ui cached: %p",
+                           size, slot, p);
+
+            return p;
+        }
+    }
 
     ngx_shmtx_lock(&pool->mutex);
 
@@ -182,6 +274,45 @@ ngx_slab_alloc(ngx_slab_pool_t *pool, size_t size)
 
 void *
 ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size)
+{
+    void                 *p;
+    ngx_uint_t            slot;
+    ngx_slab_magazine_t  *mag;
+
+    slot = ngx_slab_size_slot(pool, size);
+
+    if (slot == NGX_SLAB_MAGAZINE_SLOTS) {
+        return ngx_slab_alloc_shared(pool, size);
+    }
+
+    mag = ngx_slab_magazine(pool, 1);
+    if (mag == NULL) {
+        return ngx_slab_alloc_shared(pool, size);
+    }
+
+    ngx_slab_magazine_sync(pool, mag);
+
+    if (mag->n[slot] == 0) {
+        ngx_slab_magazine_refill(pool, mag, slot);
+
+        if (mag->n[slot] == 0) {
+            return ngx_slab_alloc_shared(pool, size);
+        }
+    }
+
+    ngx_slab_magazine_pop(mag, slot, p);
+
+    pool->stats[slot].reqs++;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
+                   "slab alloc: %uz slot: %ui cached: %p", size, slot, p);
+
+    return p;
+}
+
+
+static void *
+ngx_slab_alloc_shared(ngx_slab_pool_t *pool, size_t size)
 {
     size_t            s;
     uintptr_t         p, m, mask, *bitmap;
@@ -215,7 +346,9 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size)
         slot = 0;
     }
 
-    pool->stats[slot].reqs++;
+    if (!ngx_slab_refilling) {
+        pool->stats[slot].reqs++;
+    }
 
     ngx_log_debug2(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
                    "slab alloc: %uz slot: %ui", size, slot);
@@ -406,7 +539,9 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size)
 
     p = 0;
 
-    pool->stats[slot].fails++;
+    if (!ngx_slab_refilling) {
+        pool->stats[slot].fails++;
+    }
 
 done:
 
@@ -422,11 +557,10 @@ ngx_slab_calloc(ngx_slab_pool_t *pool, size_t size)
 {
     void  *p;
 
-    ngx_shmtx_lock(&pool->mutex);
-
-    p = ngx_slab_calloc_locked(pool, size);
-
-    ngx_shmtx_unlock(&pool->mutex);
+    p = ngx_slab_alloc(pool, size);
+    if (p) {
+        ngx_memzero(p, size);
+    }
 
     return p;
 }
@@ -449,6 +583,29 @@ ngx_slab_calloc_locked(ngx_slab_pool_t *pool, size_t size)
 void
 ngx_slab_free(ngx_slab_pool_t *pool, void *p)
 {
+    ngx_uint_t            slot;
+    ngx_slab_magazine_t  *mag;
+
+    slot = ngx_slab_chunk_slot(pool, p);
+
+    if (slot != NGX_SLAB_MAGAZINE_SLOTS) {
+        mag = ngx_slab_magazine(pool, 0);
+
+        if (mag
+            && mag->n[slot] < ngx_slab_magazine_size
+            && mag->flush == pool->flush)
+        {
+            ngx_log_debug2(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
+                           "slab free: %p slot: %ui cached", p, slot);
+
+            ngx_slab_junk(p, (size_t) 1 << (slot + pool->min_shift));
+
+            ngx_slab_magazine_push(mag, slot, p);
+
+            return;
+        }
+    }
+
     ngx_shmtx_lock(&pool->mutex);
 
     ngx_slab_free_locked(pool, p);
@@ -459,6 +616,41 @@ ngx_slab_free(ngx_slab_pool_t *pool, void *p)
 
 void
 ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p)
+{
+    ngx_uint_t            slot;
+    ngx_slab_magazine_t  *mag;
+
+    slot = ngx_slab_chunk_slot(pool, p);
+
+    if (slot == NGX_SLAB_MAGAZINE_SLOTS) {
+        ngx_slab_free_shared(pool, p);
+        return;
+    }
+
+    mag = ngx_slab_magazine(pool, 1);
+    if (mag == NULL) {
+        ngx_slab_free_shared(pool, p);
+        return;
+    }
+
+    ngx_slab_magazine_sync(pool, mag);
+
+    if (mag->n[slot] >= ngx_slab_magazine_size) {
+        (void) ngx_slab_magazine_flush(pool, mag, slot,
+                                       ngx_slab_magazine_size / 2);
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
+                   "slab free: %p slot: %ui cached", p, slot);
+
+    ngx_slab_junk(p, (size_t) 1 << (slot + pool->min_shift));
+
+    ngx_slab_magazine_push(mag, slot, p);
+}
+
+
+static void
+ngx_slab_free_shared(ngx_slab_pool_t *pool, void *p)
 {
     size_t            size;
     uintptr_t         slab, m, *bitmap;
@@ -677,7 +869,10 @@ fail:
 static ngx_slab_page_t *
 ngx_slab_alloc_pages(ngx_slab_pool_t *pool, ngx_uint_t pages)
 {
-    ngx_slab_page_t  *page, *p;
+    ngx_slab_page_t      *page, *p;
+    ngx_slab_magazine_t  *mag;
+
+again:
 
     for (page = pool->free.next; page != &pool->free; page = page->next) {
 
@@ -721,6 +916,24 @@ ngx_slab_alloc_pages(ngx_slab_pool_t *pool, ngx_uint_t pages)
         }
     }
 
+    if (ngx_slab_refilling) {
+        return NULL;
+    }
+
+    /* give the chunks cached by this process back and retry */
+
+    mag = ngx_slab_magazine(pool, 0);
+
+    if (mag && ngx_slab_magazine_flush(pool, mag, NGX_SLAB_MAGAZINE_SLOTS, 0)) {
+        goto again;
+    }
+
+    /* ask the other processes to give theirs back */
+
+    if (pool->magazines) {
+        pool->flush++;
+    }
+
     if (pool->log_nomem) {
         ngx_slab_error(pool, NGX_LOG_CRIT,
                        "ngx_slab_alloc() failed: no memory");
@@ -810,6 +1023,360 @@ ngx_slab_free_pages(ngx_slab_pool_t *pool, ngx_slab_page_t *page,
 }
 
 
+void
+ngx_slab_usage(ngx_slab_pool_t *pool, ngx_slab_usage_t *usage)
+{
+    ngx_uint_t            i, n;
+    ngx_slab_page_t      *page;
+    ngx_slab_magazine_t  *mag;
+
+    ngx_memzero(usage, sizeof(ngx_slab_usage_t));
+
+    ngx_shmtx_lock(&pool->mutex);
+
+    usage->pages = pool->last - pool->pages;
+    usage->free = pool->pfree;
+
+    for (page = pool->free.next; page != &pool->free; page = page->next) {
+        if (page->slab > usage->largest) {
+            usage->largest = page->slab;
+        }
+    }
+
+    n = ngx_pagesize_shift - pool->min_shift;
+
+    for (i = 0; i < n; i++) {
+        usage->slack += (pool->stats[i].total - pool->stats[i].used)
+                        << (i + pool->min_shift);
+    }
+
+    for (mag = pool->magazines; mag; mag = mag->next) {
+        for (i = 0; i < NGX_SLAB_MAGAZINE_SLOTS; i++) {
+            usage->cached += mag->n[i];
+        }
+    }
+
+    usage->contended = pool->lock.contended;
+
+    ngx_shmtx_unlock(&pool->mutex);
+}
+
+
+void
+ngx_slab_flush_magazines(void)
+{
+    ngx_uint_t                i;
+    ngx_slab_pool_t          *pool;
+    ngx_slab_magazine_ref_t  *ref;
+
+    for (i = 0; i < NGX_SLAB_MAGAZINE_POOLS; i++) {
+        ref = &ngx_slab_magazines[i];
+        pool = ref->pool;
+
+        if (pool == NULL) {
+            break;
+        }
+
+        ngx_shmtx_lock(&pool->mutex);
+
+        (void) ngx_slab_magazine_release(pool, ref->magazine);
+
+        ngx_shmtx_unlock(&pool->mutex);
+
+        ref->pool = NULL;
+        ref->magazine = NULL;
+    }
+
+    ngx_slab_last_magazine = NULL;
+}
+
+
+ngx_uint_t
+ngx_slab_reclaim_magazines(ngx_slab_pool_t *pool, ngx_pid_t pid)
+{
+    ngx_uint_t            n;
+    ngx_slab_magazine_t  *mag, *next;
+
+    n = 0;
+
+    ngx_shmtx_lock(&pool->mutex);
+
+    for (mag = pool->magazines; mag; mag = next) {
+        next = mag->next;
+
+        if (mag->pid == pid) {
+            n += ngx_slab_magazine_release(pool, mag);
+        }
+    }
+
+    ngx_shmtx_unlock(&pool->mutex);
+
+    return n;
+}
+
+
+static ngx_uint_t
+ngx_slab_size_slot(ngx_slab_pool_t *pool, size_t size)
+{
+    size_t      s;
+    ngx_uint_t  shift;
+
+    /* NGX_SLAB_MAGAZINE_SLOTS means the size is not cached */
+
+    if (ngx_slab_magazine_size == 0 || size > ngx_slab_max_size) {
+        return NGX_SLAB_MAGAZINE_SLOTS;
+    }
+
+    if (size <= pool->min_size) {
+        return 0;
+    }
+
+    shift = 1;
+    for (s = size - 1; s >>= 1; shift++) { /* void */ }
+
+    return ngx_min(shift - pool->min_shift, NGX_SLAB_MAGAZINE_SLOTS);
+}
+
+
+static ngx_uint_t
+ngx_slab_chunk_slot(ngx_slab_pool_t *pool, void *p)
+{
+    ngx_uint_t        shift;
+    ngx_slab_page_t  *page;
+
+    /*
+     * the page of an allocated chunk keeps its type and shift
+     * until the chunk is freed, so the mutex is not needed
+     */
+
+    if (ngx_slab_magazine_size == 0
+        || (u_char *) p < pool->start
+        || (u_char *) p >= pool->end)
+    {
+        return NGX_SLAB_MAGAZINE_SLOTS;
+    }
+
+    page = &pool->pages[((u_char *) p - pool->start) >> ngx_pagesize_shift];
+
+    switch (ngx_slab_page_type(page)) {
+
+    case NGX_SLAB_SMALL:
+    case NGX_SLAB_BIG:
+        shift = page->slab & NGX_SLAB_SHIFT_MASK;
+        break;
+
+    case NGX_SLAB_EXACT:
+        shift = ngx_slab_exact_shift;
+        break;
+
+    default: /* NGX_SLAB_PAGE */
+        return NGX_SLAB_MAGAZINE_SLOTS;
+    }
+
+    if (shift - pool->min_shift >= NGX_SLAB_MAGAZINE_SLOTS
+        || ((uintptr_t) p & (((uintptr_t) 1 << shift) - 1)))
+    {
+        return NGX_SLAB_MAGAZINE_SLOTS;
+    }
+
+    return shift - pool->min_shift;
+}
+
+
+static ngx_slab_magazine_t *
+ngx_slab_magazine(ngx_slab_pool_t *pool, ngx_uint_t create)
+{
+    ngx_uint_t                i;
+    ngx_slab_magazine_t      *mag;
+    ngx_slab_magazine_ref_t  *ref;
+
+    ref = ngx_slab_last_magazine;
+
+    if (ref && ref->pool == pool) {
+        return ref->magazine;
+    }
+
+    for (i = 0; i < NGX_SLAB_MAGAZINE_POOLS; i++) {
+        ref = &ngx_slab_magazines[i];
+
+        if (ref->pool == pool) {
+            ngx_slab_last_magazine = ref;
+            return ref->magazine;
+        }
+
+        if (ref->pool == NULL) {
+            break;
+        }
+    }
+
+    if (!create || i == NGX_SLAB_MAGAZINE_POOLS) {
+        return NULL;
+    }
+
+    /* the pool mutex is held */
+
+    ngx_slab_refilling = 1;
+
+    mag = ngx_slab_alloc_shared(pool, sizeof(ngx_slab_magazine_t));
+
+    ngx_slab_refilling = 0;
+
+    if (mag == NULL) {
+        return NULL;
+    }
+
+    ngx_memzero(mag, sizeof(ngx_slab_magazine_t));
+
+    mag->pid = ngx_pid;
+    mag->flush = pool->flush;
+
+    mag->next = pool->magazines;
+    pool->magazines = mag;
+
+    ref->pool = pool;
+    ref->magazine = mag;
+
+    ngx_slab_last_magazine = ref;
+
+    return mag;
+}
+
+
+static void
+ngx_slab_magazine_sync(ngx_slab_pool_t *pool, ngx_slab_magazine_t *mag)
+{
+    if (mag->flush != pool->flush) {
+        (void) ngx_slab_magazine_flush(pool, mag, NGX_SLAB_MAGAZINE_SLOTS, 0);
+        mag->flush = pool->flush;
+    }
+}
+
+
+static void
+ngx_slab_magazine_refill(ngx_slab_pool_t *pool, ngx_slab_magazine_t *mag,
+    ngx_uint_t slot)
+{
+    void        *p;
+    size_t       size;
+    ngx_uint_t   n;
+
+    size = (size_t) 1 << (slot + pool->min_shift);
+    n = ngx_slab_magazine_size / 2;
+
+    if (n == 0) {
+        n = 1;
+    }
+
+    /*
+     * the refill only takes what the pool has readily available:
+     * the magazines are not flushed and failures are not accounted
+     */
+
+    ngx_slab_refilling = 1;
+
+    while (mag->n[slot] < n) {
+        p = ngx_slab_alloc_shared(pool, size);
+        if (p == NULL) {
+            break;
+        }
+
+        ngx_slab_magazine_push(mag, slot, p);
+    }
+
+    ngx_slab_refilling = 0;
+
+    /* the requests served without the mutex */
+
+    pool->stats[slot].reqs += mag->reqs[slot];
+    mag->reqs[slot] = 0;
+}
+
+
+static ngx_uint_t
+ngx_slab_magazine_flush(ngx_slab_pool_t *pool, ngx_slab_magazine_t *mag,
+    ngx_uint_t slot, ngx_uint_t n)
+{
+    void        *p, *next;
+    ngx_uint_t   i, k, last, freed;
+
+    /* NGX_SLAB_MAGAZINE_SLOTS as "slot" means all slots */
+
+    if (slot == NGX_SLAB_MAGAZINE_SLOTS) {
+        i = 0;
+        last = NGX_SLAB_MAGAZINE_SLOTS;
+
+    } else {
+        i = slot;
+        last = slot + 1;
+    }
+
+    freed = 0;
+
+    for ( /* void */ ; i < last; i++) {
+
+        pool->stats[i].reqs += mag->reqs[i];
+        mag->reqs[i] = 0;
+
+        /*
+         * the recently freed chunks at the head are kept; without them
+         * the list is followed to its end, as the count of a magazine
+         * left by a crashed worker may be one less
+         */
+
+        if (n == 0) {
+            p = mag->chunks[i];
+            mag->chunks[i] = NULL;
+
+        } else if (mag->n[i] > n) {
+            p = mag->chunks[i];
+
+            for (k = 1; k < n; k++) {
+                p = *(void **) p;
+            }
+
+            next = *(void **) p;
+            *(void **) p = NULL;
+            p = next;
+
+        } else {
+            continue;
+        }
+
+        mag->n[i] = n;
+
+        while (p) {
+            next = *(void **) p;
+            ngx_slab_free_shared(pool, p);
+            p = next;
+            freed++;
+        }
+    }
+
+    return freed;
+}
+
+
+static ngx_uint_t
+ngx_slab_magazine_release(ngx_slab_pool_t *pool, ngx_slab_magazine_t *mag)
+{
+    ngx_uint_t            n;
+    ngx_slab_magazine_t  **prev;
+
+    n = ngx_slab_magazine_flush(pool, mag, NGX_SLAB_MAGAZINE_SLOTS, 0);
+
+    for (prev = &pool->magazines; *prev; prev = &(*prev)->next) {
+        if (*prev == mag) {
+            *prev = mag->next;
+            break;
+        }
+    }
+
+    ngx_slab_free_shared(pool, mag);
+
+    return n;
+}
+
+
 static void
 ngx_slab_error(ngx_slab_pool_t *pool, ngx_uint_t level, char *text)
 {
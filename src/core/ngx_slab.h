@@ -31,6 +31,19 @@ typedef struct {
 } ngx_slab_stat_t;
 
 
+typedef struct ngx_slab_magazine_s  ngx_slab_magazine_t;
+
+
+typedef struct {
+    ngx_uint_t        pages;
+    ngx_uint_t        free;
+    ngx_uint_t        largest;
+    size_t            slack;
+    ngx_uint_t        cached;
+    ngx_uint_t        contended;
+} ngx_slab_usage_t;
+
+
 typedef struct {
     ngx_shmtx_sh_t    lock;
 
@@ -49,6 +62,14 @@ typedef struct {
 
     ngx_shmtx_t       mutex;
 
+    /* additional mutexes of the zone, unlocked along with the pool one */
+    ngx_shmtx_t      *mutexes;
+    ngx_uint_t        nmutexes;
+
+    /* the magazines of the worker processes and the flush generation */
+    ngx_slab_magazine_t  *magazines;
+    ngx_uint_t            flush;
+
     u_char           *log_ctx;
     u_char            zero;
 
@@ -67,6 +88,12 @@ void *ngx_slab_calloc(ngx_slab_pool_t *pool, size_t size);
 void *ngx_slab_calloc_locked(ngx_slab_pool_t *pool, size_t size);
 void ngx_slab_free(ngx_slab_pool_t *pool, void *p);
 void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p);
+void ngx_slab_usage(ngx_slab_pool_t *pool, ngx_slab_usage_t *usage);
+void ngx_slab_flush_magazines(void);
+ngx_uint_t ngx_slab_reclaim_magazines(ngx_slab_pool_t *pool, ngx_pid_t pid);
+
+
+extern ngx_uint_t  ngx_slab_magazine_size;
 
 
 #endif /* _NGX_SLAB_H_INCLUDED_ */
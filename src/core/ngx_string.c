@@ -8,6 +8,10 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 
+#if (defined __SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 static u_char *ngx_sprintf_num(u_char *buf, u_char *last, uint64_t ui64,
     u_char zero, ngx_uint_t hexadecimal, ngx_uint_t width);
@@ -18,6 +22,14 @@ static void ngx_encode_base64_internal(ngx_str_t *dst, ngx_str_t *src,
 static ngx_int_t ngx_decode_base64_internal(ngx_str_t *dst, ngx_str_t *src,
     const u_char *basis);
 
+#if (defined __SSE2__)
+static ngx_inline size_t ngx_escape_uri_skip(u_char *p, size_t size,
+    ngx_uint_t slash);
+static ngx_inline size_t ngx_unescape_uri_skip(u_char *p, size_t size,
+    ngx_uint_t question);
+static ngx_inline size_t ngx_escape_json_skip(u_char *p, size_t size);
+#endif
+
 
 void
 ngx_strlow(u_char *dst, u_char *src, size_t n)
@@ -1486,12 +1498,130 @@ ngx_utf8_cpystrn(u_char *dst, u_char *src, size_t n, size_t len)
 }
 
 
+#if (defined __SSE2__)
+
+/*
+ * The escape functions below skip runs of bytes that are copied as is
+ * 16 bytes at a time and fall back to the byte-wise loop on the first
+ * byte that may need escaping.  The helpers return the length of such
+ * a run; only whole 16-byte blocks are checked, the tail is left to
+ * the byte-wise loop.  After a run is broken the byte-wise loop handles
+ * the next 16 bytes, so that input dense with escaped bytes does not pay
+ * for a vector check per byte.
+ */
+
+static ngx_inline size_t
+ngx_escape_uri_skip(u_char *p, size_t size, ngx_uint_t slash)
+{
+    int      mask;
+    size_t   len;
+    __m128i  v, m;
+
+    /*
+     * ALPHA, DIGIT, "-", ".", "_" and "~" are not escaped by any
+     * of the tables, "/" is only escaped in uri_component
+     */
+
+    for (len = 0; size - len >= 16; len += 16) {
+        v = _mm_loadu_si128((__m128i *) (p + len));
+
+        /* "-", ".", "/", DIGIT */
+
+        m = _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8((char) (0x80 - '-'))),
+                           _mm_set1_epi8((char) (0x80 + '9' - '-' + 1)));
+
+        if (!slash) {
+            m = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('/')), m);
+        }
+
+        m = _mm_or_si128(m, _mm_cmplt_epi8(
+                _mm_add_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)),
+                             _mm_set1_epi8((char) (0x80 - 'a'))),
+                _mm_set1_epi8((char) (0x80 + 26))));
+
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('~')));
+
+        mask = ~_mm_movemask_epi8(m) & 0xffff;
+
+        if (mask) {
+            return len + __builtin_ctz(mask);
+        }
+    }
+
+    return len;
+}
+
+
+static ngx_inline size_t
+ngx_unescape_uri_skip(u_char *p, size_t size, ngx_uint_t question)
+{
+    int      mask;
+    size_t   len;
+    __m128i  v, m;
+
+    for (len = 0; size - len >= 16; len += 16) {
+        v = _mm_loadu_si128((__m128i *) (p + len));
+
+        m = _mm_cmpeq_epi8(v, _mm_set1_epi8('%'));
+
+        if (question) {
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('?')));
+        }
+
+        mask = _mm_movemask_epi8(m);
+
+        if (mask) {
+            return len + __builtin_ctz(mask);
+        }
+    }
+
+    return len;
+}
+
+
+static ngx_inline size_t
+ngx_escape_json_skip(u_char *p, size_t size)
+{
+    int      mask;
+    size_t   len;
+    __m128i  v, m;
+
+    for (len = 0; size - len >= 16; len += 16) {
+        v = _mm_loadu_si128((__m128i *) (p + len));
+
+        /* %00-%1F */
+
+        m = _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8((char) 0x80)),
+                           _mm_set1_epi8((char) (0x80 + 0x20)));
+
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+
+        mask = _mm_movemask_epi8(m);
+
+        if (mask) {
+            return len + __builtin_ctz(mask);
+        }
+    }
+
+    return len;
+}
+
+#endif
+
+
 uintptr_t
 ngx_escape_uri(u_char *dst, u_char *src, size_t size, ngx_uint_t type)
 {
+    size_t          block;
     ngx_uint_t      n;
     uint32_t       *escape;
     static u_char   hex[] = "0123456789ABCDEF";
+#if (defined __SSE2__)
+    size_t          len;
+    ngx_uint_t      slash;
+#endif
 
                     /* " ", "#", "%", "?", %00-%1F, %7F-%FF */
 
@@ -1621,6 +1751,10 @@ ngx_escape_uri(u_char *dst, u_char *src, size_t size, ngx_uint_t type)
 
     escape = map[type];
 
+#if (defined __SSE2__)
+    slash = !(escape['/' >> 5] & (1U << ('/' & 0x1f)));
+#endif
+
     if (dst == NULL) {
 
         /* find the number of the characters to be escaped */
@@ -1628,27 +1762,56 @@ ngx_escape_uri(u_char *dst, u_char *src, size_t size, ngx_uint_t type)
         n = 0;
 
         while (size) {
-            if (escape[*src >> 5] & (1U << (*src & 0x1f))) {
-                n++;
+
+#if (defined __SSE2__)
+            len = ngx_escape_uri_skip(src, size, slash);
+            src += len;
+            size -= len;
+
+            block = ngx_min(size, 16);
+#else
+            block = size;
+#endif
+
+            size -= block;
+
+            while (block--) {
+                if (escape[*src >> 5] & (1U << (*src & 0x1f))) {
+                    n++;
+                }
+                src++;
             }
-            src++;
-            size--;
         }
 
         return (uintptr_t) n;
     }
 
     while (size) {
-        if (escape[*src >> 5] & (1U << (*src & 0x1f))) {
-            *dst++ = '%';
-            *dst++ = hex[*src >> 4];
-            *dst++ = hex[*src & 0xf];
-            src++;
 
-        } else {
-            *dst++ = *src++;
+#if (defined __SSE2__)
+        len = ngx_escape_uri_skip(src, size, slash);
+        dst = ngx_cpymem(dst, src, len);
+        src += len;
+        size -= len;
+
+        block = ngx_min(size, 16);
+#else
+        block = size;
+#endif
+
+        size -= block;
+
+        while (block--) {
+            if (escape[*src >> 5] & (1U << (*src & 0x1f))) {
+                *dst++ = '%';
+                *dst++ = hex[*src >> 4];
+                *dst++ = hex[*src & 0xf];
+                src++;
+
+            } else {
+                *dst++ = *src++;
+            }
         }
-        size--;
     }
 
     return (uintptr_t) dst;
@@ -1659,6 +1822,10 @@ void
 ngx_unescape_uri(u_char **dst, u_char **src, size_t size, ngx_uint_t type)
 {
     u_char  *d, *s, ch, c, decoded;
+    size_t   block;
+#if (defined __SSE2__)
+    size_t   len;
+#endif
     enum {
         sw_usual = 0,
         sw_quoted,
@@ -1671,110 +1838,132 @@ ngx_unescape_uri(u_char **dst, u_char **src, size_t size, ngx_uint_t type)
     state = 0;
     decoded = 0;
 
-    while (size--) {
-
-        ch = *s++;
-
-        switch (state) {
-        case sw_usual:
-            if (ch == '?'
-                && (type & (NGX_UNESCAPE_URI|NGX_UNESCAPE_REDIRECT)))
-            {
-                *d++ = ch;
-                goto done;
-            }
-
-            if (ch == '%') {
-                state = sw_quoted;
-                break;
-            }
-
-            *d++ = ch;
-            break;
+    while (size) {
 
-        case sw_quoted:
+#if (defined __SSE2__)
+        if (state == sw_usual) {
+            len = ngx_unescape_uri_skip(s, size, type & (NGX_UNESCAPE_URI
+                                                      |NGX_UNESCAPE_REDIRECT));
 
-            if (ch >= '0' && ch <= '9') {
-                decoded = (u_char) (ch - '0');
-                state = sw_quoted_second;
-                break;
-            }
+            /* the destination may overlap the source */
 
-            c = (u_char) (ch | 0x20);
-            if (c >= 'a' && c <= 'f') {
-                decoded = (u_char) (c - 'a' + 10);
-                state = sw_quoted_second;
-                break;
-            }
+            d = ngx_movemem(d, s, len);
+            s += len;
+            size -= len;
+        }
 
-            /* the invalid quoted character */
+        block = ngx_min(size, 16);
+#else
+        block = size;
+#endif
 
-            state = sw_usual;
+        size -= block;
 
-            *d++ = ch;
+        while (block--) {
 
-            break;
+            ch = *s++;
 
-        case sw_quoted_second:
+            switch (state) {
+            case sw_usual:
+                if (ch == '?'
+                    && (type & (NGX_UNESCAPE_URI|NGX_UNESCAPE_REDIRECT)))
+                {
+                    *d++ = ch;
+                    goto done;
+                }
 
-            state = sw_usual;
+                if (ch == '%') {
+                    state = sw_quoted;
+                    break;
+                }
 
-            if (ch >= '0' && ch <= '9') {
-                ch = (u_char) ((decoded << 4) + (ch - '0'));
+                *d++ = ch;
+                break;
 
-                if (type & NGX_UNESCAPE_REDIRECT) {
-                    if (ch > '%' && ch < 0x7f) {
-                        *d++ = ch;
-                        break;
-                    }
+            case sw_quoted:
 
-                    *d++ = '%'; *d++ = *(s - 2); *d++ = *(s - 1);
+                if (ch >= '0' && ch <= '9') {
+                    decoded = (u_char) (ch - '0');
+                    state = sw_quoted_second;
+                    break;
+                }
 
+                c = (u_char) (ch | 0x20);
+                if (c >= 'a' && c <= 'f') {
+                    decoded = (u_char) (c - 'a' + 10);
+                    state = sw_quoted_second;
                     break;
                 }
 
+                /* the invalid quoted character */
+
+                state = sw_usual;
+
                 *d++ = ch;
 
                 break;
-            }
 
-            c = (u_char) (ch | 0x20);
-            if (c >= 'a' && c <= 'f') {
-                ch = (u_char) ((decoded << 4) + (c - 'a') + 10);
+            case sw_quoted_second:
 
-                if (type & NGX_UNESCAPE_URI) {
-                    if (ch == '?') {
-                        *d++ = ch;
-                        goto done;
+                state = sw_usual;
+
+                if (ch >= '0' && ch <= '9') {
+                    ch = (u_char) ((decoded << 4) + (ch - '0'));
+
+                    if (type & NGX_UNESCAPE_REDIRECT) {
+                        if (ch > '%' && ch < 0x7f) {
+                            *d++ = ch;
+                            break;
+                        }
+
+                        *d++ = '%'; *d++ = *(s - 2); *d++ = *(s - 1);
+
+                        break;
                     }
 
                     *d++ = ch;
+
                     break;
                 }
 
-                if (type & NGX_UNESCAPE_REDIRECT) {
-                    if (ch == '?') {
+                c = (u_char) (ch | 0x20);
+                if (c >= 'a' && c <= 'f') {
+                    ch = (u_char) ((decoded << 4) + (c - 'a') + 10);
+
+                    if (type & NGX_UNESCAPE_URI) {
+                        if (ch == '?') {
+                            *d++ = ch;
+                            goto done;
+                        }
+
                         *d++ = ch;
-                        goto done;
+                        break;
                     }
 
-                    if (ch > '%' && ch < 0x7f) {
-                        *d++ = ch;
+                    if (type & NGX_UNESCAPE_REDIRECT) {
+                        if (ch == '?') {
+                            *d++ = ch;
+                            goto done;
+                        }
+
+                        if (ch > '%' && ch < 0x7f) {
+                            *d++ = ch;
+                            break;
+                        }
+
+                        *d++ = '%'; *d++ = *(s - 2); *d++ = *(s - 1);
                         break;
                     }
 
-                    *d++ = '%'; *d++ = *(s - 2); *d++ = *(s - 1);
+                    *d++ = ch;
+
                     break;
                 }
 
-                *d++ = ch;
+                /* the invalid quoted character */
 
                 break;
             }
-
-            /* the invalid quoted character */
-
-            break;
         }
     }
 
@@ -1861,85 +2050,116 @@ uintptr_t
 ngx_escape_json(u_char *dst, u_char *src, size_t size)
 {
     u_char      ch;
+    size_t      block;
     ngx_uint_t  len;
+#if (defined __SSE2__)
+    size_t      n;
+#endif
 
     if (dst == NULL) {
         len = 0;
 
         while (size) {
-            ch = *src++;
 
-            if (ch == '\\' || ch == '"') {
-                len++;
+#if (defined __SSE2__)
+            n = ngx_escape_json_skip(src, size);
+            src += n;
+            size -= n;
 
-            } else if (ch <= 0x1f) {
+            block = ngx_min(size, 16);
+#else
+            block = size;
+#endif
 
-                switch (ch) {
-                case '\n':
-                case '\r':
-                case '\t':
-                case '\b':
-                case '\f':
+            size -= block;
+
+            while (block--) {
+                ch = *src++;
+
+                if (ch == '\\' || ch == '"') {
                     len++;
-                    break;
 
-                default:
-                    len += sizeof("\\u001F") - 2;
+                } else if (ch <= 0x1f) {
+
+                    switch (ch) {
+                    case '\n':
+                    case '\r':
+                    case '\t':
+                    case '\b':
+                    case '\f':
+                        len++;
+                        break;
+
+                    default:
+                        len += sizeof("\\u001F") - 2;
+                    }
                 }
             }
-
-            size--;
         }
 
         return (uintptr_t) len;
     }
 
     while (size) {
-        ch = *src++;
 
-        if (ch > 0x1f) {
+#if (defined __SSE2__)
+        n = ngx_escape_json_skip(src, size);
+        dst = ngx_cpymem(dst, src, n);
+        src += n;
+        size -= n;
 
-            if (ch == '\\' || ch == '"') {
-                *dst++ = '\\';
-            }
+        block = ngx_min(size, 16);
+#else
+        block = size;
+#endif
 
-            *dst++ = ch;
+        size -= block;
 
-        } else {
-            *dst++ = '\\';
+        while (block--) {
+            ch = *src++;
 
-            switch (ch) {
-            case '\n':
-                *dst++ = 'n';
-                break;
+            if (ch > 0x1f) {
 
-            case '\r':
-                *dst++ = 'r';
-                break;
+                if (ch == '\\' || ch == '"') {
+                    *dst++ = '\\';
+                }
 
-            case '\t':
-                *dst++ = 't';
-                break;
+                *dst++ = ch;
 
-            case '\b':
-                *dst++ = 'b';
-                break;
+            } else {
+                *dst++ = '\\';
 
-            case '\f':
-                *dst++ = 'f';
-                break;
+                switch (ch) {
+                case '\n':
+                    *dst++ = 'n';
+                    break;
 
-            default:
-                *dst++ = 'u'; *dst++ = '0'; *dst++ = '0';
-                *dst++ = '0' + (ch >> 4);
+                case '\r':
+                    *dst++ = 'r';
+                    break;
 
-                ch &= 0xf;
+                case '\t':
+                    *dst++ = 't';
+                    break;
 
-                *dst++ = (ch < 10) ? ('0' + ch) : ('A' + ch - 10);
+                case '\b':
+                    *dst++ = 'b';
+                    break;
+
+                case '\f':
+                    *dst++ = 'f';
+                    break;
+
+                default:
+                    *dst++ = 'u'; *dst++ = '0'; *dst++ = '0';
+                    *dst++ = '0' + (ch >> 4);
+
+                    ch &= 0xf;
+
+                    *dst++ = (ch < 10) ? ('0' + ch) : ('A' + ch - 10);
+                }
             }
         }
-
-        size--;
     }
 
     return (uintptr_t) dst;
@@ -26,12 +26,21 @@ typedef struct {
     (q)->last = &(q)->first
 
 
+/*
+ * Tasks are posted to a lock-free list, which the threads move
+ * into the queue under the mutex, so posting takes the mutex only
+ * to wake up a sleeping thread.
+ */
+
 struct ngx_thread_pool_s {
     ngx_thread_mutex_t        mtx;
     ngx_thread_pool_queue_t   queue;
-    ngx_int_t                 waiting;
+    ngx_atomic_t              posted;
+    ngx_atomic_t              sleeping;
     ngx_thread_cond_t         cond;
 
+    ngx_thread_pool_stat_t    stat;
+
     ngx_log_t                *log;
 
     ngx_str_t                 name;
@@ -48,6 +57,10 @@ static ngx_int_t ngx_thread_pool_init(ngx_thread_pool_t *tp, ngx_log_t *log,
 static void ngx_thread_pool_destroy(ngx_thread_pool_t *tp);
 static void ngx_thread_pool_exit_handler(void *data, ngx_log_t *log);
 
+static ngx_thread_task_t *ngx_thread_pool_take(ngx_atomic_t *list,
+    ngx_thread_task_t ***last);
+static ngx_uint_t ngx_thread_pool_push(ngx_atomic_t *list,
+    ngx_thread_task_t *task);
 static void *ngx_thread_pool_cycle(void *data);
 static void ngx_thread_pool_handler(ngx_event_t *ev);
 
@@ -98,9 +111,10 @@ ngx_module_t  ngx_thread_pool_module = {
 
 static ngx_str_t  ngx_thread_pool_default = ngx_string("default");
 
-static ngx_uint_t               ngx_thread_pool_task_id;
-static ngx_atomic_t             ngx_thread_pool_done_lock;
-static ngx_thread_pool_queue_t  ngx_thread_pool_done;
+static ngx_uint_t    ngx_thread_pool_task_id;
+static ngx_atomic_t  ngx_thread_pool_done;
+
+ngx_thread_pool_done_stat_t  ngx_thread_pool_done_stat;
 
 
 static ngx_int_t
@@ -119,6 +133,14 @@ ngx_thread_pool_init(ngx_thread_pool_t *tp, ngx_log_t *log, ngx_pool_t *pool)
 
     ngx_thread_pool_queue_init(&tp->queue);
 
+    tp->posted = 0;
+    tp->sleeping = 0;
+
+    ngx_memzero(&tp->stat, sizeof(ngx_thread_pool_stat_t));
+
+    tp->stat.name = &tp->name;
+    tp->stat.threads = tp->threads;
+
     if (ngx_thread_mutex_create(&tp->mtx, log) != NGX_OK) {
         return NGX_ERROR;
     }
@@ -230,41 +252,52 @@ ngx_thread_task_alloc(ngx_pool_t *pool, size_t size)
 ngx_int_t
 ngx_thread_task_post(ngx_thread_pool_t *tp, ngx_thread_task_t *task)
 {
+    ngx_atomic_uint_t  queued;
+
     if (task->event.active) {
         ngx_log_error(NGX_LOG_ALERT, tp->log, 0,
                       "task #%ui already active", task->id);
         return NGX_ERROR;
     }
 
-    if (ngx_thread_mutex_lock(&tp->mtx, tp->log) != NGX_OK) {
-        return NGX_ERROR;
-    }
-
-    if (tp->waiting >= tp->max_queue) {
-        (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+    queued = tp->stat.queued;
 
+    if (queued >= (ngx_atomic_uint_t) tp->max_queue) {
         ngx_log_error(NGX_LOG_ERR, tp->log, 0,
-                      "thread pool \"%V\" queue overflow: %i tasks waiting",
-                      &tp->name, tp->waiting);
+                      "thread pool \"%V\" queue overflow: %uA tasks waiting",
+                      &tp->name, queued);
         return NGX_ERROR;
     }
 
     task->event.active = 1;
 
     task->id = ngx_thread_pool_task_id++;
-    task->next = NULL;
+    task->usec = ngx_event_loop_usec();
 
-    if (ngx_thread_cond_signal(&tp->cond, tp->log) != NGX_OK) {
-        (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
-        return NGX_ERROR;
+    queued = ngx_atomic_fetch_add(&tp->stat.queued, 1) + 1;
+
+    if (queued > tp->stat.max_queued) {
+        tp->stat.max_queued = queued;
     }
 
-    *tp->queue.last = task;
-    tp->queue.last = &task->next;
+    tp->stat.tasks++;
+
+    (void) ngx_thread_pool_push(&tp->posted, task);
 
-    tp->waiting++;
+    /*
+     * the push is a full barrier, and a thread increments the number
+     * of sleeping threads before it checks the list for the last time
+     * and then waits with the mutex locked, so the signal is not lost
+     */
 
-    (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+    if (tp->sleeping) {
+        if (ngx_thread_mutex_lock(&tp->mtx, tp->log) == NGX_OK) {
+            (void) ngx_thread_cond_signal(&tp->cond, tp->log);
+            (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+
+            tp->stat.signals++;
+        }
+    }
 
     ngx_log_debug2(NGX_LOG_DEBUG_CORE, tp->log, 0,
                    "task #%ui added to thread pool \"%V\"",
@@ -274,12 +307,87 @@ ngx_thread_task_post(ngx_thread_pool_t *tp, ngx_thread_task_t *task)
 }
 
 
+ngx_thread_pool_stat_t *
+ngx_thread_pool_stat(ngx_cycle_t *cycle, ngx_uint_t n)
+{
+    ngx_thread_pool_t       **tpp;
+    ngx_thread_pool_conf_t   *tcf;
+
+    tcf = (ngx_thread_pool_conf_t *) ngx_get_conf(cycle->conf_ctx,
+                                                  ngx_thread_pool_module);
+
+    if (tcf == NULL || n >= tcf->pools.nelts) {
+        return NULL;
+    }
+
+    tpp = tcf->pools.elts;
+
+    return &tpp[n]->stat;
+}
+
+
+/*
+ * The posted and completed tasks are kept in lock-free lists in the
+ * reverse order: tasks are pushed with a compare-and-swap of the head,
+ * and the consumer takes the whole list at once, so there is no ABA
+ * problem.  The taken list is reversed to run the tasks in order.
+ */
+
+static ngx_uint_t
+ngx_thread_pool_push(ngx_atomic_t *list, ngx_thread_task_t *task)
+{
+    ngx_atomic_uint_t  head;
+
+    do {
+        head = *list;
+        task->next = (ngx_thread_task_t *) head;
+
+    } while (!ngx_atomic_cmp_set(list, head, (ngx_atomic_uint_t) task));
+
+    /* the list was empty */
+
+    return (head == 0);
+}
+
+
+static ngx_thread_task_t *
+ngx_thread_pool_take(ngx_atomic_t *list, ngx_thread_task_t ***last)
+{
+    ngx_atomic_uint_t   head;
+    ngx_thread_task_t  *task, *next, *first;
+
+    do {
+        head = *list;
+
+        if (head == 0) {
+            return NULL;
+        }
+
+    } while (!ngx_atomic_cmp_set(list, head, 0));
+
+    first = NULL;
+
+    for (task = (ngx_thread_task_t *) head; task; task = next) {
+        next = task->next;
+        task->next = first;
+        first = task;
+    }
+
+    if (last) {
+        *last = &((ngx_thread_task_t *) head)->next;
+    }
+
+    return first;
+}
+
+
 static void *
 ngx_thread_pool_cycle(void *data)
 {
     ngx_thread_pool_t *tp = data;
 
     int                 err;
+    uint64_t            now;
     sigset_t            set;
     ngx_thread_task_t  *task;
 
@@ -308,16 +416,31 @@ ngx_thread_pool_cycle(void *data)
             return NULL;
         }
 
-        /* the number may become negative */
-        tp->waiting--;
-
         while (tp->queue.first == NULL) {
+            tp->queue.first = ngx_thread_pool_take(&tp->posted,
+                                                   &tp->queue.last);
+            if (tp->queue.first) {
+                break;
+            }
+
+            (void) ngx_atomic_fetch_add(&tp->sleeping, 1);
+
+            tp->queue.first = ngx_thread_pool_take(&tp->posted,
+                                                   &tp->queue.last);
+            if (tp->queue.first) {
+                (void) ngx_atomic_fetch_add(&tp->sleeping, -1);
+                break;
+            }
+
             if (ngx_thread_cond_wait(&tp->cond, &tp->mtx, tp->log)
                 != NGX_OK)
             {
+                (void) ngx_atomic_fetch_add(&tp->sleeping, -1);
                 (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
                 return NULL;
             }
+
+            (void) ngx_atomic_fetch_add(&tp->sleeping, -1);
         }
 
         task = tp->queue.first;
@@ -331,6 +454,14 @@ ngx_thread_pool_cycle(void *data)
             return NULL;
         }
 
+        (void) ngx_atomic_fetch_add(&tp->stat.queued, -1);
+
+        now = ngx_event_loop_usec();
+
+        (void) ngx_atomic_fetch_add(&tp->stat.wait, now - task->usec);
+
+        task->usec = now;
+
 #if 0
         ngx_time_update();
 #endif
@@ -345,18 +476,22 @@ ngx_thread_pool_cycle(void *data)
                        "complete task #%ui in thread pool \"%V\"",
                        task->id, &tp->name);
 
-        task->next = NULL;
+        now = ngx_event_loop_usec();
 
-        ngx_spinlock(&ngx_thread_pool_done_lock, 1, 2048);
+        (void) ngx_atomic_fetch_add(&tp->stat.run, now - task->usec);
 
-        *ngx_thread_pool_done.last = task;
-        ngx_thread_pool_done.last = &task->next;
+        task->usec = now;
 
-        ngx_memory_barrier();
+        /*
+         * only the thread which finds the list empty notifies the event
+         * loop, the following completions are run in the same batch
+         */
 
-        ngx_unlock(&ngx_thread_pool_done_lock);
-
-        (void) ngx_notify(ngx_thread_pool_handler);
+        if (ngx_thread_pool_push(&ngx_thread_pool_done, task)) {
+            (void) ngx_atomic_fetch_add(&ngx_thread_pool_done_stat.notifies,
+                                        1);
+            (void) ngx_notify(ngx_thread_pool_handler);
+        }
     }
 }
 
@@ -364,25 +499,29 @@ ngx_thread_pool_cycle(void *data)
 static void
 ngx_thread_pool_handler(ngx_event_t *ev)
 {
+    uint64_t            now;
     ngx_event_t        *event;
     ngx_thread_task_t  *task;
 
     ngx_log_debug0(NGX_LOG_DEBUG_CORE, ev->log, 0, "thread pool handler");
 
-    ngx_spinlock(&ngx_thread_pool_done_lock, 1, 2048);
+    task = ngx_thread_pool_take(&ngx_thread_pool_done, NULL);
 
-    task = ngx_thread_pool_done.first;
-    ngx_thread_pool_done.first = NULL;
-    ngx_thread_pool_done.last = &ngx_thread_pool_done.first;
+    if (task == NULL) {
+        return;
+    }
 
-    ngx_memory_barrier();
+    now = ngx_event_loop_usec();
 
-    ngx_unlock(&ngx_thread_pool_done_lock);
+    ngx_thread_pool_done_stat.batches++;
 
     while (task) {
         ngx_log_debug1(NGX_LOG_DEBUG_CORE, ev->log, 0,
                        "run completion handler for task #%ui", task->id);
 
+        ngx_thread_pool_done_stat.tasks++;
+        ngx_thread_pool_done_stat.latency += now - task->usec;
+
         event = &task->event;
         task = task->next;
 
@@ -599,7 +738,7 @@ ngx_thread_pool_init_worker(ngx_cycle_t *cycle)
         return NGX_OK;
     }
 
-    ngx_thread_pool_queue_init(&ngx_thread_pool_done);
+    ngx_thread_pool_done = 0;
 
     tpp = tcf->pools.elts;
 
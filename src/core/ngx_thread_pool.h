@@ -20,17 +20,45 @@ struct ngx_thread_task_s {
     void                *ctx;
     void               (*handler)(void *data, ngx_log_t *log);
     ngx_event_t          event;
+    uint64_t             usec;
 };
 
 
 typedef struct ngx_thread_pool_s  ngx_thread_pool_t;
 
 
+/* the times are in microseconds */
+
+typedef struct {
+    ngx_str_t           *name;
+    ngx_uint_t           threads;
+    ngx_atomic_t         tasks;
+    ngx_atomic_t         queued;
+    ngx_atomic_t         max_queued;
+    ngx_atomic_t         signals;
+    ngx_atomic_t         wait;
+    ngx_atomic_t         run;
+} ngx_thread_pool_stat_t;
+
+
+typedef struct {
+    ngx_atomic_t         tasks;
+    ngx_atomic_t         batches;
+    ngx_atomic_t         notifies;
+    ngx_atomic_t         latency;
+} ngx_thread_pool_done_stat_t;
+
+
 ngx_thread_pool_t *ngx_thread_pool_add(ngx_conf_t *cf, ngx_str_t *name);
 ngx_thread_pool_t *ngx_thread_pool_get(ngx_cycle_t *cycle, ngx_str_t *name);
 
 ngx_thread_task_t *ngx_thread_task_alloc(ngx_pool_t *pool, size_t size);
 ngx_int_t ngx_thread_task_post(ngx_thread_pool_t *tp, ngx_thread_task_t *task);
 
+ngx_thread_pool_stat_t *ngx_thread_pool_stat(ngx_cycle_t *cycle, ngx_uint_t n);
+
+
+extern ngx_thread_pool_done_stat_t  ngx_thread_pool_done_stat;
+
 
 #endif /* _NGX_THREAD_POOL_H_INCLUDED_ */
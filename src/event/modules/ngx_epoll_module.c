@@ -115,6 +115,7 @@ struct io_event {
 typedef struct {
     ngx_uint_t  events;
     ngx_uint_t  aio_requests;
+    ngx_uint_t  spin;
 } ngx_epoll_conf_t;
 
 
@@ -158,6 +159,10 @@ static int                  ep = -1;
 static struct epoll_event  *event_list;
 static ngx_uint_t           nevents;
 
+/* the busy polling budget, adapted between 1 and the configured value */
+static ngx_uint_t           spin;
+static ngx_uint_t           spin_max;
+
 #if (NGX_HAVE_EVENTFD)
 static int                  notify_fd = -1;
 static ngx_event_t          notify_event;
@@ -196,6 +201,13 @@ static ngx_command_t  ngx_epoll_commands[] = {
       offsetof(ngx_epoll_conf_t, aio_requests),
       NULL },
 
+    { ngx_string("epoll_spin"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      0,
+      offsetof(ngx_epoll_conf_t, spin),
+      NULL },
+
       ngx_null_command
 };
 
@@ -399,6 +411,9 @@ ngx_epoll_init(ngx_cycle_t *cycle, ngx_msec_t timer)
 
     nevents = epcf->events;
 
+    spin = epcf->spin;
+    spin_max = epcf->spin;
+
     ngx_io = ngx_os_io;
 
     ngx_event_actions = ngx_epoll_module_ctx.actions;
@@ -884,7 +899,7 @@ ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
     int                events;
     uint32_t           revents;
     ngx_int_t          instance, i;
-    ngx_uint_t         level;
+    ngx_uint_t         level, spins, blocked;
     ngx_err_t          err;
     ngx_event_t       *rev, *wev;
     ngx_queue_t       *queue;
@@ -895,15 +910,72 @@ ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
                    "epoll timer: %M", timer);
 
-    // 将就绪事件 copy 至 event_list 中，每次取的数量由配置文件决定
-    events = epoll_wait(ep, event_list, (int) nevents, timer);
+    events = 0;
+    spins = 0;
+    blocked = 1;
+    err = 0;
+
+    if (spin && timer != 0) {
+
+        /*
+         * busy polling: the budget is doubled each time the events
+         * are found while spinning and halved each time they are not
+         */
+
+        do {
+            spins++;
+            events = epoll_wait(ep, event_list, (int) nevents, 0);
+        } while (events == 0 && spins < spin);
+
+        if (events == -1) {
+
+            /* a signal or an error is not a productive spin */
+
+            err = ngx_errno;
+            blocked = 0;
+
+        } else if (events == 0) {
+            spin = (spin > 1) ? spin / 2 : 1;
 
-    err = (events == -1) ? ngx_errno : 0;
+        } else {
+            blocked = 0;
+            spin = ngx_min(spin * 2, spin_max);
+        }
+
+        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                       "epoll spins: %ui, events: %d", spins, events);
+    }
+
+    if (blocked) {
+        // 将就绪事件 copy 至 event_list 中，每次取的数量由配置文件决定
+        events = epoll_wait(ep, event_list, (int) nevents, timer);
+
+        err = (events == -1) ? ngx_errno : 0;
+    }
 
     if (flags & NGX_UPDATE_TIME || ngx_event_timer_alarm) {
         ngx_time_update();
     }
 
+#if (NGX_STAT_STUB)
+    if (ngx_event_loop_stat) {
+        ngx_event_loop_wakeup(events > 0 ? events : 0);
+
+        if (spin_max && events > 0) {
+            ngx_event_loop_stat->spin_polls += spins;
+
+            if (blocked) {
+                ngx_event_loop_stat->block_wakeups++;
+                ngx_event_loop_stat->block_events += events;
+
+            } else {
+                ngx_event_loop_stat->spin_wakeups++;
+                ngx_event_loop_stat->spin_events += events;
+            }
+        }
+    }
+#endif
+
     if (err) {
 
         /*
@@ -1008,7 +1080,7 @@ ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
 
             if (flags & NGX_POST_EVENTS) {
                 queue = rev->accept ? &ngx_posted_accept_events
-                                    : &ngx_posted_events;
+                                    : ngx_posted_event_queue(c);
 
                 ngx_post_event(rev, queue);
 
@@ -1040,7 +1112,8 @@ ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
 #endif
 
             if (flags & NGX_POST_EVENTS) {
-                ngx_post_event(wev, &ngx_posted_events);
+                queue = ngx_posted_event_queue(c);
+                ngx_post_event(wev, queue);
 
             } else {
                 // 处理写事件
@@ -1151,6 +1224,7 @@ ngx_epoll_create_conf(ngx_cycle_t *cycle)
 
     epcf->events = NGX_CONF_UNSET;
     epcf->aio_requests = NGX_CONF_UNSET;
+    epcf->spin = NGX_CONF_UNSET;
 
     return epcf;
 }
@@ -1163,6 +1237,7 @@ ngx_epoll_init_conf(ngx_cycle_t *cycle, void *conf)
 
     ngx_conf_init_uint_value(epcf->events, 512);
     ngx_conf_init_uint_value(epcf->aio_requests, 32);
+    ngx_conf_init_uint_value(epcf->spin, 0);
 
     return NGX_CONF_OK;
 }
@@ -0,0 +1,1104 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+/*
+ * The module keeps the readiness model of epoll, so ngx_os_io and all
+ * the HTTP and stream handlers work unchanged: every read or write event
+ * is a multishot IORING_OP_POLL_ADD request.  Poll requests, their removal
+ * and file reads are only queued into the submission ring, and the whole
+ * batch is submitted by the same io_uring_enter() call that waits for
+ * completions, so there is one system call per event loop iteration
+ * instead of one epoll_ctl() per event change plus epoll_wait().
+ *
+ * Socket I/O is not submitted to the ring: accept(), recv() and writev()
+ * are still one system call each.  The ring would have to own the buffers
+ * until the completion, while ngx_recv() and ngx_send_chain() return
+ * the result synchronously and their callers reuse the buffers at once.
+ *
+ * The user_data of a poll request is the ngx_event_t pointer with
+ * the event instance in the lowest bit, the next bit marks file reads.
+ */
+
+#define NGX_IO_URING_INSTANCE  1
+#define NGX_IO_URING_AIO       2
+#define NGX_IO_URING_MASK      (NGX_IO_URING_INSTANCE|NGX_IO_URING_AIO)
+
+
+typedef struct {
+    ngx_uint_t  entries;
+} ngx_io_uring_conf_t;
+
+
+typedef struct {
+    uint32_t                *head;
+    uint32_t                *tail;
+    uint32_t                 mask;
+    uint32_t                 entries;
+    uint32_t                *flags;
+    uint32_t                *array;
+    struct io_uring_sqe     *sqes;
+    uint32_t                 sqe_tail;
+    uint32_t                 sqe_submitted;
+} ngx_io_uring_sq_t;
+
+
+typedef struct {
+    uint32_t                *head;
+    uint32_t                *tail;
+    uint32_t                 mask;
+    uint32_t                 entries;
+    struct io_uring_cqe     *cqes;
+} ngx_io_uring_cq_t;
+
+
+static ngx_int_t ngx_io_uring_init(ngx_cycle_t *cycle, ngx_msec_t timer);
+static ngx_int_t ngx_io_uring_setup(ngx_cycle_t *cycle,
+    ngx_io_uring_conf_t *urcf);
+static ngx_int_t ngx_io_uring_test_poll(ngx_cycle_t *cycle);
+static ngx_int_t ngx_io_uring_notify_init(ngx_log_t *log);
+static void ngx_io_uring_notify_handler(ngx_event_t *ev);
+static void ngx_io_uring_done(ngx_cycle_t *cycle);
+static ngx_int_t ngx_io_uring_add_event(ngx_event_t *ev, ngx_int_t event,
+    ngx_uint_t flags);
+static ngx_int_t ngx_io_uring_del_event(ngx_event_t *ev, ngx_int_t event,
+    ngx_uint_t flags);
+static ngx_int_t ngx_io_uring_add_connection(ngx_connection_t *c);
+static ngx_int_t ngx_io_uring_del_connection(ngx_connection_t *c,
+    ngx_uint_t flags);
+static ngx_int_t ngx_io_uring_notify(ngx_event_handler_pt handler);
+static ngx_int_t ngx_io_uring_process_events(ngx_cycle_t *cycle,
+    ngx_msec_t timer, ngx_uint_t flags);
+
+static struct io_uring_sqe *ngx_io_uring_get_sqe(ngx_log_t *log);
+static ngx_int_t ngx_io_uring_submit(ngx_log_t *log);
+static ngx_int_t ngx_io_uring_poll_add(ngx_event_t *ev, ngx_socket_t fd,
+    uint32_t events, ngx_uint_t multishot);
+static ngx_int_t ngx_io_uring_poll_remove(ngx_event_t *ev);
+static int ngx_io_uring_enter(u_int to_submit, u_int min_complete,
+    u_int flags, struct io_uring_getevents_arg *arg);
+
+static void *ngx_io_uring_create_conf(ngx_cycle_t *cycle);
+static char *ngx_io_uring_init_conf(ngx_cycle_t *cycle, void *conf);
+
+
+static int                  ring = -1;
+static void                *sq_ring_ptr;
+static size_t               sq_ring_size;
+static void                *cq_ring_ptr;
+static size_t               cq_ring_size;
+static size_t               sqes_size;
+#if (NGX_HAVE_IO_URING_CQE_SKIP)
+static ngx_uint_t           skip_remove_cqe;
+#endif
+static ngx_io_uring_sq_t    sq;
+static ngx_io_uring_cq_t    cq;
+
+static int                  notify_fd = -1;
+static ngx_event_t          notify_event;
+static ngx_connection_t     notify_conn;
+
+#if (NGX_HAVE_FILE_AIO)
+ngx_uint_t                  ngx_io_uring_aio;
+#endif
+
+
+static ngx_str_t      io_uring_name = ngx_string("io_uring");
+
+static ngx_command_t  ngx_io_uring_commands[] = {
+
+    { ngx_string("io_uring_entries"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      0,
+      offsetof(ngx_io_uring_conf_t, entries),
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_event_module_t  ngx_io_uring_module_ctx = {
+    &io_uring_name,
+    ngx_io_uring_create_conf,            /* create configuration */
+    ngx_io_uring_init_conf,              /* init configuration */
+
+    {
+        ngx_io_uring_add_event,          /* add an event */
+        ngx_io_uring_del_event,          /* delete an event */
+        ngx_io_uring_add_event,          /* enable an event */
+        ngx_io_uring_del_event,          /* disable an event */
+        ngx_io_uring_add_connection,     /* add an connection */
+        ngx_io_uring_del_connection,     /* delete an connection */
+        ngx_io_uring_notify,             /* trigger a notify */
+        ngx_io_uring_process_events,     /* process the events */
+        ngx_io_uring_init,               /* init the events */
+        ngx_io_uring_done,               /* done the events */
+    }
+};
+
+ngx_module_t  ngx_io_uring_module = {
+    NGX_MODULE_V1,
+    &ngx_io_uring_module_ctx,            /* module context */
+    ngx_io_uring_commands,               /* module directives */
+    NGX_EVENT_MODULE,                    /* module type */
+    NULL,                                /* init master */
+    NULL,                                /* init module */
+    NULL,                                /* init process */
+    NULL,                                /* init thread */
+    NULL,                                /* exit thread */
+    NULL,                                /* exit process */
+    NULL,                                /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+/*
+ * We call io_uring_setup() and io_uring_enter() directly as syscalls
+ * instead of liburing usage to avoid an external dependency.
+ */
+
+static int
+io_uring_setup(u_int entries, struct io_uring_params *p)
+{
+    return syscall(SYS_io_uring_setup, entries, p);
+}
+
+
+static int
+ngx_io_uring_enter(u_int to_submit, u_int min_complete, u_int flags,
+    struct io_uring_getevents_arg *arg)
+{
+    return syscall(SYS_io_uring_enter, ring, to_submit, min_complete,
+                   flags | IORING_ENTER_EXT_ARG, arg,
+                   sizeof(struct io_uring_getevents_arg));
+}
+
+
+static ngx_int_t
+ngx_io_uring_init(ngx_cycle_t *cycle, ngx_msec_t timer)
+{
+    ngx_io_uring_conf_t  *urcf;
+
+    urcf = ngx_event_get_conf(cycle->conf_ctx, ngx_io_uring_module);
+
+    if (ring == -1) {
+        if (ngx_io_uring_setup(cycle, urcf) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        if (ngx_io_uring_test_poll(cycle) != NGX_OK) {
+            ngx_io_uring_done(cycle);
+            return NGX_ERROR;
+        }
+
+        if (ngx_io_uring_notify_init(cycle->log) != NGX_OK) {
+            ngx_io_uring_module_ctx.actions.notify = NULL;
+        }
+
+#if (NGX_HAVE_FILE_AIO)
+        ngx_io_uring_aio = 1;
+#endif
+    }
+
+    ngx_io = ngx_os_io;
+
+    ngx_event_actions = ngx_io_uring_module_ctx.actions;
+
+    ngx_event_flags = NGX_USE_CLEAR_EVENT
+                      |NGX_USE_GREEDY_EVENT
+                      |NGX_USE_EPOLL_EVENT
+                      |NGX_USE_STALE_EVENT;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_setup(ngx_cycle_t *cycle, ngx_io_uring_conf_t *urcf)
+{
+    u_char                  *p;
+    uint32_t                 i;
+    struct io_uring_params   params;
+
+    ngx_memzero(&params, sizeof(struct io_uring_params));
+
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = urcf->entries * 4;
+
+    ring = io_uring_setup(urcf->entries, &params);
+
+    if (ring == -1) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                      "io_uring_setup(%ui) failed", urcf->entries);
+        return NGX_ERROR;
+    }
+
+    /*
+     * IORING_FEAT_EXT_ARG appeared in Linux 5.11, it is required
+     * to pass the event loop timeout to io_uring_enter() directly
+     */
+
+    if ((params.features & IORING_FEAT_EXT_ARG) == 0
+        || (params.features & IORING_FEAT_NODROP) == 0)
+    {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, 0,
+                      "io_uring is not supported on this kernel, "
+                      "use Linux 5.13 or newer");
+        goto failed;
+    }
+
+#if (NGX_HAVE_IO_URING_CQE_SKIP)
+    skip_remove_cqe = (params.features & IORING_FEAT_CQE_SKIP) ? 1 : 0;
+#endif
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size = params.cq_off.cqes
+                   + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size = ngx_max(sq_ring_size, cq_ring_size);
+        cq_ring_size = 0;
+    }
+
+    sq_ring_ptr = mmap(NULL, sq_ring_size, PROT_READ|PROT_WRITE,
+                       MAP_SHARED|MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+
+    if (sq_ring_ptr == MAP_FAILED) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                      "mmap(IORING_OFF_SQ_RING, %uz) failed", sq_ring_size);
+        sq_ring_ptr = NULL;
+        goto failed;
+    }
+
+    if (cq_ring_size) {
+        cq_ring_ptr = mmap(NULL, cq_ring_size, PROT_READ|PROT_WRITE,
+                           MAP_SHARED|MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+
+        if (cq_ring_ptr == MAP_FAILED) {
+            ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                          "mmap(IORING_OFF_CQ_RING, %uz) failed",
+                          cq_ring_size);
+            cq_ring_ptr = NULL;
+            goto failed;
+        }
+
+    } else {
+        cq_ring_ptr = sq_ring_ptr;
+    }
+
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    sq.sqes = mmap(NULL, sqes_size, PROT_READ|PROT_WRITE,
+                   MAP_SHARED|MAP_POPULATE, ring, IORING_OFF_SQES);
+
+    if (sq.sqes == MAP_FAILED) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                      "mmap(IORING_OFF_SQES, %uz) failed", sqes_size);
+        sq.sqes = NULL;
+        goto failed;
+    }
+
+    p = sq_ring_ptr;
+
+    sq.head = (uint32_t *) (p + params.sq_off.head);
+    sq.tail = (uint32_t *) (p + params.sq_off.tail);
+    sq.mask = *(uint32_t *) (p + params.sq_off.ring_mask);
+    sq.entries = *(uint32_t *) (p + params.sq_off.ring_entries);
+    sq.flags = (uint32_t *) (p + params.sq_off.flags);
+    sq.array = (uint32_t *) (p + params.sq_off.array);
+
+    /* the SQE array is used as a ring, so the indirection is fixed */
+
+    for (i = 0; i < sq.entries; i++) {
+        sq.array[i] = i;
+    }
+
+    sq.sqe_tail = *sq.tail;
+    sq.sqe_submitted = sq.sqe_tail;
+
+    p = cq_ring_ptr;
+
+    cq.head = (uint32_t *) (p + params.cq_off.head);
+    cq.tail = (uint32_t *) (p + params.cq_off.tail);
+    cq.mask = *(uint32_t *) (p + params.cq_off.ring_mask);
+    cq.entries = *(uint32_t *) (p + params.cq_off.ring_entries);
+    cq.cqes = (struct io_uring_cqe *) (p + params.cq_off.cqes);
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "io_uring: fd:%d sq:%uD cq:%uD",
+                   ring, sq.entries, cq.entries);
+
+    return NGX_OK;
+
+failed:
+
+    ngx_io_uring_done(cycle);
+
+    return NGX_ERROR;
+}
+
+
+/*
+ * Multishot poll requests appeared in Linux 5.13, the test also checks
+ * that EPOLLRDHUP is reported as the epoll module does
+ */
+
+static ngx_int_t
+ngx_io_uring_test_poll(ngx_cycle_t *cycle)
+{
+    int                            s[2], n;
+    uint32_t                       head;
+    ngx_int_t                      rc;
+    struct __kernel_timespec       ts;
+    struct io_uring_cqe           *cqe;
+    struct io_uring_getevents_arg  arg;
+
+    static ngx_event_t             ev;
+    static ngx_connection_t        c;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, s) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "socketpair() failed");
+        return NGX_ERROR;
+    }
+
+    rc = NGX_ERROR;
+
+    c.fd = (ngx_socket_t) -1;
+    ev.data = &c;
+    ev.log = cycle->log;
+
+    if (ngx_io_uring_poll_add(&ev, s[0], EPOLLIN|EPOLLRDHUP|EPOLLET, 1)
+        != NGX_OK)
+    {
+        goto failed;
+    }
+
+    if (close(s[1]) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "close() failed");
+    }
+
+    s[1] = -1;
+
+    ngx_memzero(&arg, sizeof(struct io_uring_getevents_arg));
+
+    ts.tv_sec = 5;
+    ts.tv_nsec = 0;
+    arg.ts = (uint64_t) (uintptr_t) &ts;
+
+    ngx_memory_barrier();
+    *sq.tail = sq.sqe_tail;
+
+    n = ngx_io_uring_enter(sq.sqe_tail - sq.sqe_submitted, 1,
+                           IORING_ENTER_GETEVENTS, &arg);
+
+    if (n == -1) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                      "io_uring_enter() failed");
+        goto failed;
+    }
+
+    sq.sqe_submitted += n;
+
+    head = *cq.head;
+    ngx_memory_barrier();
+
+    if (head == *cq.tail) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, NGX_ETIMEDOUT,
+                      "io_uring poll test timed out");
+        goto failed;
+    }
+
+    cqe = &cq.cqes[head & cq.mask];
+
+    if (cqe->res < 0 || (cqe->flags & IORING_CQE_F_MORE) == 0) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, 0,
+                      "io_uring multishot poll is not supported "
+                      "on this kernel, use Linux 5.13 or newer");
+        goto failed;
+    }
+
+#if (NGX_HAVE_EPOLLRDHUP)
+    ngx_use_epoll_rdhup = cqe->res & EPOLLRDHUP;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "testing the EPOLLRDHUP flag: %s",
+                   ngx_use_epoll_rdhup ? "success" : "fail");
+#endif
+
+    ngx_memory_barrier();
+    *cq.head = head + 1;
+
+    /* the cancellation of the test poll is ignored as a stale event */
+
+    rc = ngx_io_uring_poll_remove(&ev);
+
+failed:
+
+    if (s[1] != -1 && close(s[1]) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "close() failed");
+    }
+
+    if (close(s[0]) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "close() failed");
+    }
+
+    return rc;
+}
+
+
+static ngx_int_t
+ngx_io_uring_notify_init(ngx_log_t *log)
+{
+    notify_fd = eventfd(0, 0);
+
+    if (notify_fd == -1) {
+        ngx_log_error(NGX_LOG_EMERG, log, ngx_errno, "eventfd() failed");
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "notify eventfd: %d", notify_fd);
+
+    notify_event.handler = ngx_io_uring_notify_handler;
+    notify_event.log = log;
+
+    notify_conn.fd = notify_fd;
+    notify_conn.read = &notify_event;
+    notify_conn.log = log;
+
+    if (ngx_io_uring_poll_add(&notify_event, notify_fd, EPOLLIN|EPOLLET, 1)
+        != NGX_OK)
+    {
+
+        if (close(notify_fd) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          "eventfd close() failed");
+        }
+
+        notify_fd = -1;
+
+        return NGX_ERROR;
+    }
+
+    notify_event.active = 1;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_io_uring_notify_handler(ngx_event_t *ev)
+{
+    ssize_t               n;
+    uint64_t              count;
+    ngx_err_t             err;
+    ngx_event_handler_pt  handler;
+
+    if (++ev->index == NGX_MAX_UINT32_VALUE) {
+        ev->index = 0;
+
+        n = read(notify_fd, &count, sizeof(uint64_t));
+
+        err = ngx_errno;
+
+        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                       "read() eventfd %d: %z count:%uL", notify_fd, n, count);
+
+        if ((size_t) n != sizeof(uint64_t)) {
+            ngx_log_error(NGX_LOG_ALERT, ev->log, err,
+                          "read() eventfd %d failed", notify_fd);
+        }
+    }
+
+    handler = ev->data;
+    handler(ev);
+}
+
+
+static void
+ngx_io_uring_done(ngx_cycle_t *cycle)
+{
+    if (sq.sqes) {
+        if (munmap(sq.sqes, sqes_size) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "munmap(IORING_OFF_SQES) failed");
+        }
+    }
+
+    if (cq_ring_ptr && cq_ring_ptr != sq_ring_ptr) {
+        if (munmap(cq_ring_ptr, cq_ring_size) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "munmap(IORING_OFF_CQ_RING) failed");
+        }
+    }
+
+    if (sq_ring_ptr) {
+        if (munmap(sq_ring_ptr, sq_ring_size) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "munmap(IORING_OFF_SQ_RING) failed");
+        }
+    }
+
+    ngx_memzero(&sq, sizeof(ngx_io_uring_sq_t));
+    ngx_memzero(&cq, sizeof(ngx_io_uring_cq_t));
+
+    sq_ring_ptr = NULL;
+    cq_ring_ptr = NULL;
+
+    if (ring != -1 && close(ring) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "io_uring close() failed");
+    }
+
+    ring = -1;
+
+    if (notify_fd != -1 && close(notify_fd) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "eventfd close() failed");
+    }
+
+    notify_fd = -1;
+
+#if (NGX_HAVE_FILE_AIO)
+    ngx_io_uring_aio = 0;
+#endif
+}
+
+
+static struct io_uring_sqe *
+ngx_io_uring_get_sqe(ngx_log_t *log)
+{
+    struct io_uring_sqe  *sqe;
+
+    if (sq.sqe_tail - *sq.head >= sq.entries) {
+
+        /* the submission ring is full, flush it without waiting */
+
+        if (ngx_io_uring_submit(log) != NGX_OK) {
+            return NULL;
+        }
+
+        if (sq.sqe_tail - *sq.head >= sq.entries) {
+            ngx_log_error(NGX_LOG_ALERT, log, 0,
+                          "io_uring submission queue overflow");
+            return NULL;
+        }
+    }
+
+    sqe = &sq.sqes[sq.sqe_tail & sq.mask];
+    sq.sqe_tail++;
+
+    ngx_memzero(sqe, sizeof(struct io_uring_sqe));
+
+    return sqe;
+}
+
+
+static ngx_int_t
+ngx_io_uring_submit(ngx_log_t *log)
+{
+    int  n;
+
+    ngx_memory_barrier();
+    *sq.tail = sq.sqe_tail;
+
+    n = syscall(SYS_io_uring_enter, ring, sq.sqe_tail - sq.sqe_submitted,
+                0, 0, NULL, 0);
+
+    if (n == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      "io_uring_enter() failed");
+        return NGX_ERROR;
+    }
+
+    sq.sqe_submitted += n;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_poll_add(ngx_event_t *ev, ngx_socket_t fd, uint32_t events,
+    ngx_uint_t multishot)
+{
+    struct io_uring_sqe  *sqe;
+
+    sqe = ngx_io_uring_get_sqe(ev->log);
+    if (sqe == NULL) {
+        return NGX_ERROR;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+#if (NGX_HAVE_LITTLE_ENDIAN)
+    sqe->poll32_events = events;
+#else
+    sqe->poll32_events = (events << 16) | (events >> 16);
+#endif
+    sqe->user_data = (uint64_t) ((uintptr_t) ev | ev->instance);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_poll_remove(ngx_event_t *ev)
+{
+    struct io_uring_sqe  *sqe;
+
+    sqe = ngx_io_uring_get_sqe(ev->log);
+    if (sqe == NULL) {
+        return NGX_ERROR;
+    }
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->addr = (uint64_t) ((uintptr_t) ev | ev->instance);
+
+#if (NGX_HAVE_IO_URING_CQE_SKIP)
+    if (skip_remove_cqe) {
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    }
+#endif
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_add_event(ngx_event_t *ev, ngx_int_t event, ngx_uint_t flags)
+{
+    uint32_t           events;
+    ngx_connection_t  *c;
+
+    c = ev->data;
+
+    if (ev->active) {
+        return NGX_OK;
+    }
+
+    events = (event == NGX_READ_EVENT) ? EPOLLIN|EPOLLRDHUP : EPOLLOUT;
+
+    /*
+     * the edge triggered events are multishot polls, the level triggered
+     * ones are oneshot polls rearmed after each notification
+     */
+
+    ev->oneshot = (flags & NGX_CLEAR_EVENT) ? 0 : 1;
+
+    if (!ev->oneshot) {
+        events |= EPOLLET;
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "io_uring add event: fd:%d ev:%08XD mode:%s",
+                   c->fd, events, ev->oneshot ? "level" : "multishot");
+
+    if (ngx_io_uring_poll_add(ev, c->fd, events, !ev->oneshot) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    ev->active = 1;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_del_event(ngx_event_t *ev, ngx_int_t event, ngx_uint_t flags)
+{
+    /*
+     * unlike epoll, a poll request holds a reference to the file,
+     * so it has to be removed explicitly even if the descriptor
+     * is going to be closed; the removal is submitted at once then,
+     * as the descriptor number may be reused before the next
+     * io_uring_enter() call
+     */
+
+    if (!ev->active) {
+        return NGX_OK;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "io_uring del event: %p fd:%d",
+                   ev, ((ngx_connection_t *) ev->data)->fd);
+
+    ev->active = 0;
+
+    if (ngx_io_uring_poll_remove(ev) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (flags & NGX_CLOSE_EVENT) {
+        return ngx_io_uring_submit(ev->log);
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_add_connection(ngx_connection_t *c)
+{
+    if (ngx_io_uring_add_event(c->read, NGX_READ_EVENT, NGX_CLEAR_EVENT)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    return ngx_io_uring_add_event(c->write, NGX_WRITE_EVENT, NGX_CLEAR_EVENT);
+}
+
+
+static ngx_int_t
+ngx_io_uring_del_connection(ngx_connection_t *c, ngx_uint_t flags)
+{
+    /* both removals are submitted by one call */
+
+    if (ngx_io_uring_del_event(c->read, NGX_READ_EVENT,
+                               flags & ~NGX_CLOSE_EVENT)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    if (ngx_io_uring_del_event(c->write, NGX_WRITE_EVENT,
+                               flags & ~NGX_CLOSE_EVENT)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    if ((flags & NGX_CLOSE_EVENT) && sq.sqe_tail != sq.sqe_submitted) {
+        return ngx_io_uring_submit(c->log);
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_notify(ngx_event_handler_pt handler)
+{
+    static uint64_t inc = 1;
+
+    notify_event.data = handler;
+
+    if ((size_t) write(notify_fd, &inc, sizeof(uint64_t)) != sizeof(uint64_t)) {
+        ngx_log_error(NGX_LOG_ALERT, notify_event.log, ngx_errno,
+                      "write() to eventfd %d failed", notify_fd);
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+#if (NGX_HAVE_FILE_AIO)
+
+ngx_int_t
+ngx_io_uring_aio_read(ngx_event_aio_t *aio, u_char *buf, size_t size,
+    off_t offset)
+{
+    struct io_uring_sqe  *sqe;
+
+    sqe = ngx_io_uring_get_sqe(aio->event.log);
+    if (sqe == NULL) {
+        return NGX_ERROR;
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = aio->fd;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = (uint32_t) size;
+    sqe->off = (uint64_t) offset;
+    sqe->user_data = (uint64_t) ((uintptr_t) &aio->event | NGX_IO_URING_AIO);
+
+    return NGX_OK;
+}
+
+#endif
+
+
+static ngx_int_t
+ngx_io_uring_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
+    ngx_uint_t flags)
+{
+    int                             n;
+    int32_t                         res;
+    uint32_t                        head, tail, revents, cflags;
+    ngx_int_t                       instance;
+    ngx_uint_t                      level, events;
+    ngx_err_t                       err;
+    ngx_event_t                    *ev;
+    ngx_queue_t                    *queue;
+    ngx_connection_t               *c;
+    struct __kernel_timespec        ts;
+    struct io_uring_cqe            *cqe;
+    struct io_uring_getevents_arg   arg;
+#if (NGX_HAVE_FILE_AIO)
+    ngx_event_aio_t                *aio;
+#endif
+
+    /* NGX_TIMER_INFINITE == INFTIM */
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "io_uring timer: %M, submit: %uD",
+                   timer, sq.sqe_tail - sq.sqe_submitted);
+
+    ngx_memzero(&arg, sizeof(struct io_uring_getevents_arg));
+
+    if (timer != NGX_TIMER_INFINITE) {
+        ts.tv_sec = timer / 1000;
+        ts.tv_nsec = (timer % 1000) * 1000000;
+        arg.ts = (uint64_t) (uintptr_t) &ts;
+    }
+
+    ngx_memory_barrier();
+    *sq.tail = sq.sqe_tail;
+
+    n = ngx_io_uring_enter(sq.sqe_tail - sq.sqe_submitted, 1,
+                           IORING_ENTER_GETEVENTS, &arg);
+
+    err = (n == -1) ? ngx_errno : 0;
+
+    if (n > 0) {
+        sq.sqe_submitted += n;
+    }
+
+    if (flags & NGX_UPDATE_TIME || ngx_event_timer_alarm) {
+        ngx_time_update();
+    }
+
+    if (err && err != ETIME && err != NGX_EBUSY && err != NGX_EAGAIN) {
+
+        if (err == NGX_EINTR) {
+
+            if (ngx_event_timer_alarm) {
+                ngx_event_timer_alarm = 0;
+                return NGX_OK;
+            }
+
+            level = NGX_LOG_INFO;
+
+        } else {
+            level = NGX_LOG_ALERT;
+        }
+
+        ngx_log_error(level, cycle->log, err, "io_uring_enter() failed");
+        return NGX_ERROR;
+    }
+
+    head = *cq.head;
+    ngx_memory_barrier();
+    tail = *cq.tail;
+
+#if (NGX_STAT_STUB)
+    if (ngx_event_loop_stat) {
+        ngx_event_loop_wakeup(tail - head);
+    }
+#endif
+
+    if (head == tail) {
+        if (timer != NGX_TIMER_INFINITE) {
+            return NGX_OK;
+        }
+
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                      "io_uring_enter() returned no events without timeout");
+        return NGX_ERROR;
+    }
+
+    for (events = 0; head != tail; head++, events++) {
+        cqe = &cq.cqes[head & cq.mask];
+
+        res = cqe->res;
+        cflags = cqe->flags;
+
+        ev = (ngx_event_t *) (uintptr_t) (cqe->user_data & ~NGX_IO_URING_MASK);
+
+        if (ev == NULL) {
+            /* poll removal */
+            continue;
+        }
+
+#if (NGX_HAVE_FILE_AIO)
+
+        if (cqe->user_data & NGX_IO_URING_AIO) {
+
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "io_uring aio: %p res:%D", ev, res);
+
+            ev->complete = 1;
+            ev->active = 0;
+            ev->ready = 1;
+
+            aio = ev->data;
+            aio->res = res;
+
+            ngx_post_event(ev, &ngx_posted_events);
+
+            continue;
+        }
+
+#endif
+
+        instance = cqe->user_data & NGX_IO_URING_INSTANCE;
+
+        if (res == -NGX_ECANCELED) {
+            /* the poll request was removed */
+            continue;
+        }
+
+        if (ev == &notify_event) {
+
+            if ((cflags & IORING_CQE_F_MORE) == 0
+                && ngx_io_uring_poll_add(ev, notify_fd, EPOLLIN|EPOLLET, 1)
+                   != NGX_OK)
+            {
+                ev->active = 0;
+            }
+
+            ev->handler(ev);
+            continue;
+        }
+
+        c = ev->data;
+
+        if (c->fd == -1 || ev->instance != instance || !ev->active) {
+
+            /*
+             * the stale event from a file descriptor
+             * that was just closed in this iteration
+             */
+
+            ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "io_uring: stale event %p", c);
+            continue;
+        }
+
+        revents = (res < 0) ? EPOLLERR : (uint32_t) res;
+
+        ngx_log_debug4(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                       "io_uring: fd:%d ev:%04XD d:%p f:%uD",
+                       c->fd, revents, ev, cflags);
+
+        if ((cflags & IORING_CQE_F_MORE) == 0) {
+
+            /*
+             * a oneshot poll completed, or the kernel terminated
+             * a multishot one, for example, due to a memory shortage
+             */
+
+            if (res < 0
+                || ngx_io_uring_poll_add(ev, c->fd,
+                                         (ev->write ? EPOLLOUT
+                                                    : EPOLLIN|EPOLLRDHUP)
+                                         | (ev->oneshot ? 0 : EPOLLET),
+                                         !ev->oneshot)
+                   != NGX_OK)
+            {
+                ev->active = 0;
+            }
+        }
+
+        if (revents & (EPOLLERR|EPOLLHUP)) {
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "io_uring poll error on fd:%d ev:%04XD",
+                           c->fd, revents);
+
+            revents |= EPOLLIN|EPOLLOUT;
+        }
+
+        if (!ev->write) {
+
+            if ((revents & EPOLLIN) == 0) {
+                continue;
+            }
+
+            if (revents & EPOLLRDHUP) {
+                ev->pending_eof = 1;
+            }
+
+            ev->ready = 1;
+            ev->available = -1;
+
+            if (flags & NGX_POST_EVENTS) {
+                queue = ev->accept ? &ngx_posted_accept_events
+                                   : ngx_posted_event_queue(c);
+
+                ngx_post_event(ev, queue);
+
+            } else {
+                ev->handler(ev);
+            }
+
+            continue;
+        }
+
+        if ((revents & EPOLLOUT) == 0) {
+            continue;
+        }
+
+        ev->ready = 1;
+#if (NGX_THREADS)
+        ev->complete = 1;
+#endif
+
+        if (flags & NGX_POST_EVENTS) {
+            queue = ngx_posted_event_queue(c);
+            ngx_post_event(ev, queue);
+
+        } else {
+            ev->handler(ev);
+        }
+    }
+
+    ngx_memory_barrier();
+    *cq.head = head;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "io_uring events: %ui", events);
+
+    return NGX_OK;
+}
+
+
+static void *
+ngx_io_uring_create_conf(ngx_cycle_t *cycle)
+{
+    ngx_io_uring_conf_t  *urcf;
+
+    urcf = ngx_palloc(cycle->pool, sizeof(ngx_io_uring_conf_t));
+    if (urcf == NULL) {
+        return NULL;
+    }
+
+    urcf->entries = NGX_CONF_UNSET;
+
+    return urcf;
+}
+
+
+static char *
+ngx_io_uring_init_conf(ngx_cycle_t *cycle, void *conf)
+{
+    ngx_io_uring_conf_t *urcf = conf;
+
+    ngx_conf_init_uint_value(urcf->entries, 1024);
+
+    return NGX_CONF_OK;
+}
@@ -541,6 +541,12 @@ ngx_kqueue_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
         ngx_time_update();
     }
 
+#if (NGX_STAT_STUB)
+    if (ngx_event_loop_stat) {
+        ngx_event_loop_wakeup(events > 0 ? events : 0);
+    }
+#endif
+
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
                    "kevent events: %d", events);
 
@@ -267,6 +267,12 @@ ngx_poll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
         ngx_time_update();
     }
 
+#if (NGX_STAT_STUB)
+    if (ngx_event_loop_stat) {
+        ngx_event_loop_wakeup(ready > 0 ? ready : 0);
+    }
+#endif
+
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
                    "poll ready %d of %ui", ready, nevents);
 
@@ -373,7 +379,7 @@ ngx_poll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
             ev->available = -1;
 
             queue = ev->accept ? &ngx_posted_accept_events
-                               : &ngx_posted_events;
+                               : ngx_posted_event_queue(c);
 
             ngx_post_event(ev, queue);
         }
@@ -384,7 +390,8 @@ ngx_poll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
             ev = c->write;
             ev->ready = 1;
 
-            ngx_post_event(ev, &ngx_posted_events);
+            queue = ngx_posted_event_queue(c);
+            ngx_post_event(ev, queue);
         }
 
         if (found) {
@@ -268,6 +268,12 @@ ngx_select_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
         ngx_time_update();
     }
 
+#if (NGX_STAT_STUB)
+    if (ngx_event_loop_stat) {
+        ngx_event_loop_wakeup(ready > 0 ? ready : 0);
+    }
+#endif
+
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
                    "select ready %d", ready);
 
@@ -333,7 +339,7 @@ ngx_select_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
             ev->available = -1;
 
             queue = ev->accept ? &ngx_posted_accept_events
-                               : &ngx_posted_events;
+                               : ngx_posted_event_queue(c);
 
             ngx_post_event(ev, queue);
 
@@ -27,19 +27,40 @@ static char *ngx_events_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 
 static char *ngx_event_connections(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
+static char *ngx_event_connections_chunk(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 static char *ngx_event_use(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_event_posted_budget(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 static char *ngx_event_debug_connection(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 
 static void *ngx_event_core_create_conf(ngx_cycle_t *cycle);
 static char *ngx_event_core_init_conf(ngx_cycle_t *cycle, void *conf);
 
+#if (NGX_STAT_STUB)
+static ngx_uint_t ngx_event_loop_bucket(uint64_t value);
+#endif
+
+#if (NGX_HAVE_MAP_ANON)
+static void ngx_connections_idle_handler(ngx_event_t *ev);
+
+static ngx_event_t    ngx_connections_idle_event;
+static ngx_msec_t     ngx_connections_idle;
+#endif
+
 
 static ngx_uint_t     ngx_timer_resolution;
 sig_atomic_t          ngx_event_timer_alarm;
 
 static ngx_uint_t     ngx_event_max_module;
 
+/* the time budgets of the posted event classes, in microseconds */
+static ngx_uint_t     ngx_use_posted_budget;
+static uint64_t       ngx_posted_urgent_budget;
+static uint64_t       ngx_posted_budget;
+static uint64_t       ngx_posted_bulk_budget;
+
 ngx_uint_t            ngx_event_flags;
 ngx_event_actions_t   ngx_event_actions;
 
@@ -55,6 +76,10 @@ ngx_uint_t            ngx_accept_events;
 ngx_uint_t            ngx_accept_mutex_held;
 ngx_msec_t            ngx_accept_mutex_delay;
 ngx_int_t             ngx_accept_disabled;
+ngx_uint_t            ngx_use_accept_balance;
+
+ngx_accept_balance_t *ngx_accept_balance_loads;
+ngx_uint_t            ngx_accept_balance_n;
 
 
 #if (NGX_STAT_STUB)
@@ -74,6 +99,13 @@ ngx_atomic_t         *ngx_stat_writing = &ngx_stat_writing0;
 static ngx_atomic_t   ngx_stat_waiting0;
 ngx_atomic_t         *ngx_stat_waiting = &ngx_stat_waiting0;
 
+static ngx_event_loop_stat_t   ngx_event_loop_stats0;
+ngx_event_loop_stat_t         *ngx_event_loop_stats = &ngx_event_loop_stats0;
+ngx_uint_t                     ngx_event_loop_stats_n = 1;
+ngx_event_loop_stat_t         *ngx_event_loop_stat;
+
+static uint64_t                ngx_event_loop_woken;
+
 #endif
 
 
@@ -117,6 +149,11 @@ ngx_module_t  ngx_events_module = {
 static ngx_str_t  event_core_name = ngx_string("event_core");
 
 
+static ngx_conf_num_bounds_t  ngx_event_accept_batch_bounds = {
+    ngx_conf_check_num_bounds, 1, NGX_ACCEPT_BATCH_MAX
+};
+
+
 // 事件模块需要做的事情，以下内容按照顺序进行创建，简单的来说就是从 events 配置项中提取出响应的配置，然后进行相关内容的初始化
 /*
  * 例如:
@@ -137,6 +174,13 @@ static ngx_command_t  ngx_event_core_commands[] = {
       0,
       NULL },
 
+    { ngx_string("worker_connections_chunk"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE12,
+      ngx_event_connections_chunk,
+      0,
+      0,
+      NULL },
+
     // 确定哪个事件驱动模块作为事件驱动机制，Linux 上一般为 epoll
     { ngx_string("use"),
       NGX_EVENT_CONF|NGX_CONF_TAKE1,
@@ -155,6 +199,13 @@ static ngx_command_t  ngx_event_core_commands[] = {
       NULL },
 
 
+    { ngx_string("accept_batch"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      0,
+      offsetof(ngx_event_conf_t, accept_batch),
+      &ngx_event_accept_batch_bounds },
+
     /*
      * nginx 惊群现象的解决方式。由于 nginx 是一个 master-worker 模型，master 进行作为管理者不进行 accept()，所以会有多个 worker 进行
      * 在同一个端口上进行 accept()，那么假如有新的连接建立时，很可能会出现所有的 worker 都去争抢这个新的连接。
@@ -179,6 +230,13 @@ static ngx_command_t  ngx_event_core_commands[] = {
       offsetof(ngx_event_conf_t, accept_mutex),
       NULL },
 
+    { ngx_string("accept_balance"),
+      NGX_EVENT_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      0,
+      offsetof(ngx_event_conf_t, accept_balance),
+      NULL },
+
     // 当启用了 accept_mutex 以后，延迟 accept_mutex_delay 毫秒后再试图处理新的连接
     { ngx_string("accept_mutex_delay"),
       NGX_EVENT_CONF|NGX_CONF_TAKE1,
@@ -187,6 +245,27 @@ static ngx_command_t  ngx_event_core_commands[] = {
       offsetof(ngx_event_conf_t, accept_mutex_delay),
       NULL },
 
+    { ngx_string("posted_budget"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE13,
+      ngx_event_posted_budget,
+      0,
+      0,
+      NULL },
+
+    { ngx_string("timer_wheel"),
+      NGX_EVENT_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      0,
+      offsetof(ngx_event_conf_t, timer_wheel),
+      NULL },
+
+    { ngx_string("loop_stats"),
+      NGX_EVENT_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      0,
+      offsetof(ngx_event_conf_t, loop_stats),
+      NULL },
+
     { ngx_string("debug_connection"),
       NGX_EVENT_CONF|NGX_CONF_TAKE1,
       ngx_event_debug_connection,
@@ -226,8 +305,12 @@ ngx_module_t  ngx_event_core_module = {
 void
 ngx_process_events_and_timers(ngx_cycle_t *cycle)
 {
-    ngx_uint_t  flags;
-    ngx_msec_t  timer, delta;
+    ngx_uint_t              flags;
+    ngx_msec_t              timer, delta;
+#if (NGX_STAT_STUB)
+    uint64_t                posted, timers, now, end;
+    ngx_event_loop_stat_t  *stat;
+#endif
 
     if (ngx_timer_resolution) {
         timer = NGX_TIMER_INFINITE;
@@ -270,11 +353,54 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
         }
     }
 
+    if (ngx_use_accept_balance) {
+        if (ngx_accept_balance(cycle) == NGX_ERROR) {
+            return;
+        }
+
+        /* publish the load and recheck the balance periodically */
+
+        if (timer == NGX_TIMER_INFINITE || timer > ngx_accept_mutex_delay) {
+            timer = ngx_accept_mutex_delay;
+        }
+    }
+
+    if (ngx_use_posted_budget) {
+
+        /* all events are posted to be processed by priority classes */
+
+        flags |= NGX_POST_EVENTS;
+    }
+
     if (!ngx_queue_empty(&ngx_posted_next_events)) {
         ngx_event_move_posted_next(cycle);
         timer = 0;
     }
 
+    if (!ngx_queue_empty(&ngx_posted_urgent_events)
+        || !ngx_queue_empty(&ngx_posted_events)
+        || !ngx_queue_empty(&ngx_posted_bulk_events))
+    {
+        /* the events left over by the budgets */
+        timer = 0;
+    }
+
+#if (NGX_STAT_STUB)
+
+    stat = ngx_event_loop_stat;
+
+    if (stat && stat->pid != (ngx_atomic_uint_t) ngx_pid) {
+        /* a new worker with the same number took the slot over on reload */
+        ngx_event_loop_stat = NULL;
+        stat = NULL;
+    }
+
+    if (stat) {
+        ngx_event_loop_woken = 0;
+    }
+
+#endif
+
     delta = ngx_current_msec;
 
     (void) ngx_process_events(cycle, timer, flags);
@@ -284,17 +410,130 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
                    "timer delta: %M", delta);
 
+#if (NGX_STAT_STUB)
+
+    if (stat) {
+        posted = ngx_event_loop_usec();
+
+        if (ngx_event_loop_woken == 0) {
+            /* the event method does not report wakeups */
+            ngx_event_loop_woken = posted;
+        }
+    }
+
+#endif
+
     ngx_event_process_posted(cycle, &ngx_posted_accept_events);
 
     if (ngx_accept_mutex_held) {
         ngx_shmtx_unlock(&ngx_accept_mutex);
     }
 
+#if (NGX_STAT_STUB)
+
+    if (stat) {
+        timers = ngx_event_loop_usec();
+        posted = timers - posted;
+    }
+
+#endif
+
     ngx_event_expire_timers();
 
-    ngx_event_process_posted(cycle, &ngx_posted_events);
+#if (NGX_STAT_STUB)
+
+    if (stat) {
+        now = ngx_event_loop_usec();
+        timers = now - timers;
+    }
+
+#endif
+
+    ngx_event_process_posted_budget(cycle, &ngx_posted_urgent_events,
+                                    ngx_posted_urgent_budget);
+    ngx_event_process_posted_budget(cycle, &ngx_posted_events,
+                                    ngx_posted_budget);
+    ngx_event_process_posted_budget(cycle, &ngx_posted_bulk_events,
+                                    ngx_posted_bulk_budget);
+
+#if (NGX_STAT_STUB)
+
+    if (stat) {
+        end = ngx_event_loop_usec();
+        posted += end - now;
+
+        stat->loops++;
+        stat->loop[ngx_event_loop_bucket(end - ngx_event_loop_woken)]++;
+        stat->posted[ngx_event_loop_bucket(posted)]++;
+        stat->timers[ngx_event_loop_bucket(timers)]++;
+    }
+
+#endif
+}
+
+
+uint64_t
+ngx_event_loop_usec(void)
+{
+#if (NGX_HAVE_CLOCK_MONOTONIC)
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    struct timeval   tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+
+#if (NGX_STAT_STUB)
+
+void
+ngx_event_loop_wakeup(ngx_uint_t events)
+{
+    ngx_event_loop_woken = ngx_event_loop_usec();
+    ngx_event_loop_stat->events[ngx_event_loop_bucket(events)]++;
+}
+
+
+static ngx_uint_t
+ngx_event_loop_bucket(uint64_t value)
+{
+    ngx_uint_t  n;
+
+    for (n = 0; value && n < NGX_EVENT_LOOP_BUCKETS - 1; n++) {
+        value >>= 1;
+    }
+
+    return n;
 }
 
+#endif
+
+
+#if (NGX_HAVE_MAP_ANON)
+
+static void
+ngx_connections_idle_handler(ngx_event_t *ev)
+{
+    ngx_cycle_t  *cycle;
+
+    cycle = ev->data;
+
+    /* at most one chunk is returned per idle period */
+
+    ngx_shrink_connections(cycle);
+
+    ngx_add_timer(ev, ngx_connections_idle);
+}
+
+#endif
+
 
 ngx_int_t
 ngx_handle_read_event(ngx_event_t *rev, ngx_uint_t flags)
@@ -573,8 +812,20 @@ ngx_event_module_init(ngx_cycle_t *cycle)
            + cl          /* ngx_stat_writing */
            + cl;         /* ngx_stat_waiting */
 
+    /*
+     * the zone is not reallocated on reload, so the event loop statistics
+     * of workers above the initial number of workers are not collected
+     */
+
+    size += ccf->worker_processes * sizeof(ngx_event_loop_stat_t);
+
 #endif
 
+    /* the accept balancing loads, at the end of the zone */
+
+    size = ngx_align(size, cl)
+           + ccf->worker_processes * sizeof(ngx_accept_balance_t);
+
     shm.size = size;
     ngx_str_set(&shm.name, "nginx_shared_zone");
     shm.log = cycle->log;
@@ -605,6 +856,11 @@ ngx_event_module_init(ngx_cycle_t *cycle)
 
     ngx_temp_number = (ngx_atomic_t *) (shared + 2 * cl);
 
+    ngx_accept_balance_loads = (ngx_accept_balance_t *)
+                                 (shared + size - ccf->worker_processes
+                                               * sizeof(ngx_accept_balance_t));
+    ngx_accept_balance_n = ccf->worker_processes;
+
     tp = ngx_timeofday();
 
     ngx_random_number = (tp->msec << 16) + ngx_pid;
@@ -619,6 +875,9 @@ ngx_event_module_init(ngx_cycle_t *cycle)
     ngx_stat_writing = (ngx_atomic_t *) (shared + 8 * cl);
     ngx_stat_waiting = (ngx_atomic_t *) (shared + 9 * cl);
 
+    ngx_event_loop_stats = (ngx_event_loop_stat_t *) (shared + 10 * cl);
+    ngx_event_loop_stats_n = ccf->worker_processes;
+
 #endif
 
     return NGX_OK;
@@ -643,10 +902,11 @@ ngx_timer_signal_handler(int signo)
 static ngx_int_t
 ngx_event_process_init(ngx_cycle_t *cycle)
 {
+    size_t               size;
     ngx_uint_t           m, i;
-    ngx_event_t         *rev, *wev;
+    ngx_event_t         *rev;
     ngx_listening_t     *ls;
-    ngx_connection_t    *c, *next, *old;
+    ngx_connection_t    *c, *old;
     ngx_core_conf_t     *ccf;
     ngx_event_conf_t    *ecf;
     ngx_event_module_t  *module;
@@ -663,6 +923,16 @@ ngx_event_process_init(ngx_cycle_t *cycle)
         ngx_use_accept_mutex = 0;
     }
 
+    if (ccf->master && ccf->worker_processes > 1 && ecf->accept_balance
+        && !ngx_use_accept_mutex && ngx_worker < ngx_accept_balance_n)
+    {
+        ngx_use_accept_balance = 1;
+        ngx_accept_mutex_delay = ecf->accept_mutex_delay;
+
+    } else {
+        ngx_use_accept_balance = 0;
+    }
+
 #if (NGX_WIN32)
 
     /*
@@ -676,7 +946,43 @@ ngx_event_process_init(ngx_cycle_t *cycle)
 
     ngx_queue_init(&ngx_posted_accept_events);
     ngx_queue_init(&ngx_posted_next_events);
+    ngx_queue_init(&ngx_posted_urgent_events);
     ngx_queue_init(&ngx_posted_events);
+    ngx_queue_init(&ngx_posted_bulk_events);
+
+    ngx_posted_urgent_budget = (uint64_t) ecf->posted_budget[0] * 1000;
+    ngx_posted_budget = (uint64_t) ecf->posted_budget[1] * 1000;
+    ngx_posted_bulk_budget = (uint64_t) ecf->posted_budget[2] * 1000;
+
+    ngx_use_posted_budget = (ngx_posted_urgent_budget || ngx_posted_budget
+                             || ngx_posted_bulk_budget);
+
+    ngx_event_timer_wheel = ecf->timer_wheel;
+
+#if (NGX_STAT_STUB)
+
+    if (ecf->loop_stats && ngx_worker < ngx_event_loop_stats_n) {
+        ngx_event_loop_stat = &ngx_event_loop_stats[ngx_worker];
+
+        /*
+         * the slot is keyed by the pid: the worker of the previous
+         * generation stops updating it once it sees the new pid,
+         * then the counters are started anew
+         */
+
+        ngx_event_loop_stat->pid = ngx_pid;
+        ngx_memory_barrier();
+
+        ngx_memzero((u_char *) ngx_event_loop_stat
+                    + offsetof(ngx_event_loop_stat_t, loops),
+                    sizeof(ngx_event_loop_stat_t)
+                    - offsetof(ngx_event_loop_stat_t, loops));
+
+    } else {
+        ngx_event_loop_stat = NULL;
+    }
+
+#endif
 
     if (ngx_event_timer_init(cycle->log) == NGX_ERROR) {
         return NGX_ERROR;
@@ -757,53 +1063,71 @@ ngx_event_process_init(ngx_cycle_t *cycle)
 
 #endif
 
-    cycle->connections =
-        ngx_alloc(sizeof(ngx_connection_t) * cycle->connection_n, cycle->log);
-    if (cycle->connections == NULL) {
-        return NGX_ERROR;
-    }
+    size = sizeof(ngx_connection_slot_t) * cycle->connection_n;
 
-    c = cycle->connections;
+#if (NGX_HAVE_MAP_ANON)
 
-    cycle->read_events = ngx_alloc(sizeof(ngx_event_t) * cycle->connection_n,
-                                   cycle->log);
-    if (cycle->read_events == NULL) {
-        return NGX_ERROR;
-    }
+    if (ecf->connections_chunk) {
 
-    rev = cycle->read_events;
-    for (i = 0; i < cycle->connection_n; i++) {
-        rev[i].closed = 1;
-        rev[i].instance = 1;
-    }
+        /*
+         * the address space for all connections is reserved at once,
+         * the pages are only touched when the pool grows by a chunk
+         */
 
-    cycle->write_events = ngx_alloc(sizeof(ngx_event_t) * cycle->connection_n,
-                                    cycle->log);
-    if (cycle->write_events == NULL) {
-        return NGX_ERROR;
-    }
+        cycle->connections = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                                  MAP_ANON|MAP_PRIVATE, -1, 0);
 
-    wev = cycle->write_events;
-    for (i = 0; i < cycle->connection_n; i++) {
-        wev[i].closed = 1;
-    }
+        if (cycle->connections == MAP_FAILED) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "mmap(MAP_ANON|MAP_PRIVATE, %uz) failed", size);
+            return NGX_ERROR;
+        }
+
+        cycle->connection_chunk = ecf->connections_chunk;
+
+        ngx_connections_idle_event.handler = ngx_connections_idle_handler;
+        ngx_connections_idle_event.data = cycle;
+        ngx_connections_idle_event.log = cycle->log;
+        ngx_connections_idle_event.cancelable = 1;
+
+        ngx_connections_idle = ecf->connections_idle;
 
-    i = cycle->connection_n;
-    next = NULL;
+        /*
+         * the pages of a released chunk are zeroed, while a stale event
+         * may still be reported for a connection there, so the chunks
+         * are only returned with the event methods that never do so
+         */
+
+        if (ngx_event_flags & NGX_USE_STALE_EVENT) {
+            ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0,
+                          "connection chunks are not returned to the system "
+                          "with the configured event method");
+
+        } else {
+            ngx_add_timer(&ngx_connections_idle_event, ngx_connections_idle);
+        }
 
-    do {
-        i--;
+    } else
+
+#endif
 
-        c[i].data = next;
-        c[i].read = &cycle->read_events[i];
-        c[i].write = &cycle->write_events[i];
-        c[i].fd = (ngx_socket_t) -1;
+    {
+        cycle->connections = ngx_memalign(NGX_CPU_CACHE_LINE, size,
+                                          cycle->log);
+        if (cycle->connections == NULL) {
+            return NGX_ERROR;
+        }
 
-        next = &c[i];
-    } while (i);
+        cycle->connection_chunk = cycle->connection_n;
+    }
 
-    cycle->free_connections = next;
+    cycle->free_connections = NULL;
     cycle->free_connection_n = cycle->connection_n;
+    cycle->alloc_connection_n = 0;
+
+    if (ngx_grow_connections(cycle) != NGX_OK) {
+        return NGX_ERROR;
+    }
 
     /* for each listening socket */
 
@@ -1081,6 +1405,98 @@ ngx_event_connections(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 }
 
 
+static char *
+ngx_event_connections_chunk(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+#if (NGX_HAVE_MAP_ANON)
+    ngx_event_conf_t  *ecf = conf;
+
+    ngx_str_t  *value, s;
+
+    if (ecf->connections_chunk != NGX_CONF_UNSET_UINT) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    ecf->connections_chunk = ngx_atoi(value[1].data, value[1].len);
+    if (ecf->connections_chunk == (ngx_uint_t) NGX_ERROR
+        || ecf->connections_chunk == 0)
+    {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid number \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    if (cf->args->nelts == 2) {
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strncmp(value[2].data, "idle=", 5) != 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[2]);
+        return NGX_CONF_ERROR;
+    }
+
+    s.len = value[2].len - 5;
+    s.data = value[2].data + 5;
+
+    ecf->connections_idle = ngx_parse_time(&s, 0);
+    if (ecf->connections_idle == (ngx_msec_t) NGX_ERROR
+        || ecf->connections_idle == 0)
+    {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid idle time \"%V\"", &value[2]);
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+
+#else
+
+    ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                       "\"worker_connections_chunk\" is not supported "
+                       "on this platform, ignored");
+
+    return NGX_CONF_OK;
+
+#endif
+}
+
+
+static char *
+ngx_event_posted_budget(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_event_conf_t  *ecf = conf;
+
+    ngx_str_t   *value;
+    ngx_uint_t   i, n;
+
+    if (ecf->posted_budget[0] != NGX_CONF_UNSET_MSEC) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    for (i = 0; i < 3; i++) {
+
+        /* a single value sets the budget of all classes */
+
+        n = (cf->args->nelts == 2) ? 1 : i + 1;
+
+        ecf->posted_budget[i] = ngx_parse_time(&value[n], 0);
+
+        if (ecf->posted_budget[i] == (ngx_msec_t) NGX_ERROR) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid value \"%V\"", &value[n]);
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    return NGX_CONF_OK;
+}
+
+
 static char *
 ngx_event_use(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -1259,10 +1675,19 @@ ngx_event_core_create_conf(ngx_cycle_t *cycle)
     }
 
     ecf->connections = NGX_CONF_UNSET_UINT;
+    ecf->connections_chunk = NGX_CONF_UNSET_UINT;
+    ecf->connections_idle = NGX_CONF_UNSET_MSEC;
+    ecf->posted_budget[0] = NGX_CONF_UNSET_MSEC;
+    ecf->posted_budget[1] = NGX_CONF_UNSET_MSEC;
+    ecf->posted_budget[2] = NGX_CONF_UNSET_MSEC;
     ecf->use = NGX_CONF_UNSET_UINT;
     ecf->multi_accept = NGX_CONF_UNSET;
+    ecf->accept_batch = NGX_CONF_UNSET_UINT;
     ecf->accept_mutex = NGX_CONF_UNSET;
+    ecf->accept_balance = NGX_CONF_UNSET;
     ecf->accept_mutex_delay = NGX_CONF_UNSET_MSEC;
+    ecf->timer_wheel = NGX_CONF_UNSET;
+    ecf->loop_stats = NGX_CONF_UNSET;
     ecf->name = (void *) NGX_CONF_UNSET;
 
 #if (NGX_DEBUG)
@@ -1354,14 +1779,24 @@ ngx_event_core_init_conf(ngx_cycle_t *cycle, void *conf)
     ngx_conf_init_uint_value(ecf->connections, DEFAULT_CONNECTIONS);
     cycle->connection_n = ecf->connections;
 
+    ngx_conf_init_uint_value(ecf->connections_chunk, 0);
+    ngx_conf_init_msec_value(ecf->connections_idle, 60000);
+
     ngx_conf_init_uint_value(ecf->use, module->ctx_index);
 
     event_module = module->ctx;
     ngx_conf_init_ptr_value(ecf->name, event_module->name->data);
 
     ngx_conf_init_value(ecf->multi_accept, 0);
+    ngx_conf_init_uint_value(ecf->accept_batch, 1);
     ngx_conf_init_value(ecf->accept_mutex, 0);
+    ngx_conf_init_value(ecf->accept_balance, 0);
     ngx_conf_init_msec_value(ecf->accept_mutex_delay, 500);
+    ngx_conf_init_msec_value(ecf->posted_budget[0], 0);
+    ngx_conf_init_msec_value(ecf->posted_budget[1], 0);
+    ngx_conf_init_msec_value(ecf->posted_budget[2], 0);
+    ngx_conf_init_value(ecf->timer_wheel, 0);
+    ngx_conf_init_value(ecf->loop_stats, 0);
 
     return NGX_CONF_OK;
 }
@@ -167,6 +167,27 @@ struct ngx_event_s {
 };
 
 
+/*
+ * a connection is allocated together with its read and write events,
+ * so handling an event touches adjacent cache lines only; the slots
+ * are rounded up to the cache line size and the array is aligned to it,
+ * so neighbour slots never share a line
+ */
+
+typedef struct {
+    ngx_connection_t    connection;
+    ngx_event_t         read;
+    ngx_event_t         write;
+} ngx_connection_events_t;
+
+
+union ngx_connection_slot_u {
+    ngx_connection_events_t  events;
+    u_char                   line[ngx_align(sizeof(ngx_connection_events_t),
+                                            NGX_CPU_CACHE_LINE)];
+};
+
+
 #if (NGX_HAVE_FILE_AIO)
 
 struct ngx_event_aio_s {
@@ -193,6 +214,16 @@ struct ngx_event_aio_s {
     ngx_event_t                event;
 };
 
+
+#if (NGX_HAVE_IO_URING)
+
+extern ngx_uint_t  ngx_io_uring_aio;
+
+ngx_int_t ngx_io_uring_aio_read(ngx_event_aio_t *aio, u_char *buf,
+    size_t size, off_t offset);
+
+#endif
+
 #endif
 
 /*
@@ -315,6 +346,12 @@ extern ngx_uint_t            ngx_use_epoll_rdhup;
  */
 #define NGX_USE_VNODE_EVENT      0x00002000
 
+/*
+ * The event filter may report an event of a connection after the connection
+ * is closed and freed, so its slot must stay readable: io_uring.
+ */
+#define NGX_USE_STALE_EVENT      0x00004000
+
 
 /*
  * The event filter is deleted just before the closing file.
@@ -476,13 +513,24 @@ extern ngx_os_io_t  ngx_io;
 
 typedef struct {
     ngx_uint_t    connections;
+    ngx_uint_t    connections_chunk;
+    ngx_msec_t    connections_idle;
     ngx_uint_t    use;
 
     ngx_flag_t    multi_accept;
     ngx_flag_t    accept_mutex;
+    ngx_flag_t    accept_balance;
+
+    ngx_uint_t    accept_batch;
 
     ngx_msec_t    accept_mutex_delay;
 
+    /* urgent, normal and bulk posted events */
+    ngx_msec_t    posted_budget[3];
+
+    ngx_flag_t    timer_wheel;
+    ngx_flag_t    loop_stats;
+
     u_char       *name;
 
 #if (NGX_DEBUG)
@@ -535,6 +583,20 @@ extern ngx_uint_t             ngx_accept_events;
 extern ngx_uint_t             ngx_accept_mutex_held;
 extern ngx_msec_t             ngx_accept_mutex_delay;
 extern ngx_int_t              ngx_accept_disabled;
+extern ngx_uint_t             ngx_use_accept_balance;
+
+
+/* the worker load published for the accept balancing, one per cache line */
+
+typedef struct {
+    ngx_atomic_t                  free;
+    ngx_atomic_t                  time;
+    u_char                        padding[128 - 2 * sizeof(ngx_atomic_t)];
+} ngx_accept_balance_t;
+
+
+extern ngx_accept_balance_t  *ngx_accept_balance_loads;
+extern ngx_uint_t             ngx_accept_balance_n;
 
 
 #if (NGX_STAT_STUB)
@@ -547,6 +609,39 @@ extern ngx_atomic_t  *ngx_stat_reading;
 extern ngx_atomic_t  *ngx_stat_writing;
 extern ngx_atomic_t  *ngx_stat_waiting;
 
+
+/*
+ * the event loop histograms, the bucket 0 counts zero values, the bucket n
+ * counts values from 2^(n-1) to 2^n - 1, the last bucket counts the rest;
+ * the times are in microseconds
+ */
+
+#define NGX_EVENT_LOOP_BUCKETS  24
+
+typedef struct {
+    ngx_atomic_t       pid;
+    ngx_atomic_t       loops;
+    ngx_atomic_t       loop[NGX_EVENT_LOOP_BUCKETS];
+    ngx_atomic_t       events[NGX_EVENT_LOOP_BUCKETS];
+    ngx_atomic_t       posted[NGX_EVENT_LOOP_BUCKETS];
+    ngx_atomic_t       timers[NGX_EVENT_LOOP_BUCKETS];
+
+    /* the busy polling of the event method */
+    ngx_atomic_t       spin_polls;
+    ngx_atomic_t       spin_wakeups;
+    ngx_atomic_t       spin_events;
+    ngx_atomic_t       block_wakeups;
+    ngx_atomic_t       block_events;
+} ngx_event_loop_stat_t;
+
+
+extern ngx_event_loop_stat_t  *ngx_event_loop_stats;
+extern ngx_uint_t              ngx_event_loop_stats_n;
+extern ngx_event_loop_stat_t  *ngx_event_loop_stat;
+
+
+void ngx_event_loop_wakeup(ngx_uint_t events);
+
 #endif
 
 
@@ -554,6 +649,9 @@ extern ngx_atomic_t  *ngx_stat_waiting;
 #define NGX_POST_EVENTS         2
 
 
+#define NGX_ACCEPT_BATCH_MAX    64
+
+
 extern sig_atomic_t           ngx_event_timer_alarm;
 extern ngx_uint_t             ngx_event_flags;
 extern ngx_module_t           ngx_events_module;
@@ -574,6 +672,7 @@ void ngx_udp_rbtree_insert_value(ngx_rbtree_node_t *temp,
 void ngx_delete_udp_connection(void *data);
 ngx_int_t ngx_trylock_accept_mutex(ngx_cycle_t *cycle);
 ngx_int_t ngx_enable_accept_events(ngx_cycle_t *cycle);
+ngx_int_t ngx_accept_balance(ngx_cycle_t *cycle);
 u_char *ngx_accept_log_error(ngx_log_t *log, u_char *buf, size_t len);
 #if (NGX_DEBUG)
 void ngx_debug_accepted_connection(ngx_event_conf_t *ecf, ngx_connection_t *c);
@@ -581,6 +680,7 @@ void ngx_debug_accepted_connection(ngx_event_conf_t *ecf, ngx_connection_t *c);
 
 
 void ngx_process_events_and_timers(ngx_cycle_t *cycle);
+uint64_t ngx_event_loop_usec(void);
 ngx_int_t ngx_handle_read_event(ngx_event_t *rev, ngx_uint_t flags);
 ngx_int_t ngx_handle_write_event(ngx_event_t *wev, size_t lowat);
 
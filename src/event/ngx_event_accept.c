@@ -12,6 +12,11 @@
 
 static ngx_int_t ngx_disable_accept_events(ngx_cycle_t *cycle, ngx_uint_t all);
 static void ngx_close_accepted_connection(ngx_connection_t *c);
+static void ngx_event_accept_batch(ngx_listening_t *ls,
+    ngx_connection_t **batch, ngx_uint_t n);
+
+
+static ngx_uint_t  ngx_accept_balance_disabled;
 
 
 /*
@@ -23,13 +28,14 @@ ngx_event_accept(ngx_event_t *ev)
     socklen_t          socklen;
     ngx_err_t          err;
     ngx_log_t         *log;
-    ngx_uint_t         level;
+    ngx_uint_t         level, n, accepted;
     ngx_socket_t       s;
     ngx_event_t       *rev, *wev;
     ngx_sockaddr_t     sa;
     ngx_listening_t   *ls;
     ngx_connection_t  *c, *lc;
     ngx_event_conf_t  *ecf;
+    ngx_connection_t  *batch[NGX_ACCEPT_BATCH_MAX];
 #if (NGX_HAVE_ACCEPT4)
     static ngx_uint_t  use_accept4 = 1;
 #endif
@@ -45,13 +51,16 @@ ngx_event_accept(ngx_event_t *ev)
     ecf = ngx_event_get_conf(ngx_cycle->conf_ctx, ngx_event_core_module);
 
     if (!(ngx_event_flags & NGX_USE_KQUEUE_EVENT)) {
-        ev->available = ecf->multi_accept;
+        ev->available = ecf->multi_accept || ecf->accept_batch > 1;
     }
 
     lc = ev->data;
     ls = lc->listening;
     ev->ready = 0;
 
+    n = 0;
+    accepted = 0;
+
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
                    "accept on %V, ready: %d", &ls->addr_text, ev->available);
 
@@ -76,7 +85,7 @@ ngx_event_accept(ngx_event_t *ev)
             if (err == NGX_EAGAIN) {
                 ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, err,
                                "accept() not ready");
-                return;
+                break;
             }
 
             level = NGX_LOG_ALERT;
@@ -115,7 +124,7 @@ ngx_event_accept(ngx_event_t *ev)
                 if (ngx_disable_accept_events((ngx_cycle_t *) ngx_cycle, 1)
                     != NGX_OK)
                 {
-                    return;
+                    break;
                 }
 
                 if (ngx_use_accept_mutex) {
@@ -131,7 +140,7 @@ ngx_event_accept(ngx_event_t *ev)
                 }
             }
 
-            return;
+            break;
         }
 
 #if (NGX_STAT_STUB)
@@ -153,7 +162,7 @@ ngx_event_accept(ngx_event_t *ev)
                               ngx_close_socket_n " failed");
             }
 
-            return;
+            break;
         }
 
         c->type = SOCK_STREAM;
@@ -166,7 +175,7 @@ ngx_event_accept(ngx_event_t *ev)
         c->pool = ngx_create_pool(ls->pool_size, ev->log);
         if (c->pool == NULL) {
             ngx_close_accepted_connection(c);
-            return;
+            break;
         }
 
         if (socklen > (socklen_t) sizeof(ngx_sockaddr_t)) {
@@ -176,7 +185,7 @@ ngx_event_accept(ngx_event_t *ev)
         c->sockaddr = ngx_palloc(c->pool, socklen);
         if (c->sockaddr == NULL) {
             ngx_close_accepted_connection(c);
-            return;
+            break;
         }
 
         ngx_memcpy(c->sockaddr, &sa, socklen);
@@ -184,7 +193,7 @@ ngx_event_accept(ngx_event_t *ev)
         log = ngx_palloc(c->pool, sizeof(ngx_log_t));
         if (log == NULL) {
             ngx_close_accepted_connection(c);
-            return;
+            break;
         }
 
         /* set a blocking mode for iocp and non-blocking mode for others */
@@ -196,7 +205,7 @@ ngx_event_accept(ngx_event_t *ev)
                     ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_socket_errno,
                                   ngx_blocking_n " failed");
                     ngx_close_accepted_connection(c);
-                    return;
+                    break;
                 }
             }
 
@@ -206,7 +215,7 @@ ngx_event_accept(ngx_event_t *ev)
                     ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_socket_errno,
                                   ngx_nonblocking_n " failed");
                     ngx_close_accepted_connection(c);
-                    return;
+                    break;
                 }
             }
         }
@@ -277,7 +286,7 @@ ngx_event_accept(ngx_event_t *ev)
             c->addr_text.data = ngx_pnalloc(c->pool, ls->addr_text_max_len);
             if (c->addr_text.data == NULL) {
                 ngx_close_accepted_connection(c);
-                return;
+                break;
             }
 
             c->addr_text.len = ngx_sock_ntop(c->sockaddr, c->socklen,
@@ -285,7 +294,7 @@ ngx_event_accept(ngx_event_t *ev)
                                              ls->addr_text_max_len, 0);
             if (c->addr_text.len == 0) {
                 ngx_close_accepted_connection(c);
-                return;
+                break;
             }
         }
 
@@ -311,21 +320,56 @@ ngx_event_accept(ngx_event_t *ev)
         if (ngx_add_conn && (ngx_event_flags & NGX_USE_EPOLL_EVENT) == 0) {
             if (ngx_add_conn(c) == NGX_ERROR) {
                 ngx_close_accepted_connection(c);
-                return;
+                break;
             }
         }
 
         log->data = NULL;
         log->handler = NULL;
 
-        // 调用回调方法处理新的连接
-        ls->handler(c);
+        accepted++;
 
         if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
             ev->available--;
         }
 
+        if (ecf->accept_batch == 1) {
+            // 调用回调方法处理新的连接
+            ls->handler(c);
+            continue;
+        }
+
+        /*
+         * the connections accepted in a row are set up first and then
+         * are passed to the listening handler together, so the accept()
+         * calls are not interleaved with the request processing
+         */
+
+        batch[n++] = c;
+
+        if (n == ecf->accept_batch) {
+            ngx_event_accept_batch(ls, batch, n);
+            n = 0;
+
+            if (!ecf->multi_accept) {
+                break;
+            }
+        }
+
     } while (ev->available);
+
+    if (n) {
+        ngx_event_accept_batch(ls, batch, n);
+    }
+
+    if (accepted) {
+        ls->accept_events++;
+        ls->accepted += accepted;
+
+        if (accepted > ls->accept_batch_max) {
+            ls->accept_batch_max = accepted;
+        }
+    }
     // available 就在这里使用，表示一次建立多个 TCP 连接，只要 available 的值为 1，那么 accept() 过程就会一直进行下去，直到没有
     // 新的连接为止
 }
@@ -386,10 +430,95 @@ ngx_trylock_accept_mutex(ngx_cycle_t *cycle)
 }
 
 
+/*
+ * The accept balancing: each worker publishes the number of its free
+ * connections, and a worker which has notably fewer free connections
+ * than the least loaded one stops accepting until the difference goes
+ * down.  The listening sockets are shared with EPOLLEXCLUSIVE, so there is
+ * no lock, and the accept events are only switched on the load changes.
+ * The loads not updated for two rechecks are considered to be of exited
+ * workers and are ignored.
+ */
+
+ngx_int_t
+ngx_accept_balance(ngx_cycle_t *cycle)
+{
+    ngx_int_t              diff;
+    ngx_uint_t             i, n, free, max;
+    ngx_core_conf_t       *ccf;
+    ngx_accept_balance_t  *load;
+
+    if (ngx_exiting) {
+        return NGX_OK;
+    }
+
+    free = cycle->free_connection_n;
+
+    load = &ngx_accept_balance_loads[ngx_worker];
+    load->free = free;
+    load->time = ngx_current_msec;
+
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+
+    n = ngx_min((ngx_uint_t) ccf->worker_processes, ngx_accept_balance_n);
+    max = free;
+
+    for (i = 0; i < n; i++) {
+        load = &ngx_accept_balance_loads[i];
+
+        if (i == ngx_worker
+            || (ngx_msec_int_t) (ngx_current_msec - load->time)
+               > (ngx_msec_int_t) (2 * ngx_accept_mutex_delay))
+        {
+            continue;
+        }
+
+        if (load->free > max) {
+            max = load->free;
+        }
+    }
+
+    diff = max - free;
+
+    if (!ngx_accept_balance_disabled) {
+
+        if (diff <= (ngx_int_t) cycle->connection_n / 8) {
+            return NGX_OK;
+        }
+
+        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                       "accept balance off, free: %ui, max: %ui", free, max);
+
+        if (ngx_disable_accept_events(cycle, 0) == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        ngx_accept_balance_disabled = 1;
+
+        return NGX_OK;
+    }
+
+    if (diff > (ngx_int_t) cycle->connection_n / 16) {
+        return NGX_OK;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "accept balance on, free: %ui, max: %ui", free, max);
+
+    if (ngx_enable_accept_events(cycle) == NGX_ERROR) {
+        return NGX_ERROR;
+    }
+
+    ngx_accept_balance_disabled = 0;
+
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_enable_accept_events(ngx_cycle_t *cycle)
 {
-    ngx_uint_t         i;
+    ngx_uint_t         i, flags;
     ngx_listening_t   *ls;
     ngx_connection_t  *c;
 
@@ -402,7 +531,20 @@ ngx_enable_accept_events(ngx_cycle_t *cycle)
             continue;
         }
 
-        if (ngx_add_event(c->read, NGX_READ_EVENT, 0) == NGX_ERROR) {
+        flags = 0;
+
+#if (NGX_HAVE_EPOLLEXCLUSIVE)
+
+        if (ngx_use_accept_balance
+            && (ngx_event_flags & NGX_USE_EPOLL_EVENT)
+            && !ls[i].reuseport)
+        {
+            flags = NGX_EXCLUSIVE_EVENT;
+        }
+
+#endif
+
+        if (ngx_add_event(c->read, NGX_READ_EVENT, flags) == NGX_ERROR) {
             return NGX_ERROR;
         }
     }
@@ -476,6 +618,21 @@ ngx_close_accepted_connection(ngx_connection_t *c)
 }
 
 
+static void
+ngx_event_accept_batch(ngx_listening_t *ls, ngx_connection_t **batch,
+    ngx_uint_t n)
+{
+    ngx_uint_t  i;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ngx_cycle->log, 0,
+                   "accept batch on %V: %ui", &ls->addr_text, n);
+
+    for (i = 0; i < n; i++) {
+        ls->handler(batch[i]);
+    }
+}
+
+
 u_char *
 ngx_accept_log_error(ngx_log_t *log, u_char *buf, size_t len)
 {
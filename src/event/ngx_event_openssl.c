@@ -3624,7 +3624,7 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 
     ngx_memcpy(id, session_id, session_id_length);
 
-    hash = ngx_crc32_short(session_id, session_id_length);
+    hash = ngx_crc32c(session_id, session_id_length);
 
     ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
                    "ssl new session: %08XD:%ud:%d",
@@ -3685,7 +3685,7 @@ ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
     u_char                    buf[NGX_SSL_MAX_SESSION_SIZE];
     ngx_connection_t         *c;
 
-    hash = ngx_crc32_short((u_char *) (uintptr_t) id, (size_t) len);
+    hash = ngx_crc32c((u_char *) (uintptr_t) id, (size_t) len);
     *copy = 0;
 
     c = ngx_ssl_get_connection(ssl_conn);
@@ -3799,7 +3799,7 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
 
     id = (u_char *) SSL_SESSION_get_id(sess, &len);
 
-    hash = ngx_crc32_short(id, len);
+    hash = ngx_crc32c(id, len);
 
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ngx_cycle->log, 0,
                    "ssl remove session: %08XD:%ud", hash, len);
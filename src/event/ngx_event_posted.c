@@ -12,7 +12,9 @@
 
 ngx_queue_t  ngx_posted_accept_events;
 ngx_queue_t  ngx_posted_next_events;
+ngx_queue_t  ngx_posted_urgent_events;
 ngx_queue_t  ngx_posted_events;
+ngx_queue_t  ngx_posted_bulk_events;
 
 
 void
@@ -36,6 +38,45 @@ ngx_event_process_posted(ngx_cycle_t *cycle, ngx_queue_t *posted)
 }
 
 
+void
+ngx_event_process_posted_budget(ngx_cycle_t *cycle, ngx_queue_t *posted,
+    uint64_t budget)
+{
+    uint64_t      start;
+    ngx_queue_t  *q;
+    ngx_event_t  *ev;
+
+    if (budget == 0) {
+        ngx_event_process_posted(cycle, posted);
+        return;
+    }
+
+    start = ngx_event_loop_usec();
+
+    while (!ngx_queue_empty(posted)) {
+
+        q = ngx_queue_head(posted);
+        ev = ngx_queue_data(q, ngx_event_t, queue);
+
+        ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                      "posted event %p", ev);
+
+        ngx_delete_posted_event(ev);
+
+        ev->handler(ev);
+
+        if (ngx_event_loop_usec() - start >= budget) {
+
+            /* the rest is left for the next iteration */
+
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "posted events budget exceeded");
+            break;
+        }
+    }
+}
+
+
 void
 ngx_event_move_posted_next(ngx_cycle_t *cycle)
 {
@@ -38,7 +38,18 @@
 
 
 
+/*
+ * the events of a connection with buffered output belong to the bulk
+ * class, they are processed after the other posted events
+ */
+
+#define ngx_posted_event_queue(c)                                             \
+    ((c)->buffered ? &ngx_posted_bulk_events : &ngx_posted_events)
+
+
 void ngx_event_process_posted(ngx_cycle_t *cycle, ngx_queue_t *posted);
+void ngx_event_process_posted_budget(ngx_cycle_t *cycle, ngx_queue_t *posted,
+    uint64_t budget);
 void ngx_event_move_posted_next(ngx_cycle_t *cycle);
 
 
@@ -48,7 +59,9 @@ void ngx_event_move_posted_next(ngx_cycle_t *cycle);
  */
 extern ngx_queue_t  ngx_posted_accept_events;
 extern ngx_queue_t  ngx_posted_next_events;
+extern ngx_queue_t  ngx_posted_urgent_events;
 extern ngx_queue_t  ngx_posted_events;
+extern ngx_queue_t  ngx_posted_bulk_events;
 
 
 #endif /* _NGX_EVENT_POSTED_H_INCLUDED_ */
@@ -10,9 +10,67 @@
 #include <ngx_event.h>
 
 
+/*
+ * The hierarchical timer wheel.  Level 0 has 256 slots of 1 millisecond,
+ * levels 1-3 have 64 slots of 256 milliseconds, ~16 seconds and ~17 minutes
+ * each, so the wheel spans ~18.6 hours; longer timers are kept in the last
+ * level and are refiled every time their slot is cascaded.  A slot of
+ * level N is cascaded into the lower levels when the wheel time reaches
+ * the beginning of the slot, so level 0 slots contain timers with the
+ * exact expiration time of the slot only.
+ *
+ * The timers which are already expired when added are kept in a separate
+ * slot and are run on the next ngx_event_expire_timers() call.
+ *
+ * The timer node is reused for linkage: the left and right pointers
+ * link the node into the slot list, and the parent pointer points to
+ * the slot list head.
+ */
+
+#define NGX_TIMER_WHEEL_LEVELS   4
+#define NGX_TIMER_WHEEL_BITS0    8
+#define NGX_TIMER_WHEEL_BITS     6
+#define NGX_TIMER_WHEEL_SIZE0    (1 << NGX_TIMER_WHEEL_BITS0)
+#define NGX_TIMER_WHEEL_SIZE     (1 << NGX_TIMER_WHEEL_BITS)
+
+#define ngx_timer_wheel_shift(level)                                          \
+    (NGX_TIMER_WHEEL_BITS0 + ((level) - 1) * NGX_TIMER_WHEEL_BITS)
+#define ngx_timer_wheel_base(level)                                           \
+    (NGX_TIMER_WHEEL_SIZE0 + ((level) - 1) * NGX_TIMER_WHEEL_SIZE)
+
+#define NGX_TIMER_WHEEL_MAX                                                   \
+    ((ngx_msec_t) 1 << ngx_timer_wheel_shift(NGX_TIMER_WHEEL_LEVELS))
+
+#define NGX_TIMER_WHEEL_EXPIRED  ngx_timer_wheel_base(NGX_TIMER_WHEEL_LEVELS)
+#define NGX_TIMER_WHEEL_SLOTS    (NGX_TIMER_WHEEL_EXPIRED + 1)
+
+
+typedef struct {
+    /* the first millisecond not processed yet */
+    ngx_msec_t          time;
+
+    uint64_t            bitmap[(NGX_TIMER_WHEEL_SLOTS + 63) / 64];
+    ngx_rbtree_node_t   slots[NGX_TIMER_WHEEL_SLOTS];
+} ngx_event_timer_wheel_t;
+
+
+static ngx_msec_t ngx_event_timer_wheel_find(void);
+static void ngx_event_timer_wheel_expire_timers(void);
+static ngx_int_t ngx_event_timer_wheel_no_timers_left(void);
+static ngx_uint_t ngx_event_timer_wheel_slot(ngx_msec_t key);
+static void ngx_event_timer_wheel_link(ngx_uint_t n, ngx_rbtree_node_t *node);
+static void ngx_event_timer_wheel_cascade(ngx_uint_t n);
+static void ngx_event_timer_wheel_expire(ngx_uint_t n);
+static ngx_uint_t ngx_event_timer_wheel_scan(ngx_uint_t from);
+static ngx_uint_t ngx_event_timer_wheel_ctz(uint64_t bits);
+
+
 ngx_rbtree_t              ngx_event_timer_rbtree;
 static ngx_rbtree_node_t  ngx_event_timer_sentinel;
 
+ngx_uint_t                       ngx_event_timer_wheel;
+static ngx_event_timer_wheel_t   ngx_timer_wheel;
+
 /*
  * the event timer rbtree may contain the duplicate keys, however,
  * it should not be a problem, because we use the rbtree to find
@@ -23,9 +81,24 @@ static ngx_rbtree_node_t  ngx_event_timer_sentinel;
 ngx_int_t
 ngx_event_timer_init(ngx_log_t *log)
 {
+    ngx_uint_t  i;
+
     ngx_rbtree_init(&ngx_event_timer_rbtree, &ngx_event_timer_sentinel,
                     ngx_rbtree_insert_timer_value);
 
+    if (ngx_event_timer_wheel) {
+        ngx_memzero(&ngx_timer_wheel, sizeof(ngx_event_timer_wheel_t));
+
+        for (i = 0; i < NGX_TIMER_WHEEL_SLOTS; i++) {
+            ngx_timer_wheel.slots[i].left = &ngx_timer_wheel.slots[i];
+            ngx_timer_wheel.slots[i].right = &ngx_timer_wheel.slots[i];
+        }
+
+        ngx_timer_wheel.time = ngx_current_msec;
+
+        ngx_log_debug0(NGX_LOG_DEBUG_EVENT, log, 0, "event timer wheel");
+    }
+
     return NGX_OK;
 }
 
@@ -36,6 +109,10 @@ ngx_event_find_timer(void)
     ngx_msec_int_t      timer;
     ngx_rbtree_node_t  *node, *root, *sentinel;
 
+    if (ngx_event_timer_wheel) {
+        return ngx_event_timer_wheel_find();
+    }
+
     if (ngx_event_timer_rbtree.root == &ngx_event_timer_sentinel) {
         return NGX_TIMER_INFINITE;
     }
@@ -62,6 +139,11 @@ ngx_event_expire_timers(void)
     ngx_event_t        *ev;
     ngx_rbtree_node_t  *node, *root, *sentinel;
 
+    if (ngx_event_timer_wheel) {
+        ngx_event_timer_wheel_expire_timers();
+        return;
+    }
+
     sentinel = ngx_event_timer_rbtree.sentinel;
 
     for ( ;; ) {
@@ -108,6 +190,10 @@ ngx_event_no_timers_left(void)
     ngx_event_t        *ev;
     ngx_rbtree_node_t  *node, *root, *sentinel;
 
+    if (ngx_event_timer_wheel) {
+        return ngx_event_timer_wheel_no_timers_left();
+    }
+
     sentinel = ngx_event_timer_rbtree.sentinel;
     root = ngx_event_timer_rbtree.root;
 
@@ -130,3 +216,370 @@ ngx_event_no_timers_left(void)
 
     return NGX_OK;
 }
+
+
+void
+ngx_event_timer_wheel_insert(ngx_rbtree_node_t *node)
+{
+    ngx_event_timer_wheel_link(ngx_event_timer_wheel_slot(node->key), node);
+}
+
+
+void
+ngx_event_timer_wheel_delete(ngx_rbtree_node_t *node)
+{
+    ngx_uint_t          n;
+    ngx_rbtree_node_t  *head;
+
+    node->left->right = node->right;
+    node->right->left = node->left;
+
+    head = node->parent;
+
+    if (head->right == head) {
+        n = head - ngx_timer_wheel.slots;
+        ngx_timer_wheel.bitmap[n >> 6] &= ~((uint64_t) 1 << (n & 63));
+    }
+}
+
+
+/*
+ * The nearest level 0 slot gives the exact expiration time; a slot of
+ * the upper levels is accounted at the time it is cascaded, that is,
+ * not later than the first timer in it expires.  Hence the result is
+ * exact for timers expiring within the current level 0 round, and it
+ * is never later than the real nearest timer otherwise.
+ */
+
+static ngx_msec_t
+ngx_event_timer_wheel_find(void)
+{
+    uint64_t        bits;
+    ngx_msec_t      time, min, off, size;
+    ngx_uint_t      i, n, level, shift;
+    ngx_msec_int_t  timer;
+
+    for (i = 0; i < sizeof(ngx_timer_wheel.bitmap) / sizeof(uint64_t); i++) {
+        if (ngx_timer_wheel.bitmap[i]) {
+            break;
+        }
+    }
+
+    if (i == sizeof(ngx_timer_wheel.bitmap) / sizeof(uint64_t)) {
+        return NGX_TIMER_INFINITE;
+    }
+
+    n = NGX_TIMER_WHEEL_EXPIRED;
+
+    if (ngx_timer_wheel.bitmap[n >> 6] & ((uint64_t) 1 << (n & 63))) {
+        return 0;
+    }
+
+    time = ngx_timer_wheel.time;
+    min = NGX_TIMER_INFINITE;
+
+    /* level 0 */
+
+    i = time & (NGX_TIMER_WHEEL_SIZE0 - 1);
+
+    n = ngx_event_timer_wheel_scan(i);
+
+    if (n < NGX_TIMER_WHEEL_SIZE0) {
+        min = n - i;
+
+    } else {
+        n = ngx_event_timer_wheel_scan(0);
+
+        if (n < i) {
+            min = n + NGX_TIMER_WHEEL_SIZE0 - i;
+        }
+    }
+
+    /* upper levels, at the time of their next cascades */
+
+    for (level = 1; level < NGX_TIMER_WHEEL_LEVELS; level++) {
+
+        bits = ngx_timer_wheel.bitmap[ngx_timer_wheel_base(level) >> 6];
+
+        if (bits == 0) {
+            continue;
+        }
+
+        shift = ngx_timer_wheel_shift(level);
+        size = (ngx_msec_t) 1 << shift;
+
+        off = (size - (time & (size - 1))) & (size - 1);
+
+        if (off >= min) {
+            continue;
+        }
+
+        i = ((time + off) >> shift) & (NGX_TIMER_WHEEL_SIZE - 1);
+
+        if (i) {
+            bits = (bits >> i) | (bits << (NGX_TIMER_WHEEL_SIZE - i));
+        }
+
+        off += (ngx_msec_t) ngx_event_timer_wheel_ctz(bits) << shift;
+
+        if (off < min) {
+            min = off;
+        }
+    }
+
+    timer = (ngx_msec_int_t) (time + min - ngx_current_msec);
+
+    return (ngx_msec_t) (timer > 0 ? timer : 0);
+}
+
+
+static void
+ngx_event_timer_wheel_expire_timers(void)
+{
+    ngx_msec_t  now, skip;
+    ngx_uint_t  i, n, level;
+
+    now = ngx_current_msec;
+
+    ngx_event_timer_wheel_expire(NGX_TIMER_WHEEL_EXPIRED);
+
+    while ((ngx_msec_int_t) (now - ngx_timer_wheel.time) >= 0) {
+
+        i = ngx_timer_wheel.time & (NGX_TIMER_WHEEL_SIZE0 - 1);
+
+        if (i == 0) {
+            for (level = 1; level < NGX_TIMER_WHEEL_LEVELS; level++) {
+                n = (ngx_timer_wheel.time >> ngx_timer_wheel_shift(level))
+                    & (NGX_TIMER_WHEEL_SIZE - 1);
+
+                ngx_event_timer_wheel_cascade(ngx_timer_wheel_base(level) + n);
+
+                if (n) {
+                    break;
+                }
+            }
+        }
+
+        ngx_event_timer_wheel_expire(i);
+
+        /* skip empty slots up to the next cascade */
+
+        n = (i + 1 < NGX_TIMER_WHEEL_SIZE0)
+            ? ngx_event_timer_wheel_scan(i + 1) : NGX_TIMER_WHEEL_SIZE0;
+
+        skip = n - i;
+
+        if (skip > now - ngx_timer_wheel.time + 1) {
+            skip = now - ngx_timer_wheel.time + 1;
+        }
+
+        ngx_timer_wheel.time += skip;
+    }
+
+    /* timers added by the handlers with an expired time */
+
+    ngx_event_timer_wheel_expire(NGX_TIMER_WHEEL_EXPIRED);
+}
+
+
+static ngx_int_t
+ngx_event_timer_wheel_no_timers_left(void)
+{
+    ngx_uint_t          i;
+    ngx_event_t        *ev;
+    ngx_rbtree_node_t  *head, *node;
+
+    for (i = 0; i < NGX_TIMER_WHEEL_SLOTS; i++) {
+        head = &ngx_timer_wheel.slots[i];
+
+        for (node = head->right; node != head; node = node->right) {
+            ev = (ngx_event_t *) ((char *) node - offsetof(ngx_event_t, timer));
+
+            if (!ev->cancelable) {
+                return NGX_AGAIN;
+            }
+        }
+    }
+
+    /* only cancelable timers left */
+
+    return NGX_OK;
+}
+
+
+static ngx_uint_t
+ngx_event_timer_wheel_slot(ngx_msec_t key)
+{
+    ngx_msec_t  delta;
+    ngx_uint_t  level, shift;
+
+    if ((ngx_msec_int_t) (key - ngx_timer_wheel.time) < 0) {
+        return NGX_TIMER_WHEEL_EXPIRED;
+    }
+
+    delta = key - ngx_timer_wheel.time;
+
+    if (delta < NGX_TIMER_WHEEL_SIZE0) {
+        return key & (NGX_TIMER_WHEEL_SIZE0 - 1);
+    }
+
+    if (delta >= NGX_TIMER_WHEEL_MAX) {
+        key = ngx_timer_wheel.time + NGX_TIMER_WHEEL_MAX - 1;
+        delta = NGX_TIMER_WHEEL_MAX - 1;
+    }
+
+    for (level = 1; level < NGX_TIMER_WHEEL_LEVELS - 1; level++) {
+        if (delta < (ngx_msec_t) 1 << ngx_timer_wheel_shift(level + 1)) {
+            break;
+        }
+    }
+
+    shift = ngx_timer_wheel_shift(level);
+
+    return ngx_timer_wheel_base(level)
+           + ((key >> shift) & (NGX_TIMER_WHEEL_SIZE - 1));
+}
+
+
+static void
+ngx_event_timer_wheel_link(ngx_uint_t n, ngx_rbtree_node_t *node)
+{
+    ngx_rbtree_node_t  *head;
+
+    head = &ngx_timer_wheel.slots[n];
+
+    node->left = head->left;
+    node->right = head;
+    node->parent = head;
+
+    head->left->right = node;
+    head->left = node;
+
+    ngx_timer_wheel.bitmap[n >> 6] |= (uint64_t) 1 << (n & 63);
+}
+
+
+static void
+ngx_event_timer_wheel_cascade(ngx_uint_t n)
+{
+    ngx_rbtree_node_t  *head, *node, *next;
+
+    head = &ngx_timer_wheel.slots[n];
+
+    if (head->right == head) {
+        return;
+    }
+
+    node = head->right;
+    head->left->right = NULL;
+
+    head->left = head;
+    head->right = head;
+
+    ngx_timer_wheel.bitmap[n >> 6] &= ~((uint64_t) 1 << (n & 63));
+
+    while (node) {
+        next = node->right;
+        ngx_event_timer_wheel_insert(node);
+        node = next;
+    }
+}
+
+
+static void
+ngx_event_timer_wheel_expire(ngx_uint_t n)
+{
+    ngx_event_t        *ev;
+    ngx_rbtree_node_t  *head, *node;
+
+    head = &ngx_timer_wheel.slots[n];
+
+    while (head->right != head) {
+        node = head->right;
+
+        ev = (ngx_event_t *) ((char *) node - offsetof(ngx_event_t, timer));
+
+        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                       "event timer del: %d: %M",
+                       ngx_event_ident(ev->data), ev->timer.key);
+
+        ngx_event_timer_wheel_delete(node);
+
+#if (NGX_DEBUG)
+        ev->timer.left = NULL;
+        ev->timer.right = NULL;
+        ev->timer.parent = NULL;
+#endif
+
+        ev->timer_set = 0;
+
+        ev->timedout = 1;
+
+        ev->handler(ev);
+    }
+}
+
+
+/* the first non-empty level 0 slot starting from the given one */
+
+static ngx_uint_t
+ngx_event_timer_wheel_scan(ngx_uint_t from)
+{
+    uint64_t    bits;
+    ngx_uint_t  i;
+
+    i = from >> 6;
+    bits = ngx_timer_wheel.bitmap[i] & ((uint64_t) -1 << (from & 63));
+
+    for ( ;; ) {
+        if (bits) {
+            return (i << 6) + ngx_event_timer_wheel_ctz(bits);
+        }
+
+        if (++i == NGX_TIMER_WHEEL_SIZE0 / 64) {
+            return NGX_TIMER_WHEEL_SIZE0;
+        }
+
+        bits = ngx_timer_wheel.bitmap[i];
+    }
+}
+
+
+static ngx_uint_t
+ngx_event_timer_wheel_ctz(uint64_t bits)
+{
+    ngx_uint_t  n;
+
+    n = 0;
+
+    if ((bits & 0xffffffff) == 0) {
+        n += 32;
+        bits >>= 32;
+    }
+
+    if ((bits & 0xffff) == 0) {
+        n += 16;
+        bits >>= 16;
+    }
+
+    if ((bits & 0xff) == 0) {
+        n += 8;
+        bits >>= 8;
+    }
+
+    if ((bits & 0xf) == 0) {
+        n += 4;
+        bits >>= 4;
+    }
+
+    if ((bits & 0x3) == 0) {
+        n += 2;
+        bits >>= 2;
+    }
+
+    if ((bits & 0x1) == 0) {
+        n += 1;
+    }
+
+    return n;
+}
@@ -219,7 +219,7 @@ ngx_http_limit_conn_handler(ngx_http_request_t *r)
 
         r->main->limit_conn_status = NGX_HTTP_LIMIT_CONN_PASSED;
 
-        hash = ngx_crc32_short(key.data, key.len);
+        hash = ngx_crc32c(key.data, key.len);
 
         ngx_shmtx_lock(&ctx->shpool->mutex);
 
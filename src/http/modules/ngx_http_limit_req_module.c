@@ -241,7 +241,7 @@ ngx_http_limit_req_handler(ngx_http_request_t *r)
             continue;
         }
 
-        hash = ngx_crc32_short(key.data, key.len);
+        hash = ngx_crc32c(key.data, key.len);
 
         ngx_shmtx_lock(&ctx->shpool->mutex);
 
@@ -13,6 +13,7 @@
 typedef struct {
     ngx_uint_t                  hash_max_size;
     ngx_uint_t                  hash_bucket_size;
+    ngx_flag_t                  hash_open;
 } ngx_http_map_conf_t;
 
 
@@ -69,6 +70,13 @@ static ngx_command_t  ngx_http_map_commands[] = {
       offsetof(ngx_http_map_conf_t, hash_bucket_size),
       NULL },
 
+    { ngx_string("map_hash_open"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_map_conf_t, hash_open),
+      NULL },
+
       ngx_null_command
 };
 
@@ -167,6 +175,7 @@ ngx_http_map_create_conf(ngx_conf_t *cf)
 
     mcf->hash_max_size = NGX_CONF_UNSET_UINT;
     mcf->hash_bucket_size = NGX_CONF_UNSET_UINT;
+    mcf->hash_open = NGX_CONF_UNSET;
 
     return mcf;
 }
@@ -199,6 +208,10 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
                                           ngx_cacheline_size);
     }
 
+    if (mcf->hash_open == NGX_CONF_UNSET) {
+        mcf->hash_open = 0;
+    }
+
     map = ngx_pcalloc(cf->pool, sizeof(ngx_http_map_ctx_t));
     if (map == NULL) {
         return NGX_CONF_ERROR;
@@ -294,7 +307,7 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
     hash.key = ngx_hash_key_lc;
     hash.max_size = mcf->hash_max_size;
-    hash.bucket_size = mcf->hash_bucket_size;
+    hash.bucket_size = mcf->hash_open ? NGX_HASH_OPEN : mcf->hash_bucket_size;
     hash.name = "map_hash";
     hash.pool = cf->pool;
 
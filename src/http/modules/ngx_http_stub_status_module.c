@@ -11,6 +11,11 @@
 
 
 static ngx_int_t ngx_http_stub_status_handler(ngx_http_request_t *r);
+static ngx_int_t ngx_http_stub_status_extended_handler(ngx_http_request_t *r);
+static ngx_int_t ngx_http_stub_status(ngx_http_request_t *r,
+    ngx_uint_t extended);
+static u_char *ngx_http_stub_status_histogram(u_char *p, char *name,
+    ngx_atomic_t *hist);
 static ngx_int_t ngx_http_stub_status_variable(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
 static ngx_int_t ngx_http_stub_status_add_variables(ngx_conf_t *cf);
@@ -83,11 +88,34 @@ static ngx_http_variable_t  ngx_http_stub_status_vars[] = {
 static ngx_int_t
 ngx_http_stub_status_handler(ngx_http_request_t *r)
 {
-    size_t             size;
-    ngx_int_t          rc;
-    ngx_buf_t         *b;
-    ngx_chain_t        out;
-    ngx_atomic_int_t   ap, hn, ac, rq, rd, wr, wa;
+    return ngx_http_stub_status(r, 0);
+}
+
+
+static ngx_int_t
+ngx_http_stub_status_extended_handler(ngx_http_request_t *r)
+{
+    return ngx_http_stub_status(r, 1);
+}
+
+
+static ngx_int_t
+ngx_http_stub_status(ngx_http_request_t *r, ngx_uint_t extended)
+{
+    size_t                  size;
+    ngx_int_t               rc;
+    ngx_buf_t              *b;
+    ngx_uint_t              i;
+    ngx_chain_t             out;
+    ngx_list_part_t        *part;
+    ngx_shm_zone_t         *shm_zone;
+    ngx_atomic_int_t        ap, hn, ac, rq, rd, wr, wa;
+    ngx_listening_t        *ls;
+    ngx_slab_usage_t        usage;
+    ngx_event_loop_stat_t  *stat;
+#if (NGX_THREADS)
+    ngx_thread_pool_stat_t *tps;
+#endif
 
     if (!(r->method & (NGX_HTTP_GET|NGX_HTTP_HEAD))) {
         return NGX_HTTP_NOT_ALLOWED;
@@ -108,6 +136,68 @@ ngx_http_stub_status_handler(ngx_http_request_t *r)
            + 6 + 3 * NGX_ATOMIC_T_LEN
            + sizeof("Reading:  Writing:  Waiting:  \n") + 3 * NGX_ATOMIC_T_LEN;
 
+    if (extended) {
+        size += sizeof("Buckets:") - 1
+                + NGX_EVENT_LOOP_BUCKETS * (1 + NGX_INT_T_LEN) + 1
+                + ngx_event_loop_stats_n
+                  * (sizeof("Worker  pid  loops \n") - 1
+                     + NGX_INT_T_LEN + 2 * NGX_ATOMIC_T_LEN
+                     + 4 * (sizeof(" posted:") - 1
+                            + NGX_EVENT_LOOP_BUCKETS
+                              * (1 + NGX_ATOMIC_T_LEN) + 1)
+                     + sizeof(" spin: polls  wakeups  events  "
+                              "blocked: wakeups  events \n") - 1
+                     + 5 * NGX_ATOMIC_T_LEN)
+                + sizeof("Pool cache: pid  size  hits  misses  "
+                         "frees  drops \n") - 1
+                + 6 * NGX_INT_T_LEN;
+
+        ls = ngx_cycle->listening.elts;
+
+        for (i = 0; i < ngx_cycle->listening.nelts; i++) {
+            size += sizeof("Listen : pid  events  accepted  batch_max \n") - 1
+                    + ls[i].addr_text.len + NGX_INT_T_LEN
+                    + 3 * NGX_ATOMIC_T_LEN;
+        }
+
+#if (NGX_THREADS)
+        size += sizeof("Thread completions: pid  tasks  batches  "
+                       "notifies  latency \n") - 1
+                + 5 * NGX_ATOMIC_T_LEN;
+
+        for (i = 0; /* void */ ; i++) {
+            tps = ngx_thread_pool_stat((ngx_cycle_t *) ngx_cycle, i);
+
+            if (tps == NULL) {
+                break;
+            }
+
+            size += sizeof("Thread pool : threads  tasks  queued  "
+                           "max_queued  signals  wait  run \n") - 1
+                    + tps->name->len + 7 * NGX_ATOMIC_T_LEN;
+        }
+#endif
+
+        part = (ngx_list_part_t *) &ngx_cycle->shared_memory.part;
+        shm_zone = part->elts;
+
+        for (i = 0; /* void */ ; i++) {
+
+            if (i >= part->nelts) {
+                if (part->next == NULL) {
+                    break;
+                }
+                part = part->next;
+                shm_zone = part->elts;
+                i = 0;
+            }
+
+            size += sizeof("Zone : pages  free  largest  slack  cached  "
+                           "contended \n") - 1
+                    + shm_zone[i].shm.name.len + 6 * NGX_INT_T_LEN;
+        }
+    }
+
     b = ngx_create_temp_buf(r->pool, size);
     if (b == NULL) {
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
@@ -134,6 +224,125 @@ ngx_http_stub_status_handler(ngx_http_request_t *r)
     b->last = ngx_sprintf(b->last, "Reading: %uA Writing: %uA Waiting: %uA \n",
                           rd, wr, wa);
 
+    if (extended) {
+        b->last = ngx_cpymem(b->last, "Buckets:", sizeof("Buckets:") - 1);
+
+        for (i = 0; i < NGX_EVENT_LOOP_BUCKETS; i++) {
+            b->last = ngx_sprintf(b->last, " %uL",
+                                  i ? (uint64_t) 1 << (i - 1) : 0);
+        }
+
+        *b->last++ = LF;
+
+        for (i = 0; i < ngx_event_loop_stats_n; i++) {
+            stat = &ngx_event_loop_stats[i];
+
+            if (stat->loops == 0) {
+                continue;
+            }
+
+            b->last = ngx_sprintf(b->last, "Worker %ui pid %uA loops %uA\n",
+                                  i, stat->pid, stat->loops);
+
+            b->last = ngx_http_stub_status_histogram(b->last, " loop:",
+                                                     stat->loop);
+            b->last = ngx_http_stub_status_histogram(b->last, " events:",
+                                                     stat->events);
+            b->last = ngx_http_stub_status_histogram(b->last, " posted:",
+                                                     stat->posted);
+            b->last = ngx_http_stub_status_histogram(b->last, " timers:",
+                                                     stat->timers);
+
+            b->last = ngx_sprintf(b->last, " spin: polls %uA wakeups %uA "
+                                  "events %uA blocked: wakeups %uA "
+                                  "events %uA\n",
+                                  stat->spin_polls, stat->spin_wakeups,
+                                  stat->spin_events, stat->block_wakeups,
+                                  stat->block_events);
+        }
+
+        /* the block cache of the worker serving the request */
+
+        b->last = ngx_sprintf(b->last, "Pool cache: pid %P size %uz "
+                              "hits %ui misses %ui frees %ui drops %ui\n",
+                              ngx_pid, ngx_pool_cache_stat.size,
+                              ngx_pool_cache_stat.hits,
+                              ngx_pool_cache_stat.misses,
+                              ngx_pool_cache_stat.frees,
+                              ngx_pool_cache_stat.drops);
+
+        /* the listening sockets of the worker, with reuseport its copies */
+
+        ls = ngx_cycle->listening.elts;
+
+        for (i = 0; i < ngx_cycle->listening.nelts; i++) {
+
+#if (NGX_HAVE_REUSEPORT)
+            if (ls[i].reuseport && ls[i].worker != ngx_worker) {
+                continue;
+            }
+#endif
+
+            b->last = ngx_sprintf(b->last, "Listen %V: pid %P events %ui "
+                                  "accepted %ui batch_max %ui\n",
+                                  &ls[i].addr_text, ngx_pid,
+                                  ls[i].accept_events, ls[i].accepted,
+                                  ls[i].accept_batch_max);
+        }
+
+#if (NGX_THREADS)
+
+        /* the thread pools of the worker, the times are in microseconds */
+
+        for (i = 0; /* void */ ; i++) {
+            tps = ngx_thread_pool_stat((ngx_cycle_t *) ngx_cycle, i);
+
+            if (tps == NULL) {
+                break;
+            }
+
+            b->last = ngx_sprintf(b->last, "Thread pool %V: threads %ui "
+                                  "tasks %uA queued %uA max_queued %uA "
+                                  "signals %uA wait %uA run %uA\n",
+                                  tps->name, tps->threads, tps->tasks,
+                                  tps->queued, tps->max_queued,
+                                  tps->signals, tps->wait, tps->run);
+        }
+
+        b->last = ngx_sprintf(b->last, "Thread completions: pid %P "
+                              "tasks %uA batches %uA notifies %uA "
+                              "latency %uA\n",
+                              ngx_pid, ngx_thread_pool_done_stat.tasks,
+                              ngx_thread_pool_done_stat.batches,
+                              ngx_thread_pool_done_stat.notifies,
+                              ngx_thread_pool_done_stat.latency);
+#endif
+
+        part = (ngx_list_part_t *) &ngx_cycle->shared_memory.part;
+        shm_zone = part->elts;
+
+        for (i = 0; /* void */ ; i++) {
+
+            if (i >= part->nelts) {
+                if (part->next == NULL) {
+                    break;
+                }
+                part = part->next;
+                shm_zone = part->elts;
+                i = 0;
+            }
+
+            ngx_slab_usage((ngx_slab_pool_t *) shm_zone[i].shm.addr, &usage);
+
+            b->last = ngx_sprintf(b->last, "Zone %V: pages %ui free %ui "
+                                  "largest %ui slack %uz cached %ui "
+                                  "contended %ui\n",
+                                  &shm_zone[i].shm.name, usage.pages,
+                                  usage.free, usage.largest, usage.slack,
+                                  usage.cached, usage.contended);
+        }
+    }
+
     r->headers_out.status = NGX_HTTP_OK;
     r->headers_out.content_length_n = b->last - b->pos;
 
@@ -150,6 +359,23 @@ ngx_http_stub_status_handler(ngx_http_request_t *r)
 }
 
 
+static u_char *
+ngx_http_stub_status_histogram(u_char *p, char *name, ngx_atomic_t *hist)
+{
+    ngx_uint_t  i;
+
+    p = ngx_cpymem(p, name, ngx_strlen(name));
+
+    for (i = 0; i < NGX_EVENT_LOOP_BUCKETS; i++) {
+        p = ngx_sprintf(p, " %uA", hist[i]);
+    }
+
+    *p++ = LF;
+
+    return p;
+}
+
+
 static ngx_int_t
 ngx_http_stub_status_variable(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data)
@@ -217,10 +443,19 @@ ngx_http_stub_status_add_variables(ngx_conf_t *cf)
 static char *
 ngx_http_set_stub_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
+    ngx_str_t                 *value;
     ngx_http_core_loc_conf_t  *clcf;
 
     clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
     clcf->handler = ngx_http_stub_status_handler;
 
+    value = cf->args->elts;
+
+    if (cf->args->nelts == 2
+        && ngx_strcmp(value[1].data, "extended") == 0)
+    {
+        clcf->handler = ngx_http_stub_status_extended_handler;
+    }
+
     return NGX_CONF_OK;
 }
@@ -10,6 +10,11 @@
 #include <ngx_http.h>
 
 
+#define NGX_HTTP_UPSTREAM_HASH_CRC32     0
+#define NGX_HTTP_UPSTREAM_HASH_CRC32C    1
+#define NGX_HTTP_UPSTREAM_HASH_MURMUR64  2
+
+
 typedef struct {
     uint32_t                            hash;
     ngx_str_t                          *server;
@@ -24,6 +29,7 @@ typedef struct {
 
 typedef struct {
     ngx_http_complex_value_t            key;
+    ngx_uint_t                          function;
     ngx_http_upstream_chash_points_t   *points;
 } ngx_http_upstream_hash_srv_conf_t;
 
@@ -58,6 +64,12 @@ static ngx_int_t ngx_http_upstream_init_chash_peer(ngx_http_request_t *r,
 static ngx_int_t ngx_http_upstream_get_chash_peer(ngx_peer_connection_t *pc,
     void *data);
 
+static uint64_t ngx_http_upstream_hash_init(ngx_uint_t function);
+static void ngx_http_upstream_hash_update(ngx_uint_t function, uint64_t *hash,
+    u_char *p, size_t len);
+static uint32_t ngx_http_upstream_hash_final(ngx_uint_t function,
+    uint64_t hash);
+
 static void *ngx_http_upstream_hash_create_conf(ngx_conf_t *cf);
 static char *ngx_http_upstream_hash(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
@@ -66,7 +78,7 @@ static char *ngx_http_upstream_hash(ngx_conf_t *cf, ngx_command_t *cmd,
 static ngx_command_t  ngx_http_upstream_hash_commands[] = {
 
     { ngx_string("hash"),
-      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE12,
+      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE123,
       ngx_http_upstream_hash,
       NGX_HTTP_SRV_CONF_OFFSET,
       0,
@@ -164,14 +176,16 @@ ngx_http_upstream_get_hash_peer(ngx_peer_connection_t *pc, void *data)
 {
     ngx_http_upstream_hash_peer_data_t  *hp = data;
 
-    time_t                        now;
-    u_char                        buf[NGX_INT_T_LEN];
-    size_t                        size;
-    uint32_t                      hash;
-    ngx_int_t                     w;
-    uintptr_t                     m;
-    ngx_uint_t                    n, p;
-    ngx_http_upstream_rr_peer_t  *peer;
+    time_t                              now;
+    u_char                              buf[NGX_INT_T_LEN];
+    size_t                              size;
+    uint64_t                            value;
+    uint32_t                            hash;
+    ngx_int_t                           w;
+    uintptr_t                           m;
+    ngx_uint_t                          n, p;
+    ngx_http_upstream_rr_peer_t        *peer;
+    ngx_http_upstream_hash_srv_conf_t  *hcf;
 
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, pc->log, 0,
                    "get hash peer, try: %ui", pc->tries);
@@ -184,6 +198,7 @@ ngx_http_upstream_get_hash_peer(ngx_peer_connection_t *pc, void *data)
     }
 
     now = ngx_time();
+    hcf = hp->conf;
 
     pc->cached = 0;
     pc->connection = NULL;
@@ -191,20 +206,22 @@ ngx_http_upstream_get_hash_peer(ngx_peer_connection_t *pc, void *data)
     for ( ;; ) {
 
         /*
-         * Hash expression is compatible with Cache::Memcached:
+         * With the default crc32 function,
+         * hash expression is compatible with Cache::Memcached:
          * ((crc32([REHASH] KEY) >> 16) & 0x7fff) + PREV_HASH
          * with REHASH omitted at the first iteration.
          */
 
-        ngx_crc32_init(hash);
+        value = ngx_http_upstream_hash_init(hcf->function);
 
         if (hp->rehash > 0) {
             size = ngx_sprintf(buf, "%ui", hp->rehash) - buf;
-            ngx_crc32_update(&hash, buf, size);
+            ngx_http_upstream_hash_update(hcf->function, &value, buf, size);
         }
 
-        ngx_crc32_update(&hash, hp->key.data, hp->key.len);
-        ngx_crc32_final(hash);
+        ngx_http_upstream_hash_update(hcf->function, &value,
+                                      hp->key.data, hp->key.len);
+        hash = ngx_http_upstream_hash_final(hcf->function, value);
 
         hash = (hash >> 16) & 0x7fff;
 
@@ -287,7 +304,8 @@ ngx_http_upstream_init_chash(ngx_conf_t *cf, ngx_http_upstream_srv_conf_t *us)
 {
     u_char                             *host, *port, c;
     size_t                              host_len, port_len, size;
-    uint32_t                            hash, base_hash;
+    uint32_t                            hash;
+    uint64_t                            base_hash, value;
     ngx_str_t                          *server;
     ngx_uint_t                          npoints, i, j;
     ngx_http_upstream_rr_peer_t        *peer;
@@ -305,6 +323,8 @@ ngx_http_upstream_init_chash(ngx_conf_t *cf, ngx_http_upstream_srv_conf_t *us)
 
     us->peer.init = ngx_http_upstream_init_chash_peer;
 
+    hcf = ngx_http_conf_upstream_srv_conf(us, ngx_http_upstream_hash_module);
+
     peers = us->peer.data;
     npoints = peers->total_weight * 160;
 
@@ -322,7 +342,8 @@ ngx_http_upstream_init_chash(ngx_conf_t *cf, ngx_http_upstream_srv_conf_t *us)
         server = &peer->server;
 
         /*
-         * Hash expression is compatible with Cache::Memcached::Fast:
+         * With the default crc32 function,
+         * hash expression is compatible with Cache::Memcached::Fast:
          * crc32(HOST \0 PORT PREV_HASH).
          */
 
@@ -359,19 +380,23 @@ ngx_http_upstream_init_chash(ngx_conf_t *cf, ngx_http_upstream_srv_conf_t *us)
 
     done:
 
-        ngx_crc32_init(base_hash);
-        ngx_crc32_update(&base_hash, host, host_len);
-        ngx_crc32_update(&base_hash, (u_char *) "", 1);
-        ngx_crc32_update(&base_hash, port, port_len);
+        base_hash = ngx_http_upstream_hash_init(hcf->function);
+        ngx_http_upstream_hash_update(hcf->function, &base_hash,
+                                      host, host_len);
+        ngx_http_upstream_hash_update(hcf->function, &base_hash,
+                                      (u_char *) "", 1);
+        ngx_http_upstream_hash_update(hcf->function, &base_hash,
+                                      port, port_len);
 
         prev_hash.value = 0;
         npoints = peer->weight * 160;
 
         for (j = 0; j < npoints; j++) {
-            hash = base_hash;
+            value = base_hash;
 
-            ngx_crc32_update(&hash, prev_hash.byte, 4);
-            ngx_crc32_final(hash);
+            ngx_http_upstream_hash_update(hcf->function, &value,
+                                          prev_hash.byte, 4);
+            hash = ngx_http_upstream_hash_final(hcf->function, value);
 
             points->point[points->number].hash = hash;
             points->point[points->number].server = server;
@@ -401,7 +426,6 @@ ngx_http_upstream_init_chash(ngx_conf_t *cf, ngx_http_upstream_srv_conf_t *us)
 
     points->number = i + 1;
 
-    hcf = ngx_http_conf_upstream_srv_conf(us, ngx_http_upstream_hash_module);
     hcf->points = points;
 
     return NGX_OK;
@@ -465,6 +489,7 @@ ngx_http_upstream_init_chash_peer(ngx_http_request_t *r,
     ngx_http_upstream_srv_conf_t *us)
 {
     uint32_t                             hash;
+    uint64_t                             value;
     ngx_http_upstream_hash_srv_conf_t   *hcf;
     ngx_http_upstream_hash_peer_data_t  *hp;
 
@@ -477,7 +502,10 @@ ngx_http_upstream_init_chash_peer(ngx_http_request_t *r,
     hp = r->upstream->peer.data;
     hcf = ngx_http_conf_upstream_srv_conf(us, ngx_http_upstream_hash_module);
 
-    hash = ngx_crc32_long(hp->key.data, hp->key.len);
+    value = ngx_http_upstream_hash_init(hcf->function);
+    ngx_http_upstream_hash_update(hcf->function, &value,
+                                  hp->key.data, hp->key.len);
+    hash = ngx_http_upstream_hash_final(hcf->function, value);
 
     ngx_http_upstream_rr_peers_rlock(hp->rrp.peers);
 
@@ -619,6 +647,54 @@ found:
 }
 
 
+static uint64_t
+ngx_http_upstream_hash_init(ngx_uint_t function)
+{
+    if (function == NGX_HTTP_UPSTREAM_HASH_MURMUR64) {
+        return 0;
+    }
+
+    return 0xffffffff;
+}
+
+
+static void
+ngx_http_upstream_hash_update(ngx_uint_t function, uint64_t *hash, u_char *p,
+    size_t len)
+{
+    uint32_t  crc;
+
+    switch (function) {
+
+    case NGX_HTTP_UPSTREAM_HASH_CRC32C:
+        crc = (uint32_t) *hash;
+        ngx_crc32c_update(&crc, p, len);
+        *hash = crc;
+        break;
+
+    case NGX_HTTP_UPSTREAM_HASH_MURMUR64:
+        *hash = ngx_murmur_hash64(p, len, *hash);
+        break;
+
+    default: /* NGX_HTTP_UPSTREAM_HASH_CRC32 */
+        crc = (uint32_t) *hash;
+        ngx_crc32_update(&crc, p, len);
+        *hash = crc;
+    }
+}
+
+
+static uint32_t
+ngx_http_upstream_hash_final(ngx_uint_t function, uint64_t hash)
+{
+    if (function == NGX_HTTP_UPSTREAM_HASH_MURMUR64) {
+        return (uint32_t) (hash ^ (hash >> 32));
+    }
+
+    return (uint32_t) hash ^ 0xffffffff;
+}
+
+
 static void *
 ngx_http_upstream_hash_create_conf(ngx_conf_t *cf)
 {
@@ -629,6 +705,7 @@ ngx_http_upstream_hash_create_conf(ngx_conf_t *cf)
         return NULL;
     }
 
+    conf->function = NGX_HTTP_UPSTREAM_HASH_CRC32;
     conf->points = NULL;
 
     return conf;
@@ -641,6 +718,7 @@ ngx_http_upstream_hash(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_http_upstream_hash_srv_conf_t  *hcf = conf;
 
     ngx_str_t                         *value;
+    ngx_uint_t                         i;
     ngx_http_upstream_srv_conf_t      *uscf;
     ngx_http_compile_complex_value_t   ccv;
 
@@ -670,15 +748,32 @@ ngx_http_upstream_hash(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
                   |NGX_HTTP_UPSTREAM_FAIL_TIMEOUT
                   |NGX_HTTP_UPSTREAM_DOWN;
 
-    if (cf->args->nelts == 2) {
-        uscf->peer.init_upstream = ngx_http_upstream_init_hash;
+    uscf->peer.init_upstream = ngx_http_upstream_init_hash;
 
-    } else if (ngx_strcmp(value[2].data, "consistent") == 0) {
-        uscf->peer.init_upstream = ngx_http_upstream_init_chash;
+    for (i = 2; i < cf->args->nelts; i++) {
+
+        if (ngx_strcmp(value[i].data, "consistent") == 0) {
+            uscf->peer.init_upstream = ngx_http_upstream_init_chash;
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "function=crc32") == 0) {
+            hcf->function = NGX_HTTP_UPSTREAM_HASH_CRC32;
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "function=crc32c") == 0) {
+            hcf->function = NGX_HTTP_UPSTREAM_HASH_CRC32C;
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "function=murmur64") == 0) {
+            hcf->function = NGX_HTTP_UPSTREAM_HASH_MURMUR64;
+            continue;
+        }
 
-    } else {
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
-                           "invalid parameter \"%V\"", &value[2]);
+                           "invalid parameter \"%V\"", &value[i]);
         return NGX_CONF_ERROR;
     }
 
@@ -51,6 +51,14 @@ static ngx_int_t ngx_http_optimize_servers(ngx_conf_t *cf,
     ngx_http_core_main_conf_t *cmcf, ngx_array_t *ports);
 static ngx_int_t ngx_http_server_names(ngx_conf_t *cf,
     ngx_http_core_main_conf_t *cmcf, ngx_http_conf_addr_t *addr);
+#if (NGX_PCRE)
+static ngx_int_t ngx_http_server_names_regex_init(ngx_conf_t *cf,
+    ngx_http_virtual_names_t *vn);
+static ngx_int_t ngx_http_server_name_regex_key(ngx_pool_t *pool,
+    ngx_str_t *regex, ngx_str_t *key);
+static int ngx_libc_cdecl ngx_http_cmp_regex_keys(const void *one,
+    const void *two);
+#endif
 static ngx_int_t ngx_http_cmp_conf_addrs(const void *one, const void *two);
 static int ngx_libc_cdecl ngx_http_cmp_dns_wildcards(const void *one,
     const void *two);
@@ -1321,6 +1329,7 @@ ngx_http_add_address(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf,
     addr->opt = *lsopt;
     addr->hash.buckets = NULL;
     addr->hash.size = 0;
+    addr->hash.ctrl = NULL;
     addr->wc_head = NULL;
     addr->wc_tail = NULL;
 #if (NGX_PCRE)
@@ -1489,7 +1498,9 @@ ngx_http_server_names(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
 
     hash.key = ngx_hash_key_lc;
     hash.max_size = cmcf->server_names_hash_max_size;
-    hash.bucket_size = cmcf->server_names_hash_bucket_size;
+    hash.bucket_size = cmcf->server_names_hash_open
+                       ? NGX_HASH_OPEN
+                       : cmcf->server_names_hash_bucket_size;
     hash.name = "server_names_hash";
     hash.pool = cf->pool;
 
@@ -1577,6 +1588,312 @@ failed:
 }
 
 
+#if (NGX_PCRE)
+
+static ngx_int_t
+ngx_http_server_names_regex_init(ngx_conf_t *cf, ngx_http_virtual_names_t *vn)
+{
+    ngx_uint_t                  i, k, n, *list;
+    ngx_array_t                 keys, lists;
+    ngx_hash_key_t             *key, *hk;
+    ngx_hash_init_t             hash;
+    ngx_http_core_main_conf_t  *cmcf;
+
+    vn->regex_any = NULL;
+    vn->regex_all = NULL;
+    vn->cache = NULL;
+    vn->cache_mask = 0;
+
+    ngx_memzero(&vn->regex_keys, sizeof(ngx_hash_t));
+
+    if (vn->nregex == 0) {
+        return NGX_OK;
+    }
+
+    /*
+     * the regexes are grouped by their keys in the order of definition,
+     * the group of the empty key is the list of regexes without a key
+     */
+
+    if (ngx_array_init(&keys, cf->temp_pool, vn->nregex,
+                       sizeof(ngx_hash_key_t))
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < vn->nregex; i++) {
+        key = ngx_array_push(&keys);
+        if (key == NULL) {
+            return NGX_ERROR;
+        }
+
+        if (ngx_http_server_name_regex_key(cf->temp_pool, &vn->regex[i].name,
+                                           &key->key)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        key->key_hash = ngx_hash_key(key->key.data, key->key.len);
+        key->value = (void *) i;
+    }
+
+    ngx_qsort(keys.elts, (size_t) keys.nelts, sizeof(ngx_hash_key_t),
+              ngx_http_cmp_regex_keys);
+
+    if (ngx_array_init(&lists, cf->temp_pool, 16, sizeof(ngx_hash_key_t))
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    key = keys.elts;
+
+    for (i = 0; i < keys.nelts; i = k) {
+
+        for (k = i + 1; k < keys.nelts; k++) {
+            if (key[k].key.len != key[i].key.len
+                || ngx_strncmp(key[k].key.data, key[i].key.data,
+                               key[i].key.len)
+                   != 0)
+            {
+                break;
+            }
+        }
+
+        list = ngx_palloc(cf->pool, (k - i + 1) * sizeof(ngx_uint_t));
+        if (list == NULL) {
+            return NGX_ERROR;
+        }
+
+        for (n = i; n < k; n++) {
+            list[n - i] = (ngx_uint_t) key[n].value;
+        }
+
+        list[k - i] = NGX_HTTP_SERVER_NAME_END;
+
+        if (key[i].key.len == 0) {
+            vn->regex_any = list;
+            continue;
+        }
+
+        hk = ngx_array_push(&lists);
+        if (hk == NULL) {
+            return NGX_ERROR;
+        }
+
+        *hk = key[i];
+        hk->value = list;
+    }
+
+    if (vn->regex_any == NULL) {
+        vn->regex_any = ngx_palloc(cf->pool, sizeof(ngx_uint_t));
+        if (vn->regex_any == NULL) {
+            return NGX_ERROR;
+        }
+
+        vn->regex_any[0] = NGX_HTTP_SERVER_NAME_END;
+    }
+
+    vn->regex_all = ngx_palloc(cf->pool,
+                               (vn->nregex + 1) * sizeof(ngx_uint_t));
+    if (vn->regex_all == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < vn->nregex; i++) {
+        vn->regex_all[i] = i;
+    }
+
+    vn->regex_all[i] = NGX_HTTP_SERVER_NAME_END;
+
+    /*
+     * the keys are exact names, where the open addressing layout is
+     * faster; the size is not limited, as it grows with the regexes
+     */
+
+    hash.hash = &vn->regex_keys;
+    hash.key = ngx_hash_key;
+    hash.max_size = NGX_MAX_UINT32_VALUE;
+    hash.bucket_size = NGX_HASH_OPEN;
+    hash.name = "server_names_regex_hash";
+    hash.pool = cf->pool;
+    hash.temp_pool = NULL;
+
+    if (ngx_hash_init(&hash, lists.elts, lists.nelts) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    /* cf->ctx is not the http one after the http block is parsed */
+
+    cmcf = ngx_http_cycle_get_module_main_conf(cf->cycle,
+                                               ngx_http_core_module);
+
+    if (cmcf->server_names_cache == 0) {
+        return NGX_OK;
+    }
+
+    for (n = 1; n < cmcf->server_names_cache; n <<= 1) { /* void */ }
+
+    vn->cache = ngx_pcalloc(cf->pool, n * sizeof(ngx_http_server_name_cache_t));
+    if (vn->cache == NULL) {
+        return NGX_ERROR;
+    }
+
+    vn->cache_mask = n - 1;
+
+    return NGX_OK;
+}
+
+
+/*
+ * A regex that ends with "$" preceded by literal characters only matches
+ * names that end with them.  The key of a regex literal from "^" to "$"
+ * is the name itself, otherwise it is the part of the literal characters
+ * after their first dot: the labels a matching name ends with.  Escapes
+ * that take arguments, alternatives, quoting and comments are not
+ * analysed, such regexes get the empty key and are always run.
+ */
+
+static ngx_int_t
+ngx_http_server_name_regex_key(ngx_pool_t *pool, ngx_str_t *regex,
+    ngx_str_t *key)
+{
+    u_char      *p, *last, *start, *dst;
+    size_t       len;
+    ngx_uint_t   skip;
+
+    ngx_str_null(key);
+
+    p = regex->data;
+    last = p + regex->len;
+
+    start = NULL;
+    skip = 0;
+
+    while (p < last) {
+
+        if (*p == '\\') {
+
+            if (p + 1 == last || p[1] == 'Q') {
+                return NGX_OK;
+            }
+
+            if (p[1] == '.' || p[1] == '-') {
+                if (start == NULL && !skip) {
+                    start = p;
+                }
+
+                p += 2;
+                continue;
+            }
+
+            start = NULL;
+
+            /* "\x2e", "\056" or "\cA" take the characters that follow */
+
+            switch (p[1]) {
+            case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+            case 'h': case 'H': case 'v': case 'V': case 'b': case 'B':
+                skip = 0;
+                break;
+            default:
+                skip = 1;
+            }
+
+            p += 2;
+            continue;
+        }
+
+        if (*p == '|' || *p == '#') {
+            return NGX_OK;
+        }
+
+        if (*p == '$' && p + 1 == last) {
+            break;
+        }
+
+        if ((*p >= 'a' && *p <= 'z')
+            || (*p >= 'A' && *p <= 'Z')
+            || (*p >= '0' && *p <= '9')
+            || *p == '-')
+        {
+            if (start == NULL && !skip) {
+                start = p;
+            }
+
+            p++;
+            continue;
+        }
+
+        start = NULL;
+        skip = 0;
+        p++;
+    }
+
+    if (p == last || start == NULL) {
+        return NGX_OK;
+    }
+
+    dst = ngx_pnalloc(pool, p - start);
+    if (dst == NULL) {
+        return NGX_ERROR;
+    }
+
+    len = 0;
+
+    for (last = p, p = start; p < last; p++) {
+        if (*p != '\\') {
+            dst[len++] = ngx_tolower(*p);
+        }
+    }
+
+    if (start == regex->data + 1 && regex->data[0] == '^') {
+        key->len = len;
+        key->data = dst;
+        return NGX_OK;
+    }
+
+    p = ngx_strlchr(dst, dst + len, '.');
+
+    if (p == NULL || p + 1 == dst + len) {
+        return NGX_OK;
+    }
+
+    p++;
+
+    key->len = dst + len - p;
+    key->data = p;
+
+    return NGX_OK;
+}
+
+
+static int ngx_libc_cdecl
+ngx_http_cmp_regex_keys(const void *one, const void *two)
+{
+    ngx_int_t        rc;
+    ngx_hash_key_t  *first, *second;
+
+    first = (ngx_hash_key_t *) one;
+    second = (ngx_hash_key_t *) two;
+
+    rc = ngx_memn2cmp(first->key.data, second->key.data,
+                      first->key.len, second->key.len);
+
+    if (rc != 0) {
+        return (int) rc;
+    }
+
+    /* the order of definition within a key */
+
+    return ((ngx_uint_t) first->value < (ngx_uint_t) second->value) ? -1 : 1;
+}
+
+#endif
+
+
 static ngx_int_t
 ngx_http_cmp_conf_addrs(const void *one, const void *two)
 {
@@ -1765,10 +2082,18 @@ ngx_http_add_listening(ngx_conf_t *cf, ngx_http_conf_addr_t *addr)
     ls->fastopen = addr->opt.fastopen;
 #endif
 
+#if (NGX_HAVE_BUSY_POLL)
+    ls->busy_poll = addr->opt.busy_poll;
+#endif
+
 #if (NGX_HAVE_REUSEPORT)
     ls->reuseport = addr->opt.reuseport;
 #endif
 
+#if (NGX_HAVE_REUSEPORT_CBPF)
+    ls->reuseport_cpu = addr->opt.reuseport_cpu;
+#endif
+
     return ls;
 }
 
@@ -1829,6 +2154,10 @@ ngx_http_add_addrs(ngx_conf_t *cf, ngx_http_port_t *hport,
 #if (NGX_PCRE)
         vn->nregex = addr[i].nregex;
         vn->regex = addr[i].regex;
+
+        if (ngx_http_server_names_regex_init(cf, vn) != NGX_OK) {
+            return NGX_ERROR;
+        }
 #endif
     }
 
@@ -1894,6 +2223,10 @@ ngx_http_add_addrs6(ngx_conf_t *cf, ngx_http_port_t *hport,
 #if (NGX_PCRE)
         vn->nregex = addr[i].nregex;
         vn->regex = addr[i].regex;
+
+        if (ngx_http_server_names_regex_init(cf, vn) != NGX_OK) {
+            return NGX_ERROR;
+        }
 #endif
     }
 
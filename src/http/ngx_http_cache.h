@@ -29,6 +29,16 @@
 
 #define NGX_HTTP_CACHE_VERSION       5
 
+#define NGX_HTTP_CACHE_PROBATION     0
+#define NGX_HTTP_CACHE_PROTECTED     1
+#define NGX_HTTP_CACHE_WINDOW        2
+#define NGX_HTTP_CACHE_SEGMENTS      3
+
+#define NGX_HTTP_CACHE_EVICT_LRU     0
+#define NGX_HTTP_CACHE_EVICT_SLRU    1
+#define NGX_HTTP_CACHE_EVICT_GDSF    2
+#define NGX_HTTP_CACHE_EVICT_TINYLFU 3
+
 
 typedef struct {
     ngx_uint_t                       status;
@@ -51,7 +61,9 @@ typedef struct {
     unsigned                         updating:1;
     unsigned                         deleting:1;
     unsigned                         purged:1;
-                                     /* 10 unused bits */
+    unsigned                         indexed:1;
+    unsigned                         segment:2;
+                                     /* 7 unused bits */
 
     ngx_file_uniq_t                  uniq;
     time_t                           expire;
@@ -59,6 +71,7 @@ typedef struct {
     size_t                           body_start;
     off_t                            fs_size;
     ngx_msec_t                       lock_time;
+    ngx_uint_t                       priority;
 } ngx_http_file_cache_node_t;
 
 
@@ -122,6 +135,8 @@ struct ngx_http_cache_s {
 
     unsigned                         stale_updating:1;
     unsigned                         stale_error:1;
+
+    unsigned                         hot:1;
 };
 
 
@@ -147,15 +162,58 @@ typedef struct {
 typedef struct {
     ngx_rbtree_t                     rbtree;
     ngx_rbtree_node_t                sentinel;
-    ngx_queue_t                      queue;
-    ngx_atomic_t                     cold;
-    ngx_atomic_t                     loading;
+    ngx_queue_t                      queue[NGX_HTTP_CACHE_SEGMENTS];
+    ngx_uint_t                       length[NGX_HTTP_CACHE_SEGMENTS];
+    ngx_shmtx_t                     *mutex;
+    ngx_shmtx_sh_t                   lock;
     off_t                            size;
     ngx_uint_t                       count;
+    ngx_uint_t                       clock;
+    u_char                          *sketch;
+    ngx_uint_t                       width;
+    ngx_uint_t                       samples;
+} ngx_http_file_cache_part_t;
+
+
+typedef struct {
+    ngx_http_file_cache_part_t      *parts;
+    ngx_uint_t                       partitions;
+    ngx_atomic_t                     cold;
+    ngx_atomic_t                     loading;
+    ngx_atomic_t                     forced;
+    ngx_atomic_t                     journal_gen;
+    ngx_atomic_t                     journal_records;
     ngx_uint_t                       watermark;
 } ngx_http_file_cache_sh_t;
 
 
+typedef struct {
+    ngx_rbtree_node_t                node;
+    ngx_queue_t                      queue;
+
+    u_char                           key[NGX_HTTP_CACHE_KEY_LEN
+                                         - sizeof(ngx_rbtree_key_t)];
+
+    ngx_file_uniq_t                  uniq;
+    time_t                           valid_sec;
+    size_t                           len;
+    u_char                           data[1];
+} ngx_http_file_cache_hot_node_t;
+
+
+typedef struct {
+    ngx_rbtree_t                     rbtree;
+    ngx_rbtree_node_t                sentinel;
+    ngx_queue_t                      queue;
+    ngx_uint_t                       width;
+    ngx_uint_t                       samples;
+    u_char                          *sketch;
+    ngx_atomic_t                     lookups;
+    ngx_atomic_t                     hot_hits;
+    ngx_atomic_t                     disk_hits;
+} ngx_http_file_cache_hot_sh_t;
+
+
 struct ngx_http_file_cache_s {
     ngx_http_file_cache_sh_t        *sh;
     ngx_slab_pool_t                 *shpool;
@@ -175,6 +233,13 @@ struct ngx_http_file_cache_s {
     ngx_msec_t                       last;
     ngx_msec_t                       loader_sleep;
     ngx_msec_t                       loader_threshold;
+    ngx_uint_t                       loader_threads;
+
+    ngx_str_t                        journal;
+    ngx_str_t                        journal_new;
+    ngx_fd_t                         journal_fd;
+    ngx_atomic_uint_t                journal_gen;
+    time_t                           journal_fail_time;
 
     ngx_uint_t                       manager_files;
     ngx_msec_t                       manager_sleep;
@@ -184,6 +249,17 @@ struct ngx_http_file_cache_s {
 
     ngx_uint_t                       use_temp_path;
                                      /* unsigned use_temp_path:1 */
+
+    ngx_uint_t                       crc32c;
+                                     /* unsigned crc32c:1 */
+
+    ngx_uint_t                       partitions;
+    ngx_uint_t                       expire_part;
+    ngx_uint_t                       eviction;
+
+    ngx_http_file_cache_hot_sh_t    *hot;
+    ngx_slab_pool_t                 *hot_shpool;
+    ngx_shm_zone_t                  *hot_zone;
 };
 
 
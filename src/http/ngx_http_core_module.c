@@ -210,6 +210,20 @@ static ngx_command_t  ngx_http_core_commands[] = {
       offsetof(ngx_http_core_main_conf_t, server_names_hash_bucket_size),
       NULL },
 
+    { ngx_string("server_names_hash_open"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_core_main_conf_t, server_names_hash_open),
+      NULL },
+
+    { ngx_string("server_names_cache"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_core_main_conf_t, server_names_cache),
+      NULL },
+
     { ngx_string("server"),
       NGX_HTTP_MAIN_CONF|NGX_CONF_BLOCK|NGX_CONF_NOARGS,
       ngx_http_core_server,
@@ -308,6 +322,13 @@ static ngx_command_t  ngx_http_core_commands[] = {
       offsetof(ngx_http_core_loc_conf_t, types_hash_bucket_size),
       NULL },
 
+    { ngx_string("types_hash_open"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_core_loc_conf_t, types_hash_open),
+      NULL },
+
     { ngx_string("types"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF
                                           |NGX_CONF_BLOCK|NGX_CONF_NOARGS,
@@ -2923,6 +2944,9 @@ ngx_http_core_server(ngx_conf_t *cf, ngx_command_t *cmd, void *dummy)
 #endif
 #if (NGX_HAVE_TCP_FASTOPEN)
         lsopt.fastopen = -1;
+#endif
+#if (NGX_HAVE_BUSY_POLL)
+        lsopt.busy_poll = -1;
 #endif
         lsopt.wildcard = 1;
 
@@ -3308,6 +3332,8 @@ ngx_http_core_create_main_conf(ngx_conf_t *cf)
 
     cmcf->server_names_hash_max_size = NGX_CONF_UNSET_UINT;
     cmcf->server_names_hash_bucket_size = NGX_CONF_UNSET_UINT;
+    cmcf->server_names_hash_open = NGX_CONF_UNSET;
+    cmcf->server_names_cache = NGX_CONF_UNSET_UINT;
 
     cmcf->variables_hash_max_size = NGX_CONF_UNSET_UINT;
     cmcf->variables_hash_bucket_size = NGX_CONF_UNSET_UINT;
@@ -3328,6 +3354,9 @@ ngx_http_core_init_main_conf(ngx_conf_t *cf, void *conf)
     cmcf->server_names_hash_bucket_size =
             ngx_align(cmcf->server_names_hash_bucket_size, ngx_cacheline_size);
 
+    ngx_conf_init_value(cmcf->server_names_hash_open, 0);
+    ngx_conf_init_uint_value(cmcf->server_names_cache, 0);
+
 
     ngx_conf_init_uint_value(cmcf->variables_hash_max_size, 1024);
     ngx_conf_init_uint_value(cmcf->variables_hash_bucket_size, 64);
@@ -3534,6 +3563,7 @@ ngx_http_core_create_loc_conf(ngx_conf_t *cf)
     clcf->server_tokens = NGX_CONF_UNSET_UINT;
     clcf->types_hash_max_size = NGX_CONF_UNSET_UINT;
     clcf->types_hash_bucket_size = NGX_CONF_UNSET_UINT;
+    clcf->types_hash_open = NGX_CONF_UNSET;
 
     clcf->open_file_cache = NGX_CONF_UNSET_PTR;
     clcf->open_file_cache_valid = NGX_CONF_UNSET;
@@ -3613,6 +3643,8 @@ ngx_http_core_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     conf->types_hash_bucket_size = ngx_align(conf->types_hash_bucket_size,
                                              ngx_cacheline_size);
 
+    ngx_conf_merge_value(conf->types_hash_open, prev->types_hash_open, 0);
+
     /*
      * the special handling of the "types" directive in the "http" section
      * to inherit the http's conf->types_hash to all servers
@@ -3623,7 +3655,9 @@ ngx_http_core_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
         types_hash.hash = &prev->types_hash;
         types_hash.key = ngx_hash_key_lc;
         types_hash.max_size = conf->types_hash_max_size;
-        types_hash.bucket_size = conf->types_hash_bucket_size;
+        types_hash.bucket_size = conf->types_hash_open
+                                 ? NGX_HASH_OPEN
+                                 : conf->types_hash_bucket_size;
         types_hash.name = "types_hash";
         types_hash.pool = cf->pool;
         types_hash.temp_pool = NULL;
@@ -3665,7 +3699,9 @@ ngx_http_core_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
         types_hash.hash = &conf->types_hash;
         types_hash.key = ngx_hash_key_lc;
         types_hash.max_size = conf->types_hash_max_size;
-        types_hash.bucket_size = conf->types_hash_bucket_size;
+        types_hash.bucket_size = conf->types_hash_open
+                                 ? NGX_HASH_OPEN
+                                 : conf->types_hash_bucket_size;
         types_hash.name = "types_hash";
         types_hash.pool = cf->pool;
         types_hash.temp_pool = NULL;
@@ -3908,6 +3944,9 @@ ngx_http_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 #if (NGX_HAVE_TCP_FASTOPEN)
     lsopt.fastopen = -1;
 #endif
+#if (NGX_HAVE_BUSY_POLL)
+    lsopt.busy_poll = -1;
+#endif
 #if (NGX_HAVE_INET6)
     lsopt.ipv6only = 1;
 #endif
@@ -3959,6 +3998,22 @@ ngx_http_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         }
 #endif
 
+#if (NGX_HAVE_BUSY_POLL)
+        if (ngx_strncmp(value[n].data, "busy_poll=", 10) == 0) {
+            lsopt.busy_poll = ngx_atoi(value[n].data + 10, value[n].len - 10);
+            lsopt.set = 1;
+            lsopt.bind = 1;
+
+            if (lsopt.busy_poll == NGX_ERROR) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid busy_poll \"%V\"", &value[n]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+#endif
+
         if (ngx_strncmp(value[n].data, "backlog=", 8) == 0) {
             lsopt.backlog = ngx_atoi(value[n].data + 8, value[n].len - 8);
             lsopt.set = 1;
@@ -4074,6 +4129,20 @@ ngx_http_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strcmp(value[n].data, "reuseport=cpu") == 0) {
+#if (NGX_HAVE_REUSEPORT_CBPF)
+            lsopt.reuseport = 1;
+            lsopt.reuseport_cpu = 1;
+            lsopt.set = 1;
+            lsopt.bind = 1;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "reuseport=cpu is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
+
         if (ngx_strcmp(value[n].data, "ssl") == 0) {
 #if (NGX_HTTP_SSL)
             lsopt.ssl = 1;
@@ -80,6 +80,7 @@ typedef struct {
 #endif
     unsigned                   deferred_accept:1;
     unsigned                   reuseport:1;
+    unsigned                   reuseport_cpu:1;
     unsigned                   so_keepalive:2;
     unsigned                   proxy_protocol:1;
 
@@ -92,6 +93,9 @@ typedef struct {
 #if (NGX_HAVE_TCP_FASTOPEN)
     int                        fastopen;
 #endif
+#if (NGX_HAVE_BUSY_POLL)
+    int                        busy_poll;
+#endif
 #if (NGX_HAVE_KEEPALIVE_TUNABLE)
     int                        tcp_keepidle;
     int                        tcp_keepintvl;
@@ -164,6 +168,8 @@ typedef struct {
 
     ngx_uint_t                 server_names_hash_max_size;
     ngx_uint_t                 server_names_hash_bucket_size;
+    ngx_flag_t                 server_names_hash_open;
+    ngx_uint_t                 server_names_cache;
 
     ngx_uint_t                 variables_hash_max_size;
     ngx_uint_t                 variables_hash_bucket_size;
@@ -221,11 +227,43 @@ typedef struct {
 } ngx_http_server_name_t;
 
 
+#define NGX_HTTP_SERVER_NAME_CACHE_LEN  118
+
+/*
+ * a direct mapped cache of the regex server name lookups: the index of
+ * the first matching regex plus one, or 0 if none matched the name
+ */
+
 typedef struct {
-    ngx_hash_combined_t        names;
+    uint32_t                   hash;
+    uint32_t                   index;
+    u_short                    len;
+    u_char                     name[NGX_HTTP_SERVER_NAME_CACHE_LEN];
+} ngx_http_server_name_cache_t;
 
-    ngx_uint_t                 nregex;
-    ngx_http_server_name_t    *regex;
+
+/*
+ * the regexes are indexed by the literal names or name suffixes they
+ * require, see ngx_http_server_names_regex_init(); the lists of regex
+ * numbers are ascending and end with NGX_HTTP_SERVER_NAME_END
+ */
+
+#define NGX_HTTP_SERVER_NAME_END        ((ngx_uint_t) -1)
+#define NGX_HTTP_SERVER_NAME_LISTS      8
+
+
+typedef struct {
+    ngx_hash_combined_t            names;
+
+    ngx_uint_t                     nregex;
+    ngx_http_server_name_t        *regex;
+
+    ngx_hash_t                     regex_keys;
+    ngx_uint_t                    *regex_any;
+    ngx_uint_t                    *regex_all;
+
+    ngx_http_server_name_cache_t  *cache;
+    ngx_uint_t                     cache_mask;
 } ngx_http_virtual_names_t;
 
 
@@ -434,6 +472,7 @@ struct ngx_http_core_loc_conf_s {
 
     ngx_uint_t    types_hash_max_size;
     ngx_uint_t    types_hash_bucket_size;
+    ngx_flag_t    types_hash_open;
 
     ngx_queue_t  *locations;
 
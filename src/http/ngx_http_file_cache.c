@@ -11,6 +11,48 @@
 #include <ngx_md5.h>
 
 
+#define NGX_HTTP_FILE_CACHE_SKETCH_ROWS   4
+#define NGX_HTTP_FILE_CACHE_MAX_FREQ      15
+
+#define NGX_HTTP_FILE_CACHE_HOT_ADMIT     2
+#define NGX_HTTP_FILE_CACHE_HOT_EVICT     16
+
+#define NGX_HTTP_FILE_CACHE_MAX_PARTS     256
+
+#define NGX_HTTP_FILE_CACHE_GDSF_SCALE    1024
+#define NGX_HTTP_FILE_CACHE_GDSF_SAMPLES  8
+
+#define NGX_HTTP_FILE_CACHE_JOURNAL_MAGIC   0x314a434e  /* "NCJ1" */
+#define NGX_HTTP_FILE_CACHE_JOURNAL_ADD     1
+#define NGX_HTTP_FILE_CACHE_JOURNAL_DELETE  2
+#define NGX_HTTP_FILE_CACHE_JOURNAL_BUF     65536
+#define NGX_HTTP_FILE_CACHE_JOURNAL_SLACK   65536
+
+
+typedef struct {
+    uint32_t                         magic;
+    uint32_t                         op;
+    u_char                           key[NGX_HTTP_CACHE_KEY_LEN];
+    uint64_t                         fs_size;
+    uint32_t                         crc32;
+    uint32_t                         reserved;
+} ngx_http_file_cache_journal_rec_t;
+
+
+typedef struct {
+    ngx_http_file_cache_t           *cache;
+    ngx_uint_t                       files;
+    ngx_msec_t                       last;
+    ngx_uint_t                       shard;
+    ngx_uint_t                       shards;
+    ngx_int_t                        rc;
+#if (NGX_THREADS)
+    pthread_t                        tid;
+    unsigned                         thread:1;
+#endif
+} ngx_http_file_cache_loader_ctx_t;
+
+
 static ngx_int_t ngx_http_file_cache_lock(ngx_http_request_t *r,
     ngx_http_cache_t *c);
 static void ngx_http_file_cache_lock_wait_handler(ngx_event_t *ev);
@@ -32,8 +74,13 @@ static ngx_int_t ngx_http_file_cache_exists(ngx_http_file_cache_t *cache,
     ngx_http_cache_t *c);
 static ngx_int_t ngx_http_file_cache_name(ngx_http_request_t *r,
     ngx_path_t *path);
+static ngx_http_file_cache_part_t *
+    ngx_http_file_cache_part(ngx_http_file_cache_t *cache, u_char *key);
+static ngx_http_file_cache_part_t *
+    ngx_http_file_cache_node_part(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_node_t *fcn);
 static ngx_http_file_cache_node_t *
-    ngx_http_file_cache_lookup(ngx_http_file_cache_t *cache, u_char *key);
+    ngx_http_file_cache_lookup(ngx_http_file_cache_part_t *part, u_char *key);
 static void ngx_http_file_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
     ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
 static void ngx_http_file_cache_vary(ngx_http_request_t *r, u_char *vary,
@@ -46,10 +93,43 @@ static ngx_int_t ngx_http_file_cache_update_variant(ngx_http_request_t *r,
     ngx_http_cache_t *c);
 static void ngx_http_file_cache_cleanup(void *data);
 static time_t ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache);
+static time_t ngx_http_file_cache_forced_expire_part(
+    ngx_http_file_cache_t *cache, ngx_http_file_cache_part_t *part,
+    u_char *name);
 static time_t ngx_http_file_cache_expire(ngx_http_file_cache_t *cache);
+static time_t ngx_http_file_cache_expire_part(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_part_t *part, u_char *name, time_t now);
 static void ngx_http_file_cache_delete(ngx_http_file_cache_t *cache,
-    ngx_queue_t *q, u_char *name);
-static void ngx_http_file_cache_loader_sleep(ngx_http_file_cache_t *cache);
+    ngx_http_file_cache_part_t *part, ngx_queue_t *q, u_char *name);
+static void ngx_http_file_cache_usage(ngx_http_file_cache_t *cache,
+    off_t *size, ngx_uint_t *count);
+static void ngx_http_file_cache_link(ngx_http_file_cache_part_t *part,
+    ngx_http_file_cache_node_t *fcn);
+static void ngx_http_file_cache_unlink(ngx_http_file_cache_part_t *part,
+    ngx_http_file_cache_node_t *fcn);
+static void ngx_http_file_cache_access(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_part_t *part, ngx_http_file_cache_node_t *fcn,
+    u_char *key, ngx_uint_t fresh);
+static ngx_queue_t *ngx_http_file_cache_oldest(
+    ngx_http_file_cache_part_t *part);
+static ngx_queue_t *ngx_http_file_cache_victim(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_part_t *part);
+static ngx_queue_t *ngx_http_file_cache_gdsf_victim(
+    ngx_http_file_cache_part_t *part);
+static ngx_queue_t *ngx_http_file_cache_tinylfu_victim(
+    ngx_http_file_cache_part_t *part);
+static ngx_uint_t ngx_http_file_cache_node_freq(
+    ngx_http_file_cache_part_t *part, ngx_http_file_cache_node_t *fcn);
+static ngx_int_t ngx_http_file_cache_sketch_init(ngx_shm_zone_t *shm_zone,
+    ngx_http_file_cache_t *cache);
+static ngx_int_t ngx_http_file_cache_walk(ngx_http_file_cache_t *cache);
+static void ngx_http_file_cache_walk_shard(
+    ngx_http_file_cache_loader_ctx_t *lctx);
+#if (NGX_THREADS)
+static void *ngx_http_file_cache_walk_thread(void *data);
+#endif
+static void ngx_http_file_cache_loader_sleep(
+    ngx_http_file_cache_loader_ctx_t *lctx);
 static ngx_int_t ngx_http_file_cache_noop(ngx_tree_ctx_t *ctx,
     ngx_str_t *path);
 static ngx_int_t ngx_http_file_cache_manage_file(ngx_tree_ctx_t *ctx,
@@ -64,6 +144,33 @@ static ngx_int_t ngx_http_file_cache_delete_file(ngx_tree_ctx_t *ctx,
     ngx_str_t *path);
 static void ngx_http_file_cache_set_watermark(ngx_http_file_cache_t *cache);
 
+static void ngx_http_file_cache_journal_write(ngx_http_file_cache_t *cache,
+    u_char *key, off_t fs_size, ngx_uint_t op);
+static ngx_int_t ngx_http_file_cache_journal_replay(
+    ngx_http_file_cache_t *cache);
+static void ngx_http_file_cache_journal_apply(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_journal_rec_t *rec);
+static void ngx_http_file_cache_journal_sweep(ngx_http_file_cache_t *cache);
+static ngx_int_t ngx_http_file_cache_journal_compact(
+    ngx_http_file_cache_t *cache);
+
+static ngx_int_t ngx_http_file_cache_hot_init(ngx_shm_zone_t *shm_zone,
+    void *data);
+static ngx_int_t ngx_http_file_cache_hot_open(ngx_http_request_t *r,
+    ngx_http_cache_t *c);
+static void ngx_http_file_cache_hot_admit(ngx_http_request_t *r,
+    ngx_http_cache_t *c);
+static void ngx_http_file_cache_hot_delete(ngx_http_file_cache_t *cache,
+    u_char *key);
+static ngx_http_file_cache_hot_node_t *
+    ngx_http_file_cache_hot_lookup(ngx_http_file_cache_t *cache, u_char *key);
+static void ngx_http_file_cache_hot_free(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_hot_node_t *hn);
+static ngx_uint_t ngx_http_file_cache_freq(u_char *sketch, ngx_uint_t width,
+    ngx_uint_t *samples, u_char *key, ngx_uint_t add);
+static void ngx_http_file_cache_hot_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
+
 
 ngx_str_t  ngx_http_cache_status[] = {
     ngx_string("MISS"),
@@ -79,14 +186,26 @@ ngx_str_t  ngx_http_cache_status[] = {
 static u_char  ngx_http_file_cache_key[] = { LF, 'K', 'E', 'Y', ':', ' ' };
 
 
+static ngx_conf_enum_t  ngx_http_file_cache_eviction[] = {
+    { ngx_string("lru"), NGX_HTTP_CACHE_EVICT_LRU },
+    { ngx_string("slru"), NGX_HTTP_CACHE_EVICT_SLRU },
+    { ngx_string("gdsf"), NGX_HTTP_CACHE_EVICT_GDSF },
+    { ngx_string("tinylfu"), NGX_HTTP_CACHE_EVICT_TINYLFU },
+    { ngx_null_string, 0 }
+};
+
+
 static ngx_int_t
 ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 {
     ngx_http_file_cache_t  *ocache = data;
 
-    size_t                  len;
-    ngx_uint_t              n;
-    ngx_http_file_cache_t  *cache;
+    u_char                      *file;
+    size_t                       len;
+    ngx_uint_t                   i, n;
+    ngx_shmtx_t                 *mutexes;
+    ngx_http_file_cache_t       *cache;
+    ngx_http_file_cache_part_t  *part;
 
     cache = shm_zone->data;
 
@@ -110,6 +229,13 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
             }
         }
 
+        if (cache->partitions != ocache->sh->partitions) {
+            ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                          "cache \"%V\" had previously different partitions",
+                          &shm_zone->shm.name);
+            return NGX_ERROR;
+        }
+
         cache->sh = ocache->sh;
 
         cache->shpool = ocache->shpool;
@@ -121,7 +247,7 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
             cache->path->loader = NULL;
         }
 
-        return NGX_OK;
+        return ngx_http_file_cache_sketch_init(shm_zone, cache);
     }
 
     cache->shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
@@ -131,7 +257,7 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
         cache->bsize = ngx_fs_bsize(cache->path->name.data);
         cache->max_size /= cache->bsize;
 
-        return NGX_OK;
+        return ngx_http_file_cache_sketch_init(shm_zone, cache);
     }
 
     cache->sh = ngx_slab_alloc(cache->shpool, sizeof(ngx_http_file_cache_sh_t));
@@ -141,15 +267,59 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 
     cache->shpool->data = cache->sh;
 
-    ngx_rbtree_init(&cache->sh->rbtree, &cache->sh->sentinel,
-                    ngx_http_file_cache_rbtree_insert_value);
+    /*
+     * the keys are spread over the partitions, each one with its own
+     * rbtree, inactive queue and mutex, while the zone size is shared
+     */
+
+    part = ngx_slab_calloc(cache->shpool,
+                           cache->partitions
+                           * sizeof(ngx_http_file_cache_part_t));
+    if (part == NULL) {
+        return NGX_ERROR;
+    }
+
+    mutexes = ngx_slab_calloc(cache->shpool,
+                              cache->partitions * sizeof(ngx_shmtx_t));
+    if (mutexes == NULL) {
+        return NGX_ERROR;
+    }
+
+#if (NGX_HAVE_ATOMIC_OPS)
+
+    file = NULL;
+
+#else
+
+    /* the lock file is deleted right after it is opened */
+
+    file = cache->shpool->mutex.name;
+
+#endif
+
+    for (n = 0; n < cache->partitions; n++) {
+        ngx_rbtree_init(&part[n].rbtree, &part[n].sentinel,
+                        ngx_http_file_cache_rbtree_insert_value);
 
-    ngx_queue_init(&cache->sh->queue);
+        for (i = 0; i < NGX_HTTP_CACHE_SEGMENTS; i++) {
+            ngx_queue_init(&part[n].queue[i]);
+        }
+
+        part[n].mutex = &mutexes[n];
+
+        if (ngx_shmtx_create(part[n].mutex, &part[n].lock, file) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
 
+    cache->shpool->mutexes = mutexes;
+    cache->shpool->nmutexes = cache->partitions;
+
+    cache->sh->parts = part;
+    cache->sh->partitions = cache->partitions;
     cache->sh->cold = 1;
     cache->sh->loading = 0;
-    cache->sh->size = 0;
-    cache->sh->count = 0;
+    cache->sh->forced = 0;
     cache->sh->watermark = (ngx_uint_t) -1;
 
     cache->bsize = ngx_fs_bsize(cache->path->name.data);
@@ -168,6 +338,62 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 
     cache->shpool->log_nomem = 0;
 
+    return ngx_http_file_cache_sketch_init(shm_zone, cache);
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_sketch_init(ngx_shm_zone_t *shm_zone,
+    ngx_http_file_cache_t *cache)
+{
+    u_char                      *sketch;
+    ngx_uint_t                   n, width;
+    ngx_http_file_cache_part_t  *part;
+
+    if (cache->eviction != NGX_HTTP_CACHE_EVICT_TINYLFU) {
+        return NGX_OK;
+    }
+
+    /*
+     * the sketches are allocated on the first use of the policy, and
+     * workers of the previous configuration do not look at them;
+     * each row has about one counter per node the zone can hold;
+     * a partition without a sketch is evicted as with "slru"
+     */
+
+    width = 256;
+
+    while (width * cache->sh->partitions
+           < shm_zone->shm.size / sizeof(ngx_http_file_cache_node_t))
+    {
+        width <<= 1;
+    }
+
+    for (n = 0; n < cache->sh->partitions; n++) {
+        part = &cache->sh->parts[n];
+
+        if (part->sketch) {
+            continue;
+        }
+
+        sketch = ngx_slab_calloc(cache->shpool,
+                                 NGX_HTTP_FILE_CACHE_SKETCH_ROWS * width);
+        if (sketch == NULL) {
+            ngx_log_error(NGX_LOG_WARN, shm_zone->shm.log, 0,
+                          "could not allocate frequency sketch "
+                          "in cache keys zone \"%V\"", &shm_zone->shm.name);
+            return NGX_OK;
+        }
+
+        ngx_shmtx_lock(part->mutex);
+
+        part->width = width;
+        part->samples = 0;
+        part->sketch = sketch;
+
+        ngx_shmtx_unlock(part->mutex);
+    }
+
     return NGX_OK;
 }
 
@@ -229,7 +455,7 @@ ngx_http_file_cache_create_key(ngx_http_request_t *r)
 {
     size_t             len;
     ngx_str_t         *key;
-    ngx_uint_t         i;
+    ngx_uint_t         i, crc32c;
     ngx_md5_t          md5;
     ngx_http_cache_t  *c;
 
@@ -237,7 +463,17 @@ ngx_http_file_cache_create_key(ngx_http_request_t *r)
 
     len = 0;
 
-    ngx_crc32_init(c->crc32);
+    /* the key crc is stored in the cache file header */
+
+    crc32c = c->file_cache->crc32c;
+
+    if (crc32c) {
+        ngx_crc32c_init(c->crc32);
+
+    } else {
+        ngx_crc32_init(c->crc32);
+    }
+
     ngx_md5_init(&md5);
 
     key = c->keys.elts;
@@ -247,14 +483,26 @@ ngx_http_file_cache_create_key(ngx_http_request_t *r)
 
         len += key[i].len;
 
-        ngx_crc32_update(&c->crc32, key[i].data, key[i].len);
+        if (crc32c) {
+            ngx_crc32c_update(&c->crc32, key[i].data, key[i].len);
+
+        } else {
+            ngx_crc32_update(&c->crc32, key[i].data, key[i].len);
+        }
+
         ngx_md5_update(&md5, key[i].data, key[i].len);
     }
 
     c->header_start = sizeof(ngx_http_file_cache_header_t)
                       + sizeof(ngx_http_file_cache_key) + len + 1;
 
-    ngx_crc32_final(c->crc32);
+    if (crc32c) {
+        ngx_crc32c_final(c->crc32);
+
+    } else {
+        ngx_crc32_final(c->crc32);
+    }
+
     ngx_md5_final(c->key, &md5);
 
     ngx_memcpy(c->main, c->key, NGX_HTTP_CACHE_KEY_LEN);
@@ -284,6 +532,8 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
 
     cache = c->file_cache;
 
+    c->hot = 0;
+
     if (c->node == NULL) {
         cln = ngx_pool_cleanup_add(r->pool, 0);
         if (cln == NULL) {
@@ -292,6 +542,10 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
 
         cln->handler = ngx_http_file_cache_cleanup;
         cln->data = c;
+
+        if (cache->hot && !c->secondary) {
+            (void) ngx_atomic_fetch_add(&cache->hot->lookups, 1);
+        }
     }
 
     c->buffer_size = c->body_start;
@@ -345,6 +599,18 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
         goto done;
     }
 
+    if (cache->hot && c->exists) {
+        rc = ngx_http_file_cache_hot_open(r, c);
+
+        if (rc == NGX_OK) {
+            return ngx_http_file_cache_read(r, c);
+        }
+
+        if (rc == NGX_ERROR) {
+            return rc;
+        }
+    }
+
     clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
     ngx_memzero(&of, sizeof(ngx_open_file_info_t));
@@ -384,6 +650,13 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
     c->length = of.size;
     c->fs_size = (of.fs_size + cache->bsize - 1) / cache->bsize;
 
+    if (cache->hot && c->length <= (off_t) c->buffer_size) {
+
+        /* small files are read at once to be admitted to the hot tier */
+
+        c->body_start = (size_t) c->length;
+    }
+
     c->buf = ngx_create_temp_buf(r->pool, c->body_start);
     if (c->buf == NULL) {
         return NGX_ERROR;
@@ -404,8 +677,9 @@ done:
 static ngx_int_t
 ngx_http_file_cache_lock(ngx_http_request_t *r, ngx_http_cache_t *c)
 {
-    ngx_msec_t                 now, timer;
-    ngx_http_file_cache_t     *cache;
+    ngx_msec_t                   now, timer;
+    ngx_http_file_cache_t       *cache;
+    ngx_http_file_cache_part_t  *part;
 
     if (!c->lock) {
         return NGX_DECLINED;
@@ -414,8 +688,9 @@ ngx_http_file_cache_lock(ngx_http_request_t *r, ngx_http_cache_t *c)
     now = ngx_current_msec;
 
     cache = c->file_cache;
+    part = ngx_http_file_cache_node_part(cache, c->node);
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    ngx_shmtx_lock(part->mutex);
 
     timer = c->node->lock_time - now;
 
@@ -426,7 +701,7 @@ ngx_http_file_cache_lock(ngx_http_request_t *r, ngx_http_cache_t *c)
         c->lock_time = c->node->lock_time;
     }
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(part->mutex);
 
     ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "http file cache lock u:%d wt:%M",
@@ -483,9 +758,10 @@ ngx_http_file_cache_lock_wait_handler(ngx_event_t *ev)
 static void
 ngx_http_file_cache_lock_wait(ngx_http_request_t *r, ngx_http_cache_t *c)
 {
-    ngx_uint_t              wait;
-    ngx_msec_t              now, timer;
-    ngx_http_file_cache_t  *cache;
+    ngx_uint_t                   wait;
+    ngx_msec_t                   now, timer;
+    ngx_http_file_cache_t       *cache;
+    ngx_http_file_cache_part_t  *part;
 
     now = ngx_current_msec;
 
@@ -499,9 +775,10 @@ ngx_http_file_cache_lock_wait(ngx_http_request_t *r, ngx_http_cache_t *c)
     }
 
     cache = c->file_cache;
+    part = ngx_http_file_cache_node_part(cache, c->node);
     wait = 0;
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    ngx_shmtx_lock(part->mutex);
 
     timer = c->node->lock_time - now;
 
@@ -509,7 +786,7 @@ ngx_http_file_cache_lock_wait(ngx_http_request_t *r, ngx_http_cache_t *c)
         wait = 1;
     }
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(part->mutex);
 
     if (wait) {
         ngx_add_timer(&c->wait_event, (timer > 500) ? 500 : timer);
@@ -534,12 +811,18 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
     ngx_int_t                      rc;
     ngx_uint_t                     i;
     ngx_http_file_cache_t         *cache;
+    ngx_http_file_cache_part_t    *part;
     ngx_http_file_cache_header_t  *h;
 
-    n = ngx_http_file_cache_aio_read(r, c);
+    if (c->hot) {
+        n = c->length;
 
-    if (n < 0) {
-        return n;
+    } else {
+        n = ngx_http_file_cache_aio_read(r, c);
+
+        if (n < 0) {
+            return n;
+        }
     }
 
     if ((size_t) n < c->header_start) {
@@ -616,10 +899,11 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
     r->cached = 1;
 
     cache = c->file_cache;
+    part = ngx_http_file_cache_node_part(cache, c->node);
 
     if (cache->sh->cold) {
 
-        ngx_shmtx_lock(&cache->shpool->mutex);
+        ngx_shmtx_lock(part->mutex);
 
         if (!c->node->exists) {
             c->node->uses = 1;
@@ -628,10 +912,10 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
             c->node->uniq = c->uniq;
             c->node->fs_size = c->fs_size;
 
-            cache->sh->size += c->fs_size;
+            part->size += c->fs_size;
         }
 
-        ngx_shmtx_unlock(&cache->shpool->mutex);
+        ngx_shmtx_unlock(part->mutex);
     }
 
     now = ngx_time();
@@ -640,7 +924,7 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
         c->stale_updating = c->valid_sec + c->updating_sec >= now;
         c->stale_error = c->valid_sec + c->error_sec >= now;
 
-        ngx_shmtx_lock(&cache->shpool->mutex);
+        ngx_shmtx_lock(part->mutex);
 
         if (c->node->updating) {
             rc = NGX_HTTP_CACHE_UPDATING;
@@ -652,7 +936,7 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
             rc = NGX_HTTP_CACHE_STALE;
         }
 
-        ngx_shmtx_unlock(&cache->shpool->mutex);
+        ngx_shmtx_unlock(part->mutex);
 
         ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                        "http file cache expired: %i %T %T",
@@ -661,6 +945,22 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
         return rc;
     }
 
+    if (cache->hot) {
+
+        if (c->hot) {
+            (void) ngx_atomic_fetch_add(&cache->hot->hot_hits, 1);
+
+        } else {
+            (void) ngx_atomic_fetch_add(&cache->hot->disk_hits, 1);
+
+            /* only the responses read from disk at once are admitted */
+
+            if (n == c->length) {
+                ngx_http_file_cache_hot_admit(r, c);
+            }
+        }
+    }
+
     return NGX_OK;
 }
 
@@ -822,18 +1122,27 @@ static ngx_int_t
 ngx_http_file_cache_exists(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
 {
     ngx_int_t                    rc;
+    ngx_uint_t                   access, fresh;
     ngx_http_file_cache_node_t  *fcn;
+    ngx_http_file_cache_part_t  *part;
+
+    part = ngx_http_file_cache_part(cache, c->key);
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    /* only the first lookup of a request counts as an access */
+
+    access = (c->node == NULL);
+    fresh = 0;
+
+    ngx_shmtx_lock(part->mutex);
 
     fcn = c->node;
 
     if (fcn == NULL) {
-        fcn = ngx_http_file_cache_lookup(cache, c->key);
+        fcn = ngx_http_file_cache_lookup(part, c->key);
     }
 
     if (fcn) {
-        ngx_queue_remove(&fcn->queue);
+        ngx_http_file_cache_unlink(part, fcn);
 
         if (c->node == NULL) {
             fcn->uses++;
@@ -868,19 +1177,18 @@ ngx_http_file_cache_exists(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
         goto done;
     }
 
-    fcn = ngx_slab_calloc_locked(cache->shpool,
-                                 sizeof(ngx_http_file_cache_node_t));
+    fcn = ngx_slab_calloc(cache->shpool, sizeof(ngx_http_file_cache_node_t));
     if (fcn == NULL) {
         ngx_http_file_cache_set_watermark(cache);
 
-        ngx_shmtx_unlock(&cache->shpool->mutex);
+        ngx_shmtx_unlock(part->mutex);
 
         (void) ngx_http_file_cache_forced_expire(cache);
 
-        ngx_shmtx_lock(&cache->shpool->mutex);
+        ngx_shmtx_lock(part->mutex);
 
-        fcn = ngx_slab_calloc_locked(cache->shpool,
-                                     sizeof(ngx_http_file_cache_node_t));
+        fcn = ngx_slab_calloc(cache->shpool,
+                              sizeof(ngx_http_file_cache_node_t));
         if (fcn == NULL) {
             ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
                           "could not allocate node%s", cache->shpool->log_ctx);
@@ -889,18 +1197,20 @@ ngx_http_file_cache_exists(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
         }
     }
 
-    cache->sh->count++;
+    part->count++;
 
     ngx_memcpy((u_char *) &fcn->node.key, c->key, sizeof(ngx_rbtree_key_t));
 
     ngx_memcpy(fcn->key, &c->key[sizeof(ngx_rbtree_key_t)],
                NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
 
-    ngx_rbtree_insert(&cache->sh->rbtree, &fcn->node);
+    ngx_rbtree_insert(&part->rbtree, &fcn->node);
 
     fcn->uses = 1;
     fcn->count = 1;
 
+    fresh = 1;
+
 renew:
 
     rc = NGX_DECLINED;
@@ -917,7 +1227,12 @@ done:
 
     fcn->expire = ngx_time() + cache->inactive;
 
-    ngx_queue_insert_head(&cache->sh->queue, &fcn->queue);
+    if (access) {
+        ngx_http_file_cache_access(cache, part, fcn, c->key, fresh);
+
+    } else {
+        ngx_http_file_cache_link(part, fcn);
+    }
 
     c->uniq = fcn->uniq;
     c->error = fcn->error;
@@ -925,7 +1240,7 @@ done:
 
 failed:
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(part->mutex);
 
     return rc;
 }
@@ -966,8 +1281,34 @@ ngx_http_file_cache_name(ngx_http_request_t *r, ngx_path_t *path)
 }
 
 
+static ngx_http_file_cache_part_t *
+ngx_http_file_cache_part(ngx_http_file_cache_t *cache, u_char *key)
+{
+    ngx_uint_t  n;
+
+    /* the last byte of the key is not used by the rbtree node key */
+
+    n = key[NGX_HTTP_CACHE_KEY_LEN - 1] % cache->sh->partitions;
+
+    return &cache->sh->parts[n];
+}
+
+
+static ngx_http_file_cache_part_t *
+ngx_http_file_cache_node_part(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_node_t *fcn)
+{
+    ngx_uint_t  n;
+
+    n = fcn->key[NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t) - 1]
+        % cache->sh->partitions;
+
+    return &cache->sh->parts[n];
+}
+
+
 static ngx_http_file_cache_node_t *
-ngx_http_file_cache_lookup(ngx_http_file_cache_t *cache, u_char *key)
+ngx_http_file_cache_lookup(ngx_http_file_cache_part_t *part, u_char *key)
 {
     ngx_int_t                    rc;
     ngx_rbtree_key_t             node_key;
@@ -976,8 +1317,8 @@ ngx_http_file_cache_lookup(ngx_http_file_cache_t *cache, u_char *key)
 
     ngx_memcpy((u_char *) &node_key, key, sizeof(ngx_rbtree_key_t));
 
-    node = cache->sh->rbtree.root;
-    sentinel = cache->sh->rbtree.sentinel;
+    node = part->rbtree.root;
+    sentinel = part->rbtree.sentinel;
 
     while (node != sentinel) {
 
@@ -1209,7 +1550,8 @@ ngx_http_file_cache_vary_header(ngx_http_request_t *r, ngx_md5_t *md5,
 static ngx_int_t
 ngx_http_file_cache_reopen(ngx_http_request_t *r, ngx_http_cache_t *c)
 {
-    ngx_http_file_cache_t  *cache;
+    ngx_http_file_cache_t       *cache;
+    ngx_http_file_cache_part_t  *part;
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->file.log, 0,
                    "http file cache reopen");
@@ -1222,13 +1564,14 @@ ngx_http_file_cache_reopen(ngx_http_request_t *r, ngx_http_cache_t *c)
     }
 
     cache = c->file_cache;
+    part = ngx_http_file_cache_node_part(cache, c->node);
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    ngx_shmtx_lock(part->mutex);
 
     c->node->count--;
     c->node = NULL;
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(part->mutex);
 
     c->secondary = 1;
     c->file.name.len = 0;
@@ -1308,7 +1651,8 @@ ngx_http_file_cache_set_header(ngx_http_request_t *r, u_char *buf)
 static ngx_int_t
 ngx_http_file_cache_update_variant(ngx_http_request_t *r, ngx_http_cache_t *c)
 {
-    ngx_http_file_cache_t  *cache;
+    ngx_http_file_cache_t       *cache;
+    ngx_http_file_cache_part_t  *part;
 
     if (!c->secondary) {
         return NGX_OK;
@@ -1330,13 +1674,15 @@ ngx_http_file_cache_update_variant(ngx_http_request_t *r, ngx_http_cache_t *c)
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "http file cache main key");
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    part = ngx_http_file_cache_node_part(cache, c->node);
+
+    ngx_shmtx_lock(part->mutex);
 
     c->node->count--;
     c->node->updating = 0;
     c->node = NULL;
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(part->mutex);
 
     c->file.name.len = 0;
     c->update_variant = 1;
@@ -1358,13 +1704,14 @@ ngx_http_file_cache_update_variant(ngx_http_request_t *r, ngx_http_cache_t *c)
 void
 ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf)
 {
-    off_t                   fs_size;
-    ngx_int_t               rc;
-    ngx_file_uniq_t         uniq;
-    ngx_file_info_t         fi;
-    ngx_http_cache_t        *c;
-    ngx_ext_rename_file_t   ext;
-    ngx_http_file_cache_t  *cache;
+    off_t                        fs_size;
+    ngx_int_t                    rc;
+    ngx_file_uniq_t              uniq;
+    ngx_file_info_t              fi;
+    ngx_http_cache_t            *c;
+    ngx_ext_rename_file_t        ext;
+    ngx_http_file_cache_t       *cache;
+    ngx_http_file_cache_part_t  *part;
 
     c = r->cache;
 
@@ -1410,14 +1757,16 @@ ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf)
         }
     }
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    part = ngx_http_file_cache_node_part(cache, c->node);
+
+    ngx_shmtx_lock(part->mutex);
 
     c->node->count--;
     c->node->error = 0;
     c->node->uniq = uniq;
     c->node->body_start = c->body_start;
 
-    cache->sh->size += fs_size - c->node->fs_size;
+    part->size += fs_size - c->node->fs_size;
     c->node->fs_size = fs_size;
 
     if (rc == NGX_OK) {
@@ -1425,8 +1774,19 @@ ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf)
     }
 
     c->node->updating = 0;
+    c->node->indexed = 0;
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(part->mutex);
+
+    if (cache->journal.len && rc == NGX_OK) {
+        ngx_http_file_cache_journal_write(cache, c->key,
+                                          fs_size * cache->bsize,
+                                          NGX_HTTP_FILE_CACHE_JOURNAL_ADD);
+    }
+
+    if (cache->hot) {
+        ngx_http_file_cache_hot_delete(cache, c->key);
+    }
 }
 
 
@@ -1553,6 +1913,10 @@ ngx_http_file_cache_update_header(ngx_http_request_t *r)
     (void) ngx_write_file(&file, (u_char *) &h,
                           sizeof(ngx_http_file_cache_header_t), 0);
 
+    if (c->file_cache->hot) {
+        ngx_http_file_cache_hot_delete(c->file_cache, c->key);
+    }
+
 done:
 
     if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
@@ -1586,9 +1950,11 @@ ngx_http_cache_send(ngx_http_request_t *r)
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
 
-    b->file = ngx_pcalloc(r->pool, sizeof(ngx_file_t));
-    if (b->file == NULL) {
-        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    if (!c->hot) {
+        b->file = ngx_pcalloc(r->pool, sizeof(ngx_file_t));
+        if (b->file == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
     }
 
     rc = ngx_http_send_header(r);
@@ -1597,17 +1963,29 @@ ngx_http_cache_send(ngx_http_request_t *r)
         return rc;
     }
 
-    b->file_pos = c->body_start;
-    b->file_last = c->length;
+    if (c->hot) {
+
+        /* the response copied from the hot tier */
+
+        b->pos = c->buf->pos + c->body_start;
+        b->last = c->buf->pos + c->length;
+
+        b->memory = (c->length - c->body_start) ? 1: 0;
+
+    } else {
+        b->file_pos = c->body_start;
+        b->file_last = c->length;
+
+        b->in_file = (c->length - c->body_start) ? 1: 0;
+
+        b->file->fd = c->file.fd;
+        b->file->name = c->file.name;
+        b->file->log = r->connection->log;
+    }
 
-    b->in_file = (c->length - c->body_start) ? 1: 0;
     b->last_buf = (r == r->main) ? 1: 0;
     b->last_in_chain = 1;
 
-    b->file->fd = c->file.fd;
-    b->file->name = c->file.name;
-    b->file->log = r->connection->log;
-
     out.buf = b;
     out.next = NULL;
 
@@ -1620,6 +1998,7 @@ ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
 {
     ngx_http_file_cache_t       *cache;
     ngx_http_file_cache_node_t  *fcn;
+    ngx_http_file_cache_part_t  *part;
 
     if (c->updated || c->node == NULL) {
         return;
@@ -1630,9 +2009,11 @@ ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->file.log, 0,
                    "http file cache free, fd: %d", c->file.fd);
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
-
     fcn = c->node;
+    part = ngx_http_file_cache_node_part(cache, fcn);
+
+    ngx_shmtx_lock(part->mutex);
+
     fcn->count--;
 
     if (c->updating && fcn->lock_time == c->lock_time) {
@@ -1648,14 +2029,14 @@ ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
         }
 
     } else if (!fcn->exists && fcn->count == 0 && c->min_uses == 1) {
-        ngx_queue_remove(&fcn->queue);
-        ngx_rbtree_delete(&cache->sh->rbtree, &fcn->node);
-        ngx_slab_free_locked(cache->shpool, fcn);
-        cache->sh->count--;
+        ngx_http_file_cache_unlink(part, fcn);
+        ngx_rbtree_delete(&part->rbtree, &fcn->node);
+        ngx_slab_free(cache->shpool, fcn);
+        part->count--;
         c->node = NULL;
     }
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(part->mutex);
 
     c->updated = 1;
     c->updating = 0;
@@ -1704,14 +2085,12 @@ ngx_http_file_cache_cleanup(void *data)
 static time_t
 ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
 {
-    u_char                      *name, *p;
+    u_char                      *name;
     size_t                       len;
-    time_t                       wait;
-    ngx_uint_t                   tries;
+    time_t                       wait, rc;
+    ngx_uint_t                   i, n, start;
     ngx_path_t                  *path;
-    ngx_queue_t                 *q, *sentinel;
-    ngx_http_file_cache_node_t  *fcn;
-    u_char                       key[2 * NGX_HTTP_CACHE_KEY_LEN];
+    ngx_http_file_cache_part_t  *part;
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
                    "http file cache forced expire");
@@ -1726,20 +2105,56 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
 
     ngx_memcpy(name, path->name.data, path->name.len);
 
+    /*
+     * there is no global inactive queue, so the partitions are tried
+     * in turn starting from the next one after the previous call
+     */
+
     wait = 10;
-    tries = 20;
-    sentinel = NULL;
+    n = cache->sh->partitions;
+    start = ngx_atomic_fetch_add(&cache->sh->forced, 1);
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    for (i = 0; i < n; i++) {
+        part = &cache->sh->parts[(start + i) % n];
 
-    for ( ;; ) {
-        if (ngx_queue_empty(&cache->sh->queue)) {
+        rc = ngx_http_file_cache_forced_expire_part(cache, part, name);
+        if (rc < wait) {
+            wait = rc;
+        }
+
+        if (wait == 0) {
             break;
         }
+    }
+
+    ngx_free(name);
 
-        q = ngx_queue_last(&cache->sh->queue);
+    return wait;
+}
+
+
+static time_t
+ngx_http_file_cache_forced_expire_part(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_part_t *part, u_char *name)
+{
+    u_char                      *p;
+    size_t                       len;
+    time_t                       wait;
+    ngx_uint_t                   tries;
+    ngx_queue_t                 *q, *sentinel;
+    ngx_http_file_cache_node_t  *fcn;
+    u_char                       key[2 * NGX_HTTP_CACHE_KEY_LEN];
+
+    wait = 10;
+    tries = 20;
+    sentinel = NULL;
+
+    ngx_shmtx_lock(part->mutex);
+
+    for ( ;; ) {
+        q = ngx_http_file_cache_victim(cache, part);
 
-        if (q == sentinel) {
+        if (q == NULL || q == sentinel) {
             break;
         }
 
@@ -1751,7 +2166,7 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
                   fcn->key[0], fcn->key[1], fcn->key[2], fcn->key[3]);
 
         if (fcn->count == 0) {
-            ngx_http_file_cache_delete(cache, q, name);
+            ngx_http_file_cache_delete(cache, part, q, name);
             wait = 0;
             break;
         }
@@ -1767,9 +2182,9 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
          * we prefer to just move them to the top of the inactive queue
          */
 
-        ngx_queue_remove(q);
+        ngx_http_file_cache_unlink(part, fcn);
         fcn->expire = ngx_time() + cache->inactive;
-        ngx_queue_insert_head(&cache->sh->queue, &fcn->queue);
+        ngx_http_file_cache_link(part, fcn);
 
         ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
                       "ignore long locked inactive cache entry %*s, count:%d",
@@ -1787,9 +2202,7 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
         break;
     }
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
-
-    ngx_free(name);
+    ngx_shmtx_unlock(part->mutex);
 
     return wait;
 }
@@ -1798,14 +2211,12 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
 static time_t
 ngx_http_file_cache_expire(ngx_http_file_cache_t *cache)
 {
-    u_char                      *name, *p;
+    u_char                      *name;
     size_t                       len;
-    time_t                       now, wait;
+    time_t                       now, wait, rc;
+    ngx_uint_t                   i, n;
     ngx_path_t                  *path;
-    ngx_msec_t                   elapsed;
-    ngx_queue_t                 *q;
-    ngx_http_file_cache_node_t  *fcn;
-    u_char                       key[2 * NGX_HTTP_CACHE_KEY_LEN];
+    ngx_http_file_cache_part_t  *part;
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
                    "http file cache expire");
@@ -1822,7 +2233,48 @@ ngx_http_file_cache_expire(ngx_http_file_cache_t *cache)
 
     now = ngx_time();
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    /*
+     * the partition which exhausted the manager limits
+     * is continued first on the next run
+     */
+
+    wait = 10;
+    n = cache->sh->partitions;
+
+    for (i = 0; i < n; i++) {
+        part = &cache->sh->parts[cache->expire_part % n];
+
+        rc = ngx_http_file_cache_expire_part(cache, part, name, now);
+        if (rc < wait) {
+            wait = rc;
+        }
+
+        if (wait == 0) {
+            break;
+        }
+
+        cache->expire_part++;
+    }
+
+    ngx_free(name);
+
+    return wait;
+}
+
+
+static time_t
+ngx_http_file_cache_expire_part(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_part_t *part, u_char *name, time_t now)
+{
+    u_char                      *p;
+    size_t                       len;
+    time_t                       wait;
+    ngx_msec_t                   elapsed;
+    ngx_queue_t                 *q;
+    ngx_http_file_cache_node_t  *fcn;
+    u_char                       key[2 * NGX_HTTP_CACHE_KEY_LEN];
+
+    ngx_shmtx_lock(part->mutex);
 
     for ( ;; ) {
 
@@ -1831,13 +2283,13 @@ ngx_http_file_cache_expire(ngx_http_file_cache_t *cache)
             break;
         }
 
-        if (ngx_queue_empty(&cache->sh->queue)) {
+        q = ngx_http_file_cache_oldest(part);
+
+        if (q == NULL) {
             wait = 10;
             break;
         }
 
-        q = ngx_queue_last(&cache->sh->queue);
-
         fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
 
         wait = fcn->expire - now;
@@ -1853,7 +2305,7 @@ ngx_http_file_cache_expire(ngx_http_file_cache_t *cache)
                        fcn->key[0], fcn->key[1], fcn->key[2], fcn->key[3]);
 
         if (fcn->count == 0) {
-            ngx_http_file_cache_delete(cache, q, name);
+            ngx_http_file_cache_delete(cache, part, q, name);
             goto next;
         }
 
@@ -1873,9 +2325,9 @@ ngx_http_file_cache_expire(ngx_http_file_cache_t *cache)
          * we prefer to just move them to the top of the inactive queue
          */
 
-        ngx_queue_remove(q);
+        ngx_http_file_cache_unlink(part, fcn);
         fcn->expire = ngx_time() + cache->inactive;
-        ngx_queue_insert_head(&cache->sh->queue, &fcn->queue);
+        ngx_http_file_cache_link(part, fcn);
 
         ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
                       "ignore long locked inactive cache entry %*s, count:%d",
@@ -1898,19 +2350,17 @@ next:
         }
     }
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
-
-    ngx_free(name);
+    ngx_shmtx_unlock(part->mutex);
 
     return wait;
 }
 
 
 static void
-ngx_http_file_cache_delete(ngx_http_file_cache_t *cache, ngx_queue_t *q,
-    u_char *name)
+ngx_http_file_cache_delete(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_part_t *part, ngx_queue_t *q, u_char *name)
 {
-    u_char                      *p;
+    u_char                      *p, key[NGX_HTTP_CACHE_KEY_LEN];
     size_t                       len;
     ngx_path_t                  *path;
     ngx_http_file_cache_node_t  *fcn;
@@ -1918,7 +2368,7 @@ ngx_http_file_cache_delete(ngx_http_file_cache_t *cache, ngx_queue_t *q,
     fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
 
     if (fcn->exists) {
-        cache->sh->size -= fcn->fs_size;
+        part->size -= fcn->fs_size;
 
         path = cache->path;
         p = name + path->name.len + 1 + path->len;
@@ -1930,7 +2380,15 @@ ngx_http_file_cache_delete(ngx_http_file_cache_t *cache, ngx_queue_t *q,
 
         fcn->count++;
         fcn->deleting = 1;
-        ngx_shmtx_unlock(&cache->shpool->mutex);
+        ngx_shmtx_unlock(part->mutex);
+
+        if (cache->hot) {
+            ngx_memcpy(key, &fcn->node.key, sizeof(ngx_rbtree_key_t));
+            ngx_memcpy(&key[sizeof(ngx_rbtree_key_t)], fcn->key,
+                       NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+            ngx_http_file_cache_hot_delete(cache, key);
+        }
 
         len = path->name.len + 1 + path->len + 2 * NGX_HTTP_CACHE_KEY_LEN;
         ngx_create_hashed_filename(path, name, len);
@@ -1943,17 +2401,366 @@ ngx_http_file_cache_delete(ngx_http_file_cache_t *cache, ngx_queue_t *q,
                           ngx_delete_file_n " \"%s\" failed", name);
         }
 
-        ngx_shmtx_lock(&cache->shpool->mutex);
-        fcn->count--;
+        if (cache->journal.len) {
+            ngx_memcpy(key, &fcn->node.key, sizeof(ngx_rbtree_key_t));
+            ngx_memcpy(&key[sizeof(ngx_rbtree_key_t)], fcn->key,
+                       NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+            ngx_http_file_cache_journal_write(cache, key, 0,
+                                           NGX_HTTP_FILE_CACHE_JOURNAL_DELETE);
+        }
+
+        ngx_shmtx_lock(part->mutex);
+        fcn->count--;
         fcn->deleting = 0;
     }
 
     if (fcn->count == 0) {
-        ngx_queue_remove(q);
-        ngx_rbtree_delete(&cache->sh->rbtree, &fcn->node);
-        ngx_slab_free_locked(cache->shpool, fcn);
-        cache->sh->count--;
+        ngx_http_file_cache_unlink(part, fcn);
+        ngx_rbtree_delete(&part->rbtree, &fcn->node);
+        ngx_slab_free(cache->shpool, fcn);
+        part->count--;
+    }
+}
+
+
+static void
+ngx_http_file_cache_usage(ngx_http_file_cache_t *cache, off_t *size,
+    ngx_uint_t *count)
+{
+    ngx_uint_t                   n;
+    ngx_http_file_cache_part_t  *part;
+
+    *size = 0;
+    *count = 0;
+
+    for (n = 0; n < cache->sh->partitions; n++) {
+        part = &cache->sh->parts[n];
+
+        ngx_shmtx_lock(part->mutex);
+
+        *size += part->size;
+        *count += part->count;
+
+        ngx_shmtx_unlock(part->mutex);
+    }
+}
+
+
+/*
+ * Each partition keeps up to three queues of nodes, the most recently
+ * used ones at the heads: the probation queue, used by all policies,
+ * the protected queue of nodes requested again while on probation,
+ * and the admission window of the tinylfu policy.
+ */
+
+static void
+ngx_http_file_cache_link(ngx_http_file_cache_part_t *part,
+    ngx_http_file_cache_node_t *fcn)
+{
+    ngx_queue_insert_head(&part->queue[fcn->segment], &fcn->queue);
+    part->length[fcn->segment]++;
+}
+
+
+static void
+ngx_http_file_cache_unlink(ngx_http_file_cache_part_t *part,
+    ngx_http_file_cache_node_t *fcn)
+{
+    ngx_queue_remove(&fcn->queue);
+    part->length[fcn->segment]--;
+}
+
+
+static void
+ngx_http_file_cache_access(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_part_t *part, ngx_http_file_cache_node_t *fcn,
+    u_char *key, ngx_uint_t fresh)
+{
+    ngx_queue_t                 *q;
+    ngx_http_file_cache_node_t  *tail;
+
+    switch (cache->eviction) {
+
+    case NGX_HTTP_CACHE_EVICT_GDSF:
+        fcn->priority = part->clock;
+        break;
+
+    case NGX_HTTP_CACHE_EVICT_TINYLFU:
+
+        if (part->sketch) {
+            (void) ngx_http_file_cache_freq(part->sketch, part->width,
+                                            &part->samples, key, 1);
+        }
+
+        if (fresh) {
+            fcn->segment = NGX_HTTP_CACHE_WINDOW;
+            break;
+        }
+
+        if (fcn->segment == NGX_HTTP_CACHE_WINDOW) {
+            break;
+        }
+
+        /* fall through */
+
+    case NGX_HTTP_CACHE_EVICT_SLRU:
+
+        if (!fresh) {
+            fcn->segment = NGX_HTTP_CACHE_PROTECTED;
+        }
+
+        break;
+
+    default: /* NGX_HTTP_CACHE_EVICT_LRU */
+        break;
+    }
+
+    ngx_http_file_cache_link(part, fcn);
+
+    /* the window is limited to 1% of the nodes */
+
+    while (part->length[NGX_HTTP_CACHE_WINDOW] > 1
+           && part->length[NGX_HTTP_CACHE_WINDOW] > part->count / 100)
+    {
+        q = ngx_queue_last(&part->queue[NGX_HTTP_CACHE_WINDOW]);
+        tail = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
+
+        ngx_http_file_cache_unlink(part, tail);
+        tail->segment = NGX_HTTP_CACHE_PROBATION;
+        ngx_http_file_cache_link(part, tail);
+    }
+
+    /* the protected queue is limited to 80% of the nodes */
+
+    while (part->length[NGX_HTTP_CACHE_PROTECTED]
+           > part->count - part->count / 5)
+    {
+        q = ngx_queue_last(&part->queue[NGX_HTTP_CACHE_PROTECTED]);
+        tail = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
+
+        ngx_http_file_cache_unlink(part, tail);
+        tail->segment = NGX_HTTP_CACHE_PROBATION;
+        ngx_http_file_cache_link(part, tail);
+    }
+}
+
+
+static ngx_queue_t *
+ngx_http_file_cache_oldest(ngx_http_file_cache_part_t *part)
+{
+    ngx_uint_t                   i;
+    ngx_queue_t                 *q, *oldest;
+    ngx_http_file_cache_node_t  *fcn, *ofcn;
+
+    oldest = NULL;
+    ofcn = NULL;
+
+    for (i = 0; i < NGX_HTTP_CACHE_SEGMENTS; i++) {
+
+        if (ngx_queue_empty(&part->queue[i])) {
+            continue;
+        }
+
+        q = ngx_queue_last(&part->queue[i]);
+        fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
+
+        if (ofcn == NULL || fcn->expire < ofcn->expire) {
+            oldest = q;
+            ofcn = fcn;
+        }
+    }
+
+    return oldest;
+}
+
+
+static ngx_queue_t *
+ngx_http_file_cache_victim(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_part_t *part)
+{
+    switch (cache->eviction) {
+
+    case NGX_HTTP_CACHE_EVICT_GDSF:
+        return ngx_http_file_cache_gdsf_victim(part);
+
+    case NGX_HTTP_CACHE_EVICT_TINYLFU:
+
+        if (part->sketch) {
+            return ngx_http_file_cache_tinylfu_victim(part);
+        }
+
+        /* fall through */
+
+    case NGX_HTTP_CACHE_EVICT_SLRU:
+
+        if (!ngx_queue_empty(&part->queue[NGX_HTTP_CACHE_PROBATION])) {
+            return ngx_queue_last(&part->queue[NGX_HTTP_CACHE_PROBATION]);
+        }
+
+        break;
+    }
+
+    return ngx_http_file_cache_oldest(part);
+}
+
+
+/*
+ * GreedyDual-Size-Frequency: the priority of a node is the clock value
+ * at its last access plus its uses per block, and the clock advances
+ * to the priority of each evicted node, so small popular responses
+ * stay longer while idle ones age out.  Instead of keeping a priority
+ * queue, a few unlocked nodes from the least recently used end are
+ * sampled.
+ */
+
+static ngx_queue_t *
+ngx_http_file_cache_gdsf_victim(ngx_http_file_cache_part_t *part)
+{
+    off_t                        size;
+    ngx_uint_t                   n, h, min;
+    ngx_queue_t                 *q, *queue, *victim;
+    ngx_http_file_cache_node_t  *fcn;
+
+    queue = &part->queue[NGX_HTTP_CACHE_PROBATION];
+
+    victim = NULL;
+    min = 0;
+    n = 0;
+
+    for (q = ngx_queue_last(queue);
+         q != ngx_queue_sentinel(queue)
+         && n++ < NGX_HTTP_FILE_CACHE_GDSF_SAMPLES;
+         q = ngx_queue_prev(q))
+    {
+        fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
+
+        if (fcn->count) {
+            continue;
+        }
+
+        size = fcn->fs_size ? fcn->fs_size : 1;
+
+        h = fcn->priority
+            + (ngx_uint_t) (fcn->uses * NGX_HTTP_FILE_CACHE_GDSF_SCALE / size);
+
+        if (victim == NULL || h < min) {
+            victim = q;
+            min = h;
+        }
+    }
+
+    if (victim == NULL) {
+        return ngx_http_file_cache_oldest(part);
+    }
+
+    if (min > part->clock) {
+        part->clock = min;
+    }
+
+    return victim;
+}
+
+
+/*
+ * W-TinyLFU: new nodes enter a small window, and its least recently
+ * used nodes move on to the head of the probation queue.  When space
+ * is needed, the newest node on probation competes with the oldest
+ * one, and the one requested less often according to the frequency
+ * sketch is evicted.  Nodes in use are skipped; without unlocked
+ * nodes on probation the protected queue and then the window are
+ * tried from their least recently used ends.
+ */
+
+static ngx_queue_t *
+ngx_http_file_cache_tinylfu_victim(ngx_http_file_cache_part_t *part)
+{
+    ngx_uint_t                   i;
+    ngx_queue_t                 *q, *queue, *candidate, *victim;
+    ngx_http_file_cache_node_t  *fcn;
+
+    queue = &part->queue[NGX_HTTP_CACHE_PROBATION];
+
+    candidate = NULL;
+
+    for (q = ngx_queue_head(queue);
+         q != ngx_queue_sentinel(queue);
+         q = ngx_queue_next(q))
+    {
+        fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
+
+        if (fcn->count) {
+            continue;
+        }
+
+        candidate = q;
+        break;
+    }
+
+    if (candidate) {
+        victim = NULL;
+
+        for (q = ngx_queue_last(queue); q != candidate; q = ngx_queue_prev(q))
+        {
+            fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
+
+            if (fcn->count) {
+                continue;
+            }
+
+            victim = q;
+            break;
+        }
+
+        if (victim == NULL) {
+            return candidate;
+        }
+
+        if (ngx_http_file_cache_node_freq(part,
+                   ngx_queue_data(candidate, ngx_http_file_cache_node_t,
+                                  queue))
+            > ngx_http_file_cache_node_freq(part,
+                   ngx_queue_data(victim, ngx_http_file_cache_node_t, queue)))
+        {
+            return victim;
+        }
+
+        return candidate;
+    }
+
+    /* the protected queue is followed by the window */
+
+    for (i = NGX_HTTP_CACHE_PROTECTED; i < NGX_HTTP_CACHE_SEGMENTS; i++) {
+        queue = &part->queue[i];
+
+        for (q = ngx_queue_last(queue);
+             q != ngx_queue_sentinel(queue);
+             q = ngx_queue_prev(q))
+        {
+            fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
+
+            if (fcn->count == 0) {
+                return q;
+            }
+        }
     }
+
+    return NULL;
+}
+
+
+static ngx_uint_t
+ngx_http_file_cache_node_freq(ngx_http_file_cache_part_t *part,
+    ngx_http_file_cache_node_t *fcn)
+{
+    u_char  key[NGX_HTTP_CACHE_KEY_LEN];
+
+    ngx_memcpy(key, &fcn->node.key, sizeof(ngx_rbtree_key_t));
+    ngx_memcpy(&key[sizeof(ngx_rbtree_key_t)], fcn->key,
+               NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+    return ngx_http_file_cache_freq(part->sketch, part->width,
+                                    &part->samples, key, 0);
 }
 
 
@@ -1970,6 +2777,16 @@ ngx_http_file_cache_manager(void *data)
     cache->last = ngx_current_msec;
     cache->files = 0;
 
+    if (cache->journal.len && !cache->sh->cold) {
+        ngx_http_file_cache_usage(cache, &size, &count);
+
+        if (cache->sh->journal_records
+            > 2 * count + NGX_HTTP_FILE_CACHE_JOURNAL_SLACK)
+        {
+            (void) ngx_http_file_cache_journal_compact(cache);
+        }
+    }
+
     next = (ngx_msec_t) ngx_http_file_cache_expire(cache) * 1000;
 
     if (next == 0) {
@@ -1978,14 +2795,10 @@ ngx_http_file_cache_manager(void *data)
     }
 
     for ( ;; ) {
-        ngx_shmtx_lock(&cache->shpool->mutex);
+        ngx_http_file_cache_usage(cache, &size, &count);
 
-        size = cache->sh->size;
-        count = cache->sh->count;
         watermark = cache->sh->watermark;
 
-        ngx_shmtx_unlock(&cache->shpool->mutex);
-
         ngx_log_debug3(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
                        "http file cache size: %O c:%ui w:%i",
                        size, count, (ngx_int_t) watermark);
@@ -2049,7 +2862,8 @@ ngx_http_file_cache_loader(void *data)
 {
     ngx_http_file_cache_t  *cache = data;
 
-    ngx_tree_ctx_t  tree;
+    off_t       size;
+    ngx_uint_t  count;
 
     if (!cache->sh->cold || cache->sh->loading) {
         return;
@@ -2062,229 +2876,1296 @@ ngx_http_file_cache_loader(void *data)
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
                    "http file cache loader");
 
-    tree.init_handler = NULL;
-    tree.file_handler = ngx_http_file_cache_manage_file;
-    tree.pre_tree_handler = ngx_http_file_cache_manage_directory;
-    tree.post_tree_handler = ngx_http_file_cache_noop;
-    tree.spec_handler = ngx_http_file_cache_delete_file;
-    tree.data = cache;
-    tree.alloc = 0;
-    tree.log = ngx_cycle->log;
+    /*
+     * the journal is replayed first to fill the keys zone quickly,
+     * and the directory walk then reconciles it with the actual files
+     */
 
-    cache->last = ngx_current_msec;
-    cache->files = 0;
+    if (cache->journal.len
+        && ngx_http_file_cache_journal_replay(cache) == NGX_ABORT)
+    {
+        cache->sh->loading = 0;
+        return;
+    }
 
-    if (ngx_walk_tree(&tree, &cache->path->name) == NGX_ABORT) {
+    if (ngx_http_file_cache_walk(cache) == NGX_ABORT) {
         cache->sh->loading = 0;
         return;
     }
 
+    if (cache->journal.len) {
+        ngx_http_file_cache_journal_sweep(cache);
+        (void) ngx_http_file_cache_journal_compact(cache);
+    }
+
     cache->sh->cold = 0;
     cache->sh->loading = 0;
 
+    ngx_http_file_cache_usage(cache, &size, &count);
+
     ngx_log_error(NGX_LOG_NOTICE, ngx_cycle->log, 0,
                   "http file cache: %V %.3fM, bsize: %uz",
                   &cache->path->name,
-                  ((double) cache->sh->size * cache->bsize) / (1024 * 1024),
+                  ((double) size * cache->bsize) / (1024 * 1024),
                   cache->bsize);
 }
 
 
 static ngx_int_t
-ngx_http_file_cache_noop(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+ngx_http_file_cache_walk(ngx_http_file_cache_t *cache)
 {
-    return NGX_OK;
-}
+    ngx_int_t                          rc;
+    ngx_uint_t                         n, shards;
+    ngx_http_file_cache_loader_ctx_t  *lctx;
+#if (NGX_THREADS)
+    ngx_err_t                          err;
+#endif
 
+    /*
+     * with levels, the first level directories are spread
+     * over the loader threads
+     */
 
-static ngx_int_t
-ngx_http_file_cache_manage_file(ngx_tree_ctx_t *ctx, ngx_str_t *path)
-{
-    ngx_msec_t              elapsed;
-    ngx_http_file_cache_t  *cache;
+    shards = cache->path->level[0] ? cache->loader_threads : 1;
 
-    cache = ctx->data;
+    lctx = ngx_calloc(shards * sizeof(ngx_http_file_cache_loader_ctx_t),
+                      ngx_cycle->log);
+    if (lctx == NULL) {
+        return NGX_ERROR;
+    }
 
-    if (ngx_http_file_cache_add_file(ctx, path) != NGX_OK) {
-        (void) ngx_http_file_cache_delete_file(ctx, path);
+    for (n = 0; n < shards; n++) {
+        lctx[n].cache = cache;
+        lctx[n].last = ngx_current_msec;
+        lctx[n].shard = n;
+        lctx[n].shards = shards;
+    }
+
+#if (NGX_THREADS)
+
+    for (n = 1; n < shards; n++) {
+        err = pthread_create(&lctx[n].tid, NULL,
+                             ngx_http_file_cache_walk_thread, &lctx[n]);
+        if (err) {
+            ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, err,
+                          "pthread_create() failed");
+            continue;
+        }
+
+        lctx[n].thread = 1;
+    }
+
+#endif
+
+    for (n = 0; n < shards; n++) {
+
+#if (NGX_THREADS)
+        if (lctx[n].thread) {
+            continue;
+        }
+#endif
+
+        ngx_http_file_cache_walk_shard(&lctx[n]);
+    }
+
+    rc = NGX_OK;
+
+    for (n = 0; n < shards; n++) {
+
+#if (NGX_THREADS)
+        if (lctx[n].thread) {
+            err = pthread_join(lctx[n].tid, NULL);
+            if (err) {
+                ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, err,
+                              "pthread_join() failed");
+            }
+        }
+#endif
+
+        if (lctx[n].rc == NGX_ABORT) {
+            rc = NGX_ABORT;
+        }
     }
 
-    if (++cache->files >= cache->loader_files) {
-        ngx_http_file_cache_loader_sleep(cache);
+    ngx_free(lctx);
+
+    return rc;
+}
+
+
+static void
+ngx_http_file_cache_walk_shard(ngx_http_file_cache_loader_ctx_t *lctx)
+{
+    ngx_tree_ctx_t  tree;
+
+    tree.init_handler = NULL;
+    tree.file_handler = ngx_http_file_cache_manage_file;
+    tree.pre_tree_handler = ngx_http_file_cache_manage_directory;
+    tree.post_tree_handler = ngx_http_file_cache_noop;
+    tree.spec_handler = ngx_http_file_cache_delete_file;
+    tree.data = lctx;
+    tree.alloc = 0;
+    tree.log = ngx_cycle->log;
+
+    lctx->rc = ngx_walk_tree(&tree, &lctx->cache->path->name);
+}
+
+
+#if (NGX_THREADS)
+
+static void *
+ngx_http_file_cache_walk_thread(void *data)
+{
+    ngx_http_file_cache_loader_ctx_t *lctx = data;
+
+    int        err;
+    sigset_t   set;
+
+    sigfillset(&set);
+
+    sigdelset(&set, SIGILL);
+    sigdelset(&set, SIGFPE);
+    sigdelset(&set, SIGSEGV);
+    sigdelset(&set, SIGBUS);
+
+    err = pthread_sigmask(SIG_BLOCK, &set, NULL);
+    if (err) {
+        ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, err,
+                      "pthread_sigmask() failed");
+    }
+
+    ngx_http_file_cache_walk_shard(lctx);
+
+    return NULL;
+}
+
+#endif
+
+
+static ngx_int_t
+ngx_http_file_cache_noop(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_manage_file(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    u_char                            *p;
+    ngx_msec_t                         elapsed;
+    ngx_http_file_cache_t             *cache;
+    ngx_http_file_cache_loader_ctx_t  *lctx;
+
+    lctx = ctx->data;
+    cache = lctx->cache;
+
+    p = path->data + cache->path->name.len + 1;
+
+    if (ngx_strlchr(p, path->data + path->len, '/') == NULL) {
+
+        /* a file in the cache root */
+
+        if (cache->journal.len
+            && (ngx_strcmp(path->data, cache->journal.data) == 0
+                || ngx_strcmp(path->data, cache->journal_new.data) == 0))
+        {
+            return NGX_OK;
+        }
+
+        if (lctx->shard != 0) {
+            return NGX_OK;
+        }
+    }
+
+    if (ngx_http_file_cache_add_file(ctx, path) != NGX_OK) {
+        (void) ngx_http_file_cache_delete_file(ctx, path);
+    }
+
+    if (++lctx->files >= cache->loader_files) {
+        ngx_http_file_cache_loader_sleep(lctx);
+
+    } else {
+        ngx_time_update();
+
+        elapsed = ngx_abs((ngx_msec_int_t) (ngx_current_msec - lctx->last));
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                       "http file cache loader time elapsed: %M", elapsed);
+
+        if (elapsed >= cache->loader_threshold) {
+            ngx_http_file_cache_loader_sleep(lctx);
+        }
+    }
+
+    return (ngx_quit || ngx_terminate) ? NGX_ABORT : NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_manage_directory(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    size_t                             len;
+    ngx_int_t                          n;
+    ngx_http_file_cache_t             *cache;
+    ngx_http_file_cache_loader_ctx_t  *lctx;
+
+    if (path->len >= 5
+        && ngx_strncmp(path->data + path->len - 5, "/temp", 5) == 0)
+    {
+        return NGX_DECLINED;
+    }
+
+    lctx = ctx->data;
+
+    if (lctx->shards == 1) {
+        return NGX_OK;
+    }
+
+    cache = lctx->cache;
+    len = cache->path->level[0];
+
+    if (path->len != cache->path->name.len + 1 + len) {
+        return NGX_OK;
+    }
+
+    /* a first level directory */
+
+    n = ngx_hextoi(path->data + path->len - len, len);
+
+    if (n == NGX_ERROR) {
+        return (lctx->shard == 0) ? NGX_OK : NGX_DECLINED;
+    }
+
+    return ((ngx_uint_t) n % lctx->shards == lctx->shard) ? NGX_OK
+                                                           : NGX_DECLINED;
+}
+
+
+static void
+ngx_http_file_cache_loader_sleep(ngx_http_file_cache_loader_ctx_t *lctx)
+{
+    ngx_msleep(lctx->cache->loader_sleep);
+
+    ngx_time_update();
+
+    lctx->last = ngx_current_msec;
+    lctx->files = 0;
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_add_file(ngx_tree_ctx_t *ctx, ngx_str_t *name)
+{
+    u_char                 *p;
+    ngx_int_t               n;
+    ngx_uint_t              i;
+    ngx_http_cache_t        c;
+    ngx_http_file_cache_t  *cache;
+
+    if (name->len < 2 * NGX_HTTP_CACHE_KEY_LEN) {
+        return NGX_ERROR;
+    }
+
+    /*
+     * Temporary files in cache have a suffix consisting of a dot
+     * followed by 10 digits.
+     */
+
+    if (name->len >= 2 * NGX_HTTP_CACHE_KEY_LEN + 1 + 10
+        && name->data[name->len - 10 - 1] == '.')
+    {
+        return NGX_OK;
+    }
+
+    if (ctx->size < (off_t) sizeof(ngx_http_file_cache_header_t)) {
+        ngx_log_error(NGX_LOG_CRIT, ctx->log, 0,
+                      "cache file \"%s\" is too small", name->data);
+        return NGX_ERROR;
+    }
+
+    ngx_memzero(&c, sizeof(ngx_http_cache_t));
+    cache = ((ngx_http_file_cache_loader_ctx_t *) ctx->data)->cache;
+
+    c.length = ctx->size;
+    c.fs_size = (ctx->fs_size + cache->bsize - 1) / cache->bsize;
+
+    p = &name->data[name->len - 2 * NGX_HTTP_CACHE_KEY_LEN];
+
+    for (i = 0; i < NGX_HTTP_CACHE_KEY_LEN; i++) {
+        n = ngx_hextoi(p, 2);
+
+        if (n == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        p += 2;
+
+        c.key[i] = (u_char) n;
+    }
+
+    return ngx_http_file_cache_add(cache, &c);
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_add(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
+{
+    ngx_http_file_cache_node_t  *fcn;
+    ngx_http_file_cache_part_t  *part;
+
+    part = ngx_http_file_cache_part(cache, c->key);
+
+    ngx_shmtx_lock(part->mutex);
+
+    fcn = ngx_http_file_cache_lookup(part, c->key);
+
+    if (fcn == NULL) {
+
+        fcn = ngx_slab_calloc(cache->shpool,
+                              sizeof(ngx_http_file_cache_node_t));
+        if (fcn == NULL) {
+            ngx_http_file_cache_set_watermark(cache);
+
+            if (cache->fail_time != ngx_time()) {
+                cache->fail_time = ngx_time();
+                ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
+                           "could not allocate node%s", cache->shpool->log_ctx);
+            }
+
+            ngx_shmtx_unlock(part->mutex);
+            return NGX_ERROR;
+        }
+
+        part->count++;
+
+        ngx_memcpy((u_char *) &fcn->node.key, c->key, sizeof(ngx_rbtree_key_t));
+
+        ngx_memcpy(fcn->key, &c->key[sizeof(ngx_rbtree_key_t)],
+                   NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+        ngx_rbtree_insert(&part->rbtree, &fcn->node);
+
+        fcn->uses = 1;
+        fcn->exists = 1;
+        fcn->fs_size = c->fs_size;
+
+        part->size += c->fs_size;
+
+    } else {
+        ngx_http_file_cache_unlink(part, fcn);
+
+        if (fcn->indexed) {
+
+            /* the node was replayed from the journal */
+
+            part->size += c->fs_size - fcn->fs_size;
+            fcn->fs_size = c->fs_size;
+            fcn->indexed = 0;
+        }
+    }
+
+    fcn->expire = ngx_time() + cache->inactive;
+
+    ngx_http_file_cache_link(part, fcn);
+
+    ngx_shmtx_unlock(part->mutex);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_delete_file(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ctx->log, 0,
+                   "http file cache delete: \"%s\"", path->data);
+
+    if (ngx_delete_file(path->data) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, ctx->log, ngx_errno,
+                      ngx_delete_file_n " \"%s\" failed", path->data);
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_file_cache_set_watermark(ngx_http_file_cache_t *cache)
+{
+    ngx_uint_t  n, count;
+
+    /*
+     * only one partition is locked by the caller,
+     * so the total count of nodes is approximate
+     */
+
+    count = 0;
+
+    for (n = 0; n < cache->sh->partitions; n++) {
+        count += cache->sh->parts[n].count;
+    }
+
+    cache->sh->watermark = count - count / 8;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                   "http file cache watermark: %ui", cache->sh->watermark);
+}
+
+
+static void
+ngx_http_file_cache_journal_write(ngx_http_file_cache_t *cache, u_char *key,
+    off_t fs_size, ngx_uint_t op)
+{
+    ssize_t                            n;
+    ngx_fd_t                           fd;
+    ngx_atomic_uint_t                  gen;
+    ngx_http_file_cache_journal_rec_t  rec;
+
+    gen = cache->sh->journal_gen;
+
+    if (cache->journal_fd != NGX_INVALID_FILE && cache->journal_gen != gen) {
+
+        /* the journal was compacted and replaced */
+
+        if (ngx_close_file(cache->journal_fd) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
+                          ngx_close_file_n " \"%s\" failed",
+                          cache->journal.data);
+        }
+
+        cache->journal_fd = NGX_INVALID_FILE;
+    }
+
+    if (cache->journal_fd == NGX_INVALID_FILE) {
+        fd = ngx_open_file(cache->journal.data, NGX_FILE_APPEND,
+                           NGX_FILE_CREATE_OR_OPEN, NGX_FILE_DEFAULT_ACCESS);
+
+        if (fd == NGX_INVALID_FILE) {
+            if (cache->journal_fail_time != ngx_time()) {
+                cache->journal_fail_time = ngx_time();
+                ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                              ngx_open_file_n " \"%s\" failed",
+                              cache->journal.data);
+            }
+
+            return;
+        }
+
+        cache->journal_fd = fd;
+        cache->journal_gen = gen;
+    }
+
+    ngx_memzero(&rec, sizeof(ngx_http_file_cache_journal_rec_t));
+
+    rec.magic = NGX_HTTP_FILE_CACHE_JOURNAL_MAGIC;
+    rec.op = (uint32_t) op;
+    ngx_memcpy(rec.key, key, NGX_HTTP_CACHE_KEY_LEN);
+    rec.fs_size = (uint64_t) fs_size;
+    rec.crc32 = ngx_crc32_short((u_char *) &rec,
+                      offsetof(ngx_http_file_cache_journal_rec_t, crc32));
+
+    /*
+     * records are appended by all processes at once, and a torn record
+     * left by a crash is skipped on replay as its checksum mismatches
+     */
+
+    n = ngx_write_fd(cache->journal_fd, &rec, sizeof(rec));
+
+    if (n != (ssize_t) sizeof(rec)) {
+        if (cache->journal_fail_time != ngx_time()) {
+            cache->journal_fail_time = ngx_time();
+            ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                          ngx_write_fd_n " \"%s\" failed",
+                          cache->journal.data);
+        }
+
+        return;
+    }
+
+    (void) ngx_atomic_fetch_add(&cache->sh->journal_records, 1);
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_journal_replay(ngx_http_file_cache_t *cache)
+{
+    u_char                             *buf, *p, *last;
+    size_t                              size, len;
+    ssize_t                             n;
+    ngx_fd_t                            fd;
+    ngx_int_t                           rc;
+    ngx_err_t                           err;
+    ngx_uint_t                          records, skipped;
+    ngx_msec_t                          start;
+    ngx_http_file_cache_journal_rec_t   rec;
+
+    fd = ngx_open_file(cache->journal.data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (fd == NGX_INVALID_FILE) {
+        err = ngx_errno;
+
+        if (err != NGX_ENOENT) {
+            ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, err,
+                          ngx_open_file_n " \"%s\" failed",
+                          cache->journal.data);
+        }
+
+        return NGX_DECLINED;
+    }
+
+    buf = ngx_alloc(NGX_HTTP_FILE_CACHE_JOURNAL_BUF, ngx_cycle->log);
+    if (buf == NULL) {
+        rc = NGX_ERROR;
+        goto done;
+    }
+
+    rc = NGX_OK;
+    start = ngx_current_msec;
+    records = 0;
+    skipped = 0;
+    last = buf;
+    len = 0;
+
+    for ( ;; ) {
+        size = buf + NGX_HTTP_FILE_CACHE_JOURNAL_BUF - last;
+
+        n = ngx_read_fd(fd, last, size);
+
+        if (n == -1) {
+            ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                          ngx_read_fd_n " \"%s\" failed",
+                          cache->journal.data);
+            rc = NGX_ERROR;
+            break;
+        }
+
+        if (n == 0) {
+            break;
+        }
+
+        last += n;
+        p = buf;
+
+        while ((size_t) (last - p) >= sizeof(rec)) {
+            ngx_memcpy(&rec, p, sizeof(rec));
+
+            if (rec.magic != NGX_HTTP_FILE_CACHE_JOURNAL_MAGIC
+                || rec.crc32 != ngx_crc32_short((u_char *) &rec,
+                           offsetof(ngx_http_file_cache_journal_rec_t, crc32)))
+            {
+                /* resynchronize after a torn record */
+
+                p++;
+                skipped++;
+                continue;
+            }
+
+            ngx_http_file_cache_journal_apply(cache, &rec);
+
+            p += sizeof(rec);
+            records++;
+        }
+
+        len = last - p;
+        last = ngx_movemem(buf, p, len);
+
+        if (ngx_quit || ngx_terminate) {
+            rc = NGX_ABORT;
+            break;
+        }
+    }
+
+    skipped += len;
+
+    ngx_free(buf);
+
+    cache->sh->journal_records = records;
+
+    ngx_time_update();
+
+    ngx_log_error(NGX_LOG_NOTICE, ngx_cycle->log, 0,
+                  "http file cache journal: %V %ui records, "
+                  "%ui bytes skipped, %M ms",
+                  &cache->journal, records, skipped,
+                  (ngx_msec_t) (ngx_current_msec - start));
+
+done:
+
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", cache->journal.data);
+    }
+
+    return rc;
+}
+
+
+static void
+ngx_http_file_cache_journal_apply(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_journal_rec_t *rec)
+{
+    off_t                        fs_size;
+    ngx_http_file_cache_node_t  *fcn;
+    ngx_http_file_cache_part_t  *part;
+
+    part = ngx_http_file_cache_part(cache, rec->key);
+
+    ngx_shmtx_lock(part->mutex);
+
+    fcn = ngx_http_file_cache_lookup(part, rec->key);
+
+    if (rec->op == NGX_HTTP_FILE_CACHE_JOURNAL_DELETE) {
+
+        /* nodes created by workers are newer than the journal */
+
+        if (fcn && fcn->indexed && fcn->count == 0) {
+            ngx_http_file_cache_unlink(part, fcn);
+            ngx_rbtree_delete(&part->rbtree, &fcn->node);
+            part->size -= fcn->fs_size;
+            part->count--;
+            ngx_slab_free(cache->shpool, fcn);
+        }
+
+        goto done;
+    }
+
+    fs_size = ((off_t) rec->fs_size + cache->bsize - 1) / cache->bsize;
+
+    if (fcn == NULL) {
+        fcn = ngx_slab_calloc(cache->shpool,
+                              sizeof(ngx_http_file_cache_node_t));
+        if (fcn == NULL) {
+            ngx_http_file_cache_set_watermark(cache);
+
+            if (cache->fail_time != ngx_time()) {
+                cache->fail_time = ngx_time();
+                ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
+                           "could not allocate node%s", cache->shpool->log_ctx);
+            }
+
+            goto done;
+        }
+
+        part->count++;
+
+        ngx_memcpy((u_char *) &fcn->node.key, rec->key,
+                   sizeof(ngx_rbtree_key_t));
+
+        ngx_memcpy(fcn->key, &rec->key[sizeof(ngx_rbtree_key_t)],
+                   NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+        ngx_rbtree_insert(&part->rbtree, &fcn->node);
+
+        fcn->uses = 1;
+        fcn->exists = 1;
+        fcn->indexed = 1;
+
+    } else if (fcn->indexed) {
+        ngx_http_file_cache_unlink(part, fcn);
+        part->size -= fcn->fs_size;
+
+    } else {
+        goto done;
+    }
+
+    fcn->fs_size = fs_size;
+    part->size += fs_size;
+
+    fcn->expire = ngx_time() + cache->inactive;
+
+    ngx_http_file_cache_link(part, fcn);
+
+done:
+
+    ngx_shmtx_unlock(part->mutex);
+}
+
+
+static void
+ngx_http_file_cache_journal_sweep(ngx_http_file_cache_t *cache)
+{
+    ngx_uint_t                   n, i, removed;
+    ngx_queue_t                 *q;
+    ngx_http_file_cache_node_t  *fcn;
+    ngx_http_file_cache_part_t  *part;
+
+    /* replayed nodes not confirmed by the directory walk are stale */
+
+    removed = 0;
+
+    for (n = 0; n < cache->sh->partitions; n++) {
+        part = &cache->sh->parts[n];
+
+        ngx_shmtx_lock(part->mutex);
+
+        for (i = 0; i < NGX_HTTP_CACHE_SEGMENTS; i++) {
+            q = ngx_queue_head(&part->queue[i]);
+
+            while (q != ngx_queue_sentinel(&part->queue[i])) {
+                fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
+
+                q = ngx_queue_next(q);
+
+                if (!fcn->indexed) {
+                    continue;
+                }
+
+                fcn->indexed = 0;
+
+                if (fcn->count) {
+                    continue;
+                }
+
+                ngx_http_file_cache_unlink(part, fcn);
+                ngx_rbtree_delete(&part->rbtree, &fcn->node);
+                part->size -= fcn->fs_size;
+                part->count--;
+                ngx_slab_free(cache->shpool, fcn);
+
+                removed++;
+            }
+        }
+
+        ngx_shmtx_unlock(part->mutex);
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                   "http file cache journal: %ui stale nodes", removed);
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_journal_compact(ngx_http_file_cache_t *cache)
+{
+    u_char                             *buf, *p;
+    ssize_t                             n;
+    ngx_fd_t                            fd;
+    ngx_uint_t                          i, k, records;
+    ngx_queue_t                        *q;
+    ngx_http_file_cache_node_t         *fcn;
+    ngx_http_file_cache_part_t         *part;
+    ngx_http_file_cache_journal_rec_t  *rec;
+
+    fd = ngx_open_file(cache->journal_new.data, NGX_FILE_WRONLY,
+                       NGX_FILE_TRUNCATE, NGX_FILE_DEFAULT_ACCESS);
+
+    if (fd == NGX_INVALID_FILE) {
+        ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                      ngx_open_file_n " \"%s\" failed",
+                      cache->journal_new.data);
+        return NGX_ERROR;
+    }
+
+    buf = ngx_alloc(NGX_HTTP_FILE_CACHE_JOURNAL_BUF, ngx_cycle->log);
+    if (buf == NULL) {
+        goto failed;
+    }
+
+    p = buf;
+    records = 0;
+
+    /*
+     * the nodes are written from the least recently used ones,
+     * so a replay restores the order of inactive queues;
+     * records appended to the old journal meanwhile may be lost,
+     * and the next directory walk will reconcile them
+     */
+
+    for (i = 0; i < cache->sh->partitions; i++) {
+        part = &cache->sh->parts[i];
+
+        ngx_shmtx_lock(part->mutex);
+
+        for (k = 0; k < NGX_HTTP_CACHE_SEGMENTS; k++) {
+            for (q = ngx_queue_last(&part->queue[k]);
+                 q != ngx_queue_sentinel(&part->queue[k]);
+                 q = ngx_queue_prev(q))
+            {
+                fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
+
+                if (!fcn->exists) {
+                    continue;
+                }
+
+                rec = (ngx_http_file_cache_journal_rec_t *) p;
+
+                ngx_memzero(rec, sizeof(ngx_http_file_cache_journal_rec_t));
+
+                rec->magic = NGX_HTTP_FILE_CACHE_JOURNAL_MAGIC;
+                rec->op = NGX_HTTP_FILE_CACHE_JOURNAL_ADD;
+                ngx_memcpy(rec->key, &fcn->node.key, sizeof(ngx_rbtree_key_t));
+                ngx_memcpy(&rec->key[sizeof(ngx_rbtree_key_t)], fcn->key,
+                           NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+                rec->fs_size = (uint64_t) (fcn->fs_size * cache->bsize);
+                rec->crc32 = ngx_crc32_short((u_char *) rec,
+                           offsetof(ngx_http_file_cache_journal_rec_t, crc32));
+
+                p += sizeof(ngx_http_file_cache_journal_rec_t);
+                records++;
+
+                if ((size_t) (buf + NGX_HTTP_FILE_CACHE_JOURNAL_BUF - p)
+                    >= sizeof(ngx_http_file_cache_journal_rec_t))
+                {
+                    continue;
+                }
+
+                n = ngx_write_fd(fd, buf, p - buf);
+
+                if (n != p - buf) {
+                    ngx_shmtx_unlock(part->mutex);
+                    goto write_failed;
+                }
+
+                p = buf;
+            }
+        }
+
+        ngx_shmtx_unlock(part->mutex);
+    }
+
+    if (p != buf) {
+        n = ngx_write_fd(fd, buf, p - buf);
+
+        if (n != p - buf) {
+            goto write_failed;
+        }
+    }
+
+    ngx_free(buf);
+
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed",
+                      cache->journal_new.data);
+    }
+
+    if (ngx_rename_file(cache->journal_new.data, cache->journal.data)
+        == NGX_FILE_ERROR)
+    {
+        ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                      ngx_rename_file_n " \"%s\" to \"%s\" failed",
+                      cache->journal_new.data, cache->journal.data);
+
+        fd = NGX_INVALID_FILE;
+        goto failed;
+    }
+
+    cache->sh->journal_records = records;
+    (void) ngx_atomic_fetch_add(&cache->sh->journal_gen, 1);
+
+    ngx_log_error(NGX_LOG_NOTICE, ngx_cycle->log, 0,
+                  "http file cache journal: %V compacted, %ui records",
+                  &cache->journal, records);
+
+    return NGX_OK;
+
+write_failed:
+
+    ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                  ngx_write_fd_n " \"%s\" failed", cache->journal_new.data);
+
+    ngx_free(buf);
+
+failed:
+
+    if (fd != NGX_INVALID_FILE
+        && ngx_close_file(fd) == NGX_FILE_ERROR)
+    {
+        ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed",
+                      cache->journal_new.data);
+    }
+
+    if (ngx_delete_file(cache->journal_new.data) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                      ngx_delete_file_n " \"%s\" failed",
+                      cache->journal_new.data);
+    }
+
+    return NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_hot_init(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_http_file_cache_t  *ocache = data;
+
+    size_t                  len;
+    ngx_uint_t              width;
+    ngx_http_file_cache_t  *cache;
+
+    cache = shm_zone->data;
+
+    if (ocache) {
+        cache->hot = ocache->hot;
+        cache->hot_shpool = ocache->hot_shpool;
+
+        return NGX_OK;
+    }
+
+    cache->hot_shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    if (shm_zone->shm.exists) {
+        cache->hot = cache->hot_shpool->data;
+
+        return NGX_OK;
+    }
+
+    cache->hot = ngx_slab_calloc(cache->hot_shpool,
+                                 sizeof(ngx_http_file_cache_hot_sh_t));
+    if (cache->hot == NULL) {
+        return NGX_ERROR;
+    }
+
+    cache->hot_shpool->data = cache->hot;
+
+    ngx_rbtree_init(&cache->hot->rbtree, &cache->hot->sentinel,
+                    ngx_http_file_cache_hot_insert_value);
+
+    ngx_queue_init(&cache->hot->queue);
+
+    /*
+     * the frequency sketch has about one counter per kilobyte
+     * of the zone in each of its rows
+     */
+
+    width = 256;
+
+    while (width < shm_zone->shm.size / 1024) {
+        width <<= 1;
+    }
+
+    cache->hot->width = width;
+
+    cache->hot->sketch = ngx_slab_calloc(cache->hot_shpool,
+                                      NGX_HTTP_FILE_CACHE_SKETCH_ROWS * width);
+    if (cache->hot->sketch == NULL) {
+        return NGX_ERROR;
+    }
+
+    len = sizeof(" in cache hot zone \"\"") + shm_zone->shm.name.len;
+
+    cache->hot_shpool->log_ctx = ngx_slab_alloc(cache->hot_shpool, len);
+    if (cache->hot_shpool->log_ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_sprintf(cache->hot_shpool->log_ctx, " in cache hot zone \"%V\"%Z",
+                &shm_zone->shm.name);
+
+    /* allocation failures are expected, they cause eviction */
+
+    cache->hot_shpool->log_nomem = 0;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_hot_open(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    ngx_http_file_cache_t           *cache;
+    ngx_http_file_cache_hot_node_t  *hn;
+
+    cache = c->file_cache;
+
+    ngx_shmtx_lock(&cache->hot_shpool->mutex);
+
+    (void) ngx_http_file_cache_freq(cache->hot->sketch, cache->hot->width,
+                                    &cache->hot->samples, c->key, 1);
+
+    hn = ngx_http_file_cache_hot_lookup(cache, c->key);
+
+    if (hn == NULL) {
+        ngx_shmtx_unlock(&cache->hot_shpool->mutex);
+        return NGX_DECLINED;
+    }
+
+    if (hn->uniq != c->uniq || hn->valid_sec < ngx_time()) {
+
+        /*
+         * the cache file was replaced or the response has expired,
+         * stale responses are handled by the disk tier
+         */
+
+        ngx_http_file_cache_hot_free(cache, hn);
+
+        ngx_shmtx_unlock(&cache->hot_shpool->mutex);
+        return NGX_DECLINED;
+    }
+
+    /* copy the entry, it may be evicted by other workers while sent */
+
+    c->buf = ngx_create_temp_buf(r->pool, hn->len);
+    if (c->buf == NULL) {
+        ngx_shmtx_unlock(&cache->hot_shpool->mutex);
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(c->buf->pos, hn->data, hn->len);
+
+    c->length = hn->len;
+    c->hot = 1;
+
+    ngx_queue_remove(&hn->queue);
+    ngx_queue_insert_head(&cache->hot->queue, &hn->queue);
+
+    ngx_shmtx_unlock(&cache->hot_shpool->mutex);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache hot: %O", c->length);
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_file_cache_hot_admit(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    u_char                           key[NGX_HTTP_CACHE_KEY_LEN];
+    size_t                           size;
+    ngx_uint_t                       freq, n;
+    ngx_queue_t                     *q;
+    ngx_http_file_cache_t           *cache;
+    ngx_http_file_cache_hot_node_t  *hn;
+
+    cache = c->file_cache;
+
+    size = offsetof(ngx_http_file_cache_hot_node_t, data) + c->length;
+
+    ngx_shmtx_lock(&cache->hot_shpool->mutex);
+
+    freq = ngx_http_file_cache_freq(cache->hot->sketch, cache->hot->width,
+                                    &cache->hot->samples, c->key, 0);
+
+    if (freq < NGX_HTTP_FILE_CACHE_HOT_ADMIT) {
+        goto done;
+    }
+
+    hn = ngx_http_file_cache_hot_lookup(cache, c->key);
+
+    if (hn) {
+        ngx_http_file_cache_hot_free(cache, hn);
+    }
+
+    for (n = 0; /* void */ ; n++) {
+
+        hn = ngx_slab_alloc_locked(cache->hot_shpool, size);
+
+        if (hn) {
+            break;
+        }
+
+        if (n == NGX_HTTP_FILE_CACHE_HOT_EVICT
+            || ngx_queue_empty(&cache->hot->queue))
+        {
+            goto done;
+        }
 
-    } else {
-        ngx_time_update();
+        /*
+         * TinyLFU admission: the least recently used entry is evicted
+         * only if it is less popular than the candidate
+         */
 
-        elapsed = ngx_abs((ngx_msec_int_t) (ngx_current_msec - cache->last));
+        q = ngx_queue_last(&cache->hot->queue);
+        hn = ngx_queue_data(q, ngx_http_file_cache_hot_node_t, queue);
 
-        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
-                       "http file cache loader time elapsed: %M", elapsed);
+        ngx_memcpy(key, &hn->node.key, sizeof(ngx_rbtree_key_t));
+        ngx_memcpy(&key[sizeof(ngx_rbtree_key_t)], hn->key,
+                   NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
 
-        if (elapsed >= cache->loader_threshold) {
-            ngx_http_file_cache_loader_sleep(cache);
+        if (ngx_http_file_cache_freq(cache->hot->sketch, cache->hot->width,
+                                     &cache->hot->samples, key, 0)
+            >= freq)
+        {
+            goto done;
         }
+
+        ngx_http_file_cache_hot_free(cache, hn);
     }
 
-    return (ngx_quit || ngx_terminate) ? NGX_ABORT : NGX_OK;
-}
+    ngx_memcpy((u_char *) &hn->node.key, c->key, sizeof(ngx_rbtree_key_t));
+    ngx_memcpy(hn->key, &c->key[sizeof(ngx_rbtree_key_t)],
+               NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
 
+    hn->uniq = c->uniq;
+    hn->valid_sec = c->valid_sec;
+    hn->len = c->length;
 
-static ngx_int_t
-ngx_http_file_cache_manage_directory(ngx_tree_ctx_t *ctx, ngx_str_t *path)
-{
-    if (path->len >= 5
-        && ngx_strncmp(path->data + path->len - 5, "/temp", 5) == 0)
-    {
-        return NGX_DECLINED;
-    }
+    ngx_memcpy(hn->data, c->buf->pos, c->length);
 
-    return NGX_OK;
+    ngx_rbtree_insert(&cache->hot->rbtree, &hn->node);
+    ngx_queue_insert_head(&cache->hot->queue, &hn->queue);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache hot admit: %O f:%ui", c->length, freq);
+
+done:
+
+    ngx_shmtx_unlock(&cache->hot_shpool->mutex);
 }
 
 
 static void
-ngx_http_file_cache_loader_sleep(ngx_http_file_cache_t *cache)
+ngx_http_file_cache_hot_delete(ngx_http_file_cache_t *cache, u_char *key)
 {
-    ngx_msleep(cache->loader_sleep);
+    ngx_http_file_cache_hot_node_t  *hn;
 
-    ngx_time_update();
+    ngx_shmtx_lock(&cache->hot_shpool->mutex);
 
-    cache->last = ngx_current_msec;
-    cache->files = 0;
+    hn = ngx_http_file_cache_hot_lookup(cache, key);
+
+    if (hn) {
+        ngx_http_file_cache_hot_free(cache, hn);
+    }
+
+    ngx_shmtx_unlock(&cache->hot_shpool->mutex);
 }
 
 
-static ngx_int_t
-ngx_http_file_cache_add_file(ngx_tree_ctx_t *ctx, ngx_str_t *name)
+static ngx_http_file_cache_hot_node_t *
+ngx_http_file_cache_hot_lookup(ngx_http_file_cache_t *cache, u_char *key)
 {
-    u_char                 *p;
-    ngx_int_t               n;
-    ngx_uint_t              i;
-    ngx_http_cache_t        c;
-    ngx_http_file_cache_t  *cache;
+    ngx_int_t                        rc;
+    ngx_rbtree_key_t                 node_key;
+    ngx_rbtree_node_t               *node, *sentinel;
+    ngx_http_file_cache_hot_node_t  *hn;
 
-    if (name->len < 2 * NGX_HTTP_CACHE_KEY_LEN) {
-        return NGX_ERROR;
-    }
+    ngx_memcpy((u_char *) &node_key, key, sizeof(ngx_rbtree_key_t));
 
-    /*
-     * Temporary files in cache have a suffix consisting of a dot
-     * followed by 10 digits.
-     */
+    node = cache->hot->rbtree.root;
+    sentinel = cache->hot->rbtree.sentinel;
 
-    if (name->len >= 2 * NGX_HTTP_CACHE_KEY_LEN + 1 + 10
-        && name->data[name->len - 10 - 1] == '.')
-    {
-        return NGX_OK;
-    }
+    while (node != sentinel) {
 
-    if (ctx->size < (off_t) sizeof(ngx_http_file_cache_header_t)) {
-        ngx_log_error(NGX_LOG_CRIT, ctx->log, 0,
-                      "cache file \"%s\" is too small", name->data);
-        return NGX_ERROR;
-    }
+        if (node_key < node->key) {
+            node = node->left;
+            continue;
+        }
 
-    ngx_memzero(&c, sizeof(ngx_http_cache_t));
-    cache = ctx->data;
+        if (node_key > node->key) {
+            node = node->right;
+            continue;
+        }
 
-    c.length = ctx->size;
-    c.fs_size = (ctx->fs_size + cache->bsize - 1) / cache->bsize;
+        /* node_key == node->key */
 
-    p = &name->data[name->len - 2 * NGX_HTTP_CACHE_KEY_LEN];
+        hn = (ngx_http_file_cache_hot_node_t *) node;
 
-    for (i = 0; i < NGX_HTTP_CACHE_KEY_LEN; i++) {
-        n = ngx_hextoi(p, 2);
+        rc = ngx_memcmp(&key[sizeof(ngx_rbtree_key_t)], hn->key,
+                        NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
 
-        if (n == NGX_ERROR) {
-            return NGX_ERROR;
+        if (rc == 0) {
+            return hn;
         }
 
-        p += 2;
-
-        c.key[i] = (u_char) n;
+        node = (rc < 0) ? node->left : node->right;
     }
 
-    return ngx_http_file_cache_add(cache, &c);
+    /* not found */
+
+    return NULL;
 }
 
 
-static ngx_int_t
-ngx_http_file_cache_add(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
+static void
+ngx_http_file_cache_hot_free(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_hot_node_t *hn)
 {
-    ngx_http_file_cache_node_t  *fcn;
+    ngx_queue_remove(&hn->queue);
+    ngx_rbtree_delete(&cache->hot->rbtree, &hn->node);
+    ngx_slab_free_locked(cache->hot_shpool, hn);
+}
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
 
-    fcn = ngx_http_file_cache_lookup(cache, c->key);
+/*
+ * A count-min sketch with saturating counters approximates how often
+ * the keys were requested recently.  The counters are halved after
+ * the number of samples reaches ten times the sketch width.  The key
+ * is a random md5 hash, so its words are used as the row hashes.
+ */
 
-    if (fcn == NULL) {
+static ngx_uint_t
+ngx_http_file_cache_freq(u_char *sketch, ngx_uint_t width,
+    ngx_uint_t *samples, u_char *key, ngx_uint_t add)
+{
+    u_char      *counter;
+    uint32_t     hash;
+    ngx_uint_t   i, freq, size;
 
-        fcn = ngx_slab_calloc_locked(cache->shpool,
-                                     sizeof(ngx_http_file_cache_node_t));
-        if (fcn == NULL) {
-            ngx_http_file_cache_set_watermark(cache);
+    freq = NGX_HTTP_FILE_CACHE_MAX_FREQ;
 
-            if (cache->fail_time != ngx_time()) {
-                cache->fail_time = ngx_time();
-                ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
-                           "could not allocate node%s", cache->shpool->log_ctx);
-            }
+    for (i = 0; i < NGX_HTTP_FILE_CACHE_SKETCH_ROWS; i++) {
+        ngx_memcpy(&hash, &key[i * sizeof(uint32_t)], sizeof(uint32_t));
 
-            ngx_shmtx_unlock(&cache->shpool->mutex);
-            return NGX_ERROR;
+        counter = &sketch[i * width + (hash & (width - 1))];
+
+        if (add && *counter < NGX_HTTP_FILE_CACHE_MAX_FREQ) {
+            (*counter)++;
         }
 
-        cache->sh->count++;
+        if (*counter < freq) {
+            freq = *counter;
+        }
+    }
 
-        ngx_memcpy((u_char *) &fcn->node.key, c->key, sizeof(ngx_rbtree_key_t));
+    if (add && ++*samples >= 10 * width) {
 
-        ngx_memcpy(fcn->key, &c->key[sizeof(ngx_rbtree_key_t)],
-                   NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+        size = NGX_HTTP_FILE_CACHE_SKETCH_ROWS * width;
 
-        ngx_rbtree_insert(&cache->sh->rbtree, &fcn->node);
+        for (i = 0; i < size; i++) {
+            sketch[i] >>= 1;
+        }
 
-        fcn->uses = 1;
-        fcn->exists = 1;
-        fcn->fs_size = c->fs_size;
+        *samples /= 2;
+    }
 
-        cache->sh->size += c->fs_size;
+    return freq;
+}
 
-    } else {
-        ngx_queue_remove(&fcn->queue);
-    }
 
-    fcn->expire = ngx_time() + cache->inactive;
+static void
+ngx_http_file_cache_hot_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
+{
+    ngx_rbtree_node_t               **p;
+    ngx_http_file_cache_hot_node_t   *hn, *hnt;
 
-    ngx_queue_insert_head(&cache->sh->queue, &fcn->queue);
+    for ( ;; ) {
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+        if (node->key < temp->key) {
 
-    return NGX_OK;
-}
+            p = &temp->left;
 
+        } else if (node->key > temp->key) {
 
-static ngx_int_t
-ngx_http_file_cache_delete_file(ngx_tree_ctx_t *ctx, ngx_str_t *path)
-{
-    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ctx->log, 0,
-                   "http file cache delete: \"%s\"", path->data);
+            p = &temp->right;
 
-    if (ngx_delete_file(path->data) == NGX_FILE_ERROR) {
-        ngx_log_error(NGX_LOG_CRIT, ctx->log, ngx_errno,
-                      ngx_delete_file_n " \"%s\" failed", path->data);
-    }
+        } else { /* node->key == temp->key */
 
-    return NGX_OK;
-}
+            hn = (ngx_http_file_cache_hot_node_t *) node;
+            hnt = (ngx_http_file_cache_hot_node_t *) temp;
+
+            p = (ngx_memcmp(hn->key, hnt->key,
+                            NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t))
+                 < 0)
+                    ? &temp->left : &temp->right;
+        }
 
+        if (*p == sentinel) {
+            break;
+        }
 
-static void
-ngx_http_file_cache_set_watermark(ngx_http_file_cache_t *cache)
-{
-    cache->sh->watermark = cache->sh->count - cache->sh->count / 8;
+        temp = *p;
+    }
 
-    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
-                   "http file cache watermark: %ui", cache->sh->watermark);
+    *p = node;
+    node->parent = temp;
+    node->left = sentinel;
+    node->right = sentinel;
+    ngx_rbt_red(node);
 }
 
 
@@ -2323,11 +4204,13 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     u_char                 *last, *p;
     time_t                  inactive;
     ssize_t                 size;
-    ngx_str_t               s, name, *value;
+    ssize_t                 hot_size;
+    ngx_str_t               s, name, hot_name, *value;
     ngx_int_t               loader_files, manager_files;
     ngx_msec_t              loader_sleep, manager_sleep, loader_threshold,
                             manager_threshold;
-    ngx_uint_t              i, n, use_temp_path;
+    ngx_int_t               partitions, loader_threads;
+    ngx_uint_t              i, n, use_temp_path, journal;
     ngx_array_t            *caches;
     ngx_http_file_cache_t  *cache, **ce;
 
@@ -2348,6 +4231,9 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     loader_files = 100;
     loader_sleep = 50;
     loader_threshold = 200;
+    loader_threads = 1;
+
+    journal = 0;
 
     manager_files = 100;
     manager_sleep = 50;
@@ -2355,6 +4241,8 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
     name.len = 0;
     size = 0;
+    hot_size = 0;
+    partitions = 1;
     max_size = NGX_MAX_OFF_T_VALUE;
     min_free = 0;
 
@@ -2409,6 +4297,25 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             return NGX_CONF_ERROR;
         }
 
+        if (ngx_strncmp(value[i].data, "key_crc=", 8) == 0) {
+
+            if (ngx_strcmp(&value[i].data[8], "crc32") == 0) {
+                cache->crc32c = 0;
+
+            } else if (ngx_strcmp(&value[i].data[8], "crc32c") == 0) {
+                cache->crc32c = 1;
+
+            } else {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid key_crc value \"%V\", "
+                                   "it must be \"crc32\" or \"crc32c\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
         if (ngx_strncmp(value[i].data, "use_temp_path=", 14) == 0) {
 
             if (ngx_strcmp(&value[i].data[14], "on") == 0) {
@@ -2428,6 +4335,25 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strncmp(value[i].data, "journal=", 8) == 0) {
+
+            if (ngx_strcmp(&value[i].data[8], "on") == 0) {
+                journal = 1;
+
+            } else if (ngx_strcmp(&value[i].data[8], "off") == 0) {
+                journal = 0;
+
+            } else {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid journal value \"%V\", "
+                                   "it must be \"on\" or \"off\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
         if (ngx_strncmp(value[i].data, "keys_zone=", 10) == 0) {
 
             name.data = value[i].data + 10;
@@ -2462,6 +4388,73 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strncmp(value[i].data, "hot=", 4) == 0) {
+
+            s.len = value[i].len - 4;
+            s.data = value[i].data + 4;
+
+            hot_size = ngx_parse_size(&s);
+
+            if (hot_size == NGX_ERROR) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid hot zone size \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            if (hot_size < (ssize_t) (8 * ngx_pagesize)) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "hot zone \"%V\" is too small", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "partitions=", 11) == 0) {
+
+            partitions = ngx_atoi(value[i].data + 11, value[i].len - 11);
+            if (partitions == NGX_ERROR
+                || partitions < 1
+                || partitions > NGX_HTTP_FILE_CACHE_MAX_PARTS)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid partitions value \"%V\", "
+                                   "it must be between 1 and %d",
+                                   &value[i], NGX_HTTP_FILE_CACHE_MAX_PARTS);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "eviction=", 9) == 0) {
+
+            s.len = value[i].len - 9;
+            s.data = value[i].data + 9;
+
+            for (n = 0; ngx_http_file_cache_eviction[n].name.len; n++) {
+                if (s.len == ngx_http_file_cache_eviction[n].name.len
+                    && ngx_strcmp(s.data,
+                                  ngx_http_file_cache_eviction[n].name.data)
+                       == 0)
+                {
+                    cache->eviction = ngx_http_file_cache_eviction[n].value;
+                    break;
+                }
+            }
+
+            if (ngx_http_file_cache_eviction[n].name.len == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid eviction value \"%V\", "
+                                   "it must be \"lru\", \"slru\", "
+                                   "\"gdsf\" or \"tinylfu\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
         if (ngx_strncmp(value[i].data, "inactive=", 9) == 0) {
 
             s.len = value[i].len - 9;
@@ -2557,6 +4550,27 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strncmp(value[i].data, "loader_threads=", 15) == 0) {
+
+            loader_threads = ngx_atoi(value[i].data + 15, value[i].len - 15);
+            if (loader_threads == NGX_ERROR || loader_threads == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid loader_threads value \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+#if !(NGX_THREADS)
+            if (loader_threads > 1) {
+                ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                                   "loader_threads require threads support, "
+                                   "ignored");
+                loader_threads = 1;
+            }
+#endif
+
+            continue;
+        }
+
         if (ngx_strncmp(value[i].data, "manager_files=", 14) == 0) {
 
             manager_files = ngx_atoi(value[i].data + 14, value[i].len - 14);
@@ -2619,6 +4633,7 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     cache->loader_files = loader_files;
     cache->loader_sleep = loader_sleep;
     cache->loader_threshold = loader_threshold;
+    cache->loader_threads = loader_threads;
     cache->manager_files = manager_files;
     cache->manager_sleep = manager_sleep;
     cache->manager_threshold = manager_threshold;
@@ -2642,7 +4657,49 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     cache->shm_zone->init = ngx_http_file_cache_init;
     cache->shm_zone->data = cache;
 
+    if (hot_size) {
+        hot_name.len = name.len + sizeof(":hot") - 1;
+
+        hot_name.data = ngx_pnalloc(cf->pool, hot_name.len);
+        if (hot_name.data == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        ngx_sprintf(hot_name.data, "%V:hot", &name);
+
+        cache->hot_zone = ngx_shared_memory_add(cf, &hot_name, hot_size,
+                                                cmd->post);
+        if (cache->hot_zone == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        cache->hot_zone->init = ngx_http_file_cache_hot_init;
+        cache->hot_zone->data = cache;
+    }
+
     cache->use_temp_path = use_temp_path;
+    cache->partitions = partitions;
+
+    cache->journal_fd = NGX_INVALID_FILE;
+
+    if (journal) {
+        cache->journal.len = cache->path->name.len + sizeof("/journal") - 1;
+        cache->journal.data = ngx_pnalloc(cf->pool, cache->journal.len + 1);
+        if (cache->journal.data == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        ngx_sprintf(cache->journal.data, "%V/journal%Z", &cache->path->name);
+
+        cache->journal_new.len = cache->journal.len + sizeof(".new") - 1;
+        cache->journal_new.data = ngx_pnalloc(cf->pool,
+                                              cache->journal_new.len + 1);
+        if (cache->journal_new.data == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        ngx_sprintf(cache->journal_new.data, "%V.new%Z", &cache->journal);
+    }
 
     cache->inactive = inactive;
     cache->max_size = max_size;
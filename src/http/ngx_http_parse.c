@@ -9,6 +9,10 @@
 #include <ngx_core.h>
 #include <ngx_http.h>
 
+#if (defined __SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 static uint32_t  usual[] = {
     0xffffdbfe, /* 1111 1111 1111 1111  1101 1011 1111 1110 */
@@ -98,6 +102,64 @@ static uint32_t  usual[] = {
 #endif
 
 
+/*
+ * Inside the URI and header values most bytes do not change the parser
+ * state.  ngx_http_parse_skip() returns the first byte of [p, last) that
+ * is one of the "stop" bytes, checking 16 bytes at a time; the rest of
+ * the buffer shorter than 16 bytes is left to the state machine.
+ */
+
+#if (defined __SSE2__)
+
+static ngx_inline u_char *
+ngx_http_parse_skip(u_char *p, u_char *last, const u_char *stop, ngx_uint_t n)
+{
+    int         mask;
+    __m128i     v, m;
+    ngx_uint_t  i;
+
+    while (last - p >= 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+        m = _mm_setzero_si128();
+
+        for (i = 0; i < n; i++) {
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(v,
+                                             _mm_set1_epi8((char) stop[i])));
+        }
+
+        mask = _mm_movemask_epi8(m);
+
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+
+        p += 16;
+    }
+
+    return p;
+}
+
+
+/* the bytes not set in the "usual" bitmap */
+
+static const u_char  ngx_http_parse_check_uri_stop[] = {
+    '\0', LF, CR, ' ', '#', '%', '+', '.', '/', '?',
+#if (NGX_WIN32)
+    '\\'
+#endif
+};
+
+static const u_char  ngx_http_parse_uri_stop[] = { '\0', LF, CR, ' ', '#' };
+
+static const u_char  ngx_http_parse_value_stop[] = { '\0', LF, CR, ' ' };
+
+#else
+
+#define ngx_http_parse_skip(p, last, stop, n)  (p)
+
+#endif
+
+
 /* gcc, icc, msvc and others compile these switches as an jump table */
 
 ngx_int_t
@@ -559,6 +621,10 @@ ngx_http_parse_request_line(ngx_http_request_t *r, ngx_buf_t *b)
         case sw_check_uri:
 
             if (usual[ch >> 5] & (1U << (ch & 0x1f))) {
+                p = ngx_http_parse_skip(p + 1, b->last,
+                                        ngx_http_parse_check_uri_stop,
+                                        sizeof(ngx_http_parse_check_uri_stop))
+                    - 1;
                 break;
             }
 
@@ -645,6 +711,9 @@ ngx_http_parse_request_line(ngx_http_request_t *r, ngx_buf_t *b)
         case sw_uri:
 
             if (usual[ch >> 5] & (1U << (ch & 0x1f))) {
+                p = ngx_http_parse_skip(p + 1, b->last, ngx_http_parse_uri_stop,
+                                        sizeof(ngx_http_parse_uri_stop))
+                    - 1;
                 break;
             }
 
@@ -1048,6 +1117,12 @@ ngx_http_parse_header_line(ngx_http_request_t *r, ngx_buf_t *b,
                 goto done;
             case '\0':
                 return NGX_HTTP_PARSE_INVALID_HEADER;
+            default:
+                p = ngx_http_parse_skip(p + 1, b->last,
+                                        ngx_http_parse_value_stop,
+                                        sizeof(ngx_http_parse_value_stop))
+                    - 1;
+                break;
             }
             break;
 
@@ -38,6 +38,15 @@ static ngx_int_t ngx_http_set_virtual_server(ngx_http_request_t *r,
 static ngx_int_t ngx_http_find_virtual_server(ngx_connection_t *c,
     ngx_http_virtual_names_t *virtual_names, ngx_str_t *host,
     ngx_http_request_t *r, ngx_http_core_srv_conf_t **cscfp);
+#if (NGX_PCRE)
+static ngx_uint_t ngx_http_server_name_regexes(
+    ngx_http_virtual_names_t *virtual_names, ngx_str_t *host,
+    ngx_uint_t **lists);
+static ngx_uint_t ngx_http_server_name_next(ngx_uint_t **lists,
+    ngx_uint_t n);
+static void ngx_http_server_name_cache_set(ngx_http_server_name_cache_t *nc,
+    ngx_uint_t key, ngx_str_t *host, ngx_uint_t index);
+#endif
 
 static void ngx_http_request_handler(ngx_event_t *ev);
 static void ngx_http_terminate_request(ngx_http_request_t *r, ngx_int_t rc);
@@ -2286,14 +2295,16 @@ ngx_http_find_virtual_server(ngx_connection_t *c,
     ngx_http_virtual_names_t *virtual_names, ngx_str_t *host,
     ngx_http_request_t *r, ngx_http_core_srv_conf_t **cscfp)
 {
+    ngx_uint_t                 key;
     ngx_http_core_srv_conf_t  *cscf;
 
     if (virtual_names == NULL) {
         return NGX_DECLINED;
     }
 
-    cscf = ngx_hash_find_combined(&virtual_names->names,
-                                  ngx_hash_key(host->data, host->len),
+    key = ngx_hash_key(host->data, host->len);
+
+    cscf = ngx_hash_find_combined(&virtual_names->names, key,
                                   host->data, host->len);
 
     if (cscf) {
@@ -2304,18 +2315,58 @@ ngx_http_find_virtual_server(ngx_connection_t *c,
 #if (NGX_PCRE)
 
     if (host->len && virtual_names->nregex) {
-        ngx_int_t                n;
-        ngx_uint_t               i;
-        ngx_http_server_name_t  *sn;
+        ngx_int_t                      n;
+        ngx_uint_t                     i, nlists, one[2];
+        ngx_uint_t                    *lists[NGX_HTTP_SERVER_NAME_LISTS];
+        ngx_http_server_name_t        *sn;
+        ngx_http_server_name_cache_t  *nc;
 
         sn = virtual_names->regex;
 
+        nlists = 0;
+        nc = NULL;
+
+        if (virtual_names->cache
+            && host->len <= NGX_HTTP_SERVER_NAME_CACHE_LEN)
+        {
+            nc = &virtual_names->cache[key & virtual_names->cache_mask];
+
+            if (nc->hash == (uint32_t) key
+                && nc->len == host->len
+                && ngx_memcmp(nc->name, host->data, host->len) == 0)
+            {
+                if (nc->index == 0) {
+                    return NGX_DECLINED;
+                }
+
+                /* only the matched regex is run to set its captures */
+
+                one[0] = nc->index - 1;
+                one[1] = NGX_HTTP_SERVER_NAME_END;
+
+                lists[0] = one;
+                nlists = 1;
+
+                nc = NULL;
+            }
+        }
+
+        if (nlists == 0) {
+            nlists = ngx_http_server_name_regexes(virtual_names, host, lists);
+        }
+
 #if (NGX_HTTP_SSL && defined SSL_CTRL_SET_TLSEXT_HOSTNAME)
 
         if (r == NULL) {
             ngx_http_connection_t  *hc;
 
-            for (i = 0; i < virtual_names->nregex; i++) {
+            for ( ;; ) {
+
+                i = ngx_http_server_name_next(lists, nlists);
+
+                if (i == NGX_HTTP_SERVER_NAME_END) {
+                    break;
+                }
 
                 n = ngx_regex_exec(sn[i].regex->regex, host, NULL, 0);
 
@@ -2327,6 +2378,8 @@ ngx_http_find_virtual_server(ngx_connection_t *c,
                     hc = c->data;
                     hc->ssl_servername_regex = sn[i].regex;
 
+                    ngx_http_server_name_cache_set(nc, key, host, i + 1);
+
                     *cscfp = sn[i].server;
                     return NGX_OK;
                 }
@@ -2339,12 +2392,20 @@ ngx_http_find_virtual_server(ngx_connection_t *c,
                 return NGX_ERROR;
             }
 
+            ngx_http_server_name_cache_set(nc, key, host, 0);
+
             return NGX_DECLINED;
         }
 
 #endif /* NGX_HTTP_SSL && defined SSL_CTRL_SET_TLSEXT_HOSTNAME */
 
-        for (i = 0; i < virtual_names->nregex; i++) {
+        for ( ;; ) {
+
+            i = ngx_http_server_name_next(lists, nlists);
+
+            if (i == NGX_HTTP_SERVER_NAME_END) {
+                break;
+            }
 
             n = ngx_http_regex_exec(r, sn[i].regex, host);
 
@@ -2353,12 +2414,16 @@ ngx_http_find_virtual_server(ngx_connection_t *c,
             }
 
             if (n == NGX_OK) {
+                ngx_http_server_name_cache_set(nc, key, host, i + 1);
+
                 *cscfp = sn[i].server;
                 return NGX_OK;
             }
 
             return NGX_ERROR;
         }
+
+        ngx_http_server_name_cache_set(nc, key, host, 0);
     }
 
 #endif /* NGX_PCRE */
@@ -2367,6 +2432,97 @@ ngx_http_find_virtual_server(ngx_connection_t *c,
 }
 
 
+#if (NGX_PCRE)
+
+static ngx_uint_t
+ngx_http_server_name_regexes(ngx_http_virtual_names_t *virtual_names,
+    ngx_str_t *host, ngx_uint_t **lists)
+{
+    u_char      *p, *last;
+    ngx_uint_t   n, *list;
+
+    /*
+     * the regexes that may match the name: the ones without a key and
+     * the ones keyed by the name itself or by the labels it ends with
+     */
+
+    lists[0] = virtual_names->regex_any;
+    n = 1;
+
+    p = host->data;
+    last = p + host->len;
+
+    for ( ;; ) {
+        list = ngx_hash_find(&virtual_names->regex_keys,
+                             ngx_hash_key(p, last - p), p, last - p);
+
+        if (list) {
+            if (n == NGX_HTTP_SERVER_NAME_LISTS) {
+                lists[0] = virtual_names->regex_all;
+                return 1;
+            }
+
+            lists[n++] = list;
+        }
+
+        p = ngx_strlchr(p, last, '.');
+
+        if (p == NULL) {
+            return n;
+        }
+
+        p++;
+    }
+}
+
+
+static ngx_uint_t
+ngx_http_server_name_next(ngx_uint_t **lists, ngx_uint_t n)
+{
+    ngx_uint_t  i, k;
+
+    /* the lowest regex number left in the lists */
+
+    i = NGX_HTTP_SERVER_NAME_END;
+
+    for (k = 0; k < n; k++) {
+        if (*lists[k] < i) {
+            i = *lists[k];
+        }
+    }
+
+    if (i == NGX_HTTP_SERVER_NAME_END) {
+        return i;
+    }
+
+    for (k = 0; k < n; k++) {
+        if (*lists[k] == i) {
+            lists[k]++;
+        }
+    }
+
+    return i;
+}
+
+
+static void
+ngx_http_server_name_cache_set(ngx_http_server_name_cache_t *nc,
+    ngx_uint_t key, ngx_str_t *host, ngx_uint_t index)
+{
+    if (nc == NULL) {
+        return;
+    }
+
+    nc->hash = (uint32_t) key;
+    nc->index = (uint32_t) index;
+    nc->len = (u_short) host->len;
+
+    ngx_memcpy(nc->name, host->data, host->len);
+}
+
+#endif
+
+
 static void
 ngx_http_request_handler(ngx_event_t *ev)
 {
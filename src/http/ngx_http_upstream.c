@@ -23,6 +23,10 @@ static ngx_int_t ngx_http_upstream_cache_check_range(ngx_http_request_t *r,
     ngx_http_upstream_t *u);
 static ngx_int_t ngx_http_upstream_cache_status(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_http_upstream_cache_tier(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_http_upstream_cache_ratio(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
 static ngx_int_t ngx_http_upstream_cache_last_modified(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
 static ngx_int_t ngx_http_upstream_cache_etag(ngx_http_request_t *r,
@@ -416,6 +420,20 @@ static ngx_http_variable_t  ngx_http_upstream_vars[] = {
       ngx_http_upstream_cache_status, 0,
       NGX_HTTP_VAR_NOCACHEABLE, 0 },
 
+    { ngx_string("upstream_cache_tier"), NULL,
+      ngx_http_upstream_cache_tier, 0,
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("upstream_cache_hot_ratio"), NULL,
+      ngx_http_upstream_cache_ratio,
+      offsetof(ngx_http_file_cache_hot_sh_t, hot_hits),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("upstream_cache_disk_ratio"), NULL,
+      ngx_http_upstream_cache_ratio,
+      offsetof(ngx_http_file_cache_hot_sh_t, disk_hits),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
     { ngx_string("upstream_cache_last_modified"), NULL,
       ngx_http_upstream_cache_last_modified, 0,
       NGX_HTTP_VAR_NOCACHEABLE|NGX_HTTP_VAR_NOHASH, 0 },
@@ -852,6 +870,8 @@ ngx_http_upstream_cache(ngx_http_request_t *r, ngx_http_upstream_t *u)
 
         /* TODO: add keys */
 
+        r->cache->file_cache = cache;
+
         ngx_http_file_cache_create_key(r);
 
         if (r->cache->header_start + 256 > u->conf->buffer_size) {
@@ -871,7 +891,6 @@ ngx_http_upstream_cache(ngx_http_request_t *r, ngx_http_upstream_t *u)
 
         c->body_start = u->conf->buffer_size;
         c->min_uses = u->conf->cache_min_uses;
-        c->file_cache = cache;
 
         switch (ngx_http_test_predicates(r, u->conf->cache_bypass)) {
 
@@ -5687,6 +5706,76 @@ ngx_http_upstream_cache_status(ngx_http_request_t *r,
 }
 
 
+static ngx_int_t
+ngx_http_upstream_cache_tier(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    if (r->upstream == NULL
+        || r->upstream->cache_status != NGX_HTTP_CACHE_HIT
+        || r->cache == NULL
+        || !r->cached)
+    {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+
+    if (r->cache->hot) {
+        ngx_str_set(v, "hot");
+
+    } else {
+        ngx_str_set(v, "disk");
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_cache_ratio(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    u_char                        *p;
+    ngx_atomic_uint_t              hits, lookups, ratio;
+    ngx_http_file_cache_hot_sh_t  *hot;
+
+    if (r->cache == NULL
+        || r->cache->file_cache == NULL
+        || r->cache->file_cache->hot == NULL)
+    {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    hot = r->cache->file_cache->hot;
+
+    hits = *(ngx_atomic_t *) ((char *) hot + data);
+    lookups = hot->lookups;
+
+    ratio = lookups ? hits * 1000 / lookups : 0;
+
+    if (ratio > 1000) {
+        ratio = 1000;
+    }
+
+    p = ngx_pnalloc(r->pool, sizeof("1.000") - 1);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    v->len = ngx_sprintf(p, "%uA.%03uA", ratio / 1000, ratio % 1000) - p;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+    v->data = p;
+
+    return NGX_OK;
+}
+
+
 static ngx_int_t
 ngx_http_upstream_cache_last_modified(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data)
@@ -624,7 +624,7 @@ error:
     c->error = 1;
 
     if (!h2c->blocked) {
-        ngx_post_event(wev, &ngx_posted_events);
+        ngx_post_event(wev, &ngx_posted_urgent_events);
     }
 
     return NGX_ERROR;
@@ -4587,7 +4587,7 @@ ngx_http_v2_close_stream(ngx_http_v2_stream_t *stream, ngx_int_t rc)
     ev = h2c->connection->read;
 
     ev->handler = ngx_http_v2_handle_connection_handler;
-    ngx_post_event(ev, &ngx_posted_events);
+    ngx_post_event(ev, &ngx_posted_urgent_events);
 }
 
 
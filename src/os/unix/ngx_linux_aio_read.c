@@ -93,6 +93,26 @@ ngx_file_aio_read(ngx_file_t *file, u_char *buf, size_t size, off_t offset,
         return NGX_ERROR;
     }
 
+#if (NGX_HAVE_IO_URING)
+
+    if (ngx_io_uring_aio) {
+        aio->fd = file->fd;
+
+        if (ngx_io_uring_aio_read(aio, buf, size, offset) != NGX_OK) {
+            return ngx_read_file(file, buf, size, offset);
+        }
+
+        ev->handler = ngx_file_aio_event_handler;
+
+        ev->active = 1;
+        ev->ready = 0;
+        ev->complete = 0;
+
+        return NGX_AGAIN;
+    }
+
+#endif
+
     ngx_memzero(&aio->aiocb, sizeof(struct iocb));
 
     aio->aiocb.aio_data = (uint64_t) (uintptr_t) ev;
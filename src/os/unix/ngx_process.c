@@ -578,7 +578,7 @@ ngx_process_get_status(void)
 static void
 ngx_unlock_mutexes(ngx_pid_t pid)
 {
-    ngx_uint_t        i;
+    ngx_uint_t        i, n;
     ngx_shm_zone_t   *shm_zone;
     ngx_list_part_t  *part;
     ngx_slab_pool_t  *sp;
@@ -618,6 +618,15 @@ ngx_unlock_mutexes(ngx_pid_t pid)
                           "shared memory zone \"%V\" was locked by %P",
                           &shm_zone[i].shm.name, pid);
         }
+
+        for (n = 0; n < sp->nmutexes; n++) {
+            if (ngx_shmtx_force_unlock(&sp->mutexes[n], pid)) {
+                ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
+                              "shared memory zone \"%V\" mutex #%ui "
+                              "was locked by %P",
+                              &shm_zone[i].shm.name, n, pid);
+            }
+        }
     }
 }
 
@@ -18,6 +18,7 @@ static void ngx_start_cache_manager_processes(ngx_cycle_t *cycle,
 static void ngx_pass_open_channel(ngx_cycle_t *cycle);
 static void ngx_signal_worker_processes(ngx_cycle_t *cycle, int signo);
 static ngx_uint_t ngx_reap_children(ngx_cycle_t *cycle);
+static void ngx_reclaim_slab_magazines(ngx_cycle_t *cycle, ngx_pid_t pid);
 static void ngx_master_process_exit(ngx_cycle_t *cycle);
 static void ngx_worker_process_cycle(ngx_cycle_t *cycle, void *data);
 static void ngx_worker_process_init(ngx_cycle_t *cycle, ngx_int_t worker);
@@ -287,13 +288,18 @@ ngx_master_process_cycle(ngx_cycle_t *cycle)
 void
 ngx_single_process_cycle(ngx_cycle_t *cycle)
 {
-    ngx_uint_t  i;
+    ngx_uint_t        i;
+    ngx_core_conf_t  *ccf;
 
     if (ngx_set_environment(cycle, NULL) == NULL) {
         /* fatal */
         exit(2);
     }
 
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+
+    ngx_pool_cache_max = ccf->pool_cache;
+
     for (i = 0; cycle->modules[i]; i++) {
         if (cycle->modules[i]->init_process) {
             if (cycle->modules[i]->init_process(cycle) == NGX_ERROR) {
@@ -330,6 +336,11 @@ ngx_single_process_cycle(ngx_cycle_t *cycle)
             }
 
             ngx_cycle = cycle;
+
+            ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx,
+                                                   ngx_core_module);
+
+            ngx_pool_cache_max = ccf->pool_cache;
         }
 
         if (ngx_reopen) {
@@ -573,6 +584,8 @@ ngx_reap_children(ngx_cycle_t *cycle)
 
         if (ngx_processes[i].exited) {
 
+            ngx_reclaim_slab_magazines(cycle, ngx_processes[i].pid);
+
             if (!ngx_processes[i].detached) {
                 ngx_close_channel(ngx_processes[i].channel, cycle->log);
 
@@ -663,6 +676,48 @@ ngx_reap_children(ngx_cycle_t *cycle)
 }
 
 
+static void
+ngx_reclaim_slab_magazines(ngx_cycle_t *cycle, ngx_pid_t pid)
+{
+    ngx_uint_t        i, n;
+    ngx_shm_zone_t   *shm_zone;
+    ngx_list_part_t  *part;
+    ngx_slab_pool_t  *sp;
+
+    /* return the chunks cached by the exited process to the zones */
+
+    part = (ngx_list_part_t *) &cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        sp = (ngx_slab_pool_t *) shm_zone[i].shm.addr;
+
+        if (sp == NULL || sp->magazines == NULL) {
+            continue;
+        }
+
+        n = ngx_slab_reclaim_magazines(sp, pid);
+
+        if (n) {
+            ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0,
+                          "%ui chunks cached by process %P returned to "
+                          "shared memory zone \"%V\"",
+                          n, pid, &shm_zone[i].shm.name);
+        }
+    }
+}
+
+
 static void
 ngx_master_process_exit(ngx_cycle_t *cycle)
 {
@@ -781,6 +836,12 @@ ngx_worker_process_init(ngx_cycle_t *cycle, ngx_int_t worker)
 
     ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
 
+    ngx_pool_cache_max = ccf->pool_cache;
+
+    if (worker >= 0) {
+        ngx_slab_magazine_size = ccf->slab_magazine;
+    }
+
     if (worker >= 0 && ccf->priority != 0) {
         if (setpriority(PRIO_PROCESS, 0, ccf->priority) == -1) {
             ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
@@ -865,7 +926,7 @@ ngx_worker_process_init(ngx_cycle_t *cycle, ngx_int_t worker)
     }
 
     if (worker >= 0) {
-        cpu_affinity = ngx_get_cpu_affinity(worker);
+        cpu_affinity = ngx_get_cpu_affinity(cycle, worker);
 
         if (cpu_affinity) {
             ngx_setaffinity(cpu_affinity, cycle->log);
@@ -971,18 +1032,21 @@ ngx_worker_process_exit(ngx_cycle_t *cycle)
         }
     }
 
+    ngx_slab_flush_magazines();
+
     if (ngx_exiting) {
-        c = cycle->connections;
-        for (i = 0; i < cycle->connection_n; i++) {
-            if (c[i].fd != -1
-                && c[i].read
-                && !c[i].read->accept
-                && !c[i].read->channel
-                && !c[i].read->resolver)
+        for (i = 0; i < cycle->alloc_connection_n; i++) {
+            c = &cycle->connections[i].events.connection;
+
+            if (c->fd != -1
+                && c->read
+                && !c->read->accept
+                && !c->read->channel
+                && !c->read->resolver)
             {
                 ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
                               "*%uA open socket #%d left in connection %ui",
-                              c[i].number, c[i].fd, i);
+                              c->number, c->fd, i);
                 ngx_debug_quit = 1;
             }
         }
@@ -497,6 +497,10 @@ ngx_stream_optimize_servers(ngx_conf_t *cf, ngx_array_t *ports)
             ls->rcvbuf = addr[i].opt.rcvbuf;
             ls->sndbuf = addr[i].opt.sndbuf;
 
+#if (NGX_HAVE_BUSY_POLL)
+            ls->busy_poll = addr[i].opt.busy_poll;
+#endif
+
             ls->wildcard = addr[i].opt.wildcard;
 
             ls->keepalive = addr[i].opt.so_keepalive;
@@ -514,6 +518,10 @@ ngx_stream_optimize_servers(ngx_conf_t *cf, ngx_array_t *ports)
             ls->reuseport = addr[i].opt.reuseport;
 #endif
 
+#if (NGX_HAVE_REUSEPORT_CBPF)
+            ls->reuseport_cpu = addr[i].opt.reuseport_cpu;
+#endif
+
             stport = ngx_palloc(cf->pool, sizeof(ngx_stream_port_t));
             if (stport == NULL) {
                 return NGX_CONF_ERROR;
@@ -18,9 +18,9 @@ typedef struct {
 
 
 typedef struct {
-    ngx_radix_tree_t                  *tree;
+    ngx_radix_stride_t                *tree;
 #if (NGX_HAVE_INET6)
-    ngx_radix_tree_t                  *tree6;
+    ngx_radix_stride_t                *tree6;
 #endif
 } ngx_stream_geo_trees_t;
 
@@ -178,7 +178,7 @@ ngx_stream_geo_cidr_variable(ngx_stream_session_t *s,
 
     if (ngx_stream_geo_addr(s, ctx, &addr) != NGX_OK) {
         vv = (ngx_stream_variable_value_t *)
-                  ngx_radix32tree_find(ctx->u.trees.tree, INADDR_NONE);
+                  ngx_radix32stride_find(ctx->u.trees.tree, INADDR_NONE);
         goto done;
     }
 
@@ -196,11 +196,11 @@ ngx_stream_geo_cidr_variable(ngx_stream_session_t *s,
             inaddr += p[15];
 
             vv = (ngx_stream_variable_value_t *)
-                      ngx_radix32tree_find(ctx->u.trees.tree, inaddr);
+                      ngx_radix32stride_find(ctx->u.trees.tree, inaddr);
 
         } else {
             vv = (ngx_stream_variable_value_t *)
-                      ngx_radix128tree_find(ctx->u.trees.tree6, p);
+                      ngx_radix128stride_find(ctx->u.trees.tree6, p);
         }
 
         break;
@@ -209,7 +209,7 @@ ngx_stream_geo_cidr_variable(ngx_stream_session_t *s,
 #if (NGX_HAVE_UNIX_DOMAIN)
     case AF_UNIX:
         vv = (ngx_stream_variable_value_t *)
-                  ngx_radix32tree_find(ctx->u.trees.tree, INADDR_NONE);
+                  ngx_radix32stride_find(ctx->u.trees.tree, INADDR_NONE);
         break;
 #endif
 
@@ -218,7 +218,7 @@ ngx_stream_geo_cidr_variable(ngx_stream_session_t *s,
         inaddr = ntohl(sin->sin_addr.s_addr);
 
         vv = (ngx_stream_variable_value_t *)
-                  ngx_radix32tree_find(ctx->u.trees.tree, inaddr);
+                  ngx_radix32stride_find(ctx->u.trees.tree, inaddr);
 
         break;
     }
@@ -495,23 +495,19 @@ ngx_stream_geo_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
     } else {
         if (ctx.tree == NULL) {
-            ctx.tree = ngx_radix_tree_create(cf->pool, -1);
+            ctx.tree = ngx_radix_tree_create(ctx.temp_pool, -1);
             if (ctx.tree == NULL) {
                 goto failed;
             }
         }
 
-        geo->u.trees.tree = ctx.tree;
-
 #if (NGX_HAVE_INET6)
         if (ctx.tree6 == NULL) {
-            ctx.tree6 = ngx_radix_tree_create(cf->pool, -1);
+            ctx.tree6 = ngx_radix_tree_create(ctx.temp_pool, -1);
             if (ctx.tree6 == NULL) {
                 goto failed;
             }
         }
-
-        geo->u.trees.tree6 = ctx.tree6;
 #endif
 
         var->get_handler = ngx_stream_geo_cidr_variable;
@@ -534,6 +530,25 @@ ngx_stream_geo_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             goto failed;
         }
 #endif
+
+        /*
+         * the radix trees are only used to collect the networks,
+         * the lookups are done in the compiled multibit tries
+         */
+
+        geo->u.trees.tree = ngx_radix_stride_create(cf->pool, ctx.temp_pool,
+                                                    ctx.tree);
+        if (geo->u.trees.tree == NULL) {
+            goto failed;
+        }
+
+#if (NGX_HAVE_INET6)
+        geo->u.trees.tree6 = ngx_radix_stride_create(cf->pool, ctx.temp_pool,
+                                                     ctx.tree6);
+        if (geo->u.trees.tree6 == NULL) {
+            goto failed;
+        }
+#endif
     }
 
     ngx_destroy_pool(ctx.temp_pool);
@@ -1007,7 +1022,7 @@ ngx_stream_geo_cidr(ngx_conf_t *cf, ngx_stream_geo_conf_ctx_t *ctx,
     ngx_cidr_t   cidr;
 
     if (ctx->tree == NULL) {
-        ctx->tree = ngx_radix_tree_create(ctx->pool, -1);
+        ctx->tree = ngx_radix_tree_create(ctx->temp_pool, -1);
         if (ctx->tree == NULL) {
             return NGX_CONF_ERROR;
         }
@@ -1015,7 +1030,7 @@ ngx_stream_geo_cidr(ngx_conf_t *cf, ngx_stream_geo_conf_ctx_t *ctx,
 
 #if (NGX_HAVE_INET6)
     if (ctx->tree6 == NULL) {
-        ctx->tree6 = ngx_radix_tree_create(ctx->pool, -1);
+        ctx->tree6 = ngx_radix_tree_create(ctx->temp_pool, -1);
         if (ctx->tree6 == NULL) {
             return NGX_CONF_ERROR;
         }
@@ -199,7 +199,7 @@ ngx_stream_limit_conn_handler(ngx_stream_session_t *s)
 
         s->limit_conn_status = NGX_STREAM_LIMIT_CONN_PASSED;
 
-        hash = ngx_crc32_short(key.data, key.len);
+        hash = ngx_crc32c(key.data, key.len);
 
         ngx_shmtx_lock(&ctx->shpool->mutex);
 